@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MeshCache.h"
+#include "RayKernels.h"
+
+class ThreadPool;
+
+/// <summary>
+/// Bounding volume hierarchy over the triangles of an indexed mesh, built on the CPU.
+/// The acceleration structures of the renderer are built by the driver and can't be looked at, this one is the reference they can be compared with:
+/// it takes the same vertex and index arrays that go into the bottom level acceleration structure (MeshCache::Vertex matches D3D12HelloTriangle::Vertex).
+/// The builder bins the triangle centroids along every axis and splits where the surface area heuristic (SAH) is the lowest.
+/// Subtrees that are large enough are built in parallel on the thread pool, and the result is the same for any number of threads.
+/// The same builder makes hierarchies over boxes, for primitives that are intersected by the caller like the instances of TopLevelBvh.
+/// A mesh whose vertices move is refit instead of rebuilt: the tree is kept and only the boxes above the triangles that moved are recomputed,
+/// until the SAH cost has grown enough that building it again pays off.
+/// The nodes are 32 bytes and the two children of a node are next to each other in the same 64 byte cache line.
+/// </summary>
+class Bvh
+{
+public:
+    struct alignas(32) Node
+    {
+        float boundsMin[3];
+        //Interior nodes: index of the left child, the right child is the next node. Leaves: first entry of the leaf in the triangle order.
+        uint32_t leftFirst;
+        float boundsMax[3];
+        //Number of triangles of a leaf, 0 for interior nodes.
+        uint32_t triangleCount;
+
+        bool IsLeaf() const { return triangleCount > 0; }
+    };
+
+    /// <summary>
+    /// Triangle corners in the order of the leaves, so that a leaf reads its triangles from one place.
+    /// </summary>
+    struct Triangle
+    {
+        float v0[3];
+        float v1[3];
+        float v2[3];
+    };
+
+    struct Settings
+    {
+        //Centroid bins per axis.
+        uint32_t binCount = 16;
+        //Largest leaf. Leaves are made smaller than this whenever the SAH finds a cheaper split.
+        uint32_t maxLeafSize = 8;
+        //SAH cost of visiting a node and of intersecting a triangle. The builder counts a leaf of triangles as one intersection per
+        //RayKernels::Width of them, since they are tested a packet at a time.
+        float traversalCost = 1.0f;
+        float intersectionCost = 1.0f;
+        //Subtrees with fewer triangles are built on the thread that made them.
+        uint32_t parallelThreshold = 8192;
+        //Refit() rebuilds the hierarchy once its SAH cost is this many times the cost it was built with. FLT_MAX never rebuilds.
+        float rebuildThreshold = 1.5f;
+    };
+
+    struct RefitStatistics
+    {
+        uint32_t movedTriangles;
+        //Nodes whose boxes were recomputed.
+        uint32_t refitNodes;
+        //SAH cost of the refit hierarchy, with the costs of its Settings, and its ratio to the cost after the last build.
+        float sahCost;
+        float sahDegradation;
+        //Whether the degradation passed Settings::rebuildThreshold and the hierarchy was built again from the new positions.
+        bool rebuilt;
+    };
+
+    struct Statistics
+    {
+        uint32_t nodeCount;
+        uint32_t leafCount;
+        uint32_t maxDepth;
+        uint32_t maxLeafSize;
+        float averageLeafSize;
+        //Expected cost of a random ray that hits the root, in units of intersectionCost, see ComputeSahCost().
+        float sahCost;
+    };
+
+    /// <summary>
+    /// A primitive of BuildFromBounds().
+    /// </summary>
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+    };
+
+    struct Hit
+    {
+        float t;
+        //Index of the triangle in the index array the hierarchy was built from, the triangle that starts at index 3 * triangle.
+        uint32_t triangle;
+        //Barycentric coordinates of the hit point, weights of the second and third corners.
+        float u;
+        float v;
+    };
+
+    Bvh();
+
+    /// <summary>
+    /// Builds the hierarchy. The vertices and indices are not referenced after the call, the corners of the triangles are copied into the leaf order.
+    /// </summary>
+    /// <param name="settings">Optional. The default Settings if not given.</param>
+    /// <param name="pool">Optional. The pool that runs the build, ThreadPool::Shared() if not given.</param>
+    /// <returns>Returns false for an empty mesh, an index count that isn't a multiple of 3 or an index that is out of range.</returns>
+    bool Build(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const Settings* settings = nullptr,
+        ThreadPool* pool = nullptr);
+    /// <summary>
+    /// Builds the hierarchy over boxes instead of triangles. The leaves list the indices of the boxes in GetTriangleIndices(), there are no triangles:
+    /// Intersect() and Occluded() find nothing and the caller tests the entries of the leaves VisitLeaves() reaches.
+    /// </summary>
+    /// <returns>Returns false if there are no boxes or a box has a min above its max.</returns>
+    bool BuildFromBounds(const Bounds* bounds, size_t count, const Settings* settings = nullptr, ThreadPool* pool = nullptr);
+    /// <summary>
+    /// Moves the triangles to the new positions of their vertices and recomputes the boxes of the leaves that hold a moved triangle and of the nodes
+    /// above them, keeping the tree. The leaves are refit in parallel, each then walks up to the root and the second child to arrive at a node
+    /// refits it, so only the nodes above a moved triangle are touched. The SAH cost of the result is compared with the cost after the last build,
+    /// and past Settings::rebuildThreshold times that the hierarchy is built again with the settings it was built with.
+    /// </summary>
+    /// <param name="indices">The index array the hierarchy was built from, with the same triangles in the same order.</param>
+    /// <param name="movedVertices">Optional. One byte per vertex, not 0 for the vertices that moved since the last build or refit. Every triangle is moved if not given.</param>
+    /// <param name="pool">Optional. The pool that runs the refit, ThreadPool::Shared() if not given.</param>
+    /// <param name="statistics">Optional. Receives what the refit did.</param>
+    /// <returns>Returns false for a hierarchy without triangles or a different index count. An index that is out of range also returns false and clears the hierarchy.</returns>
+    bool Refit(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const uint8_t* movedVertices = nullptr,
+        ThreadPool* pool = nullptr, RefitStatistics* statistics = nullptr);
+    void Clear();
+
+    /// <summary>
+    /// Node 0 is the root. Node 1 is unused, so that the children of every node start at an even index and share a cache line.
+    /// </summary>
+    const Node* GetNodes() const;
+    uint32_t GetNodeCount() const;
+    const Triangle* GetTriangles() const;
+    /// <summary>
+    /// Index in the index array of each triangle of GetTriangles(), or index of each box for a hierarchy built by BuildFromBounds().
+    /// </summary>
+    const uint32_t* GetTriangleIndices() const;
+    /// <summary>
+    /// Number of entries of GetTriangleIndices().
+    /// </summary>
+    uint32_t GetTriangleCount() const;
+
+    /// <summary>
+    /// Sum of the surface areas of the interior nodes times the traversal cost and of the leaves times their triangle count times the intersection cost,
+    /// divided by the surface area of the root. Lower is better.
+    /// </summary>
+    float ComputeSahCost(float traversalCost = 1.0f, float intersectionCost = 1.0f) const;
+    Statistics ComputeStatistics() const;
+    /// <summary>
+    /// Checks that every triangle is in exactly one leaf and that every node contains its children and its triangles.
+    /// The boxes of BuildFromBounds() aren't kept, only that each of them is in one leaf is checked for those.
+    /// </summary>
+    bool Validate() const;
+
+    /// <summary>
+    /// Finds the closest triangle the ray hits between 0 and tMax. The triangles of a leaf are tested RayKernels::Width at a time with
+    /// RayKernels::IntersectTriangles(), and of the triangles hit at the same distance the first one in the leaf order wins.
+    /// </summary>
+    /// <param name="cull">Optional. Whether back facing triangles are skipped, both sides are hit by default.</param>
+    /// <returns>Returns whether a triangle was hit. hit is only written if one was.</returns>
+    bool Intersect(const float origin[3], const float direction[3], float tMax, Hit& hit, RayKernels::CullMode cull = RayKernels::CullMode::None) const;
+    /// <summary>
+    /// Finds whether the ray hits any triangle between 0 and tMax, stopping at the first one it finds. This is what a shadow ray needs.
+    /// </summary>
+    bool Occluded(const float origin[3], const float direction[3], float tMax, RayKernels::CullMode cull = RayKernels::CullMode::None) const;
+    /// <summary>
+    /// Calls visitor(first, count, tMax) for the leaves the ray reaches between 0 and tMax, front to back, with the range of GetTriangleIndices()
+    /// the leaf lists. The visitor lowers tMax to the closest hit it has found, which skips the nodes behind it, and returns true to end the traversal.
+    /// </summary>
+    /// <returns>Returns whether the visitor ended the traversal.</returns>
+    template <class Visitor>
+    bool VisitLeaves(const float origin[3], const float direction[3], float tMax, const Visitor& visitor) const
+    {
+        return VisitLeaves(origin, direction, tMax, [](const void* context, uint32_t first, uint32_t count, float& tMax)
+            {
+                return (*static_cast<const Visitor*>(context))(first, count, tMax);
+            }, &visitor);
+    }
+
+private:
+    typedef bool (*LeafCallback)(const void* context, uint32_t first, uint32_t count, float& tMax);
+
+
+    //Two sibling nodes, the unit the nodes are allocated and aligned in.
+    struct alignas(64) NodePair
+    {
+        Node nodes[2];
+    };
+
+    std::vector<NodePair> nodePairs;
+    uint32_t nodeCount;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> triangleIndices;
+    //The triangles of every leaf as packets, the last one of a leaf padded with empty lanes, and the first packet of every leaf by node index.
+    std::vector<RayKernels::TrianglePacket> leafPackets;
+    std::vector<uint32_t> firstLeafPackets;
+    //What Refit() needs: the settings to rebuild with, the SAH cost after the last build and now, and, made by the first refit, the parent
+    //of every node and the position in the leaf order of every triangle of the index array.
+    Settings buildSettings;
+    float builtSahCost;
+    float sahCost;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> leafPositions;
+
+    void SetNodes(const std::vector<Node>& nodes);
+    bool VisitLeaves(const float origin[3], const float direction[3], float tMax, LeafCallback callback, const void* context) const;
+};
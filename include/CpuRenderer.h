@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "MeshCache.h"
+
+class ThreadPool;
+
+/// <summary>
+/// Headless renderer that traces the scene on the CPU, for machines that can't run DispatchRays. It follows the ray tracing shaders:
+/// primary rays are made like RayGen.hlsl makes them, hits are shaded like ClosestHit and PlaneClosestHit in Hit.hlsl, with the reflection
+/// and shadow rays they cast, and misses get the gradient of Miss.hlsl. The image is split in tiles that the threads render in parallel,
+/// each thread starts on its own run of tiles and steals half of the run of another one when it runs out. A pixel only depends on the scene,
+/// so the image is the same for any number of threads. The rays find the instances through a TopLevelBvh built over them for every image,
+/// and instances of the same mesh share its Bvh like they share a bottom level acceleration structure.
+/// </summary>
+class CpuRenderer
+{
+public:
+    /// <summary>
+    /// Hit groups of the shader binding table, the values of TLASParams::hitGroupIndex. Instances with another hit group are shaded like models.
+    /// </summary>
+    static const uint32_t ModelHitGroup = 0;
+    static const uint32_t PlaneHitGroup = 2;
+    /// <summary>
+    /// Recursion depth the pipeline is created with. A ray that would go deeper, which removes the device on the GPU, is not cast.
+    /// </summary>
+    static const uint32_t MaxRecursionDepth = 20;
+
+    /// <summary>
+    /// Geometry of a bottom level acceleration structure. The renderer doesn't own it.
+    /// </summary>
+    struct Mesh
+    {
+        const Bvh* bvh;
+        //Vertices and indices the hierarchy was built from. The hit shading reads the normals of the corners of the hit triangle.
+        const MeshCache::Vertex* vertices;
+        const uint32_t* indices;
+    };
+
+    struct Instance
+    {
+        //Index into Scene::meshes.
+        uint32_t mesh;
+        //Object to world transform as the first three rows of a matrix that multiplies column vectors, the transpose of TLASParams::transformMatrix.
+        float transform[3][4];
+        uint32_t hitGroupIndex;
+        //Index into Scene::materials.
+        uint32_t materialIndex;
+        //Whether the hit shading casts reflection rays for the instance.
+        bool reflective;
+    };
+
+    struct Scene
+    {
+        std::vector<Mesh> meshes;
+        std::vector<Instance> instances;
+        //The materials buffer of the renderer: the default material at index 0 and the materials of the model after it.
+        std::vector<MeshCache::Material> materials;
+    };
+
+    /// <summary>
+    /// The look at of the camera manipulator and the projection of UpdateCameraBuffer().
+    /// </summary>
+    struct Camera
+    {
+        float eye[3];
+        float center[3];
+        float up[3];
+        //Vertical field of view in radians.
+        float fovY;
+        float nearPlane;
+        float farPlane;
+    };
+
+    struct Settings
+    {
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        //Width and height of the tiles the threads take, in pixels.
+        uint32_t tileSize = 16;
+    };
+
+    struct Statistics
+    {
+        uint64_t primaryRays;
+        uint64_t reflectionRays;
+        uint64_t shadowRays;
+        uint32_t tileCount;
+        //Tiles a thread took from the queue of another one.
+        uint32_t stolenTiles;
+    };
+
+    /// <summary>
+    /// Renders the scene into 4 bytes per pixel, RGBA, row by row from the top, like the R8G8B8A8_UNORM output of the ray tracing pass.
+    /// </summary>
+    /// <param name="settings">Optional. The default Settings if not given.</param>
+    /// <param name="pool">Optional. The pool that runs the tiles, ThreadPool::Shared() if not given. The calling thread renders tiles too.</param>
+    /// <param name="statistics">Optional. Receives the ray counts of the image.</param>
+    static void Render(const Scene& scene, const Camera& camera, std::vector<uint8_t>& pixels, const Settings* settings = nullptr, ThreadPool* pool = nullptr,
+        Statistics* statistics = nullptr);
+};
@@ -22,6 +22,10 @@
 #include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
 #include "UIConstructor.h"
 #include "OBJ_FileManager.h"
+#include "IndexPacking.h"
+#include "VertexQuantization.h"
+#include "MeshCache.h"
+#include "ModelLoadTask.h"
 #include "chrono"
 #include "thread"
 
@@ -55,7 +59,16 @@ private:
 		Vertex(XMFLOAT3 position = XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3 normal = XMFLOAT3(0.0f, 1.0f, 0.0f)) : position(position), normal(normal) {}
 	};
 
-	void ComputeVertexNormals(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	/// <summary>
+	/// Loads the vertices (with normals) and indices of a model file and waits for the load to finish. Only used while initializing.
+	/// The .rtmesh cache beside the file is used if it is up to date, otherwise the file is parsed and the cache is rewritten.
+	/// </summary>
+	/// <param name="lods">Receives the levels of detail of the model. Their index ranges follow each other in indices.</param>
+	/// <param name="parts">Receives the parts of the model, one per material.</param>
+	/// <param name="modelMaterials">Receives the materials the parts use.</param>
+	/// <returns>Returns whether the model could be loaded.</returns>
+	bool LoadModelFile(const std::string& path, std::vector<Vertex>& vertices, std::vector<UINT>& indices, std::vector<MeshCache::Lod>& lods,
+		std::vector<MeshCache::Part>& parts, std::vector<MeshCache::Material>& modelMaterials);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -68,6 +81,8 @@ private:
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
 	ComPtr<ID3D12PipelineState> m_pipelineState;
+	//Raster pipeline for models with the quantized vertex layout. It decodes the vertices with m_modelDequantization.
+	ComPtr<ID3D12PipelineState> m_quantizedPipelineState;
 	ComPtr<ID3D12GraphicsCommandList4> m_commandList;
 	UINT m_rtvDescriptorSize;
 
@@ -75,6 +90,14 @@ private:
 	ComPtr<ID3D12Resource> m_modelVertexBuffer;
 	D3D12_VERTEX_BUFFER_VIEW m_modelVertexBufferView;
 	UINT m_modelVertexCount;
+	//Chosen per mesh when the model is uploaded. The BLAS, the vertex buffer view and the hit shader all follow it.
+	VertexQuantization::Format m_modelVertexFormat = VertexQuantization::Format::Float;
+	//Maps the quantized positions back to model space while the BLAS is built. Only set for quantized models.
+	ComPtr<ID3D12Resource> m_modelTransformBuffer;
+	//The same transform as m_modelTransformBuffer for the raster path, which gets it as root constants.
+	float m_modelDequantization[12] = {};
+	//Set this to false to always upload full float vertices.
+	bool quantizeModelVertices = true;
 
 	// Synchronization objects.
 	UINT m_frameIndex;
@@ -121,25 +144,63 @@ private:
 		ComPtr<ID3D12Resource> blas;
 		DirectX::XMMATRIX transformMatrix;
 		UINT hitGroupIndex;
+		//Index into materials, the hit shader reads the material of the instance from there.
 		UINT materialIndex;
-
-		TLASParams(const ComPtr<ID3D12Resource>& blas, const DirectX::XMMATRIX& transformMatrix, const UINT& hitGroupIndex, const UINT& materialIndex)
-			: blas(blas), transformMatrix(transformMatrix), hitGroupIndex(hitGroupIndex), materialIndex(materialIndex)
+		//Instances of the model switch between the BLAS of the levels of detail of one of its parts, see SelectModelLods().
+		bool usesModelLods;
+		UINT modelPart;
+		UINT lod;
+		//Whether the hit shader casts reflection rays for the instance.
+		bool reflective;
+
+		TLASParams(const ComPtr<ID3D12Resource>& blas, const DirectX::XMMATRIX& transformMatrix, const UINT& hitGroupIndex, const UINT& materialIndex, bool usesModelLods = false)
+			: blas(blas), transformMatrix(transformMatrix), hitGroupIndex(hitGroupIndex), materialIndex(materialIndex), usesModelLods(usesModelLods), modelPart(0), lod(0), reflective(false)
 		{
 		}
 	};
 
+	struct ModelLod
+	{
+		ComPtr<ID3D12Resource> blas;
+		UINT firstIndex;
+		UINT indexCount;
+		//Largest distance between this level and the full model, in model space.
+		float error;
+	};
+
+	struct ModelPart
+	{
+		//Index into materials.
+		UINT materialIndex;
+		std::vector<ModelLod> lods;
+	};
+
 	ComPtr<ID3D12Resource> m_bottomLevelAS; // Storage for the bottom Level AS
 
 	AccelerationStructureBuffers m_topLevelASBuffers;
 	std::vector<TLASParams> m_instances;
+	//Parts of the model, one per material, each with its own levels of detail. The first level of a part is its full detail mesh.
+	//All of them share the vertex buffer and use index ranges of m_modelIndexBuffer.
+	std::vector<ModelPart> m_modelParts;
+	//Model space bounding sphere of the model (center and radius), used to estimate its size on screen.
+	XMFLOAT4 m_modelBoundingSphere = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	//A level of detail is used while its error covers at most this many pixels on screen.
+	float m_lodPixelError = 1.0f;
+	//Set when SelectModelLods() changes the BLAS of an instance, the TLAS is rebuilt before the next DispatchRays.
+	bool m_instancesChanged = false;
 
 	/// <summary>
 	/// Create the acceleration structure of an instance
 	/// </summary>
-	/// <param name="vVertexBuffers">Pair of vertex buffers and vertex count. The vertex buffers are assumed to contain Vertex structures.</param>
+	/// <param name="vVertexBuffers">Pair of vertex buffers and vertex count. The vertex buffers are assumed to contain Vertex structures unless vVertexFormats says otherwise.</param>
+	/// <param name="vIndexBuffers">Pair of index buffers and index count for the vertex buffers at the same positions.</param>
+	/// <param name="vIndexFormats">Formats of the index buffers. Index buffers without a format are 32 bit.</param>
+	/// <param name="vVertexFormats">Layouts of the vertex buffers. Vertex buffers without a layout are full float.</param>
+	/// <param name="vTransformBuffers">Transforms applied to the vertex buffers during the build. Quantized vertex buffers need their dequantization transform here.</param>
+	/// <param name="vFirstIndices">Index in the index buffers the triangles start at. Index buffers without one start at 0.</param>
 	/// <returns>AccelerationStructureBuffers for TLAS</returns>
-	AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers = {});
+	AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers = {}, std::vector<DXGI_FORMAT> vIndexFormats = {},
+		std::vector<VertexQuantization::Format> vVertexFormats = {}, std::vector<ComPtr<ID3D12Resource>> vTransformBuffers = {}, std::vector<UINT> vFirstIndices = {});
 
 	/// <summary>
 	/// Create the main acceleration structure that holds all instances of the scene
@@ -148,9 +209,26 @@ private:
 	/// <param name="updateOnly">Whether to build TLAS from scratch or just update the existing one</param>
 	void CreateTopLevelAS(const std::vector<TLASParams> &instances, bool updateOnly = false);
 	/// <summary>
-	/// Updates the TLAS using the index and vertex data in the pendingVertices and pendingIndices buffers.
+	/// Builds one BLAS per level of detail of every part of the model into m_modelParts.
+	/// </summary>
+	/// <returns>Returns the buffers of the builds, the scratch buffers must be kept until the command list has executed.</returns>
+	std::vector<AccelerationStructureBuffers> CreateModelLodBottomLevelAS();
+	/// <summary>
+	/// Fills m_instances with the instances of the model, one per part and placement, and the plane. The model instances start at their full detail level.
+	/// </summary>
+	void CreateSceneInstances(const ComPtr<ID3D12Resource>& planeBlas);
+	/// <summary>
+	/// Picks the coarsest level of detail for every model instance whose error stays under m_lodPixelError pixels at the current camera position.
+	/// </summary>
+	void SelectModelLods();
+	/// <summary>
+	/// Replaces the model buffers with pendingVertexBuffer and pendingIndexBuffer and rebuilds the acceleration structures.
 	/// </summary>
 	void UpdateModelWithPendings();
+	/// <summary>
+	/// Moves the pending model buffers into the model buffers and sets up their views. The GPU must not be using the old buffers.
+	/// </summary>
+	void UsePendingModelBuffers();
 
 	/// <summary>
 	/// Create all acceleration structures, bottom and top
@@ -208,6 +286,11 @@ private:
 		XMMATRIX objectToWorld;
 		//#DXR Extra - Simple Lighting
 		XMMATRIX objectToWorldNormal;
+		//First index of the level of detail the instance uses, the hit shader adds it to 3 * PrimitiveIndex().
+		UINT firstIndex;
+		UINT materialIndex;
+		UINT reflective;
+		UINT padding;
 	};
 
 	ComPtr<ID3D12Resource> m_instancePropertiesBuffer;
@@ -239,7 +322,16 @@ private:
 
 	ComPtr<ID3D12Resource> m_modelIndexBuffer;
 	D3D12_INDEX_BUFFER_VIEW m_modelIndexBufferView;
-	UINT m_modelIndexCount;
+	//Chosen per mesh from its vertex count. The BLAS, the index buffer view and the hit shader all follow it.
+	IndexPacking::Format m_modelIndexFormat = IndexPacking::Format::UInt32;
+	static DXGI_FORMAT GetDxgiIndexFormat(IndexPacking::Format format);
+	static DXGI_FORMAT GetDxgiVertexFormat(VertexQuantization::Format format);
+	/// <summary>
+	/// Packs the index size and the vertex format into the shader record entry of the MeshConstants root constants of Hit.hlsl.
+	/// </summary>
+	static void* GetMeshConstants(IndexPacking::Format indexFormat, VertexQuantization::Format vertexFormat);
+	//Vertical field of view of the camera in radians.
+	const float m_fovAngleY = 45.0f * XM_PI / 180.0f;
 
 	// #DXR Extra: Depth Buffering
 	void CreateDepthBuffer();
@@ -258,7 +350,8 @@ private:
 	bool renderUI;
 
 	//Material system
-	//A default material is added in the constructor of the class. New materials start from index 1 unless the default material is removed.
+	//A default material is added in the constructor of the class and is driven by the UI. The materials of the model start from index 1,
+	//parts without a material use the default one.
 	std::vector<Material> materials;
 	ComPtr<ID3D12Resource> materialsBuffer;
 	void CreateMaterialsBuffer();
@@ -270,8 +363,27 @@ private:
 	float frameTime; //Frame time in milliseconds
 
 	//Model updating
-	void QueueModelVertexAndIndexBufferUpdates(std::vector<XMFLOAT3>& vertexPoints, std::vector<UINT>& indices);
-	std::vector<Vertex> pendingVertices;
-	std::vector<UINT> pendingIndices;
-	bool pendingModelUpdate = false;
+	//Models are loaded in the background by modelLoadTask and the current model is drawn until the new one is ready.
+	ModelLoadTask modelLoadTask;
+	/// <summary>
+	/// Runs on the model loading thread. Creates the upload buffers of the loaded model and fills them.
+	/// The startup model goes through here as well.
+	/// </summary>
+	/// <param name="lods">Index ranges of the levels of detail in indices. Empty means indices is a single level.</param>
+	/// <param name="parts">Parts of the model and their levels of detail. Empty means the model is a single part with the default material.</param>
+	/// <param name="modelMaterials">Materials of the parts. They are added to materials after the default material when the model is swapped in.</param>
+	bool CreatePendingModelBuffers(const MeshCache::Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices, const std::vector<MeshCache::Lod>& lods,
+		const std::vector<MeshCache::Part>& parts, const std::vector<MeshCache::Material>& modelMaterials);
+	ComPtr<ID3D12Resource> pendingVertexBuffer;
+	ComPtr<ID3D12Resource> pendingIndexBuffer;
+	ComPtr<ID3D12Resource> pendingTransformBuffer;
+	float pendingDequantization[12] = {};
+	UINT pendingVertexCount = 0;
+	UINT pendingIndexCount = 0;
+	IndexPacking::Format pendingIndexFormat = IndexPacking::Format::UInt32;
+	VertexQuantization::Format pendingVertexFormat = VertexQuantization::Format::Float;
+	std::vector<MeshCache::Lod> pendingLods;
+	std::vector<MeshCache::Part> pendingParts;
+	std::vector<MeshCache::Material> pendingMaterials;
+	XMFLOAT4 pendingBoundingSphere = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
 };
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MemoryMappedFile.h"
+#include "MeshCache.h"
+
+/// <summary>
+/// Reads glTF 2.0 files, both binary (.glb) and text (.gltf) files whose buffers are separate files or data URIs.
+/// The files are memory mapped. The vertices and indices of a primitive point straight into the mapped file when its accessors
+/// already have the layout of MeshCache::Vertex (float positions and normals interleaved with a 24 byte stride) and 32 bit indices,
+/// everything else is converted once into storage owned by the file manager.
+/// Only triangle lists are read. Sparse accessors, morph targets and skins are not supported, and texture coordinates are ignored.
+/// </summary>
+class GLTFFileManager
+{
+public:
+    /// <summary>
+    /// A read only view of elements that are stored somewhere else.
+    /// </summary>
+    template <class T>
+    struct Span
+    {
+        const T* data = nullptr;
+        size_t size = 0;
+
+        const T* begin() const { return data; }
+        const T* end() const { return data + size; }
+        const T& operator[](size_t i) const { return data[i]; }
+    };
+
+    /// <summary>
+    /// A triangle list of a mesh with one material.
+    /// </summary>
+    struct Primitive
+    {
+        Span<MeshCache::Vertex> vertices;
+        Span<uint32_t> indices;
+        //Index into GetMaterials(), or MeshCache::NoMaterial if the primitive uses the default material.
+        uint32_t material = MeshCache::NoMaterial;
+        //Whether vertices and indices point into the mapped file instead of converted copies.
+        bool verticesMapped = false;
+        bool indicesMapped = false;
+        //Set when the file has no normals for the primitive. The normals of its vertices are (0, 1, 0) then.
+        bool missingNormals = false;
+    };
+
+    /// <summary>
+    /// A mesh of the file, which is primitiveCount primitives of GetPrimitives() starting at firstPrimitive.
+    /// </summary>
+    struct Mesh
+    {
+        uint32_t firstPrimitive;
+        uint32_t primitiveCount;
+    };
+
+    /// <summary>
+    /// A node of the default scene that draws a mesh. The transform is the world transform of the node as 16 floats in the layout of DirectX::XMMATRIX
+    /// (row vectors, translation in the last row). That is the column major layout glTF stores matrices in, so it goes into TLASParams as is.
+    /// </summary>
+    struct Instance
+    {
+        uint32_t mesh;
+        float transform[16];
+    };
+
+    GLTFFileManager();
+    ~GLTFFileManager();
+    GLTFFileManager(const GLTFFileManager&) = delete;
+    GLTFFileManager& operator=(const GLTFFileManager&) = delete;
+
+    /// <summary>
+    /// Reads the .gltf or .glb file in the given path. Anything loaded before is dropped first.
+    /// </summary>
+    /// <returns>Returns whether the file was read. Files that reference data they don't have, or use features that are not supported, fail to load.</returns>
+    bool Load(const std::string& path);
+    /// <summary>
+    /// Unmaps the files and drops everything that was loaded. The spans of the primitives are invalid after this call.
+    /// </summary>
+    void Close();
+
+    const std::vector<Primitive>& GetPrimitives() const;
+    const std::vector<Mesh>& GetMeshes() const;
+    const std::vector<Instance>& GetInstances() const;
+    /// <summary>
+    /// Materials of the file converted from their metallic roughness parameters. Smooth metals get a reflectivity of metallic * (1 - roughness).
+    /// </summary>
+    const std::vector<MeshCache::Material>& GetMaterials() const;
+
+    /// <summary>
+    /// Returns whether the path has a .gltf or .glb extension.
+    /// </summary>
+    static bool IsGltfPath(const std::string& path);
+
+    /// <summary>
+    /// Writes a .glb file with a single mesh and a single node. Every part becomes a primitive that draws the first level of detail of the part.
+    /// The vertices are stored interleaved and the indices as 32 bit integers, so Load() reads them back without a copy.
+    /// </summary>
+    /// <param name="parts">Optional. Without parts the whole index buffer is one primitive with the default material.</param>
+    /// <returns>Returns whether the file could be written.</returns>
+    static bool WriteGlb(const std::string& path, const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+        const MeshCache::Lod* lods = nullptr, const MeshCache::Part* parts = nullptr, size_t partCount = 0,
+        const MeshCache::Material* materials = nullptr, size_t materialCount = 0);
+
+private:
+    struct Document;
+
+    bool LoadDocument(const Document& document, const std::string& folder, const char* binaryChunk, size_t binaryChunkSize);
+
+    MemoryMappedFile file;
+    //Mapped .bin files of a .gltf file.
+    std::vector<std::unique_ptr<MemoryMappedFile>> bufferFiles;
+    //Buffers decoded from data URIs.
+    std::vector<std::vector<char>> decodedBuffers;
+    //Converted attributes. The outer vectors may move their elements, but the element buffers the spans point into stay where they are.
+    std::vector<std::vector<MeshCache::Vertex>> convertedVertices;
+    std::vector<std::vector<uint32_t>> convertedIndices;
+    std::vector<Primitive> primitives;
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    std::vector<MeshCache::Material> materials;
+};
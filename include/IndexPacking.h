@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// Packs 32 bit mesh indices into the smallest index format that can address every vertex of the mesh.
+/// Meshes with at most 65536 vertices get 16 bit indices, which halves their index buffer and the bandwidth of every index fetch.
+/// The packed data is laid out the way Hit.hlsl reads it through a ByteAddressBuffer.
+/// </summary>
+class IndexPacking
+{
+public:
+    /// <summary>
+    /// Size of one index in bytes. The hit shader gets the same value as its indexSize constant.
+    /// </summary>
+    enum class Format : uint32_t
+    {
+        UInt16 = 2,
+        UInt32 = 4
+    };
+
+    /// <summary>
+    /// Largest vertex count that 16 bit indices can address.
+    /// </summary>
+    static const size_t MaxUInt16VertexCount = 65536;
+
+    static Format ChooseFormat(size_t vertexCount);
+
+    /// <summary>
+    /// Size of the packed indices in bytes. It is rounded up to 4 bytes because a ByteAddressBuffer is read 4 bytes at a time.
+    /// </summary>
+    static size_t GetPackedSize(size_t indexCount, Format format);
+
+    /// <summary>
+    /// Writes the indices in the given format to destination, which must hold GetPackedSize() bytes. The padding is zeroed.
+    /// The indices must fit in the format, which is always the case with the format ChooseFormat() returned for the mesh.
+    /// </summary>
+    static void Pack(const uint32_t* indices, size_t indexCount, Format format, void* destination);
+
+    /// <summary>
+    /// Reads one index from packed data the same way the hit shader does.
+    /// </summary>
+    static uint32_t Unpack(const void* packed, Format format, size_t index);
+};
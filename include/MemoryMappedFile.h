@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// <summary>
+/// Read-only view of a whole file mapped into the address space of the process.
+/// Used by the model loaders so that the file bytes can be parsed in place without copying them into strings first.
+/// </summary>
+class MemoryMappedFile
+{
+public:
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    /// <summary>
+    /// Maps the file in the given path. Any previously mapped file is closed first.
+    /// </summary>
+    /// <param name="path">Path of the file to map.</param>
+    /// <returns>Returns whether the file could be opened. An empty file is opened successfully but has no data.</returns>
+    bool Open(const std::string& path);
+    /// <summary>
+    /// Unmaps the file. Pointers returned from Data() are invalid after this call.
+    /// </summary>
+    void Close();
+
+    const char* Data() const;
+    size_t Size() const;
+    bool IsOpen() const;
+
+private:
+    const char* data;
+    size_t size;
+    bool isOpen;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
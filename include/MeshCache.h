@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MemoryMappedFile.h"
+
+/// <summary>
+/// Binary cache of a model that is ready to be uploaded to the GPU (.rtmesh).
+/// The cache is written beside the source file (or where the asset baker puts it) after it is parsed, optimized, its normals are generated and its levels of detail are built.
+/// Later loads map the cache and decode its vertices and indices, so the source is never parsed again.
+/// The vertex and index streams are compressed with MeshCodec, which decodes faster than the disk reads the raw streams would take.
+/// A cache is only used if its format version and the hash of the source file contents, and of the material libraries of an OBJ file, still match.
+/// </summary>
+class MeshCache
+{
+public:
+    /// <summary>
+    /// Vertex layout stored in the cache. It matches D3D12HelloTriangle::Vertex byte for byte.
+    /// </summary>
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+    };
+
+    /// <summary>
+    /// A level of detail of the mesh: a range of the index buffer that draws the mesh with fewer triangles.
+    /// </summary>
+    struct Lod
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        //Estimated largest distance between this level and the full detail mesh, in model units.
+        float error;
+    };
+
+    /// <summary>
+    /// A piece of the mesh drawn with one material. Every part has its own chain of levels of detail, which are lodCount entries of the level table starting at firstLod.
+    /// </summary>
+    struct Part
+    {
+        uint32_t firstLod;
+        uint32_t lodCount;
+        //Index into the material table, or NoMaterial if the part uses the default material.
+        uint32_t material;
+    };
+
+    /// <summary>
+    /// Material stored in the cache. It matches D3D12HelloTriangle::Material byte for byte.
+    /// </summary>
+    struct Material
+    {
+        float albedo[3];
+        float roughness;
+        float metallic;
+        float reflectivity;
+    };
+
+    static const uint32_t NoMaterial = UINT32_MAX;
+
+    /// <summary>
+    /// Bump this whenever the file layout or the way the cached data is generated changes, so that old caches are rebuilt.
+    /// </summary>
+    static const uint32_t Version = 6;
+
+    /// <summary>
+    /// Alignment of every section in the file, relative to the start of the file.
+    /// </summary>
+    static const size_t SectionAlignment = 16;
+
+    MeshCache();
+
+    /// <summary>
+    /// Hashes the source file, and the material libraries it names if it is an OBJ file, and maps its cache if the cache is valid for it.
+    /// The source hash is remembered either way, so Write() can be called right after a miss without hashing again.
+    /// </summary>
+    /// <param name="sourcePath">Path of the model file the cache belongs to.</param>
+    /// <param name="cachePath">Optional. Where the cache is read from and written to, GetCachePath(sourcePath) if empty.</param>
+    /// <returns>Returns whether a valid cache was found and mapped.</returns>
+    bool Open(const std::string& sourcePath, const std::string& cachePath = std::string());
+    /// <summary>
+    /// Maps a baked cache without its source file, for models that are shipped without their sources.
+    /// Everything but the source hash is validated, down to every index being within the vertices. Write() can't be called after this.
+    /// </summary>
+    /// <returns>Returns whether the cache was mapped.</returns>
+    bool OpenBaked(const std::string& cachePath);
+    void Close();
+
+    /// <summary>
+    /// Writes the cache of the source file passed to the last Open() call.
+    /// The file is written under a temporary name and renamed at the end, so a half written cache is never picked up.
+    /// Any cache mapped by this object is closed first.
+    /// </summary>
+    /// <returns>Returns whether the cache could be written. Failing to write a cache is not an error for the caller.</returns>
+    bool Write(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const Lod* lods = nullptr, size_t lodCount = 0,
+        const Part* parts = nullptr, size_t partCount = 0, const Material* materials = nullptr, size_t materialCount = 0);
+
+    const Vertex* GetVertices() const;
+    uint32_t GetVertexCount() const;
+    const uint32_t* GetIndices() const;
+    uint32_t GetIndexCount() const;
+    const Lod* GetLods() const;
+    uint32_t GetLodCount() const;
+    const Part* GetParts() const;
+    uint32_t GetPartCount() const;
+    const Material* GetMaterials() const;
+    uint32_t GetMaterialCount() const;
+    /// <summary>
+    /// Moves the decoded vertices and indices out of the cache instead of copying them. GetVertices() and GetIndices() return nothing afterwards.
+    /// </summary>
+    void TakeStreams(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    /// <summary>
+    /// Hash of the source file contents the cache belongs to, with the material libraries of an OBJ file. Valid after Open(), and after a successful OpenBaked().
+    /// </summary>
+    uint64_t GetSourceHash() const;
+
+    /// <summary>
+    /// Returns the path of the cache of a model file, which is the model path with .rtmesh added after its extension
+    /// </summary>
+    static std::string GetCachePath(const std::string& sourcePath);
+
+    /// <summary>
+    /// 64 bit hash (XXH64) of a block of memory. Used to detect changes in the source files.
+    /// </summary>
+    static uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+private:
+    /// <summary>
+    /// Maps cachePath and validates it, including the source hash if checkSource is set.
+    /// </summary>
+    bool MapCache(bool checkSource);
+
+    MemoryMappedFile file;
+    std::string sourcePath;
+    std::string cachePath;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    bool sourceHashed;
+    std::vector<Vertex> decodedVertices;
+    std::vector<uint32_t> decodedIndices;
+    const Vertex* vertices;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+    const Lod* lods;
+    uint32_t lodCount;
+    const Part* parts;
+    uint32_t partCount;
+    const Material* materials;
+    uint32_t materialCount;
+};
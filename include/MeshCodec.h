@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Lossless compression of vertex and index streams for the .rtmesh cache.
+/// Every 4 byte word of a vertex is predicted from the same word of the previous vertex. The difference is zigzag encoded so small negative
+/// differences become small numbers, and the four bytes of the differences are split into byte planes. Each byte plane is stored in groups of 16
+/// bytes with 0, 2, 4 or 8 bits per byte, whichever is the smallest that holds every byte of the group. Vertices that are in fetch order
+/// (see MeshOptimizer::OptimizeVertexFetch) are near their predecessor, so the high planes are mostly empty groups that take no space at all.
+/// Indices are encoded the same way as 4 byte vertices, which is delta coding of the index stream.
+/// Decoding is a few shifts, masks and adds per word with no branches inside a group, and it checks every read against the size of the input.
+/// </summary>
+class MeshCodec
+{
+public:
+    /// <summary>
+    /// Vertices per block. Every block stores a 2 bit width for each group of 16 bytes of each of its byte planes.
+    /// </summary>
+    static const size_t BlockVertexCount = 256;
+    /// <summary>
+    /// Largest vertex size the codec accepts.
+    /// </summary>
+    static const size_t MaxVertexSize = 256;
+
+    /// <summary>
+    /// Appends the encoded vertices to encoded.
+    /// </summary>
+    /// <param name="vertexSize">Size of a vertex in bytes. It has to be a multiple of 4 and at most MaxVertexSize.</param>
+    /// <returns>Returns false for an unsupported vertex size, leaving encoded unchanged.</returns>
+    static bool EncodeVertices(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<uint8_t>& encoded);
+    /// <summary>
+    /// Decodes vertexCount vertices of vertexSize bytes into destination. Bytes after the encoded vertices are ignored.
+    /// </summary>
+    /// <param name="bytesRead">Optional. Receives the size of the encoded vertices.</param>
+    /// <returns>Returns false if the data is not a valid encoding of that many vertices. destination is partly written then.</returns>
+    static bool DecodeVertices(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* encoded, size_t encodedSize, size_t* bytesRead = nullptr);
+
+    /// <summary>
+    /// Smallest size any valid encoding of vertexCount vertices of vertexSize bytes can have. Lets a reader reject a vertex count that is too large
+    /// for the encoded data before it allocates memory for the decoded vertices.
+    /// </summary>
+    static size_t GetMinimumEncodedSize(size_t vertexCount, size_t vertexSize);
+
+    static void EncodeIndices(const uint32_t* indices, size_t indexCount, std::vector<uint8_t>& encoded);
+    /// <summary>
+    /// Decodes indexCount indices into destination. Bytes after the encoded indices are ignored.
+    /// </summary>
+    /// <param name="bytesRead">Optional. Receives the size of the encoded indices.</param>
+    /// <returns>Returns false if the data is not a valid encoding of that many indices. destination is partly written then.</returns>
+    static bool DecodeIndices(uint32_t* destination, size_t indexCount, const uint8_t* encoded, size_t encodedSize, size_t* bytesRead = nullptr);
+};
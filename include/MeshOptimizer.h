@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MeshCache.h"
+
+/// <summary>
+/// Import time clean up and reordering of a mesh so both the raster path and the hit shader read its buffers in a cache friendly order.
+/// Optimize() welds duplicate vertices, drops degenerate and duplicate triangles, reorders the triangles for the post transform vertex cache
+/// (Tipsify, Sander et al. 2007) and finally reorders the vertices in the order the triangles first use them.
+/// The order of the corners inside a triangle is never changed, Hit.hlsl depends on it when it interpolates the normals.
+/// </summary>
+class MeshOptimizer
+{
+public:
+    /// <summary>
+    /// Cache size the triangles are ordered for and the statistics are measured with. Most GPUs keep at least this many transformed vertices.
+    /// </summary>
+    static const uint32_t DefaultCacheSize = 16;
+
+    /// <summary>
+    /// Result of simulating a FIFO vertex cache over an index buffer.
+    /// ACMR is the average number of cache misses per triangle (0.5 is the best a regular grid can reach, 3 means no reuse).
+    /// ATVR is the number of cache misses per referenced vertex (1 is optimal).
+    /// </summary>
+    struct CacheStatistics
+    {
+        float acmr = 0.0f;
+        float atvr = 0.0f;
+    };
+
+    struct Report
+    {
+        size_t inputVertexCount = 0;
+        size_t inputTriangleCount = 0;
+        size_t outputVertexCount = 0;
+        size_t outputTriangleCount = 0;
+        size_t weldedVertexCount = 0;
+        size_t degenerateTriangleCount = 0;
+        size_t duplicateTriangleCount = 0;
+        CacheStatistics before;
+        CacheStatistics after;
+    };
+
+    /// <summary>
+    /// Runs every step in order.
+    /// </summary>
+    /// <param name="report">Optional. Receives the counts and the cache statistics before and after.</param>
+    /// <param name="cancelled">Optional. The optimization stops between steps, leaving the mesh valid but partly optimized, once this becomes true.</param>
+    /// <param name="progress">Optional. Receives the finished part of the optimization between 0 and 1.</param>
+    /// <returns>Returns false if the optimization was cancelled.</returns>
+    static bool Optimize(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, Report* report = nullptr,
+        const std::atomic<bool>* cancelled = nullptr, std::atomic<float>* progress = nullptr);
+    /// <summary>
+    /// Runs every step in order on a mesh made of parts that follow each other in indices, for example one per material.
+    /// The vertices are welded and reordered for the whole mesh, the triangles are cleaned up and reordered inside their own part.
+    /// </summary>
+    /// <param name="partIndexCounts">Number of indices of every part, each a multiple of 3. Receives the counts after the clean up.</param>
+    static bool Optimize(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& partIndexCounts, Report* report = nullptr,
+        const std::atomic<bool>* cancelled = nullptr, std::atomic<float>* progress = nullptr);
+
+    /// <summary>
+    /// Merges vertices that have bitwise equal positions and normals (0 and -0 count as equal). The first of the equal vertices is kept.
+    /// </summary>
+    /// <returns>Returns the number of removed vertices.</returns>
+    static size_t WeldVertices(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices);
+    /// <summary>
+    /// Removes the triangles that use the same vertex more than once.
+    /// </summary>
+    /// <returns>Returns the number of removed triangles.</returns>
+    static size_t RemoveDegenerateTriangles(std::vector<uint32_t>& indices);
+    /// <summary>
+    /// Removes the triangles that use the same vertices with the same winding as an earlier triangle.
+    /// A triangle and its reversed copy both stay since they face different ways.
+    /// </summary>
+    /// <returns>Returns the number of removed triangles.</returns>
+    static size_t RemoveDuplicateTriangles(std::vector<uint32_t>& indices);
+    /// <summary>
+    /// Reorders the triangles with Tipsify for a vertex cache of the given size.
+    /// </summary>
+    static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = DefaultCacheSize);
+    /// <summary>
+    /// Reorders the vertices in the order the index buffer first uses them. Vertices no triangle uses are removed.
+    /// </summary>
+    static void OptimizeVertexFetch(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    static CacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = DefaultCacheSize);
+};
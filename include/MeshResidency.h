@@ -0,0 +1,173 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MemoryMappedFile.h"
+#include "MeshCache.h"
+
+/// <summary>
+/// Keeps the CPU side vertices and indices of many meshes within a memory budget.
+/// The meshes live in a pack file (.rtpack) that holds the MeshCodec streams of every mesh. The pack is mapped, and a mesh is decoded into
+/// memory the first time it is acquired after it was evicted. Meshes that are not acquired by anyone are kept in least recently used order,
+/// and the oldest of them are evicted whenever the decoded meshes take more than the budget.
+/// A mesh is pinned while it is acquired, so meshes that are referenced by live instances are never evicted. If the pinned meshes alone take
+/// more than the budget, the budget is exceeded rather than failing the acquire.
+/// All the methods are thread safe. A mesh is decoded outside the lock, and threads that acquire a mesh that is being decoded wait for it.
+/// </summary>
+class MeshResidency
+{
+public:
+    /// <summary>
+    /// Writes a pack file one mesh at a time, so the meshes of a scene never have to be in memory together.
+    /// The file is written under a temporary name and renamed by Finish(), so a half written pack is never picked up.
+    /// </summary>
+    class PackWriter
+    {
+    public:
+        PackWriter();
+        ~PackWriter();
+
+        PackWriter(const PackWriter&) = delete;
+        PackWriter& operator=(const PackWriter&) = delete;
+
+        bool Open(const std::string& path);
+        /// <summary>
+        /// Encodes a mesh and appends it to the pack.
+        /// </summary>
+        /// <returns>Returns the id of the mesh, which is the number of meshes added before it, or UINT32_MAX if it could not be written.</returns>
+        uint32_t Add(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount);
+        /// <summary>
+        /// Writes the mesh table and renames the pack to its final name. Nothing is kept if any of the writes failed.
+        /// </summary>
+        bool Finish();
+
+    private:
+        /// <summary>
+        /// Writes data followed by zeros up to the next section boundary and returns the offset it was written at.
+        /// </summary>
+        uint64_t WriteSection(const std::vector<uint8_t>& data);
+
+        std::string path;
+        FILE* output;
+        uint64_t written;
+        bool failed;
+        uint32_t meshCount;
+        //Mesh table of the file. It is written at the end, when every mesh is in.
+        std::vector<uint8_t> table;
+        std::vector<uint8_t> encoded;
+    };
+
+    /// <summary>
+    /// Decoded data of a resident mesh. It stays valid until the mesh is released.
+    /// </summary>
+    struct Mesh
+    {
+        const MeshCache::Vertex* vertices;
+        uint32_t vertexCount;
+        const uint32_t* indices;
+        uint32_t indexCount;
+    };
+
+    struct Statistics
+    {
+        //Acquires of a mesh that was resident.
+        uint64_t hits;
+        //Acquires that had to decode the mesh from the pack.
+        uint64_t misses;
+        //Meshes dropped to stay within the budget.
+        uint64_t evictions;
+        //Acquires that failed because the mesh could not be decoded.
+        uint64_t failures;
+        uint64_t bytesPagedIn;
+        size_t residentBytes;
+        size_t peakResidentBytes;
+        size_t pinnedBytes;
+        uint32_t residentMeshes;
+        uint32_t pinnedMeshes;
+    };
+
+    static const uint32_t Version = 1;
+
+    MeshResidency();
+    ~MeshResidency();
+
+    MeshResidency(const MeshResidency&) = delete;
+    MeshResidency& operator=(const MeshResidency&) = delete;
+
+    /// <summary>
+    /// Maps a pack file and validates its mesh table. No mesh is decoded until it is acquired.
+    /// </summary>
+    /// <param name="budgetBytes">Largest size of all the decoded meshes, in bytes. Only pinned meshes can take them over it.</param>
+    bool Open(const std::string& packPath, size_t budgetBytes);
+    /// <summary>
+    /// Drops every mesh and unmaps the pack. No mesh may be acquired when this is called.
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Pins a mesh and decodes it if it isn't resident. Every successful Acquire() needs a Release() of the same mesh.
+    /// </summary>
+    /// <returns>Returns the decoded mesh, or nullptr if the id is out of range or the mesh could not be decoded.</returns>
+    const Mesh* Acquire(uint32_t mesh);
+    /// <summary>
+    /// Unpins a mesh. It stays resident as the most recently used mesh until the budget needs its memory.
+    /// </summary>
+    void Release(uint32_t mesh);
+
+    /// <summary>
+    /// Changes the budget and evicts meshes that don't fit in the new one.
+    /// </summary>
+    void SetBudget(size_t budgetBytes);
+    size_t GetBudget() const;
+    uint32_t GetMeshCount() const;
+    /// <summary>
+    /// Size of a mesh once it is decoded, in bytes. This is what it counts against the budget.
+    /// </summary>
+    size_t GetMeshSize(uint32_t mesh) const;
+    Statistics GetStatistics() const;
+    void ResetCounters();
+
+private:
+    enum class State
+    {
+        Evicted,
+        Loading,
+        Resident,
+    };
+
+    struct Entry
+    {
+        const uint8_t* encodedVertices;
+        size_t encodedVertexSize;
+        const uint8_t* encodedIndices;
+        size_t encodedIndexSize;
+        size_t decodedSize;
+        State state;
+        uint32_t pinCount;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh mesh;
+        //Position in leastRecentlyUsed. Only meshes that are resident and not pinned are in that list.
+        std::list<uint32_t>::iterator lruPosition;
+    };
+
+    /// <summary>
+    /// Evicts the least recently used meshes until the meshes take at most budget bytes or only pinned meshes are left. mutex has to be held.
+    /// </summary>
+    void EvictToFit(size_t budgetBytes);
+
+    MemoryMappedFile file;
+    mutable std::mutex mutex;
+    std::condition_variable loaded;
+    std::vector<Entry> entries;
+    //Front is the most recently used.
+    std::list<uint32_t> leastRecentlyUsed;
+    size_t budget;
+    Statistics statistics;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MeshCache.h"
+
+/// <summary>
+/// Quadric error metric simplification (Garland and Heckbert 1997) that only collapses edges onto one of their two vertices,
+/// so every level of detail indexes the same vertex buffer and only needs its own index range.
+/// Vertices on the open border of the mesh only slide along the border, and vertices on edges shared by more than two triangles never move.
+/// </summary>
+class MeshSimplifier
+{
+public:
+    /// <summary>
+    /// Simplifies the triangles until at most targetIndexCount indices are left or the next collapse would be more than maxError away from the original surface.
+    /// It also stops early when nearly every remaining collapse is blocked, which happens on triangle soups.
+    /// </summary>
+    /// <param name="resultError">Optional. Receives the estimated largest distance between the result and the original surface.</param>
+    /// <returns>Returns the indices of the simplified triangles.</returns>
+    static std::vector<uint32_t> Simplify(const std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float maxError, float* resultError = nullptr);
+
+    /// <summary>
+    /// Builds a chain of levels of detail, each with about reduction times the triangles of the previous one.
+    /// The chain stops at maxLevelCount levels, when a level would have less than minTriangleCount triangles or when a level can't be reduced further.
+    /// The first level is the mesh itself. The index ranges of the levels follow each other in indices, which is rewritten with all of them,
+    /// and the triangles of every level are reordered for the vertex cache.
+    /// </summary>
+    /// <param name="cancelled">Optional. The generation stops between two passes once this becomes true.</param>
+    /// <param name="progress">Optional. Receives the finished part of the generation between 0 and 1.</param>
+    /// <returns>Returns false if the generation was cancelled, leaving the indices unchanged.</returns>
+    static bool BuildLodChain(const std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshCache::Lod>& lods,
+        size_t maxLevelCount = 6, float reduction = 0.5f, size_t minTriangleCount = 64,
+        const std::atomic<bool>* cancelled = nullptr, std::atomic<float>* progress = nullptr);
+};
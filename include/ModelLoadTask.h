@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "OBJ_FileManager.h"
+
+class ThreadPool;
+
+/// <summary>
+/// Loads an OBJ or glTF model file on a background thread in five stages: parsing the file (or reading its .rtmesh cache),
+/// optimizing the mesh for the vertex cache (see MeshOptimizer), generating the vertex normals, building the levels of detail (see MeshSimplifier)
+/// and preparing the buffers the GPU reads from.
+/// The materials of the file (or of an OBJ file's material libraries) are converted and deduplicated, and the triangles are grouped into one part per material.
+/// The instances of a glTF scene are baked into the one model with their transforms.
+/// The owner polls the stage every frame and takes the result once it is Finished, so the render loop never waits for a load.
+/// A running load can be cancelled, which stops it within a few megabytes of parsing or a few thousand triangles of normals.
+/// </summary>
+class ModelLoadTask
+{
+public:
+    enum class Stage
+    {
+        Idle,
+        Parsing,
+        Optimizing,
+        ComputingNormals,
+        GeneratingLods,
+        PreparingBuffers,
+        Finished,
+        Failed,
+        Cancelled
+    };
+
+    /// <summary>
+    /// Called on the loading thread as the last stage with the final vertices, indices, levels of detail, parts and materials, for example to fill upload buffers.
+    /// Returning false (or throwing) makes the load fail.
+    /// </summary>
+    typedef std::function<bool(const std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices,
+        const std::vector<MeshCache::Lod>& lods, const std::vector<MeshCache::Part>& parts, const std::vector<MeshCache::Material>& materials)> PrepareBuffersFunction;
+
+    ModelLoadTask();
+    /// <summary>
+    /// Cancels the running load and waits for its thread.
+    /// </summary>
+    ~ModelLoadTask();
+    ModelLoadTask(const ModelLoadTask&) = delete;
+    ModelLoadTask& operator=(const ModelLoadTask&) = delete;
+
+    /// <summary>
+    /// Sets the function of the PreparingBuffers stage. If none is set the stage only finishes the load.
+    /// Must not be called while a load is running.
+    /// </summary>
+    void SetPrepareBuffersFunction(PrepareBuffersFunction function);
+
+    /// <summary>
+    /// Starts loading the model file in the given path. A result of an earlier load that wasn't taken is dropped.
+    /// A baked .rtmesh file is loaded as is, without its source file.
+    /// </summary>
+    /// <param name="cachePath">Optional. Where the .rtmesh cache of the model is read from and written to, beside the model if empty.</param>
+    /// <returns>Returns false without doing anything if a load is already running.</returns>
+    bool Start(const std::string& path, const std::string& cachePath = std::string());
+    /// <summary>
+    /// Asks the running load to stop. The stage becomes Cancelled once the loading thread notices it.
+    /// </summary>
+    void Cancel();
+    /// <summary>
+    /// Blocks until the running load, if any, has finished, failed or been cancelled.
+    /// </summary>
+    void Wait();
+
+    bool IsRunning() const;
+    Stage GetStage() const;
+    /// <summary>
+    /// Returns the finished part of the current stage between 0 and 1.
+    /// </summary>
+    float GetStageProgress() const;
+    const std::string& GetPath() const;
+    /// <summary>
+    /// Returns how long the last load spent in one of the stages from Parsing to PreparingBuffers, 0 for stages it skipped.
+    /// Only valid once the load is no longer running.
+    /// </summary>
+    double GetStageSeconds(Stage stage) const;
+
+    /// <summary>
+    /// Moves the loaded vertices and indices out of the task. Only succeeds once per load, after the stage became Finished.
+    /// The indices hold the levels of detail of every part one after the other, the first level of a part is its full detail mesh.
+    /// </summary>
+    /// <param name="lods">Optional. Receives the index ranges of the levels of detail. There is always at least one.</param>
+    /// <param name="parts">Optional. Receives the parts of the model. There is always at least one.</param>
+    /// <param name="materials">Optional. Receives the materials the parts use.</param>
+    /// <returns>Returns whether there was a result to take.</returns>
+    bool TakeResult(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshCache::Lod>* lods = nullptr,
+        std::vector<MeshCache::Part>* parts = nullptr, std::vector<MeshCache::Material>* materials = nullptr);
+
+    /// <summary>
+    /// Gives what the Optimizing stage did to the mesh. Only valid once the stage is Finished.
+    /// </summary>
+    /// <returns>Returns false if the mesh came from the .rtmesh cache, which is already optimized.</returns>
+    bool GetOptimizationReport(MeshOptimizer::Report& report) const;
+
+    static const char* GetStageName(Stage stage);
+
+    /// <summary>
+    /// Converts an MTL material to the material the renderer uses. The PBR extension (Pr and Pm) is used when the material has it,
+    /// otherwise the roughness comes from the specular exponent and the metallic is 0. Materials with a reflective illumination model
+    /// reflect as much as their strongest specular color channel.
+    /// </summary>
+    static MeshCache::Material ConvertMaterial(const objl::Material& material);
+
+    /// <summary>
+    /// How the normals of the triangles around a vertex are weighted in its normal.
+    /// Face weights every triangle the same. Angle weights every triangle by its angle at the vertex, which keeps
+    /// the normal from leaning towards the side that happens to be split into more triangles.
+    /// </summary>
+    enum class NormalWeighting
+    {
+        Face,
+        Angle
+    };
+
+    /// <summary>
+    /// Computes face normals and distributes them as vertex normals. The work is split over the threads of the pool
+    /// and the result is the same for any number of threads.
+    /// </summary>
+    /// <param name="cancelled">Optional. The computation stops early, leaving the normals incomplete, once this becomes true.</param>
+    /// <param name="progress">Optional. Receives the finished part of the computation between 0 and 1.</param>
+    /// <param name="pool">Optional. The pool that runs the computation, ThreadPool::Shared() if not given.</param>
+    /// <returns>Returns false if the computation was cancelled.</returns>
+    static bool ComputeVertexNormals(std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices, NormalWeighting weighting = NormalWeighting::Face,
+        const std::atomic<bool>* cancelled = nullptr, std::atomic<float>* progress = nullptr, ThreadPool* pool = nullptr);
+
+private:
+    void Run();
+    /// <summary>
+    /// The stages of the load. Returns false if the load failed or was cancelled, stage tells which one.
+    /// </summary>
+    bool RunStages();
+    /// <summary>
+    /// Moves on to the next stage and adds the time spent in the current one to its stage time.
+    /// </summary>
+    void EnterStage(Stage next);
+    /// <summary>
+    /// Loads the material libraries of the file and converts its materials into materials, without duplicates.
+    /// </summary>
+    /// <returns>Returns the index in materials of every material name, NoMaterial for the ones the libraries don't define.</returns>
+    std::vector<uint32_t> ImportMaterials(const OBJFileManager::MaterialGroups& groups);
+    /// <summary>
+    /// Reads a .gltf or .glb file into vertices and indices with every instance of its default scene transformed into place,
+    /// and converts its materials into materials, without duplicates.
+    /// </summary>
+    /// <param name="ranges">Receives a range for every primitive, whose material is the material index in the file.</param>
+    /// <param name="materialOfName">Receives the index in materials of every material of the file.</param>
+    bool LoadGltfFile(std::vector<OBJFileManager::MaterialGroups::Range>& ranges, std::vector<uint32_t>& materialOfName);
+
+    std::thread worker;
+    std::atomic<Stage> stage;
+    std::atomic<float> stageProgress;
+    std::chrono::steady_clock::time_point stageStart;
+    //Seconds spent in each stage from Parsing to PreparingBuffers.
+    double stageSeconds[5];
+    OBJFileManager::LoadProgress parseProgress;
+    std::string path;
+    std::string cachePath;
+    PrepareBuffersFunction prepareBuffers;
+    std::vector<MeshCache::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshCache::Lod> lods;
+    std::vector<MeshCache::Part> parts;
+    std::vector<MeshCache::Material> materials;
+    bool resultTaken;
+    MeshOptimizer::Report optimizationReport;
+    bool optimized;
+};
@@ -1,17 +1,144 @@
 #pragma once
 
-#include "DirectXMath.h"
 #include "OBJ_Loader.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
 class OBJFileManager
 {
 public:
+    /// <summary>
+    /// Shared between a LoadObjFile() call and the thread that waits for it. The file is parsed in two passes,
+    /// so processedBytes goes up to twice totalBytes. Setting cancelled stops the load at the next chunk of the file.
+    /// </summary>
+    struct LoadProgress
+    {
+        std::atomic<uint64_t> totalBytes{ 0 };
+        std::atomic<uint64_t> processedBytes{ 0 };
+        std::atomic<bool> cancelled{ false };
+
+        /// <summary>
+        /// Returns the finished part of the load between 0 and 1.
+        /// </summary>
+        float GetFraction() const;
+    };
+
+    /// <summary>
+    /// The materials the faces of an OBJ file use, as given by its mtllib and usemtl statements.
+    /// </summary>
+    struct MaterialGroups
+    {
+        /// <summary>
+        /// A run of triangles that use the same material. It lasts until the next range starts or the file ends.
+        /// </summary>
+        struct Range
+        {
+            uint32_t firstTriangle;
+            //Index into names, or MissingIndex for the triangles before the first usemtl statement.
+            uint32_t material;
+        };
+
+        //Material libraries in the order the file names them, as written in the file. They are relative to the folder of the file.
+        std::vector<std::string> libraries;
+        //Every material name the file uses, in the order it first uses them.
+        std::vector<std::string> names;
+        //Ranges in file order. The first one always starts at triangle 0 and no two ranges in a row have the same material.
+        std::vector<Range> ranges;
+    };
+
     /// <summary>
     /// Reads the OBJ file in the given path and adds it to the passed in vectors.
+    /// The file is memory mapped and parsed in place, so no per-line allocations are made.
+    /// Faces can use any of the v, v/vt, v//vn and v/vt/vn forms and can have any number of corners, polygons are triangulated as a fan.
+    /// Corners that use the same position, texture coordinate and normal share one vertex.
     /// </summary>
     /// <param name="path">Path of the obj file.</param>
     /// <param name="vertices">The vector to hold the loaded vertices.</param>
     /// <param name="indices">The vector to hold the loaded indices.</param>
-    /// <returns>Returns whether the file was read successfully.</returns>
-    bool LoadObjFile(std::string path, std::vector<objl::Vertex>& vertices, std::vector<unsigned int>& indices);
+    /// <param name="progress">Optional. Lets another thread follow the load and cancel it.</param>
+    /// <param name="materials">Optional. Receives the materials of the faces. Its triangles are counted from the first triangle this call adds to indices.</param>
+    /// <returns>Returns whether the file was read successfully. Faces that reference attributes which don't exist make the load fail, and so does cancelling it.</returns>
+    bool LoadObjFile(std::string path, std::vector<objl::Vertex>& vertices, std::vector<unsigned int>& indices, LoadProgress* progress = nullptr,
+        MaterialGroups* materials = nullptr);
+
+    /// <summary>
+    /// Returns the material libraries named by the mtllib statements of OBJ file contents, read the same way LoadObjFile() reads them
+    /// for MaterialGroups::libraries: as written in the file, relative to its folder, in file order.
+    /// </summary>
+    static std::vector<std::string> FindMaterialLibraries(const char* data, size_t size);
+
+    /// <summary>
+    /// Marks a texture coordinate or normal that a face corner doesn't reference.
+    /// </summary>
+    static const uint32_t MissingIndex = UINT32_MAX;
+
+    /// <summary>
+    /// Attribute indices of one corner of a face, all 0-based and counted from the start of the file.
+    /// </summary>
+    struct FaceCorner
+    {
+        uint32_t position;
+        uint32_t texCoord;
+        uint32_t normal;
+
+        bool operator==(const FaceCorner& other) const
+        {
+            return position == other.position && texCoord == other.texCoord && normal == other.normal;
+        }
+    };
+
+    /// <summary>
+    /// Limits of the buffers used by StreamObjFile(). The buffers of the stream take at most
+    /// readBlockSize + trianglesPerChunk * 36 + attributesPerChunk * 32 bytes, no matter how large the file is.
+    /// Only a line longer than readBlockSize makes the read block grow, it is doubled until the line fits.
+    /// </summary>
+    struct StreamSettings
+    {
+        size_t trianglesPerChunk = 64 * 1024;
+        size_t attributesPerChunk = 64 * 1024;
+        size_t readBlockSize = 4 * 1024 * 1024;
+
+        /// <summary>
+        /// Splits a memory budget in bytes between the read block and the chunk buffers, so that the buffers fit in it.
+        /// The read block gets at least 64 KiB and the chunks at least 1024 triangles and attributes, which needs a budget of 136 KiB.
+        /// </summary>
+        static StreamSettings FromMemoryBudget(size_t budgetInBytes);
+    };
+
+    /// <summary>
+    /// A piece of an OBJ file that is passed to the consumer of StreamObjFile().
+    /// The pointers are only valid during the call to the consumer.
+    /// </summary>
+    struct StreamChunk
+    {
+        //Attributes defined in this piece of the file, in file order.
+        //The first of them has the index firstPosition/firstTexCoord/firstNormal in the whole file.
+        const objl::Vector3* positions;
+        size_t positionCount;
+        size_t firstPosition;
+        const objl::Vector2* texCoords;
+        size_t texCoordCount;
+        size_t firstTexCoord;
+        const objl::Vector3* normals;
+        size_t normalCount;
+        size_t firstNormal;
+        //Triangles of this piece of the file as 3 corners each. They only reference attributes of this or earlier chunks.
+        const FaceCorner* corners;
+        size_t triangleCount;
+        size_t firstTriangle;
+    };
+
+    /// <summary>
+    /// Reads the OBJ file in the given path in fixed size blocks and passes its attributes and triangulated faces to the consumer
+    /// in chunks, instead of keeping the whole model in memory. Meant for converting models that don't fit in memory.
+    /// Faces can use every corner form LoadObjFile() supports, but they can only reference attributes defined before them.
+    /// </summary>
+    /// <param name="path">Path of the obj file.</param>
+    /// <param name="settings">Sizes of the chunks and of the read block.</param>
+    /// <param name="consumer">Called with every chunk, in file order. Returning false stops the stream.</param>
+    /// <returns>Returns whether the whole file was read successfully.</returns>
+    bool StreamObjFile(const std::string& path, const StreamSettings& settings, const std::function<bool(const StreamChunk& chunk)>& consumer);
 };
\ No newline at end of file
@@ -11,6 +11,15 @@
 // String - STD String Library
 #include <string>
 
+// String View - STD Non Owning String Library
+#include <string_view>
+
+// Deque - STD Double Ended Queue Library
+#include <deque>
+
+// Unordered Set - STD Hash Set Library
+#include <unordered_set>
+
 // fStream - STD File I/O Library
 #include <fstream>
 
@@ -95,12 +104,18 @@ namespace objl
 		Vector2 TextureCoordinate;
 	};
 
+	// Structure: Material
+	//
+	// Description: Material of a mesh. The strings are views of
+	//	strings interned by the Loader that loaded the material.
+	//	They become invalid when that Loader is destroyed or moved
+	//	from, copy them to keep them any longer
 	struct Material
 	{
 		Material();
 
 		// Material Name
-		std::string name;
+		std::string_view name;
 		// Ambient Color
 		Vector3 Ka;
 		// Diffuse Color
@@ -115,41 +130,52 @@ namespace objl
 		float d;
 		// Illumination
 		int illum;
+		// Roughness and Metallic of the PBR extension, negative if the material doesn't set them
+		float Pr;
+		float Pm;
 		// Ambient Texture Map
-		std::string map_Ka;
+		std::string_view map_Ka;
 		// Diffuse Texture Map
-		std::string map_Kd;
+		std::string_view map_Kd;
 		// Specular Texture Map
-		std::string map_Ks;
+		std::string_view map_Ks;
 		// Specular Hightlight Map
-		std::string map_Ns;
+		std::string_view map_Ns;
 		// Alpha Texture Map
-		std::string map_d;
+		std::string_view map_d;
 		// Bump Map
-		std::string map_bump;
+		std::string_view map_bump;
 	};
 
 	// Structure: Mesh
 	//
-	// Description: A Simple Mesh Object that holds
-	//	a name, a vertex list, and an index list
+	// Description: A view of the part of the geometry of its
+	//	Loader that belongs to one mesh: VertexCount vertices of
+	//	LoadedVertices from VertexStart and IndexCount indices of
+	//	LoadedIndices from IndexStart. The indices point into
+	//	LoadedVertices, subtracting VertexStart gives the index
+	//	of the vertex in the mesh
 	struct Mesh
 	{
 		// Default Constructor
 		Mesh();
-		// Variable Set Constructor
-		Mesh(std::vector<Vertex>& _Vertices, std::vector<unsigned int>& _Indices);
-		// Mesh Name
-		std::string MeshName;
-		// Vertex List
-		std::vector<Vertex> Vertices;
-		// Index List
-		std::vector<unsigned int> Indices;
-
-		// Material
-		Material MeshMaterial;
+		// Mesh Name, interned by the Loader, invalid once the
+		//	Loader is destroyed or moved from
+		std::string_view MeshName;
+		// Vertex Range
+		unsigned int VertexStart;
+		unsigned int VertexCount;
+		// Index Range
+		unsigned int IndexStart;
+		unsigned int IndexCount;
+
+		// Material Index in LoadedMaterials, or NoMaterial
+		unsigned int MaterialIndex;
 	};
 
+	// Material index of a mesh without a material
+	const unsigned int NoMaterial = ~0u;
+
 	// Namespace: Math
 	//
 	// Description: The namespace that holds all of the math
@@ -200,8 +226,13 @@ namespace objl
 		inline std::string firstToken(const std::string& in);
 
 		// Get element at given index position
+		//
+		// Negative (relative) indices count back from the first
+		//	visibleCount elements, which are the ones defined before
+		//	the line that is being parsed. Returns false if the index
+		//	is not a number or there is no element at it
 		template <class T>
-		inline const T& getElement(const std::vector<T>& elements, std::string& index);
+		inline bool getElement(const std::vector<T>& elements, size_t visibleCount, std::string_view index, T& element);
 	}
 
 	// Class: Loader
@@ -214,6 +245,15 @@ namespace objl
 		Loader();
 		~Loader();
 
+		// The meshes and materials hold views of the strings
+		//	of their Loader, so a Loader can be moved but not copied.
+		//	Views taken from a Loader must not be used after it is
+		//	moved from, take them again from the Loader it moved to
+		Loader(const Loader&) = delete;
+		Loader& operator=(const Loader&) = delete;
+		Loader(Loader&&) = default;
+		Loader& operator=(Loader&&) = default;
+
 		// Load a file into the loader
 		//
 		// If file is loaded return true
@@ -222,30 +262,81 @@ namespace objl
 		// or unable to be loaded return false
 		bool LoadFile(std::string Path);
 
-		// Loaded Mesh Objects
+		// Load Materials from .mtl file into LoadedMaterials
+		bool LoadMaterials(std::string path);
+
+		// Vertices, indices and material of a mesh
+		const Vertex* GetMeshVertices(const Mesh& mesh) const;
+		const unsigned int* GetMeshIndices(const Mesh& mesh) const;
+		// Returns a default Material for a mesh without a material
+		const Material& GetMeshMaterial(const Mesh& mesh) const;
+
+		// Loaded Mesh Objects, views of LoadedVertices and LoadedIndices
 		std::vector<Mesh> LoadedMeshes;
-		// Loaded Vertex Objects
+		// Loaded Vertex Objects of every mesh in file order
 		std::vector<Vertex> LoadedVertices;
-		// Loaded Index Positions
+		// Loaded Index Positions of every mesh in file order
 		std::vector<unsigned int> LoadedIndices;
 		// Loaded Material Objects
 		std::vector<Material> LoadedMaterials;
 
 	private:
+		// Returns a view of a copy of text owned by the Loader,
+		//	equal strings share the same copy
+		std::string_view Intern(std::string_view text);
+
+		// Interned strings. A deque never moves its elements, so
+		//	the views of them stay valid as it grows
+		std::deque<std::string> InternedStrings;
+		std::unordered_set<std::string_view> InternedLookup;
+
+		// Structure: AttributeCounts
+		//
+		// Description: Number of positions, texture coordinates and
+		//	normals defined before a face line
+		struct AttributeCounts
+		{
+			size_t Positions = 0;
+			size_t TCoords = 0;
+			size_t Normals = 0;
+		};
+
+		// Structure: FileChunk
+		//
+		// Description: A range of whole lines of the file that is
+		//	parsed on its own thread, along with everything parsed from it
+		struct FileChunk;
+
+		// Parse the vertex positions, texture coordinates and
+		//	normals in a chunk
+		void ParseChunkAttributes(FileChunk& chunk);
+
+		// Generate the face vertices and indices of a chunk and
+		//	record the lines that have to be handled in file order.
+		//	Returns false at the first face with an invalid index
+		bool ParseChunkFaces(FileChunk& chunk,
+			const std::vector<Vector3>& iPositions,
+			const std::vector<Vector2>& iTCoords,
+			const std::vector<Vector3>& iNormals);
+
 		// Generate vertices from a list of positions, 
 		//	tcoords, normals and a face line
-		void GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
+		//
+		// iCounts holds the number of each attribute defined
+		//	before the face line, relative indices are resolved
+		//	against it. Returns false if a corner references an
+		//	attribute that doesn't exist
+		bool GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
 			const std::vector<Vector3>& iPositions,
 			const std::vector<Vector2>& iTCoords,
 			const std::vector<Vector3>& iNormals,
-			std::string icurline);
+			const AttributeCounts& iCounts,
+			std::string_view icurline);
 
 		// Triangulate a list of vertices into a face by printing
 		//	inducies corresponding with triangles within it
 		void VertexTriangluation(std::vector<unsigned int>& oIndices,
 			const std::vector<Vertex>& iVerts);
 
-		// Load Materials from .mtl file
-		bool LoadMaterials(std::string path);
 	};
 }
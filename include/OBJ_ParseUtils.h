@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cfloat>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Namespace: OBJL::Parse
+//
+// Description: Helpers that work directly on the bytes of a memory
+//	mapped OBJ/MTL file. None of them allocate and none of them
+//	depend on the current locale.
+namespace objl
+{
+	namespace parse
+	{
+		// A range of whole lines inside a file
+		struct TextChunk
+		{
+			const char* begin;
+			const char* end;
+		};
+
+		// Files smaller than this are never split into chunks, the thread
+		//	handoff would cost more than parsing them on a single core.
+		const size_t MinChunkSizeInBytes = 1 << 20;
+
+		inline bool IsInlineWhitespace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+		}
+
+		inline const char* SkipInlineWhitespace(const char* cursor, const char* end)
+		{
+			while (cursor < end && IsInlineWhitespace(*cursor))
+			{
+				cursor++;
+			}
+			return cursor;
+		}
+
+		// Returns the start of the line after the one that begins at cursor
+		inline const char* NextLine(const char* cursor, const char* end)
+		{
+			const char* newLine = static_cast<const char*>(memchr(cursor, '\n', (size_t)(end - cursor)));
+			return newLine == nullptr ? end : newLine + 1;
+		}
+
+		// Returns the end of the line that begins at cursor, excluding the new line character
+		inline const char* LineEnd(const char* cursor, const char* end)
+		{
+			const char* newLine = static_cast<const char*>(memchr(cursor, '\n', (size_t)(end - cursor)));
+			return newLine == nullptr ? end : newLine;
+		}
+
+		// Whether a decimal number that from_chars() matched in [begin, end)
+		//	but couldn't represent is too large rather than too small,
+		//	from where its first significant digit is and its exponent
+		inline bool IsDecimalOverflow(const char* begin, const char* end)
+		{
+			const char* cursor = begin < end && *begin == '-' ? begin + 1 : begin;
+			long long magnitude = 0;
+			bool significant = false;
+			bool fraction = false;
+			for (; cursor < end && *cursor != 'e' && *cursor != 'E'; cursor++)
+			{
+				if (*cursor == '.')
+				{
+					fraction = true;
+				}
+				else if (!significant && *cursor == '0')
+				{
+					magnitude -= fraction ? 1 : 0;
+				}
+				else
+				{
+					significant = true;
+					magnitude += fraction ? 0 : 1;
+				}
+			}
+			long long exponent = 0;
+			if (cursor < end)
+			{
+				cursor++;
+				const bool negative = cursor < end && *cursor == '-';
+				if (cursor < end && (*cursor == '-' || *cursor == '+'))
+				{
+					cursor++;
+				}
+				// Saturated, any exponent this large is out of range already
+				for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++)
+				{
+					exponent = exponent < 1000000000 ? exponent * 10 + (*cursor - '0') : exponent;
+				}
+				exponent = negative ? -exponent : exponent;
+			}
+			return significant && magnitude + exponent > 0;
+		}
+
+		// Parses a float at the cursor after skipping leading whitespace.
+		//	Writes 0 if there is no number, which is what stream extraction does.
+		//	A number that is out of the range of a float is clamped to the
+		//	largest float of its sign, or to a zero of its sign if it is too small.
+		inline const char* ParseFloat(const char* cursor, const char* end, float& value)
+		{
+			cursor = SkipInlineWhitespace(cursor, end);
+			// from_chars() doesn't accept an explicit plus sign but OBJ exporters sometimes write one
+			if (cursor < end && *cursor == '+')
+			{
+				cursor++;
+			}
+			std::from_chars_result result = std::from_chars(cursor, end, value);
+			if (result.ec == std::errc::invalid_argument)
+			{
+				value = 0.0f;
+				return cursor;
+			}
+			if (result.ec == std::errc::result_out_of_range)
+			{
+				// from_chars() leaves the value as it was
+				const bool negative = *cursor == '-';
+				value = IsDecimalOverflow(cursor, result.ptr) ? FLT_MAX : 0.0f;
+				value = negative ? -value : value;
+			}
+			return result.ptr;
+		}
+
+		// Parses a signed integer at the cursor after skipping leading whitespace.
+		//	Writes 0 if there is no number, and the smallest or largest
+		//	long long for a number that doesn't fit in one.
+		inline const char* ParseInt(const char* cursor, const char* end, long long& value)
+		{
+			cursor = SkipInlineWhitespace(cursor, end);
+			if (cursor < end && *cursor == '+')
+			{
+				cursor++;
+			}
+			std::from_chars_result result = std::from_chars(cursor, end, value);
+			if (result.ec == std::errc::invalid_argument)
+			{
+				value = 0;
+				return cursor;
+			}
+			if (result.ec == std::errc::result_out_of_range)
+			{
+				value = *cursor == '-' ? LLONG_MIN : LLONG_MAX;
+			}
+			return result.ptr;
+		}
+
+		// Skips the rest of a whitespace separated token, such as the "/2/3" part of "1/2/3"
+		inline const char* SkipToken(const char* cursor, const char* end)
+		{
+			while (cursor < end && !IsInlineWhitespace(*cursor) && *cursor != '\n')
+			{
+				cursor++;
+			}
+			return cursor;
+		}
+
+		// Returns the end of the line that begins at cursor without its new line character,
+		//	dropping the carriage return of CRLF files like text mode streams do
+		inline const char* TrimmedLineEnd(const char* cursor, const char* end)
+		{
+			const char* lineEnd = LineEnd(cursor, end);
+			if (lineEnd > cursor && lineEnd[-1] == '\r')
+			{
+				lineEnd--;
+			}
+			return lineEnd;
+		}
+
+		// Returns the next space or tab separated token at the cursor
+		//	and moves the cursor past it. Returns an empty view at the end
+		inline std::string_view NextToken(const char*& cursor, const char* end)
+		{
+			while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+			{
+				cursor++;
+			}
+			const char* tokenBegin = cursor;
+			while (cursor < end && *cursor != ' ' && *cursor != '\t')
+			{
+				cursor++;
+			}
+			return std::string_view(tokenBegin, (size_t)(cursor - tokenBegin));
+		}
+
+		// Non allocating version of algorithm::firstToken()
+		inline std::string_view FirstToken(std::string_view line)
+		{
+			const char* cursor = line.data();
+			return NextToken(cursor, line.data() + line.size());
+		}
+
+		// Non allocating version of algorithm::tail(), the line after
+		//	its first token without the surrounding spaces and tabs
+		inline std::string_view Tail(std::string_view line)
+		{
+			const char* cursor = line.data();
+			const char* end = line.data() + line.size();
+			NextToken(cursor, end);
+			while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+			{
+				cursor++;
+			}
+			while (end > cursor && (end[-1] == ' ' || end[-1] == '\t'))
+			{
+				end--;
+			}
+			return std::string_view(cursor, (size_t)(end - cursor));
+		}
+
+		// Splits [begin, end) into at most maxChunks ranges of roughly equal size.
+		//	Every range starts at the beginning of a line and ends right after a new line
+		//	(or at end), so a line is never split between two chunks.
+		inline std::vector<TextChunk> SplitIntoLineChunks(const char* begin, const char* end, size_t maxChunks)
+		{
+			const size_t size = (size_t)(end - begin);
+			size_t chunkCount = size / MinChunkSizeInBytes;
+			if (chunkCount > maxChunks)
+			{
+				chunkCount = maxChunks;
+			}
+			if (chunkCount < 1)
+			{
+				chunkCount = 1;
+			}
+
+			std::vector<TextChunk> chunks;
+			chunks.reserve(chunkCount);
+			const char* chunkBegin = begin;
+			for (size_t i = 1; i <= chunkCount && chunkBegin < end; i++)
+			{
+				const char* chunkEnd = end;
+				if (i < chunkCount)
+				{
+					const char* target = begin + (size * i) / chunkCount;
+					chunkEnd = target <= chunkBegin ? chunkBegin : target;
+					// Move the split point to the start of the next line
+					if (chunkEnd > begin && chunkEnd[-1] != '\n')
+					{
+						chunkEnd = NextLine(chunkEnd, end);
+					}
+				}
+				if (chunkEnd > chunkBegin)
+				{
+					chunks.push_back({ chunkBegin, chunkEnd });
+				}
+				chunkBegin = chunkEnd;
+			}
+			return chunks;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+/// <summary>
+/// Ray tracing kernels for the CPU: one ray against 8 triangles and 8 rays against one box.
+/// Every kernel has a scalar version, which is the reference, and SSE4.1 and AVX2 versions that give the same bits: they do the same operations
+/// in the same order on every lane, with no fused multiply-adds and no approximate reciprocals. The fastest version the CPU supports is picked
+/// when the kernels are first used, and SetInstructionSet() can pick another one, for example to compare them.
+/// </summary>
+class RayKernels
+{
+public:
+    /// <summary>
+    /// Lanes of a packet.
+    /// </summary>
+    static const uint32_t Width = 8;
+
+    /// <summary>
+    /// Which sides of the triangles a ray hits, like the ray flags the shaders pass to TraceRay(): None is RAY_FLAG_NONE and BackFacing is
+    /// RAY_FLAG_CULL_BACK_FACING_TRIANGLES. A triangle faces the ray when its corners appear clockwise from the ray origin, which is the DXR rule
+    /// for instances without D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE.
+    /// </summary>
+    enum class CullMode
+    {
+        None,
+        BackFacing,
+    };
+
+    enum class InstructionSet
+    {
+        Scalar,
+        Sse4,
+        Avx2,
+    };
+
+    /// <summary>
+    /// Up to Width triangles as a structure of arrays, each as its first corner and the edges to the other two.
+    /// </summary>
+    struct alignas(32) TrianglePacket
+    {
+        float v0[3][Width];
+        float edge1[3][Width];
+        float edge2[3][Width];
+
+        /// <summary>
+        /// Empties every lane. An empty lane has edges of 0, which no ray hits.
+        /// </summary>
+        void Clear();
+        void Set(uint32_t lane, const float corner0[3], const float corner1[3], const float corner2[3]);
+    };
+
+    /// <summary>
+    /// Up to Width rays as a structure of arrays. Lanes that hold no ray should have a tMax below 0.
+    /// </summary>
+    struct alignas(32) RayPacket
+    {
+        float origin[3][Width];
+        //1 / direction. A direction of 0 gives an infinity, which the box test handles.
+        float inverseDirection[3][Width];
+        float tMax[Width];
+
+        void Set(uint32_t lane, const float rayOrigin[3], const float direction[3], float rayTMax);
+    };
+
+    /// <summary>
+    /// Fastest instruction set of the CPU the kernels run on.
+    /// </summary>
+    static InstructionSet GetSupportedInstructionSet();
+    static InstructionSet GetInstructionSet();
+    /// <summary>
+    /// Makes the kernels use an instruction set, or the fastest supported one below it if the CPU doesn't support it.
+    /// </summary>
+    /// <returns>Returns the instruction set the kernels use now.</returns>
+    static InstructionSet SetInstructionSet(InstructionSet instructionSet);
+    static const char* GetName(InstructionSet instructionSet);
+
+    /// <summary>
+    /// Moller-Trumbore test of one ray against one triangle, the scalar reference of IntersectTriangles().
+    /// </summary>
+    /// <param name="t">Distance to beat. Receives the distance of the hit if it is closer.</param>
+    /// <param name="u">Receives the weight of the second corner at the hit point.</param>
+    /// <param name="v">Receives the weight of the third corner at the hit point.</param>
+    /// <returns>Returns whether the ray hits the triangle at a distance in [0, t).</returns>
+    static bool IntersectTriangle(const float v0[3], const float edge1[3], const float edge2[3], const float origin[3], const float direction[3],
+        CullMode cull, float& t, float& u, float& v);
+    /// <summary>
+    /// Tests one ray against every lane of a packet. Where two triangles are hit at the same distance, the one in the lower lane wins,
+    /// which is what calling IntersectTriangle() on the lanes in order gives.
+    /// </summary>
+    /// <returns>Returns the lane of the closest triangle that is hit at a distance in [0, t), or -1 if none is. t, u and v are only written if one is.</returns>
+    static int IntersectTriangles(const TrianglePacket& triangles, const float origin[3], const float direction[3], CullMode cull, float& t, float& u, float& v);
+
+    /// <summary>
+    /// Slab test of one ray against one box, the scalar reference of IntersectBox().
+    /// </summary>
+    /// <returns>Returns the distance at which the ray enters the box, clamped to 0, or a negative value if it misses the box before tMax.</returns>
+    static float IntersectBoxScalar(const float boundsMin[3], const float boundsMax[3], const float origin[3], const float inverseDirection[3], float tMax);
+    /// <summary>
+    /// Tests every ray of a packet against one box.
+    /// </summary>
+    /// <param name="tEnter">Receives the distance each ray enters the box at, clamped to 0. Only the lanes of the returned mask are meaningful.</param>
+    /// <returns>Returns a mask with bit i set if ray i enters the box before its tMax.</returns>
+    static uint32_t IntersectBox(const RayPacket& rays, const float boundsMin[3], const float boundsMax[3], float tEnter[Width]);
+};
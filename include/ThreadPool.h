@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// A fixed size pool of worker threads that runs queued jobs in FIFO order.
+/// </summary>
+class ThreadPool
+{
+public:
+    /// <summary>
+    /// Creates the pool and starts its workers.
+    /// </summary>
+    /// <param name="threadCount">Number of worker threads. 0 uses the number of hardware threads.</param>
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// <summary>
+    /// Queues a job to run on one of the workers.
+    /// </summary>
+    /// <returns>A future that holds the return value of the job, or the exception it threw.</returns>
+    template <class F>
+    auto Enqueue(F&& job) -> std::future<decltype(job())>
+    {
+        using ResultType = decltype(job());
+        auto task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<F>(job));
+        std::future<ResultType> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            jobs.push([task]() { (*task)(); });
+        }
+        jobAvailable.notify_one();
+        return result;
+    }
+
+    /// <summary>
+    /// Runs body(i) for every i in [0, count) and blocks until all of them are done.
+    /// The calling thread takes part in the work, so it is safe to call this from inside a job of the same pool.
+    /// If a body throws, the first exception is rethrown on the calling thread after all started bodies finish.
+    /// </summary>
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    unsigned int GetThreadCount() const;
+
+    /// <summary>
+    /// The process wide pool that is shared by the loaders and the other CPU side mesh processing code.
+    /// </summary>
+    static ThreadPool& Shared();
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+
+class ThreadPool;
+
+/// <summary>
+/// Two level hierarchy for instanced geometry, the CPU counterpart of the top level acceleration structure CreateTopLevelAS() builds.
+/// A Bvh over the world space bounds of the instances finds the instances a ray reaches, and the ray is moved into the object space
+/// of each of them and traced through its bottom level Bvh. The bottom level hierarchies are shared, not copied, so an instance costs
+/// its record and its share of the top level nodes however large its mesh is.
+/// </summary>
+class TopLevelBvh
+{
+public:
+    /// <summary>
+    /// An instance as TLASParams describes it.
+    /// </summary>
+    struct Instance
+    {
+        //Bottom level hierarchy of the instance. It isn't owned and has to outlive the build.
+        const Bvh* blas;
+        //Object to world transform as the first three rows of a matrix that multiplies column vectors, the transpose of TLASParams::transformMatrix.
+        float transform[3][4];
+        uint32_t hitGroupIndex;
+        uint32_t materialIndex;
+    };
+
+    struct Hit
+    {
+        //Distance along the world space ray. The ray isn't normalized in object space, so it is the distance there too.
+        float t;
+        //Index of the instance in the array the hierarchy was built from.
+        uint32_t instance;
+        //Triangle of the bottom level hierarchy and barycentrics, as in Bvh::Hit.
+        uint32_t triangle;
+        float u;
+        float v;
+    };
+
+    TopLevelBvh();
+
+    /// <summary>
+    /// Builds the hierarchy over the instances. The instance records are copied, the bottom level hierarchies are referenced.
+    /// </summary>
+    /// <param name="settings">Optional. The Bvh::Settings of the top level, the default ones if not given.</param>
+    /// <param name="pool">Optional. The pool that runs the build, ThreadPool::Shared() if not given.</param>
+    /// <returns>Returns false if there are no instances, an instance has no bottom level hierarchy or one that is empty, or a transform can't be inverted.</returns>
+    bool Build(const Instance* instances, size_t instanceCount, const Bvh::Settings* settings = nullptr, ThreadPool* pool = nullptr);
+    void Clear();
+
+    const Instance& GetInstance(uint32_t instance) const;
+    uint32_t GetInstanceCount() const;
+    /// <summary>
+    /// The hierarchy over the instances, its leaves list instance indices in GetTriangleIndices().
+    /// </summary>
+    const Bvh& GetHierarchy() const;
+    /// <summary>
+    /// Bytes of the instance records and the top level nodes. The bottom level hierarchies are not counted.
+    /// </summary>
+    size_t GetMemorySize() const;
+    /// <summary>
+    /// The ray in the object space of an instance, ObjectRayOrigin() and ObjectRayDirection() of the shaders. The traversal moves rays with it.
+    /// </summary>
+    void ToObjectSpace(uint32_t instance, const float origin[3], const float direction[3], float objectOrigin[3], float objectDirection[3]) const;
+
+    /// <summary>
+    /// Finds the closest triangle of any instance the ray hits between 0 and tMax. Instances that are hit at the same distance go to the
+    /// lowest instance index, as they would in a loop over the instances, so the hit doesn't depend on the shape of the hierarchy.
+    /// </summary>
+    /// <param name="cull">Optional. Whether back facing triangles are skipped. Facing is decided in object space, as DXR does.</param>
+    /// <returns>Returns whether a triangle was hit. hit is only written if one was.</returns>
+    bool Intersect(const float origin[3], const float direction[3], float tMax, Hit& hit, RayKernels::CullMode cull = RayKernels::CullMode::None) const;
+    /// <summary>
+    /// Finds whether the ray hits any triangle of any instance between 0 and tMax, stopping at the first one it finds.
+    /// </summary>
+    bool Occluded(const float origin[3], const float direction[3], float tMax, RayKernels::CullMode cull = RayKernels::CullMode::None) const;
+
+private:
+    struct Record
+    {
+        Instance instance;
+        //Inverse of instance.transform, takes the rays into object space.
+        float worldToObject[3][4];
+    };
+
+    std::vector<Record> records;
+    Bvh hierarchy;
+};
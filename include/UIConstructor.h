@@ -5,13 +5,14 @@
 #include <DirectXMath.h>
 #include <functional>
 #include <string>
-#include "OBJ_FileManager.h"
+#include <vector>
 
 typedef unsigned int UINT;
 
 using namespace DirectX;
 
 extern class D3D12HelloTriangle;
+class ModelLoadTask;
 
 class UIConstructor
 {
@@ -28,7 +29,7 @@ public:
     float GetRoughness();
     float GetMetallic();
     float GetReflectivity();
-    void SetModelUpdateFunction(std::function<void(std::vector<XMFLOAT3>& vertices, std::vector<UINT>& indices)> function);
+    void SetModelLoadTask(ModelLoadTask* task);
 private:
     bool demoUIShown;
     float lightColor[3];
@@ -39,7 +40,7 @@ private:
     float roughness;
     float metallic;
     float reflectivity;
-    std::function<void(std::vector<XMFLOAT3>& vertices, std::vector<UINT>& indices)> modelUpdateFunction;
+    ModelLoadTask* modelLoadTask;
     std::string modelFileLoadFeedbackMessage;
     char newModelFilePath[121] = { 0 };
 };
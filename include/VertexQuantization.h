@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MeshCache.h"
+
+/// <summary>
+/// Compressed vertex layout for the model vertex buffer: 12 bytes instead of the 24 bytes of the full float layout.
+/// Positions are quantized to 16 bits per axis against the bounding box of the mesh and the normals are octahedral encoded into two 16 bit values.
+/// The position is stored as R16G16B16A16_SNORM so the BLAS can be built straight from it, with GetDequantizationTransform() as its geometry transform.
+/// Hit.hlsl and the raster vertex shader in shaders.hlsl decode the normals with the same math as DecodeNormal().
+/// </summary>
+class VertexQuantization
+{
+public:
+    /// <summary>
+    /// Vertex layout of the model vertex buffer. The hit shader gets the same value as its vertexFormat constant.
+    /// </summary>
+    enum class Format : uint32_t
+    {
+        Float = 0,
+        Quantized = 1
+    };
+
+    struct QuantizedVertex
+    {
+        //x, y, z in snorm16 relative to the bounds. w is always 0, it is only there because the BLAS has no 3 component 16 bit format.
+        int16_t position[4];
+        //Octahedral encoded normal in snorm16.
+        int16_t normal[2];
+    };
+
+    struct Bounds
+    {
+        float center[3];
+        //Half of the size of the box on each axis. Flat axes get 1 so the quantization never divides by 0.
+        float halfExtent[3];
+    };
+
+    static const size_t FloatVertexSize = sizeof(MeshCache::Vertex);
+    static const size_t QuantizedVertexSize = sizeof(QuantizedVertex);
+
+    static Bounds ComputeBounds(const MeshCache::Vertex* vertices, size_t vertexCount);
+
+    static void EncodePosition(const float position[3], const Bounds& bounds, int16_t encoded[4]);
+    static void DecodePosition(const int16_t encoded[4], const Bounds& bounds, float position[3]);
+
+    /// <summary>
+    /// The normal doesn't have to be normalized. A zero normal is encoded as +Z.
+    /// </summary>
+    static void EncodeNormal(const float normal[3], int16_t encoded[2]);
+    /// <summary>
+    /// Returns a unit vector.
+    /// </summary>
+    static void DecodeNormal(const int16_t encoded[2], float normal[3]);
+
+    /// <summary>
+    /// Largest difference between a coordinate on the given axis and its decoded value: half a quantization step plus float rounding.
+    /// </summary>
+    static float GetPositionErrorBound(const Bounds& bounds, int axis);
+    /// <summary>
+    /// Largest angle in radians between a unit normal and its decoded value.
+    /// </summary>
+    static float GetNormalErrorBound();
+
+    /// <summary>
+    /// Row major 3x4 matrix that maps decoded snorm positions ([-1, 1] on each axis) back to the positions of the mesh.
+    /// This is the layout D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC::Transform3x4 expects.
+    /// </summary>
+    static void GetDequantizationTransform(const Bounds& bounds, float transform[12]);
+
+    /// <summary>
+    /// Picks the vertex format of a mesh. The quantized layout is used unless it would collapse a triangle of the mesh into a line or a point,
+    /// which happens when the mesh has detail smaller than a quantization step of its bounds.
+    /// </summary>
+    static Format ChooseFormat(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount);
+
+    static size_t GetVertexSize(Format format);
+
+    /// <summary>
+    /// Writes the vertices in the given format to destination, which must hold vertexCount * GetVertexSize(format) bytes.
+    /// The bounds are only used by the quantized format.
+    /// </summary>
+    static void Encode(const MeshCache::Vertex* vertices, size_t vertexCount, Format format, const Bounds& bounds, void* destination);
+};
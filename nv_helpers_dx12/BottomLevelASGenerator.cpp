@@ -55,22 +55,25 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT vertexFormat /* = DXGI_FORMAT_R32G32B32_FLOAT */ // Format of
+                                                                 // the vertex
+                                                                 // positions
 ) {
   AddVertexBuffer(vertexBuffer, vertexOffsetInBytes, vertexCount,
                   vertexSizeInBytes, nullptr, 0, 0, transformBuffer,
-                  transformOffsetInBytes, isOpaque);
+                  transformOffsetInBytes, isOpaque, DXGI_FORMAT_R32_UINT,
+                  vertexFormat);
 }
 
 //--------------------------------------------------------------------------------------------------
 // Add a vertex buffer along with its index buffer in GPU memory into the
-// acceleration structure. The vertices are supposed to be represented by 3
-// float32 value. This implementation limits the original flexibility of the
-// API:
+// acceleration structure. The vertices are represented by 3 float32 values
+// unless another vertex format is given. This implementation limits the
+// original flexibility of the API:
 //   - triangles (no custom intersector support)
-//   - 3xfloat32 format
-//   - 32-bit indices
+//   - 16-bit or 32-bit indices
 void BottomLevelASGenerator::AddVertexBuffer(
     ID3D12Resource *vertexBuffer, // Buffer containing the vertex coordinates,
                                   // possibly interleaved with other vertex data
@@ -88,23 +91,28 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT indexFormat /* = DXGI_FORMAT_R32_UINT */, // Format of the
+                                                          // indices
+    DXGI_FORMAT vertexFormat /* = DXGI_FORMAT_R32G32B32_FLOAT */ // Format of
+                                                                 // the vertex
+                                                                 // positions
 ) {
   // Create the DX12 descriptor representing the input data, assumed to be
-  // opaque triangles, with 3xf32 vertex coordinates and 32-bit indices
+  // opaque triangles, with 16-bit or 32-bit indices
   D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
   descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
   descriptor.Triangles.VertexBuffer.StartAddress =
       vertexBuffer->GetGPUVirtualAddress() + vertexOffsetInBytes;
   descriptor.Triangles.VertexBuffer.StrideInBytes = vertexSizeInBytes;
   descriptor.Triangles.VertexCount = vertexCount;
-  descriptor.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+  descriptor.Triangles.VertexFormat = vertexFormat;
   descriptor.Triangles.IndexBuffer =
       indexBuffer ? (indexBuffer->GetGPUVirtualAddress() + indexOffsetInBytes)
                   : 0;
   descriptor.Triangles.IndexFormat =
-      indexBuffer ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
+      indexBuffer ? indexFormat : DXGI_FORMAT_UNKNOWN;
   descriptor.Triangles.IndexCount = indexCount;
   descriptor.Triangles.Transform3x4 =
       transformBuffer
@@ -79,8 +79,8 @@ class BottomLevelASGenerator
 {
 public:
   /// Add a vertex buffer in GPU memory into the acceleration structure. The
-  /// vertices are supposed to be represented by 3 float32 value. Indices are
-  /// implicit.
+  /// vertices are supposed to be represented by 3 float32 value unless
+  /// vertexFormat says otherwise. Indices are implicit.
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -96,13 +96,18 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT vertexFormat = DXGI_FORMAT_R32G32B32_FLOAT /// Format of the vertex
+                                                                              /// positions. 16 bit
+                                                                              /// snorm positions need
+                                                                              /// a transform to be
+                                                                              /// scaled back
   );
 
   /// Add a vertex buffer along with its index buffer in GPU memory into the acceleration structure.
-  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 32-bit
-  /// unsigned ints
+  /// The vertices are supposed to be represented by 3 float32 value unless vertexFormat says otherwise,
+  /// and the indices are 16-bit or 32-bit unsigned ints
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -123,8 +128,13 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT, /// Format of the indices,
+                                                                       /// DXGI_FORMAT_R16_UINT or
+                                                                       /// DXGI_FORMAT_R32_UINT
+                       DXGI_FORMAT vertexFormat = DXGI_FORMAT_R32G32B32_FLOAT /// Format of the vertex
+                                                                              /// positions
   );
 
   /// Compute the size of the scratch space required to build the acceleration structure, as well as
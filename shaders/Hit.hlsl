@@ -1,12 +1,6 @@
 #include "Common.hlsl"
 
 //The structures has the same bit mapping as their counterpart structures on the CPU side.
-struct STriVertex
-{
-    float3 position;
-    float3 normal;
-};
-
 struct Material
 {
 	float3 albedo;
@@ -20,6 +14,13 @@ struct InstanceProperties
 {
     float4x4 objectToWorld;
     float4x4 objectToWorldNormal;
+    //First index of the level of detail the instance uses. The triangles of every level start at 0 in their own BLAS.
+    uint firstIndex;
+    //Index of the material of the instance in materials. 0 is the default material.
+    uint materialIndex;
+    //Only reflective instances cast reflection rays.
+    uint reflective;
+    uint padding;
 };
 
 struct Light
@@ -29,8 +30,10 @@ struct Light
     float intensity;
 };
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+//Model vertices, either full float or quantized depending on the mesh (see VertexQuantization on the CPU side).
+ByteAddressBuffer BTriVertex : register(t0);
+//Model indices, 16 or 32 bit depending on the vertex count of the mesh (see IndexPacking on the CPU side).
+ByteAddressBuffer indices : register(t1);
 // #DXR Extra - Another ray type
 // Raytracing TLAS, accessed as a SRV
 RaytracingAccelerationStructure SceneBVH : register(t2);
@@ -45,6 +48,59 @@ cbuffer Colors : register(b0)
     float3 C;
 }
 
+//Root constants of the hit group. Size of one index in bytes, either 2 or 4, and the layout of the vertices.
+cbuffer MeshConstants : register(b1)
+{
+    uint indexSize;
+    uint vertexFormat;
+}
+
+//float3 position, float3 normal.
+static const uint VERTEX_FORMAT_FLOAT = 0;
+static const uint FLOAT_VERTEX_SIZE = 24;
+//snorm16 x 4 position, snorm16 x 2 octahedral normal.
+static const uint VERTEX_FORMAT_QUANTIZED = 1;
+static const uint QUANTIZED_VERTEX_SIZE = 12;
+
+uint LoadIndex(uint index)
+{
+    if (indexSize == 2)
+    {
+        //ByteAddressBuffer loads are 4 byte aligned, so the word that holds the index is loaded and its half is picked.
+        uint word = indices.Load((index * 2) & ~3u);
+        return (index & 1) ? (word >> 16) : (word & 0xFFFF);
+    }
+    return indices.Load(index * 4);
+}
+
+//Has to stay the same as VertexQuantization::DecodeNormal.
+float3 DecodeOctahedralNormal(float2 encoded)
+{
+    float3 normal = float3(encoded.x, encoded.y, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float t = saturate(-normal.z);
+    normal.x += normal.x >= 0.0f ? -t : t;
+    normal.y += normal.y >= 0.0f ? -t : t;
+    return normalize(normal);
+}
+
+float3 LoadVertexNormal(uint vertexIndex)
+{
+    if (vertexFormat == VERTEX_FORMAT_QUANTIZED)
+    {
+        //The two snorm16 values of the normal share the last 4 byte word of the vertex.
+        uint word = BTriVertex.Load(vertexIndex * QUANTIZED_VERTEX_SIZE + 8);
+        int2 encoded = int2(int(word << 16) >> 16, int(word) >> 16);
+        return DecodeOctahedralNormal(max(float2(encoded) / 32767.0f, -1.0f));
+    }
+    return asfloat(BTriVertex.Load3(vertexIndex * FLOAT_VERTEX_SIZE + 12));
+}
+
+//Only used for full float vertex buffers. Quantized positions only exist in the BLAS after the dequantization transform.
+float3 LoadFloatVertexPosition(uint vertexIndex)
+{
+    return asfloat(BTriVertex.Load3(vertexIndex * FLOAT_VERTEX_SIZE));
+}
+
 static const int LIGHT_COUNT = 6;
 static Light lights[LIGHT_COUNT] =
 {
@@ -67,14 +123,14 @@ float3 ComputeFaceNormal(float3 vertex0, float3 vertex1, float3 vertex2)
 float3 CalculateInterpolatedWorldNormal(float3 barycentrics)
 {
     //Interpolate vertex normals with barycentric coordinates
-    uint vertId = 3 * PrimitiveIndex();
+    uint vertId = instanceProperties[InstanceID()].firstIndex + 3 * PrimitiveIndex();
     //Index offsets are given in the order 1 2 0 and not 0 1 2 because the file used for debugging has the indices
     //cycled by one. Using 0 1 2 causes the normals to get incorrectly calculated
     //The proper solution would be to properly set up an OBJ loader that will convert the indices to whatever the application
     //expects, but I don't have time for that.
-    float3 n0 = BTriVertex[indices[vertId + 1]].normal;
-    float3 n1 = BTriVertex[indices[vertId + 2]].normal;
-    float3 n2 = BTriVertex[indices[vertId + 0]].normal;
+    float3 n0 = LoadVertexNormal(LoadIndex(vertId + 1));
+    float3 n1 = LoadVertexNormal(LoadIndex(vertId + 2));
+    float3 n2 = LoadVertexNormal(LoadIndex(vertId + 0));
     float3 normal = normalize(n0 * barycentrics.x + n1 * barycentrics.y + n2 * barycentrics.z);
     normal = mul(instanceProperties[InstanceID()].objectToWorldNormal, float4(normal, 0.0f)).xyz;
     return normalize(normal);
@@ -186,14 +242,14 @@ void ClosestHit(inout HitInfo payload, BuiltInTriangleIntersectionAttributes att
     float3 hitWorldPosition = GetWorldHitPoint();
     float3 barycentrics = float3(attrib.barycentrics.x, attrib.barycentrics.y, 1.0f - attrib.barycentrics.x - attrib.barycentrics.y);
     float3 normal = CalculateInterpolatedWorldNormal(barycentrics);
-    Material material = materials[0];
+    Material material = materials[instanceProperties[InstanceID()].materialIndex];
     float3 surfaceColor = material.albedo;
     float3 lightColor = CalculateDirectLighting(hitWorldPosition, normal, surfaceColor);
     float3 finalSurfaceColor = lightColor + CalculatePBRShading(material, normal, WorldRayOrigin(), hitWorldPosition);
     //Assume the material isn't reflective.
     float3 reflectionColor = finalSurfaceColor;
     float reflectivity = 0.0f;
-    if (InstanceID() == 0 || InstanceID() == 1) //If the material is reflective, calculate the reflection.
+    if (instanceProperties[InstanceID()].reflective != 0 && material.reflectivity > 0.0f) //If the material is reflective, calculate the reflection.
     {
         HitInfo reflectionPayload;
         ReflectRay(hitWorldPosition, normal, reflectionPayload);
@@ -216,8 +272,8 @@ void PlaneClosestHit(inout HitInfo payload, BuiltInTriangleIntersectionAttribute
     // #DXR Extra - Simple Lighting
     //The face normal is used for the plane instead of vertex normals because face and vertex normals are the same for plane and this was easier to implement.
     uint vertId = 3 * PrimitiveIndex();
-    float3 e1 = BTriVertex[vertId + 1].position - BTriVertex[vertId + 0].position;
-    float3 e2 = BTriVertex[vertId + 2].position - BTriVertex[vertId + 0].position;
+    float3 e1 = LoadFloatVertexPosition(vertId + 1) - LoadFloatVertexPosition(vertId + 0);
+    float3 e2 = LoadFloatVertexPosition(vertId + 2) - LoadFloatVertexPosition(vertId + 0);
     float3 normal = normalize(cross(e1, e2));
     normal = mul(instanceProperties[InstanceID()].objectToWorldNormal, float4(normal, 0.f)).xyz;
     
@@ -24,6 +24,10 @@ struct InstanceProperties
     float4x4 objectToWorld;
 	// #DXR Extra - Simple Lighting
     float4x4 objectToWorldNormal; //Not used here, used for raytracing. Here only for alignment.
+    uint firstIndex; //Same as above.
+    uint materialIndex; //Same as above.
+    uint reflective; //Same as above.
+    uint padding;
 };
 
 StructuredBuffer<InstanceProperties> instanceProps : register(t0);
@@ -53,6 +57,40 @@ PSInput VSMain(float4 position : POSITION, float4 color : COLOR)
 	return result;
 }
 
+//Rows of the 3x4 transform that maps quantized positions back to model space, see VertexQuantization::GetDequantizationTransform.
+cbuffer Dequantization : register(b2)
+{
+    float4 dequantization[3];
+}
+
+//Has to stay the same as VertexQuantization::DecodeNormal.
+float3 DecodeOctahedralNormal(float2 encoded)
+{
+    float3 normal = float3(encoded.x, encoded.y, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float t = saturate(-normal.z);
+    normal.x += normal.x >= 0.0f ? -t : t;
+    normal.y += normal.y >= 0.0f ? -t : t;
+    return normalize(normal);
+}
+
+//Vertex shader for models with the quantized vertex layout: snorm16 position and octahedral normal.
+//The input assembler already turns the snorm values into [-1, 1], so only the bounds of the mesh have to be applied.
+PSInput VSMainQuantized(float4 position : POSITION, float2 normal : NORMAL)
+{
+	PSInput result;
+
+    float4 modelPosition = float4(position.xyz, 1.0f);
+    float4 pos = float4(dot(dequantization[0], modelPosition), dot(dequantization[1], modelPosition), dot(dequantization[2], modelPosition), 1.0f);
+    pos = mul(instanceProps[instanceIndex].objectToWorld, pos);
+    pos = mul(view, pos);
+    pos = mul(projection, pos);
+	result.position = pos;
+	//The float layout feeds the normal in as the color, so the quantized models look the same.
+	result.color = float4(DecodeOctahedralNormal(normal), 1.0f);
+
+	return result;
+}
+
 float4 PSMain(PSInput input) : SV_TARGET
 {
 	return input.color;
@@ -0,0 +1,1132 @@
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+
+namespace
+{
+    const uint32_t MaxBinCount = 64;
+    //Triangles per job of the passes that run over all the triangles, and the node size from which a node is binned by several jobs.
+    const uint32_t BlockSize = 16384;
+    const uint32_t ParallelBinningThreshold = 4 * BlockSize;
+
+    struct Aabb
+    {
+        float min[3];
+        float max[3];
+
+        static Aabb Empty()
+        {
+            return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+        }
+
+        void Grow(const Aabb& other)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                min[axis] = std::min(min[axis], other.min[axis]);
+                max[axis] = std::max(max[axis], other.max[axis]);
+            }
+        }
+
+        void Grow(const float point[3])
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                min[axis] = std::min(min[axis], point[axis]);
+                max[axis] = std::max(max[axis], point[axis]);
+            }
+        }
+
+        bool Contains(const Aabb& other) const
+        {
+            return min[0] <= other.min[0] && min[1] <= other.min[1] && min[2] <= other.min[2] &&
+                max[0] >= other.max[0] && max[1] >= other.max[1] && max[2] >= other.max[2];
+        }
+
+        float Area() const
+        {
+            float x = max[0] - min[0];
+            float y = max[1] - min[1];
+            float z = max[2] - min[2];
+            return x >= 0.0f && y >= 0.0f && z >= 0.0f ? 2.0f * (x * y + y * z + z * x) : 0.0f;
+        }
+    };
+
+    Aabb GetBounds(const Bvh::Node& node)
+    {
+        return { { node.boundsMin[0], node.boundsMin[1], node.boundsMin[2] }, { node.boundsMax[0], node.boundsMax[1], node.boundsMax[2] } };
+    }
+
+    void SetBounds(Bvh::Node& node, const Aabb& bounds)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.boundsMin[axis] = bounds.min[axis];
+            node.boundsMax[axis] = bounds.max[axis];
+        }
+    }
+
+    //Centroid bins of a range of triangles along the three axes.
+    struct Bins
+    {
+        Aabb bounds[3][MaxBinCount];
+        uint32_t counts[3][MaxBinCount];
+
+        void Reset(uint32_t binCount)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                std::fill(bounds[axis], bounds[axis] + binCount, Aabb::Empty());
+                std::fill(counts[axis], counts[axis] + binCount, 0u);
+            }
+        }
+
+        void Merge(const Bins& other, uint32_t binCount)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                for (uint32_t bin = 0; bin < binCount; bin++)
+                {
+                    bounds[axis][bin].Grow(other.bounds[axis][bin]);
+                    counts[axis][bin] += other.counts[axis][bin];
+                }
+            }
+        }
+    };
+
+    //A triangle as the builder sees it. The primitives are partitioned themselves rather than a list of triangle indices, so the passes
+    //over the triangles of a node read memory in order.
+    struct Primitive
+    {
+        Aabb bounds;
+        float centroid[3];
+        uint32_t triangle;
+    };
+
+    //What a build needs to read and write. Every subtree owns its range of primitives and its range of nodes, so subtrees are built
+    //in parallel without any locking. The nodes of a subtree of n triangles are reserved up front (a binary tree with at most n leaves
+    //has at most 2n - 2 nodes below its root), which places every node no matter in which order the subtrees are finished.
+    struct BuildContext
+    {
+        const Bvh::Settings* settings;
+        ThreadPool* pool;
+        //Primitives a leaf intersects at the cost of one. The triangles of a leaf are tested RayKernels::Width at a time, a leaf of up to
+        //that many costs as much as a leaf of one, and the boxes of BuildFromBounds() are tested by the caller one at a time.
+        uint32_t leafCostWidth;
+        std::vector<Primitive> primitives;
+        std::vector<Bvh::Node> nodes;
+    };
+
+    struct BuildTask
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        //First of the nodes reserved for the subtree below node.
+        uint32_t reserved;
+    };
+
+    inline uint32_t GetBin(float centroid, float start, float scale, uint32_t binCount)
+    {
+        //NaN lands in bin 0.
+        float bin = (centroid - start) * scale;
+        return bin > 0.0f ? std::min(binCount - 1, (uint32_t)bin) : 0;
+    }
+
+    Aabb ComputeCentroidBounds(const BuildContext& context, uint32_t first, uint32_t count)
+    {
+        Aabb bounds = Aabb::Empty();
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            bounds.Grow(context.primitives[i].centroid);
+        }
+        return bounds;
+    }
+
+    void BinRange(const BuildContext& context, uint32_t first, uint32_t count, const Aabb& centroidBounds, const float scale[3], uint32_t binCount, Bins& bins)
+    {
+        bins.Reset(binCount);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const Primitive& primitive = context.primitives[i];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                uint32_t bin = GetBin(primitive.centroid[axis], centroidBounds.min[axis], scale[axis], binCount);
+                bins.bounds[axis][bin].Grow(primitive.bounds);
+                bins.counts[axis][bin]++;
+            }
+        }
+    }
+
+    //Decides how a node is split. Returns false if the node should be a leaf. Otherwise the range of the node is partitioned,
+    //leftCount of its triangles go to the left child and the bounds of both children are returned.
+    bool SplitNode(BuildContext& context, const BuildTask& task, const Aabb& bounds, uint32_t& leftCount, Aabb& leftBounds, Aabb& rightBounds)
+    {
+        const Bvh::Settings& settings = *context.settings;
+        //A node never needs many more bins than it has triangles. Most nodes are small, and their bins would mostly be empty.
+        const uint32_t binCount = std::min(settings.binCount, std::max(4u, task.count));
+        const uint32_t first = task.first;
+        const uint32_t count = task.count;
+        if (count <= 1)
+        {
+            return false;
+        }
+
+        //Large nodes are binned by several jobs. The min and max of the bounds and the sums of the counts don't depend on the order
+        //the blocks are merged in, so the result is the same as binning on one thread.
+        Aabb centroidBounds;
+        float scale[3];
+        auto computeScale = [&]()
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                scale[axis] = extent > 0.0f ? (float)binCount / extent : 0.0f;
+            }
+        };
+        Bins bins;
+        if (count < ParallelBinningThreshold)
+        {
+            centroidBounds = ComputeCentroidBounds(context, first, count);
+            computeScale();
+            BinRange(context, first, count, centroidBounds, scale, binCount, bins);
+        }
+        else
+        {
+            const uint32_t blockCount = (count + BlockSize - 1) / BlockSize;
+            std::vector<Aabb> blockCentroidBounds(blockCount);
+            context.pool->ParallelFor(blockCount, [&](size_t block)
+                {
+                    uint32_t blockFirst = first + (uint32_t)block * BlockSize;
+                    blockCentroidBounds[block] = ComputeCentroidBounds(context, blockFirst, std::min(BlockSize, first + count - blockFirst));
+                });
+            centroidBounds = Aabb::Empty();
+            for (const Aabb& blockBounds : blockCentroidBounds)
+            {
+                centroidBounds.Grow(blockBounds);
+            }
+            computeScale();
+            std::vector<Bins> blockBins(blockCount);
+            context.pool->ParallelFor(blockCount, [&](size_t block)
+                {
+                    uint32_t blockFirst = first + (uint32_t)block * BlockSize;
+                    BinRange(context, blockFirst, std::min(BlockSize, first + count - blockFirst), centroidBounds, scale, binCount, blockBins[block]);
+                });
+            bins = blockBins[0];
+            for (uint32_t block = 1; block < blockCount; block++)
+            {
+                bins.Merge(blockBins[block], binCount);
+            }
+        }
+
+        //Sweep the split planes between the bins of every axis. The cost of the left side is gathered from the left first.
+        const float parentArea = bounds.Area();
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (scale[axis] == 0.0f)
+            {
+                continue;
+            }
+            float leftCost[MaxBinCount];
+            Aabb leftBox = Aabb::Empty();
+            uint32_t leftTriangles = 0;
+            for (uint32_t bin = 0; bin + 1 < binCount; bin++)
+            {
+                leftBox.Grow(bins.bounds[axis][bin]);
+                leftTriangles += bins.counts[axis][bin];
+                leftCost[bin] = leftBox.Area() * (float)leftTriangles;
+            }
+            Aabb rightBox = Aabb::Empty();
+            uint32_t rightTriangles = 0;
+            for (uint32_t bin = binCount - 1; bin > 0; bin--)
+            {
+                rightBox.Grow(bins.bounds[axis][bin]);
+                rightTriangles += bins.counts[axis][bin];
+                //The split plane after bin - 1.
+                if (rightTriangles == 0 || rightTriangles == count)
+                {
+                    continue;
+                }
+                float cost = leftCost[bin - 1] + rightBox.Area() * (float)rightTriangles;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin - 1;
+                }
+            }
+        }
+        const float leafCost = settings.intersectionCost * (float)((count + context.leafCostWidth - 1) / context.leafCostWidth);
+        const float splitCost = parentArea > 0.0f ? settings.traversalCost + settings.intersectionCost * bestCost / parentArea : settings.traversalCost;
+        if (bestAxis < 0 || (count <= settings.maxLeafSize && leafCost <= splitCost))
+        {
+            if (count <= settings.maxLeafSize)
+            {
+                return false;
+            }
+            if (bestAxis < 0)
+            {
+                //Every centroid is in the same place, there is no plane that separates them. The range is cut in half.
+                leftCount = count / 2;
+                leftBounds = Aabb::Empty();
+                rightBounds = Aabb::Empty();
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    (i < first + leftCount ? leftBounds : rightBounds).Grow(context.primitives[i].bounds);
+                }
+                return true;
+            }
+        }
+
+        Primitive* begin = context.primitives.data() + first;
+        Primitive* middle = std::partition(begin, begin + count, [&](const Primitive& primitive)
+            {
+                return GetBin(primitive.centroid[bestAxis], centroidBounds.min[bestAxis], scale[bestAxis], binCount) <= bestBin;
+            });
+        leftCount = (uint32_t)(middle - begin);
+        leftBounds = Aabb::Empty();
+        rightBounds = Aabb::Empty();
+        for (uint32_t bin = 0; bin < binCount; bin++)
+        {
+            (bin <= bestBin ? leftBounds : rightBounds).Grow(bins.bounds[bestAxis][bin]);
+        }
+        return true;
+    }
+
+    void BuildSubtree(BuildContext& context, const BuildTask& root)
+    {
+        std::vector<BuildTask> stack(1, root);
+        while (!stack.empty())
+        {
+            BuildTask task = stack.back();
+            stack.pop_back();
+            Bvh::Node& node = context.nodes[task.node];
+            uint32_t leftCount;
+            Aabb leftBounds;
+            Aabb rightBounds;
+            if (!SplitNode(context, task, GetBounds(node), leftCount, leftBounds, rightBounds))
+            {
+                node.leftFirst = task.first;
+                node.triangleCount = task.count;
+                continue;
+            }
+            const uint32_t left = task.reserved;
+            node.leftFirst = left;
+            node.triangleCount = 0;
+            SetBounds(context.nodes[left], leftBounds);
+            SetBounds(context.nodes[left + 1], rightBounds);
+            BuildTask leftTask = { left, task.first, leftCount, left + 2 };
+            BuildTask rightTask = { left + 1, task.first + leftCount, task.count - leftCount, left + 2 + 2 * (leftCount - 1) };
+            const uint32_t threshold = context.settings->parallelThreshold;
+            if (leftTask.count >= threshold && rightTask.count >= threshold)
+            {
+                context.pool->ParallelFor(2, [&](size_t child) { BuildSubtree(context, child == 0 ? leftTask : rightTask); });
+            }
+            else
+            {
+                stack.push_back(rightTask);
+                stack.push_back(leftTask);
+            }
+        }
+    }
+
+    //Distance along the ray to where it enters the box, or FLT_MAX if it misses it before tMax.
+    inline float IntersectBox(const Bvh::Node& node, const float origin[3], const float inverseDirection[3], float tMax)
+    {
+        float tEnter = 0.0f;
+        float tExit = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (node.boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+            float t1 = (node.boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+            //min and max written this way drop the NaN of a ray that lies in the plane of a side of the box.
+            tEnter = std::max(tEnter, std::min(t0, t1));
+            tExit = std::min(tExit, std::max(t0, t1));
+        }
+        return tEnter <= tExit ? tEnter : FLT_MAX;
+    }
+
+    //Nodes left to visit during a traversal. The first ones are kept on the call stack, only a very unbalanced hierarchy needs the vector.
+    class TraversalStack
+    {
+    public:
+        TraversalStack() : count(0)
+        {
+        }
+
+        bool Empty() const
+        {
+            return count == 0 && overflow.empty();
+        }
+
+        void Push(uint32_t node)
+        {
+            if (count < LocalSize)
+            {
+                local[count++] = node;
+            }
+            else
+            {
+                overflow.push_back(node);
+            }
+        }
+
+        uint32_t Pop()
+        {
+            if (!overflow.empty())
+            {
+                uint32_t node = overflow.back();
+                overflow.pop_back();
+                return node;
+            }
+            return local[--count];
+        }
+
+    private:
+        static const uint32_t LocalSize = 64;
+        uint32_t local[LocalSize];
+        uint32_t count;
+        std::vector<uint32_t> overflow;
+    };
+
+    //Front to back traversal shared by Intersect(), Occluded() and VisitLeaves(). testLeaf(index, node, tMax) tests the entries of a leaf,
+    //lowers tMax to the closest hit it finds and returns true to end the traversal. Returns whether testLeaf ended it.
+    template <class LeafTest>
+    bool Traverse(const Bvh::Node* nodes, const float origin[3], const float direction[3], float& tMax, const LeafTest& testLeaf)
+    {
+        const float inverseDirection[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+        if (IntersectBox(nodes[0], origin, inverseDirection, tMax) == FLT_MAX)
+        {
+            return false;
+        }
+
+        //Every node on the stack is the far child of a node on the path to the current one, so the stack is never deeper than the tree.
+        TraversalStack stack;
+        uint32_t current = 0;
+        while (true)
+        {
+            const Bvh::Node& node = nodes[current];
+            if (node.IsLeaf())
+            {
+                if (testLeaf(current, node, tMax))
+                {
+                    return true;
+                }
+            }
+            else
+            {
+                float tLeft = IntersectBox(nodes[node.leftFirst], origin, inverseDirection, tMax);
+                float tRight = IntersectBox(nodes[node.leftFirst + 1], origin, inverseDirection, tMax);
+                uint32_t nearChild = tLeft <= tRight ? node.leftFirst : node.leftFirst + 1;
+                float tFar = std::max(tLeft, tRight);
+                if (std::min(tLeft, tRight) != FLT_MAX)
+                {
+                    if (tFar != FLT_MAX)
+                    {
+                        stack.Push(nearChild == node.leftFirst ? node.leftFirst + 1 : node.leftFirst);
+                    }
+                    current = nearChild;
+                    continue;
+                }
+            }
+            //A node on the stack is skipped once a hit closer than its box has been found, its box is tested again here.
+            bool found = false;
+            while (!stack.Empty() && !found)
+            {
+                current = stack.Pop();
+                found = IntersectBox(nodes[current], origin, inverseDirection, tMax) != FLT_MAX;
+            }
+            if (!found)
+            {
+                return false;
+            }
+        }
+    }
+
+    //Packets that hold the triangles of a leaf.
+    inline uint32_t GetPacketCount(const Bvh::Node& node)
+    {
+        return (node.triangleCount + RayKernels::Width - 1) / RayKernels::Width;
+    }
+
+    //Fills the packets of a leaf from its triangles, in order, and empties the lanes past the last one.
+    void FillLeafPackets(const Bvh::Node& node, const Bvh::Triangle* triangles, RayKernels::TrianglePacket* packets)
+    {
+        for (uint32_t packet = 0; packet < GetPacketCount(node); packet++)
+        {
+            packets[packet].Clear();
+            const uint32_t first = node.leftFirst + packet * RayKernels::Width;
+            const uint32_t count = std::min(node.leftFirst + node.triangleCount - first, (uint32_t)RayKernels::Width);
+            for (uint32_t lane = 0; lane < count; lane++)
+            {
+                const Bvh::Triangle& triangle = triangles[first + lane];
+                packets[packet].Set(lane, triangle.v0, triangle.v1, triangle.v2);
+            }
+        }
+    }
+
+    Bvh::Settings ClampSettings(const Bvh::Settings* settings)
+    {
+        Bvh::Settings clampedSettings = settings != nullptr ? *settings : Bvh::Settings();
+        clampedSettings.binCount = std::min(MaxBinCount, std::max(2u, clampedSettings.binCount));
+        clampedSettings.maxLeafSize = std::max(1u, clampedSettings.maxLeafSize);
+        clampedSettings.parallelThreshold = std::max(2u, clampedSettings.parallelThreshold);
+        return clampedSettings;
+    }
+
+    //Builds the nodes over the primitives of the context, which are left in the order of the leaves. The nodes are built in the reserved layout
+    //and then copied depth first into place, which drops the nodes that were never used.
+    std::vector<Bvh::Node> BuildNodes(BuildContext& context, const Aabb& rootBounds)
+    {
+        const uint32_t primitiveCount = (uint32_t)context.primitives.size();
+        context.nodes.resize(2 * (size_t)primitiveCount);
+        SetBounds(context.nodes[0], rootBounds);
+        BuildSubtree(context, { 0, 0, primitiveCount, 2 });
+
+        std::vector<Bvh::Node> compacted;
+        compacted.reserve(context.nodes.size());
+        compacted.push_back(context.nodes[0]);
+        compacted.push_back(Bvh::Node());
+        std::vector<std::pair<uint32_t, uint32_t>> stack(1, { 0u, 0u });
+        while (!stack.empty())
+        {
+            const uint32_t from = stack.back().first;
+            const uint32_t to = stack.back().second;
+            stack.pop_back();
+            const Bvh::Node& node = context.nodes[from];
+            if (node.IsLeaf())
+            {
+                continue;
+            }
+            const uint32_t left = (uint32_t)compacted.size();
+            compacted[to].leftFirst = left;
+            compacted.push_back(context.nodes[node.leftFirst]);
+            compacted.push_back(context.nodes[node.leftFirst + 1]);
+            stack.push_back({ node.leftFirst + 1, left + 1 });
+            stack.push_back({ node.leftFirst, left });
+        }
+        context.nodes = std::vector<Bvh::Node>();
+        return compacted;
+    }
+
+    //ComputeSahCost() of the nodes, on the pool if one is given. The sums of the blocks are added in order, so the cost is the same with and
+    //without a pool and for any number of threads.
+    float ComputeSahCost(const Bvh::Node* nodes, uint32_t nodeCount, float traversalCost, float intersectionCost, ThreadPool* pool)
+    {
+        if (nodeCount == 0 || GetBounds(nodes[0]).Area() <= 0.0f)
+        {
+            return 0.0f;
+        }
+        const size_t blockCount = (nodeCount + BlockSize - 1) / BlockSize;
+        std::vector<double> blockCosts(blockCount, 0.0);
+        auto sumBlock = [&](size_t block)
+        {
+            const uint32_t end = (uint32_t)std::min<size_t>(nodeCount, (block + 1) * BlockSize);
+            for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+            {
+                if (i == 1)
+                {
+                    continue;
+                }
+                double area = GetBounds(nodes[i]).Area();
+                blockCosts[block] += nodes[i].IsLeaf() ? area * intersectionCost * nodes[i].triangleCount : area * traversalCost;
+            }
+        };
+        if (pool != nullptr)
+        {
+            pool->ParallelFor(blockCount, sumBlock);
+        }
+        else
+        {
+            for (size_t block = 0; block < blockCount; block++)
+            {
+                sumBlock(block);
+            }
+        }
+        double cost = 0.0;
+        for (double blockCost : blockCosts)
+        {
+            cost += blockCost;
+        }
+        return (float)(cost / GetBounds(nodes[0]).Area());
+    }
+}
+
+Bvh::Bvh() : nodeCount(0), builtSahCost(0.0f), sahCost(0.0f)
+{
+}
+
+bool Bvh::Build(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const Settings* settings, ThreadPool* pool)
+{
+    Clear();
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || indexCount % 3 != 0 || triangleCount > UINT32_MAX / 2)
+    {
+        return false;
+    }
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::Shared();
+    }
+
+    BuildContext context;
+    const Settings clampedSettings = ClampSettings(settings);
+    context.settings = &clampedSettings;
+    context.pool = pool;
+    context.leafCostWidth = RayKernels::Width;
+    context.primitives.resize(triangleCount);
+
+    //Bounds and centroids of the triangles, and the bounds of the root.
+    const size_t blockCount = (triangleCount + BlockSize - 1) / BlockSize;
+    std::vector<Aabb> blockBounds(blockCount, Aabb::Empty());
+    std::atomic<bool> indicesValid(true);
+    pool->ParallelFor(blockCount, [&](size_t block)
+        {
+            const size_t end = std::min(triangleCount, (block + 1) * BlockSize);
+            for (size_t triangle = block * BlockSize; triangle < end; triangle++)
+            {
+                Aabb bounds = Aabb::Empty();
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    uint32_t index = indices[3 * triangle + corner];
+                    if (index >= vertexCount)
+                    {
+                        indicesValid = false;
+                        return;
+                    }
+                    bounds.Grow(vertices[index].position);
+                }
+                Primitive& primitive = context.primitives[triangle];
+                primitive.bounds = bounds;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    primitive.centroid[axis] = 0.5f * (bounds.min[axis] + bounds.max[axis]);
+                }
+                primitive.triangle = (uint32_t)triangle;
+                blockBounds[block].Grow(bounds);
+            }
+        });
+    if (!indicesValid)
+    {
+        return false;
+    }
+    Aabb rootBounds = Aabb::Empty();
+    for (const Aabb& bounds : blockBounds)
+    {
+        rootBounds.Grow(bounds);
+    }
+
+    SetNodes(BuildNodes(context, rootBounds));
+    buildSettings = clampedSettings;
+    builtSahCost = ::ComputeSahCost(GetNodes(), nodeCount, clampedSettings.traversalCost, clampedSettings.intersectionCost, pool);
+    sahCost = builtSahCost;
+
+    triangles.resize(triangleCount);
+    triangleIndices.resize(triangleCount);
+    pool->ParallelFor(blockCount, [&](size_t block)
+        {
+            const size_t end = std::min(triangleCount, (block + 1) * BlockSize);
+            for (size_t i = block * BlockSize; i < end; i++)
+            {
+                triangleIndices[i] = context.primitives[i].triangle;
+                const uint32_t* corners = indices + 3 * (size_t)triangleIndices[i];
+                std::copy(vertices[corners[0]].position, vertices[corners[0]].position + 3, triangles[i].v0);
+                std::copy(vertices[corners[1]].position, vertices[corners[1]].position + 3, triangles[i].v1);
+                std::copy(vertices[corners[2]].position, vertices[corners[2]].position + 3, triangles[i].v2);
+            }
+        });
+
+    //The packets of the leaves, in the order of the nodes.
+    firstLeafPackets.assign(nodeCount, 0);
+    uint32_t packetCount = 0;
+    const Node* nodes = GetNodes();
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        if (i != 1 && nodes[i].IsLeaf())
+        {
+            firstLeafPackets[i] = packetCount;
+            packetCount += GetPacketCount(nodes[i]);
+        }
+    }
+    leafPackets.resize(packetCount);
+    const size_t nodeBlockCount = (nodeCount + BlockSize - 1) / BlockSize;
+    pool->ParallelFor(nodeBlockCount, [&](size_t block)
+        {
+            const uint32_t end = (uint32_t)std::min<size_t>(nodeCount, (block + 1) * BlockSize);
+            for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+            {
+                if (i != 1 && nodes[i].IsLeaf())
+                {
+                    FillLeafPackets(nodes[i], triangles.data(), leafPackets.data() + firstLeafPackets[i]);
+                }
+            }
+        });
+    return true;
+}
+
+bool Bvh::BuildFromBounds(const Bounds* bounds, size_t count, const Settings* settings, ThreadPool* pool)
+{
+    Clear();
+    if (count == 0 || count > UINT32_MAX / 2)
+    {
+        return false;
+    }
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::Shared();
+    }
+
+    BuildContext context;
+    const Settings clampedSettings = ClampSettings(settings);
+    context.settings = &clampedSettings;
+    context.pool = pool;
+    context.leafCostWidth = 1;
+    context.primitives.resize(count);
+
+    const size_t blockCount = (count + BlockSize - 1) / BlockSize;
+    std::vector<Aabb> blockBounds(blockCount, Aabb::Empty());
+    std::atomic<bool> boundsValid(true);
+    pool->ParallelFor(blockCount, [&](size_t block)
+        {
+            const size_t end = std::min(count, (block + 1) * BlockSize);
+            for (size_t i = block * BlockSize; i < end; i++)
+            {
+                Primitive& primitive = context.primitives[i];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    //Written as what has to hold, so that NaN fails.
+                    if (!(bounds[i].min[axis] <= bounds[i].max[axis]))
+                    {
+                        boundsValid = false;
+                        return;
+                    }
+                    primitive.bounds.min[axis] = bounds[i].min[axis];
+                    primitive.bounds.max[axis] = bounds[i].max[axis];
+                    primitive.centroid[axis] = 0.5f * (bounds[i].min[axis] + bounds[i].max[axis]);
+                }
+                primitive.triangle = (uint32_t)i;
+                blockBounds[block].Grow(primitive.bounds);
+            }
+        });
+    if (!boundsValid)
+    {
+        return false;
+    }
+    Aabb rootBounds = Aabb::Empty();
+    for (const Aabb& blockBound : blockBounds)
+    {
+        rootBounds.Grow(blockBound);
+    }
+
+    SetNodes(BuildNodes(context, rootBounds));
+    buildSettings = clampedSettings;
+    builtSahCost = ::ComputeSahCost(GetNodes(), nodeCount, clampedSettings.traversalCost, clampedSettings.intersectionCost, pool);
+    sahCost = builtSahCost;
+    triangleIndices.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        triangleIndices[i] = context.primitives[i].triangle;
+    }
+    return true;
+}
+
+bool Bvh::Refit(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const uint8_t* movedVertices,
+    ThreadPool* pool, RefitStatistics* statistics)
+{
+    if (statistics != nullptr)
+    {
+        *statistics = {};
+    }
+    const size_t triangleCount = triangles.size();
+    if (triangleCount == 0 || indexCount != 3 * triangleCount)
+    {
+        return false;
+    }
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::Shared();
+    }
+    Node* nodes = &nodePairs[0].nodes[0];
+    const size_t triangleBlockCount = (triangleCount + BlockSize - 1) / BlockSize;
+    const size_t nodeBlockCount = (nodeCount + BlockSize - 1) / BlockSize;
+    if (parents.empty())
+    {
+        parents.assign(nodeCount, UINT32_MAX);
+        leafPositions.resize(triangleCount);
+        pool->ParallelFor(nodeBlockCount, [&](size_t block)
+            {
+                const uint32_t end = (uint32_t)std::min<size_t>(nodeCount, (block + 1) * BlockSize);
+                for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+                {
+                    if (i != 1 && !nodes[i].IsLeaf())
+                    {
+                        parents[nodes[i].leftFirst] = i;
+                        parents[nodes[i].leftFirst + 1] = i;
+                    }
+                }
+            });
+        pool->ParallelFor(triangleBlockCount, [&](size_t block)
+            {
+                const uint32_t end = (uint32_t)std::min(triangleCount, (block + 1) * BlockSize);
+                for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+                {
+                    leafPositions[triangleIndices[i]] = i;
+                }
+            });
+    }
+
+    //The corners of the triangles that have a moved vertex. The triangles are read in the order of the index array, which reads the indices
+    //and the vertices in order, and only the moved ones are written to their place in the leaf order.
+    std::vector<uint8_t> triangleMoved(triangleCount, 0);
+    std::vector<uint32_t> blockMoved(triangleBlockCount, 0);
+    std::atomic<bool> indicesValid(true);
+    pool->ParallelFor(triangleBlockCount, [&](size_t block)
+        {
+            const size_t end = std::min(triangleCount, (block + 1) * BlockSize);
+            for (size_t triangle = block * BlockSize; triangle < end; triangle++)
+            {
+                const uint32_t* corners = indices + 3 * triangle;
+                if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount)
+                {
+                    indicesValid = false;
+                    return;
+                }
+                if (movedVertices != nullptr && !movedVertices[corners[0]] && !movedVertices[corners[1]] && !movedVertices[corners[2]])
+                {
+                    continue;
+                }
+                const uint32_t i = leafPositions[triangle];
+                std::copy(vertices[corners[0]].position, vertices[corners[0]].position + 3, triangles[i].v0);
+                std::copy(vertices[corners[1]].position, vertices[corners[1]].position + 3, triangles[i].v1);
+                std::copy(vertices[corners[2]].position, vertices[corners[2]].position + 3, triangles[i].v2);
+                triangleMoved[i] = 1;
+                blockMoved[block]++;
+            }
+        });
+    if (!indicesValid)
+    {
+        Clear();
+        return false;
+    }
+    uint32_t movedTriangles = 0;
+    for (uint32_t moved : blockMoved)
+    {
+        movedTriangles += moved;
+    }
+    if (statistics != nullptr)
+    {
+        statistics->movedTriangles = movedTriangles;
+        statistics->sahCost = sahCost;
+        statistics->sahDegradation = builtSahCost > 0.0f ? sahCost / builtSahCost : 1.0f;
+    }
+    if (movedTriangles == 0)
+    {
+        return true;
+    }
+
+    //The leaves with a moved triangle are refit, and they and every node above them are marked dirty. A walk up stops at a node that is
+    //marked already, the path above it has been marked by the walk that got there first.
+    std::unique_ptr<std::atomic<uint8_t>[]> dirty(new std::atomic<uint8_t>[nodeCount]());
+    pool->ParallelFor(nodeBlockCount, [&](size_t block)
+        {
+            const uint32_t end = (uint32_t)std::min<size_t>(nodeCount, (block + 1) * BlockSize);
+            for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+            {
+                Node& node = nodes[i];
+                if (i == 1 || !node.IsLeaf())
+                {
+                    continue;
+                }
+                const uint8_t* moved = triangleMoved.data() + node.leftFirst;
+                if (std::find(moved, moved + node.triangleCount, 1) == moved + node.triangleCount)
+                {
+                    continue;
+                }
+                Aabb bounds = Aabb::Empty();
+                for (uint32_t triangle = node.leftFirst; triangle < node.leftFirst + node.triangleCount; triangle++)
+                {
+                    bounds.Grow(triangles[triangle].v0);
+                    bounds.Grow(triangles[triangle].v1);
+                    bounds.Grow(triangles[triangle].v2);
+                }
+                SetBounds(node, bounds);
+                FillLeafPackets(node, triangles.data(), leafPackets.data() + firstLeafPackets[i]);
+                dirty[i].store(1, std::memory_order_relaxed);
+                for (uint32_t parent = parents[i]; parent != UINT32_MAX && dirty[parent].exchange(1, std::memory_order_relaxed) == 0; parent = parents[parent])
+                {
+                }
+            }
+        });
+
+    //Every dirty leaf walks up again. A node is refit by the walk of its last dirty child to arrive, which sees the boxes the other child's
+    //walk wrote before it arrived, and a walk that isn't the last one stops there. Every dirty node is refit once, after its children.
+    std::unique_ptr<std::atomic<uint8_t>[]> arrivals(new std::atomic<uint8_t>[nodeCount]());
+    std::vector<uint32_t> blockRefit(nodeBlockCount, 0);
+    pool->ParallelFor(nodeBlockCount, [&](size_t block)
+        {
+            const uint32_t end = (uint32_t)std::min<size_t>(nodeCount, (block + 1) * BlockSize);
+            for (uint32_t i = (uint32_t)(block * BlockSize); i < end; i++)
+            {
+                if (i == 1 || !nodes[i].IsLeaf() || dirty[i].load(std::memory_order_relaxed) == 0)
+                {
+                    continue;
+                }
+                blockRefit[block]++;
+                for (uint32_t parent = parents[i]; parent != UINT32_MAX; parent = parents[parent])
+                {
+                    const uint32_t left = nodes[parent].leftFirst;
+                    const uint32_t dirtyChildren = dirty[left].load(std::memory_order_relaxed) + dirty[left + 1].load(std::memory_order_relaxed);
+                    if (arrivals[parent].fetch_add(1, std::memory_order_acq_rel) + 1u != dirtyChildren)
+                    {
+                        break;
+                    }
+                    Aabb bounds = GetBounds(nodes[left]);
+                    bounds.Grow(GetBounds(nodes[left + 1]));
+                    SetBounds(nodes[parent], bounds);
+                    blockRefit[block]++;
+                }
+            }
+        });
+
+    //The quality check. Refitting keeps the splits the builder chose for the old positions, so the boxes grow and overlap as the mesh deforms.
+    sahCost = ::ComputeSahCost(nodes, nodeCount, buildSettings.traversalCost, buildSettings.intersectionCost, pool);
+    const float sahDegradation = builtSahCost > 0.0f ? sahCost / builtSahCost : 1.0f;
+    const float refitSahCost = sahCost;
+    bool rebuilt = false;
+    if (sahDegradation > buildSettings.rebuildThreshold)
+    {
+        const Settings rebuildSettings = buildSettings;
+        rebuilt = Build(vertices, vertexCount, indices, indexCount, &rebuildSettings, pool);
+    }
+    if (statistics != nullptr)
+    {
+        for (uint32_t refit : blockRefit)
+        {
+            statistics->refitNodes += refit;
+        }
+        statistics->sahCost = refitSahCost;
+        statistics->sahDegradation = sahDegradation;
+        statistics->rebuilt = rebuilt;
+    }
+    return true;
+}
+
+void Bvh::Clear()
+{
+    nodePairs = std::vector<NodePair>();
+    nodeCount = 0;
+    triangles = std::vector<Triangle>();
+    triangleIndices = std::vector<uint32_t>();
+    leafPackets = std::vector<RayKernels::TrianglePacket>();
+    firstLeafPackets = std::vector<uint32_t>();
+    buildSettings = Settings();
+    builtSahCost = 0.0f;
+    sahCost = 0.0f;
+    parents = std::vector<uint32_t>();
+    leafPositions = std::vector<uint32_t>();
+}
+
+const Bvh::Node* Bvh::GetNodes() const
+{
+    return nodePairs.empty() ? nullptr : &nodePairs[0].nodes[0];
+}
+
+uint32_t Bvh::GetNodeCount() const
+{
+    return nodeCount;
+}
+
+const Bvh::Triangle* Bvh::GetTriangles() const
+{
+    return triangles.data();
+}
+
+const uint32_t* Bvh::GetTriangleIndices() const
+{
+    return triangleIndices.data();
+}
+
+uint32_t Bvh::GetTriangleCount() const
+{
+    return (uint32_t)triangleIndices.size();
+}
+
+float Bvh::ComputeSahCost(float traversalCost, float intersectionCost) const
+{
+    return ::ComputeSahCost(GetNodes(), nodeCount, traversalCost, intersectionCost, nullptr);
+}
+
+Bvh::Statistics Bvh::ComputeStatistics() const
+{
+    Statistics statistics = {};
+    if (nodeCount == 0)
+    {
+        return statistics;
+    }
+    const Node* nodes = GetNodes();
+    statistics.nodeCount = nodeCount - 1;
+    std::vector<std::pair<uint32_t, uint32_t>> stack(1, { 0u, 1u });
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back().first];
+        const uint32_t depth = stack.back().second;
+        stack.pop_back();
+        statistics.maxDepth = std::max(statistics.maxDepth, depth);
+        if (node.IsLeaf())
+        {
+            statistics.leafCount++;
+            statistics.maxLeafSize = std::max(statistics.maxLeafSize, node.triangleCount);
+            continue;
+        }
+        stack.push_back({ node.leftFirst, depth + 1 });
+        stack.push_back({ node.leftFirst + 1, depth + 1 });
+    }
+    statistics.averageLeafSize = (float)GetTriangleCount() / (float)statistics.leafCount;
+    statistics.sahCost = ComputeSahCost();
+    return statistics;
+}
+
+bool Bvh::Validate() const
+{
+    if (nodeCount < 2 || nodeCount % 2 != 0 || triangleIndices.empty())
+    {
+        return false;
+    }
+    const Node* nodes = GetNodes();
+    const uint32_t triangleCount = GetTriangleCount();
+    std::vector<uint8_t> triangleSeen(triangleCount, 0);
+    std::vector<uint8_t> indexSeen(triangleCount, 0);
+    std::vector<uint8_t> nodeSeen(nodeCount, 0);
+    std::vector<uint32_t> stack(1, 0u);
+    uint32_t reachedNodes = 0;
+    while (!stack.empty())
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        if (nodeSeen[index])
+        {
+            return false;
+        }
+        nodeSeen[index] = 1;
+        reachedNodes++;
+        const Node& node = nodes[index];
+        const Aabb bounds = GetBounds(node);
+        if (node.IsLeaf())
+        {
+            if (node.leftFirst >= triangleCount || node.triangleCount > triangleCount - node.leftFirst)
+            {
+                return false;
+            }
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+            {
+                if (triangleSeen[i] || triangleIndices[i] >= triangleCount || indexSeen[triangleIndices[i]])
+                {
+                    return false;
+                }
+                if (!triangles.empty())
+                {
+                    Aabb triangleBounds = Aabb::Empty();
+                    triangleBounds.Grow(triangles[i].v0);
+                    triangleBounds.Grow(triangles[i].v1);
+                    triangleBounds.Grow(triangles[i].v2);
+                    if (!bounds.Contains(triangleBounds))
+                    {
+                        return false;
+                    }
+                }
+                triangleSeen[i] = 1;
+                indexSeen[triangleIndices[i]] = 1;
+            }
+            continue;
+        }
+        //Children come in pairs that start at an even index after the root pair.
+        if (node.leftFirst < 2 || node.leftFirst % 2 != 0 || node.leftFirst + 1 >= nodeCount ||
+            !bounds.Contains(GetBounds(nodes[node.leftFirst])) || !bounds.Contains(GetBounds(nodes[node.leftFirst + 1])))
+        {
+            return false;
+        }
+        stack.push_back(node.leftFirst);
+        stack.push_back(node.leftFirst + 1);
+    }
+    return reachedNodes == nodeCount - 1 && std::find(triangleSeen.begin(), triangleSeen.end(), 0) == triangleSeen.end();
+}
+
+bool Bvh::Intersect(const float origin[3], const float direction[3], float tMax, Hit& hit, RayKernels::CullMode cull) const
+{
+    if (nodeCount == 0 || triangles.empty())
+    {
+        return false;
+    }
+    Hit closest = { tMax, UINT32_MAX, 0.0f, 0.0f };
+    uint32_t hitIndex = UINT32_MAX;
+    Traverse(GetNodes(), origin, direction, closest.t, [&](uint32_t index, const Node& node, float& t)
+        {
+            //The packets are tested in order and only a strictly closer hit replaces the last one, so of the triangles hit at the same distance
+            //the first one in the leaf order wins, as in the lowest lane of a packet.
+            const RayKernels::TrianglePacket* packets = leafPackets.data() + firstLeafPackets[index];
+            for (uint32_t packet = 0; packet < GetPacketCount(node); packet++)
+            {
+                const int lane = RayKernels::IntersectTriangles(packets[packet], origin, direction, cull, t, closest.u, closest.v);
+                if (lane >= 0)
+                {
+                    hitIndex = node.leftFirst + packet * RayKernels::Width + (uint32_t)lane;
+                }
+            }
+            return false;
+        });
+    if (hitIndex == UINT32_MAX)
+    {
+        return false;
+    }
+    hit = closest;
+    hit.triangle = triangleIndices[hitIndex];
+    return true;
+}
+
+bool Bvh::Occluded(const float origin[3], const float direction[3], float tMax, RayKernels::CullMode cull) const
+{
+    if (nodeCount == 0 || triangles.empty())
+    {
+        return false;
+    }
+    return Traverse(GetNodes(), origin, direction, tMax, [&](uint32_t index, const Node& node, float& t)
+        {
+            float u, v;
+            const RayKernels::TrianglePacket* packets = leafPackets.data() + firstLeafPackets[index];
+            for (uint32_t packet = 0; packet < GetPacketCount(node); packet++)
+            {
+                if (RayKernels::IntersectTriangles(packets[packet], origin, direction, cull, t, u, v) >= 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+}
+
+bool Bvh::VisitLeaves(const float origin[3], const float direction[3], float tMax, LeafCallback callback, const void* context) const
+{
+    if (nodeCount == 0)
+    {
+        return false;
+    }
+    return Traverse(GetNodes(), origin, direction, tMax, [&](uint32_t, const Node& node, float& t)
+        {
+            return callback(context, node.leftFirst, node.triangleCount, t);
+        });
+}
+
+void Bvh::SetNodes(const std::vector<Node>& nodes)
+{
+    nodeCount = (uint32_t)nodes.size();
+    nodePairs.resize(nodeCount / 2);
+    std::copy(nodes.begin(), nodes.end(), &nodePairs[0].nodes[0]);
+}
@@ -0,0 +1,626 @@
+#include "CpuRenderer.h"
+#include "ThreadPool.h"
+#include "TopLevelBvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+    typedef RayKernels::CullMode CullMode;
+
+    //float3 of the shaders. The shading below is written with the same operations in the same order as Hit.hlsl.
+    struct Float3
+    {
+        float x;
+        float y;
+        float z;
+    };
+
+    inline Float3 operator+(const Float3& a, const Float3& b)
+    {
+        return { a.x + b.x, a.y + b.y, a.z + b.z };
+    }
+
+    inline Float3 operator-(const Float3& a, const Float3& b)
+    {
+        return { a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+
+    inline Float3 operator*(const Float3& a, const Float3& b)
+    {
+        return { a.x * b.x, a.y * b.y, a.z * b.z };
+    }
+
+    inline Float3 operator*(const Float3& a, float b)
+    {
+        return { a.x * b, a.y * b, a.z * b };
+    }
+
+    inline Float3 operator/(const Float3& a, const Float3& b)
+    {
+        return { a.x / b.x, a.y / b.y, a.z / b.z };
+    }
+
+    inline Float3 operator/(const Float3& a, float b)
+    {
+        return { a.x / b, a.y / b, a.z / b };
+    }
+
+    inline float Dot(const Float3& a, const Float3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline Float3 Cross(const Float3& a, const Float3& b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    inline float Length(const Float3& a)
+    {
+        return std::sqrt(Dot(a, a));
+    }
+
+    inline Float3 Normalize(const Float3& a)
+    {
+        return a / Length(a);
+    }
+
+    inline Float3 Lerp(const Float3& a, const Float3& b, float t)
+    {
+        return a + (b - a) * t;
+    }
+
+    inline Float3 Reflect(const Float3& incident, const Float3& normal)
+    {
+        return incident - normal * (2.0f * Dot(incident, normal));
+    }
+
+    inline Float3 ToFloat3(const float value[3])
+    {
+        return { value[0], value[1], value[2] };
+    }
+
+    const float Pi = 3.14159265359f;
+
+    struct Light
+    {
+        Float3 color;
+        Float3 position;
+        float intensity;
+    };
+
+    //The lights of Hit.hlsl.
+    const int LightCount = 6;
+    const Light Lights[LightCount] =
+    {
+        { { 1.0f, 1.0f, 1.0f }, { +00.0f, +10.0f, +00.0f }, 0.2f },
+        { { 1.0f, 1.0f, 1.0f }, { +10.0f, +10.0f, +00.0f }, 0.2f },
+        { { 1.0f, 1.0f, 1.0f }, { -10.0f, +10.0f, +00.0f }, 0.2f },
+        { { 1.0f, 1.0f, 1.0f }, { +00.0f, +10.0f, +10.0f }, 0.2f },
+        { { 1.0f, 1.0f, 1.0f }, { +00.0f, +10.0f, -10.0f }, 0.2f },
+        { { 1.0f, 1.0f, 1.0f }, { +00.0f, -10.0f, +00.0f }, 0.2f },
+    };
+
+    //Matrix that multiplies column vectors, m[row][column]. This is how the shaders see the matrices of the camera buffer.
+    struct Matrix
+    {
+        float m[4][4];
+
+        Float3 Transform(float x, float y, float z, float w) const
+        {
+            return { m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3] * w,
+                     m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3] * w,
+                     m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3] * w };
+        }
+    };
+
+    //glm::lookAt, which the camera manipulator makes its matrix with.
+    Matrix LookAt(const Float3& eye, const Float3& center, const Float3& up)
+    {
+        const Float3 f = Normalize(center - eye);
+        const Float3 s = Normalize(Cross(f, up));
+        const Float3 u = Cross(s, f);
+        return { { { s.x, s.y, s.z, -Dot(s, eye) },
+                   { u.x, u.y, u.z, -Dot(u, eye) },
+                   { -f.x, -f.y, -f.z, Dot(f, eye) },
+                   { 0.0f, 0.0f, 0.0f, 1.0f } } };
+    }
+
+    //XMMatrixPerspectiveFovRH, transposed to multiply column vectors.
+    Matrix PerspectiveFovRH(float fovY, float aspectRatio, float nearPlane, float farPlane)
+    {
+        const float height = std::cos(0.5f * fovY) / std::sin(0.5f * fovY);
+        const float width = height / aspectRatio;
+        const float range = farPlane / (nearPlane - farPlane);
+        return { { { width, 0.0f, 0.0f, 0.0f },
+                   { 0.0f, height, 0.0f, 0.0f },
+                   { 0.0f, 0.0f, range, range * nearPlane },
+                   { 0.0f, 0.0f, -1.0f, 0.0f } } };
+    }
+
+    //Inverse by cofactors, like XMMatrixInverse. A singular matrix gives infinities and NaNs, as it does there.
+    Matrix Invert(const Matrix& matrix)
+    {
+        const float (&m)[4][4] = matrix.m;
+        const float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+        const float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+        const float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+        const float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+        const float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+        const float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+        const float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+        const float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+        const float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+        const float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+        const float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+        const float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+        const float inverseDeterminant = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+        Matrix inverse;
+        inverse.m[0][0] = (m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * inverseDeterminant;
+        inverse.m[0][1] = (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * inverseDeterminant;
+        inverse.m[0][2] = (m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * inverseDeterminant;
+        inverse.m[0][3] = (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * inverseDeterminant;
+        inverse.m[1][0] = (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * inverseDeterminant;
+        inverse.m[1][1] = (m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * inverseDeterminant;
+        inverse.m[1][2] = (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * inverseDeterminant;
+        inverse.m[1][3] = (m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * inverseDeterminant;
+        inverse.m[2][0] = (m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * inverseDeterminant;
+        inverse.m[2][1] = (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * inverseDeterminant;
+        inverse.m[2][2] = (m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * inverseDeterminant;
+        inverse.m[2][3] = (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * inverseDeterminant;
+        inverse.m[3][0] = (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * inverseDeterminant;
+        inverse.m[3][1] = (m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * inverseDeterminant;
+        inverse.m[3][2] = (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * inverseDeterminant;
+        inverse.m[3][3] = (m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * inverseDeterminant;
+        return inverse;
+    }
+
+    Matrix ToMatrix(const float transform[3][4])
+    {
+        Matrix matrix = { { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                matrix.m[row][column] = transform[row][column];
+            }
+        }
+        return matrix;
+    }
+
+    //An instance with the matrix the shading needs. The traversal takes the rays into object space with the matrices of the TopLevelBvh.
+    struct PreparedInstance
+    {
+        const CpuRenderer::Instance* instance;
+        const CpuRenderer::Mesh* mesh;
+        //objectToWorldNormal of the instance properties: the inverse transpose of the upper 3x3 of the transform.
+        Matrix normalToWorld;
+    };
+
+    PreparedInstance Prepare(const CpuRenderer::Scene& scene, const CpuRenderer::Instance& instance)
+    {
+        PreparedInstance prepared;
+        prepared.instance = &instance;
+        prepared.mesh = &scene.meshes[instance.mesh];
+        const Matrix objectToWorld = ToMatrix(instance.transform);
+        Matrix upper3x3 = objectToWorld;
+        for (int i = 0; i < 3; i++)
+        {
+            upper3x3.m[i][3] = 0.0f;
+            upper3x3.m[3][i] = 0.0f;
+        }
+        const Matrix inverse = Invert(upper3x3);
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                prepared.normalToWorld.m[row][column] = inverse.m[column][row];
+            }
+        }
+        return prepared;
+    }
+
+    struct SceneHit
+    {
+        const PreparedInstance* instance;
+        Bvh::Hit hit;
+    };
+
+    struct RayCounts
+    {
+        uint64_t primary;
+        uint64_t reflection;
+        uint64_t shadow;
+    };
+
+    //What the shading of one pixel needs.
+    struct ShadingContext
+    {
+        const CpuRenderer::Scene* scene;
+        const std::vector<PreparedInstance>* instances;
+        const TopLevelBvh* topLevel;
+        uint32_t height;
+        //DispatchRaysIndex().y, the miss gradient depends on it.
+        uint32_t pixelY;
+        RayCounts* counts;
+    };
+
+    //TraceRay() without the shaders. The ray starts at origin + tMin * direction, hit distances are from origin.
+    //With anyHit only whether anything is hit is found, which is all a shadow ray needs, and closest isn't written.
+    bool IntersectScene(const ShadingContext& context, const Float3& origin, const Float3& direction, float tMin, float tMax, CullMode cull, bool anyHit,
+        SceneHit& closest)
+    {
+        const Float3 start = origin + direction * tMin;
+        const float rayOrigin[3] = { start.x, start.y, start.z };
+        const float rayDirection[3] = { direction.x, direction.y, direction.z };
+        if (anyHit)
+        {
+            return context.topLevel->Occluded(rayOrigin, rayDirection, tMax - tMin, cull);
+        }
+        TopLevelBvh::Hit hit;
+        if (!context.topLevel->Intersect(rayOrigin, rayDirection, tMax - tMin, hit, cull))
+        {
+            return false;
+        }
+        closest.instance = &(*context.instances)[hit.instance];
+        closest.hit = { hit.t + tMin, hit.triangle, hit.u, hit.v };
+        return true;
+    }
+
+    Float3 TraceRadiance(const ShadingContext& context, const Float3& origin, const Float3& direction, float tMin, float tMax, CullMode cull, uint32_t depth);
+
+    //Miss in Miss.hlsl.
+    Float3 Miss(const ShadingContext& context)
+    {
+        const float ramp = (float)context.pixelY / (float)context.height;
+        return { 0.0f, 0.2f, 0.7f - 0.3f * ramp };
+    }
+
+    Float3 CalculateDirectLighting(const Float3& hitPoint, const Float3& normal, const Float3& surfaceColor)
+    {
+        Float3 color = { 0.0f, 0.0f, 0.0f };
+        for (const Light& light : Lights)
+        {
+            const Float3 directionTowardsLight = Normalize(light.position - hitPoint) * -1.0f;
+            const float lightFactor = Dot(normal, directionTowardsLight);
+            const float totalIntensity = std::max(0.0f, lightFactor * light.intensity);
+            color = color + surfaceColor * light.color * totalIntensity;
+        }
+        return color;
+    }
+
+    Float3 FresnelSchlick(float cosTheta, const Float3& f0)
+    {
+        const Float3 one = { 1.0f, 1.0f, 1.0f };
+        return f0 + (one - f0) * std::pow(std::min(std::max(1.0f - cosTheta, 0.0f), 1.0f), 5.0f);
+    }
+
+    float NormalDistributionGGX(const Float3& n, const Float3& h, float roughness)
+    {
+        const float a = roughness * roughness;
+        const float a2 = a * a;
+        const float nDotH = std::max(Dot(n, h), 0.0f);
+        const float nDotH2 = nDotH * nDotH;
+        float denominator = nDotH2 * (a2 - 1.0f) + 1.0f;
+        denominator = Pi * denominator * denominator;
+        return a2 / denominator;
+    }
+
+    float GeometrySchlickGGX(float nDotV, float roughness)
+    {
+        const float r = roughness + 1.0f;
+        const float k = (r * r) / 8.0f;
+        return nDotV / (nDotV * (1.0f - k) + k);
+    }
+
+    float GeometrySmith(const Float3& n, const Float3& v, const Float3& l, float roughness)
+    {
+        const float nDotV = std::max(Dot(n, v), 0.0f);
+        const float nDotL = std::max(Dot(n, l), 0.0f);
+        return GeometrySchlickGGX(nDotL, roughness) * GeometrySchlickGGX(nDotV, roughness);
+    }
+
+    Float3 CalculatePBRShading(const MeshCache::Material& material, const Float3& normal, const Float3& cameraPosition, const Float3& worldHitPoint)
+    {
+        const Float3 albedo = ToFloat3(material.albedo);
+        const Float3 one = { 1.0f, 1.0f, 1.0f };
+        const Float3 n = Normalize(normal) * -1.0f;
+        const Float3 v = Normalize(cameraPosition - worldHitPoint);
+        Float3 l0 = { 0.0f, 0.0f, 0.0f };
+        for (const Light& light : Lights)
+        {
+            const Float3 l = Normalize(light.position - worldHitPoint);
+            const Float3 h = Normalize(v + l);
+            const float distance = Length(light.position - worldHitPoint);
+            const float attenuation = 1.0f / std::max(distance * distance, 1.0f);
+            const Float3 radiance = light.color * attenuation;
+
+            const Float3 f0 = Lerp({ 0.04f, 0.04f, 0.04f }, albedo, material.metallic);
+            const Float3 f = FresnelSchlick(std::max(Dot(h, v), 0.0f), f0);
+            const float ndf = NormalDistributionGGX(n, h, material.roughness);
+            const float g = GeometrySmith(n, v, l, material.roughness);
+            const Float3 numerator = f * (ndf * g);
+            const float denominator = 4.0f * std::max(Dot(n, v), 0.0f) * std::max(Dot(n, l), 0.0f) + 0.0001f;
+            const Float3 specularLight = numerator / denominator;
+
+            const Float3 kD = (one - f) * (1.0f - material.metallic);
+            const float nDotL = std::max(Dot(n, l), 0.0f);
+            l0 = l0 + (kD * albedo / Pi + specularLight) * radiance * nDotL;
+        }
+
+        const Float3 ambientLight = { 0.2f, 0.2f, 0.2f };
+        Float3 color = l0 * ambientLight;
+        color = color / (color + one);
+        const float inverseGamma = 1.0f / 2.2f;
+        return { std::pow(color.x, inverseGamma), std::pow(color.y, inverseGamma), std::pow(color.z, inverseGamma) };
+    }
+
+    Float3 ToWorldNormal(const PreparedInstance& instance, const Float3& normal)
+    {
+        return instance.normalToWorld.Transform(normal.x, normal.y, normal.z, 0.0f);
+    }
+
+    //ClosestHit in Hit.hlsl.
+    Float3 ShadeModel(const ShadingContext& context, const SceneHit& hit, const Float3& rayOrigin, const Float3& rayDirection, uint32_t depth)
+    {
+        const PreparedInstance& instance = *hit.instance;
+        const Float3 hitWorldPosition = rayOrigin + rayDirection * hit.hit.t;
+        const float barycentrics[3] = { hit.hit.u, hit.hit.v, 1.0f - hit.hit.u - hit.hit.v };
+        const uint32_t* corners = instance.mesh->indices + 3 * (size_t)hit.hit.triangle;
+        const Float3 n0 = ToFloat3(instance.mesh->vertices[corners[1]].normal);
+        const Float3 n1 = ToFloat3(instance.mesh->vertices[corners[2]].normal);
+        const Float3 n2 = ToFloat3(instance.mesh->vertices[corners[0]].normal);
+        const Float3 normal = Normalize(ToWorldNormal(instance, Normalize(n0 * barycentrics[0] + n1 * barycentrics[1] + n2 * barycentrics[2])));
+
+        const MeshCache::Material& material = context.scene->materials[instance.instance->materialIndex];
+        const Float3 lightColor = CalculateDirectLighting(hitWorldPosition, normal, ToFloat3(material.albedo));
+        const Float3 finalSurfaceColor = lightColor + CalculatePBRShading(material, normal, rayOrigin, hitWorldPosition);
+        Float3 reflectionColor = finalSurfaceColor;
+        float reflectivity = 0.0f;
+        if (instance.instance->reflective && material.reflectivity > 0.0f && depth < CpuRenderer::MaxRecursionDepth)
+        {
+            //ReflectRay and CastReflectionRay. Back faces are culled, a reflection ray would otherwise bounce between the two sides of a triangle.
+            const Float3 direction = Normalize(Normalize(Reflect(Normalize(rayDirection), normal)));
+            context.counts->reflection++;
+            reflectionColor = TraceRadiance(context, hitWorldPosition + direction * 0.001f, direction, 0.001f, 1000.0f, CullMode::BackFacing, depth + 1);
+            reflectivity = material.reflectivity;
+        }
+        return Lerp(finalSurfaceColor, reflectionColor, reflectivity);
+    }
+
+    //PlaneClosestHit in Hit.hlsl.
+    Float3 ShadePlane(const ShadingContext& context, const SceneHit& hit, const Float3& rayOrigin, const Float3& rayDirection, uint32_t depth)
+    {
+        const PreparedInstance& instance = *hit.instance;
+        const Float3 hitWorldPosition = rayOrigin + rayDirection * hit.hit.t;
+        const Float3 lightDirection = Normalize(Lights[0].position - hitWorldPosition);
+
+        //The face normal. The plane isn't indexed on the GPU, its indices here are 0, 1, 2, ... so they give the same corners.
+        const uint32_t* corners = instance.mesh->indices + 3 * (size_t)hit.hit.triangle;
+        const Float3 v0 = ToFloat3(instance.mesh->vertices[corners[0]].position);
+        const Float3 e1 = ToFloat3(instance.mesh->vertices[corners[1]].position) - v0;
+        const Float3 e2 = ToFloat3(instance.mesh->vertices[corners[2]].position) - v0;
+        const Float3 normal = ToWorldNormal(instance, Normalize(Cross(e1, e2)));
+
+        bool isShadowed = Dot(normal, lightDirection) < 0.0f;
+        if (depth < CpuRenderer::MaxRecursionDepth)
+        {
+            //CastShadowRay.
+            context.counts->shadow++;
+            SceneHit shadowHit;
+            const bool isHit = IntersectScene(context, hitWorldPosition, Normalize(lightDirection), 0.01f, 100000.0f, CullMode::None, true, shadowHit);
+            isShadowed = isShadowed || isHit;
+        }
+        const float shadowFactor = isShadowed ? 0.3f : 1.0f;
+        const float lightIntensity = std::max(0.0f, Dot(normal, lightDirection));
+        const Float3 white = { 1.0f, 1.0f, 1.0f };
+        return white * lightIntensity * shadowFactor;
+    }
+
+    Float3 TraceRadiance(const ShadingContext& context, const Float3& origin, const Float3& direction, float tMin, float tMax, CullMode cull, uint32_t depth)
+    {
+        SceneHit hit;
+        if (!IntersectScene(context, origin, direction, tMin, tMax, cull, false, hit))
+        {
+            return Miss(context);
+        }
+        if (hit.instance->instance->hitGroupIndex == CpuRenderer::PlaneHitGroup)
+        {
+            return ShadePlane(context, hit, origin, direction, depth);
+        }
+        return ShadeModel(context, hit, origin, direction, depth);
+    }
+
+    //float to UNORM as the output texture stores it. NaN becomes 0.
+    uint8_t ToUnorm(float value)
+    {
+        value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+        return (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    //Tiles of one thread as a range [first, end) packed in one word, so that the thread and the threads that steal from it change it with one compare and swap.
+    //The thread takes tiles from the front and thieves take the back half.
+    class alignas(64) TileQueue
+    {
+    public:
+        void Assign(uint32_t first, uint32_t end)
+        {
+            range.store(Pack(first, end));
+        }
+
+        bool Pop(uint32_t& tile)
+        {
+            uint64_t current = range.load();
+            while (true)
+            {
+                const uint32_t first = (uint32_t)current;
+                const uint32_t end = (uint32_t)(current >> 32);
+                if (first >= end)
+                {
+                    return false;
+                }
+                if (range.compare_exchange_weak(current, Pack(first + 1, end)))
+                {
+                    tile = first;
+                    return true;
+                }
+            }
+        }
+
+        bool Steal(uint32_t& stolenFirst, uint32_t& stolenEnd)
+        {
+            uint64_t current = range.load();
+            while (true)
+            {
+                const uint32_t first = (uint32_t)current;
+                const uint32_t end = (uint32_t)(current >> 32);
+                if (first >= end)
+                {
+                    return false;
+                }
+                const uint32_t middle = first + (end - first) / 2;
+                if (range.compare_exchange_weak(current, Pack(first, middle)))
+                {
+                    stolenFirst = middle;
+                    stolenEnd = end;
+                    return true;
+                }
+            }
+        }
+
+    private:
+        static uint64_t Pack(uint32_t first, uint32_t end)
+        {
+            return (uint64_t)end << 32 | first;
+        }
+
+        std::atomic<uint64_t> range;
+    };
+}
+
+void CpuRenderer::Render(const Scene& scene, const Camera& camera, std::vector<uint8_t>& pixels, const Settings* settings, ThreadPool* pool, Statistics* statistics)
+{
+    const Settings defaultSettings;
+    const Settings& usedSettings = settings != nullptr ? *settings : defaultSettings;
+    pool = pool != nullptr ? pool : &ThreadPool::Shared();
+    const uint32_t width = usedSettings.width;
+    const uint32_t height = usedSettings.height;
+    const uint32_t tileSize = std::max(1u, usedSettings.tileSize);
+    pixels.assign((size_t)width * height * 4, 0);
+    if (statistics != nullptr)
+    {
+        *statistics = {};
+    }
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    //The top level hierarchy is built for every image, as the renderer rebuilds the top level acceleration structure when the instances change.
+    //If it can't be built, for an empty scene or a transform that can't be inverted, it stays empty and every ray misses.
+    std::vector<PreparedInstance> instances;
+    std::vector<TopLevelBvh::Instance> topLevelInstances;
+    instances.reserve(scene.instances.size());
+    topLevelInstances.reserve(scene.instances.size());
+    for (const Instance& instance : scene.instances)
+    {
+        instances.push_back(Prepare(scene, instance));
+        TopLevelBvh::Instance topLevelInstance = { scene.meshes[instance.mesh].bvh, {}, instance.hitGroupIndex, instance.materialIndex };
+        std::copy(&instance.transform[0][0], &instance.transform[0][0] + 12, &topLevelInstance.transform[0][0]);
+        topLevelInstances.push_back(topLevelInstance);
+    }
+    TopLevelBvh topLevel;
+    topLevel.Build(topLevelInstances.data(), topLevelInstances.size(), nullptr, pool);
+    //The inverses of the camera buffer.
+    const Matrix viewInverse = Invert(LookAt(ToFloat3(camera.eye), ToFloat3(camera.center), ToFloat3(camera.up)));
+    const Matrix projectionInverse = Invert(PerspectiveFovRH(camera.fovY, (float)width / (float)height, camera.nearPlane, camera.farPlane));
+
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    const uint32_t tileCount = tilesX * tilesY;
+    //One queue per thread that takes part, the workers and the calling thread, each starting with a run of rows of tiles.
+    const uint32_t queueCount = std::min(pool->GetThreadCount() + 1, tileCount);
+    std::vector<TileQueue> queues(queueCount);
+    for (uint32_t queue = 0; queue < queueCount; queue++)
+    {
+        queues[queue].Assign((uint32_t)((uint64_t)tileCount * queue / queueCount), (uint32_t)((uint64_t)tileCount * (queue + 1) / queueCount));
+    }
+    std::atomic<uint64_t> primaryRays(0), reflectionRays(0), shadowRays(0);
+    std::atomic<uint32_t> stolenTiles(0);
+
+    auto renderTile = [&](uint32_t tile, RayCounts& counts)
+    {
+        const uint32_t x0 = tile % tilesX * tileSize;
+        const uint32_t y0 = tile / tilesX * tileSize;
+        ShadingContext context = { &scene, &instances, &topLevel, height, 0, &counts };
+        for (uint32_t y = y0; y < std::min(y0 + tileSize, height); y++)
+        {
+            context.pixelY = y;
+            for (uint32_t x = x0; x < std::min(x0 + tileSize, width); x++)
+            {
+                //RayGen in RayGen.hlsl.
+                const float dx = (((float)x + 0.5f) / (float)width) * 2.0f - 1.0f;
+                const float dy = (((float)y + 0.5f) / (float)height) * 2.0f - 1.0f;
+                const Float3 origin = viewInverse.Transform(0.0f, 0.0f, 0.0f, 1.0f);
+                const Float3 cameraDirection = projectionInverse.Transform(dx, -dy, 1.0f, 1.0f);
+                const Float3 direction = viewInverse.Transform(cameraDirection.x, cameraDirection.y, cameraDirection.z, 0.0f);
+                //CastDefaultRay.
+                counts.primary++;
+                const Float3 color = TraceRadiance(context, origin, Normalize(direction), 0.0f, 100000.0f, CullMode::None, 1);
+                uint8_t* pixel = &pixels[((size_t)y * width + x) * 4];
+                pixel[0] = ToUnorm(color.x);
+                pixel[1] = ToUnorm(color.y);
+                pixel[2] = ToUnorm(color.z);
+                pixel[3] = 255;
+            }
+        }
+    };
+
+    pool->ParallelFor(queueCount, [&](size_t queue)
+        {
+            RayCounts counts = {};
+            uint32_t stolen = 0;
+            while (true)
+            {
+                uint32_t tile;
+                if (queues[queue].Pop(tile))
+                {
+                    renderTile(tile, counts);
+                    continue;
+                }
+                //Out of tiles, half of the tiles of the next thread that has some left become this thread's.
+                //A thread only stops once every queue is empty, the tiles it didn't see are being rendered by the threads that took them.
+                bool found = false;
+                for (uint32_t i = 1; i < queueCount && !found; i++)
+                {
+                    uint32_t first, end;
+                    if (queues[(queue + i) % queueCount].Steal(first, end))
+                    {
+                        stolen += end - first;
+                        queues[queue].Assign(first, end);
+                        found = true;
+                    }
+                }
+                if (!found)
+                {
+                    break;
+                }
+            }
+            primaryRays += counts.primary;
+            reflectionRays += counts.reflection;
+            shadowRays += counts.shadow;
+            stolenTiles += stolen;
+        });
+
+    if (statistics != nullptr)
+    {
+        statistics->primaryRays = primaryRays;
+        statistics->reflectionRays = reflectionRays;
+        statistics->shadowRays = shadowRays;
+        statistics->tileCount = tileCount;
+        statistics->stolenTiles = stolenTiles;
+    }
+}
@@ -29,12 +29,14 @@ D3D12HelloTriangle::D3D12HelloTriangle(UINT width, UINT height, std::wstring nam
     renderUI(false),
     materials({ Material() })
 {
-    uiConstructor.SetModelUpdateFunction(
-        [this](std::vector<XMFLOAT3>& vertices, std::vector<UINT>& indices)
+    modelLoadTask.SetPrepareBuffersFunction(
+        [this](const std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshCache::Lod>& lods,
+            const std::vector<MeshCache::Part>& parts, const std::vector<MeshCache::Material>& modelMaterials)
         {
-            this->QueueModelVertexAndIndexBufferUpdates(vertices, indices);
+            return this->CreatePendingModelBuffers(vertices.data(), vertices.size(), indices, lods, parts, modelMaterials);
         }
     );
+    uiConstructor.SetModelLoadTask(&modelLoadTask);
 }
 
 void D3D12HelloTriangle::OnInit()
@@ -223,7 +225,11 @@ void D3D12HelloTriangle::LoadAssets()
         CD3DX12_ROOT_PARAMETER indexParameter;
         indexParameter.InitAsConstants(1 /*value count*/, 1/*register*/);
 
-        std::vector<CD3DX12_ROOT_PARAMETER> params = { constantParameter, matricesParameter, indexParameter };
+        //Transform that maps quantized model positions back to model space, read by the raster pipeline of quantized models.
+        CD3DX12_ROOT_PARAMETER dequantizationParameter;
+        dequantizationParameter.InitAsConstants(12 /*value count*/, 2/*register*/);
+
+        std::vector<CD3DX12_ROOT_PARAMETER> params = { constantParameter, matricesParameter, indexParameter, dequantizationParameter };
 
         CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
         rootSignatureDesc.Init((UINT)params.size(), params.data(), 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
@@ -238,6 +244,7 @@ void D3D12HelloTriangle::LoadAssets()
     {
         ComPtr<ID3DBlob> vertexShader;
         ComPtr<ID3DBlob> pixelShader;
+        ComPtr<ID3DBlob> quantizedVertexShader;
 
 #if defined(_DEBUG)
         // Enable better shader debugging with the graphics debugging tools.
@@ -248,6 +255,7 @@ void D3D12HelloTriangle::LoadAssets()
 
         ThrowIfFailed(D3DCompileFromFile(L"shaders\\shaders.hlsl", nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
         ThrowIfFailed(D3DCompileFromFile(L"shaders\\shaders.hlsl", nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
+        ThrowIfFailed(D3DCompileFromFile(L"shaders\\shaders.hlsl", nullptr, nullptr, "VSMainQuantized", "vs_5_0", compileFlags, 0, &quantizedVertexShader, nullptr));
 
         // Define the vertex input layout.
         D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =        
@@ -274,6 +282,16 @@ void D3D12HelloTriangle::LoadAssets()
         psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
         psoDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
         ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+
+        //Same pipeline for the 12 byte quantized vertices: snorm16 position and octahedral normal, see VertexQuantization::QuantizedVertex.
+        D3D12_INPUT_ELEMENT_DESC quantizedInputElementDescs[] =
+        {
+            { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+        };
+        psoDesc.InputLayout = { quantizedInputElementDescs, _countof(quantizedInputElementDescs) };
+        psoDesc.VS = CD3DX12_SHADER_BYTECODE(quantizedVertexShader.Get());
+        ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_quantizedPipelineState)));
     }
 
     // Create the command list.
@@ -283,6 +301,9 @@ void D3D12HelloTriangle::LoadAssets()
     {
         std::vector<Vertex> vertices;
         std::vector<UINT> indices;
+        std::vector<MeshCache::Lod> lods; //Stays empty for the cube, which is a single level.
+        std::vector<MeshCache::Part> parts; //Stays empty for the cube, which is a single part with the default material.
+        std::vector<MeshCache::Material> modelMaterials;
 
         {
             bool createCube = false; //Set this to true to make a cube for debugging purposes.
@@ -329,69 +350,15 @@ void D3D12HelloTriangle::LoadAssets()
             }
             else
             {
-                OBJFileManager ofm = OBJFileManager();
-                std::vector<objl::Vertex> modelFileVertices;
-
                 std::string path = "models\\teapot.obj";
-                bool modelFileLoaded = ofm.LoadObjFile(path, modelFileVertices, indices);
+                bool modelFileLoaded = LoadModelFile(path, vertices, indices, lods, parts, modelMaterials);
                 assert(modelFileLoaded == true);
-                //Convert from objl::Vertex to Vertex struct to complete the load.
-                for (auto& vertex : modelFileVertices)
-                {
-                    Vertex v;
-                    v.position = XMFLOAT3(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
-                    vertices.push_back(v);
-                }
-
-                ComputeVertexNormals(vertices, indices);
             }
         }
 
-        m_modelVertexCount = vertices.size();
-        m_modelIndexCount = indices.size();
-
-        const UINT vertexBufferSize = vertices.size() * sizeof(Vertex);
-
-        // Note: using upload heaps to transfer static data like vert buffers is not 
-        // recommended. Every time the GPU needs it, the upload heap will be marshalled 
-        // over. Please read up on Default Heap usage. An upload heap is used here for 
-        // code simplicity and because there are very few verts to actually transfer.
-        ThrowIfFailed(m_device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_modelVertexBuffer)));
-
-        // Copy the triangle data to the vertex buffer.
-        UINT8* pVertexDataBegin;
-        CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
-        ThrowIfFailed(m_modelVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-        memcpy(pVertexDataBegin, vertices.data(), vertexBufferSize);
-        m_modelVertexBuffer->Unmap(0, nullptr);
-
-        // Initialize the vertex buffer view.
-        m_modelVertexBufferView.BufferLocation = m_modelVertexBuffer->GetGPUVirtualAddress();
-        m_modelVertexBufferView.StrideInBytes = sizeof(Vertex);
-        m_modelVertexBufferView.SizeInBytes = vertexBufferSize;
-
-        const UINT indexBufferSizeInBytes = (UINT)indices.size() * sizeof(UINT);
-
-        CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-        CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSizeInBytes);
-        ThrowIfFailed(m_device->CreateCommittedResource(&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_modelIndexBuffer)));
-
-        // Copy the triangle data to the index buffer.
-        UINT8* pIndexDataBegin;
-        ThrowIfFailed(m_modelIndexBuffer->Map(0, &readRange, (void**)&pIndexDataBegin));
-        memcpy(pIndexDataBegin, indices.data(), indexBufferSizeInBytes);
-        m_modelIndexBuffer->Unmap(0, nullptr);
-
-        // Initialize the index buffer view.
-        m_modelIndexBufferView.BufferLocation = m_modelIndexBuffer->GetGPUVirtualAddress();
-        m_modelIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-        m_modelIndexBufferView.SizeInBytes = indexBufferSizeInBytes;
+        //The startup model is uploaded the same way as the models that are loaded later on.
+        CreatePendingModelBuffers(reinterpret_cast<const MeshCache::Vertex*>(vertices.data()), vertices.size(), indices, lods, parts, modelMaterials);
+        UsePendingModelBuffers();
 
         // #DXR - Per Instance
         // Create a vertex buffer for a ground plane, similarly to the triangle definition above
@@ -428,6 +395,7 @@ void D3D12HelloTriangle::OnUpdate()
     UpdateMaterialsBuffer();
     // #DXR Extra: Perspective Camera
     UpdateCameraBuffer();
+    SelectModelLods();
     // #DXR Extra - Refitting
     UpdateInstancePropertiesBuffer();
 }
@@ -455,12 +423,14 @@ void D3D12HelloTriangle::OnRender()
 
     WaitForPreviousFrame();
 
-    //Update the model if there is a pending update
-    if (pendingModelUpdate)
+    //Swap in the model that finished loading in the background, if there is one.
+    //The upload buffers are already filled by the loading thread, only the acceleration structures are built here.
+    std::vector<MeshCache::Vertex> loadedVertices;
+    std::vector<uint32_t> loadedIndices;
+    if (modelLoadTask.TakeResult(loadedVertices, loadedIndices))
     {
         WaitForPreviousFrame();
         UpdateModelWithPendings();
-        pendingModelUpdate = false;
     }
 
     //Calculate how long the frame took
@@ -475,6 +445,9 @@ void D3D12HelloTriangle::OnDestroy()
     // Ensure that the GPU is no longer referencing resources that are about to be
     // cleaned up by the destructor.
     WaitForPreviousFrame();
+    //A load that is still running uses the device, so it has to stop before anything is released.
+    modelLoadTask.Cancel();
+    modelLoadTask.Wait();
     //Cleanup ImGui
     ImGui_ImplDX12_Shutdown();
     ImGui_ImplWin32_Shutdown();
@@ -531,10 +504,24 @@ void D3D12HelloTriangle::PopulateCommandList()
         m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
         //Render tetrahedron
         m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        const bool isQuantized = m_modelVertexFormat == VertexQuantization::Format::Quantized;
+        if (isQuantized)
+        {
+            m_commandList->SetPipelineState(m_quantizedPipelineState.Get());
+            m_commandList->SetGraphicsRoot32BitConstants(3, 12, m_modelDequantization, 0);
+        }
         m_commandList->IASetVertexBuffers(0, 1, &m_modelVertexBufferView);
         m_commandList->IASetIndexBuffer(&m_modelIndexBufferView);
-        m_commandList->DrawIndexedInstanced(m_modelIndexCount, 1, 0, 0, 0);
-        //Render plane
+        //The raster path always draws the full detail level of every part, which is the first index range of the part.
+        for (const ModelPart& part : m_modelParts)
+        {
+            m_commandList->DrawIndexedInstanced(part.lods[0].indexCount, 1, part.lods[0].firstIndex, 0, 0);
+        }
+        //Render plane, which always has float vertices.
+        if (isQuantized)
+        {
+            m_commandList->SetPipelineState(m_pipelineState.Get());
+        }
         m_commandList->IASetVertexBuffers(0, 1, &m_planeBufferView);
         m_commandList->DrawInstanced(6, 1, 0, 0);
     }
@@ -543,6 +530,13 @@ void D3D12HelloTriangle::PopulateCommandList()
         const float clearColor[] = { 0.6f, 0.8f, 0.4f, 1.0f };
         m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
 
+        //An instance switched its level of detail in OnUpdate(). The TLAS is rebuilt in place, so the descriptor heap keeps pointing at it.
+        if (m_instancesChanged)
+        {
+            CreateTopLevelAS(m_instances);
+            m_instancesChanged = false;
+        }
+
         // #DXR
         // Bind the descriptor heap giving access to the top-level acceleration
         // structure, as well as the raytracing output
@@ -679,7 +673,8 @@ void D3D12HelloTriangle::OnKeyDown(UINT8 key)
     //Important note: This function is called multiple times if the key is held.
 }
 
-D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers)
+D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers, std::vector<DXGI_FORMAT> vIndexFormats,
+    std::vector<VertexQuantization::Format> vVertexFormats, std::vector<ComPtr<ID3D12Resource>> vTransformBuffers, std::vector<UINT> vFirstIndices)
 {
     // Create a bottom-level acceleration structure based on a list of vertex
     // buffers in GPU memory along with their vertex count. The build is done
@@ -692,18 +687,23 @@ D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBotto
     // #DXR Extra: Indexed Geometry
     for (size_t i = 0; i < vVertexBuffers.size(); i++)
     {
+        VertexQuantization::Format vertexFormat = i < vVertexFormats.size() ? vVertexFormats[i] : VertexQuantization::Format::Float;
+        UINT vertexSize = (UINT)VertexQuantization::GetVertexSize(vertexFormat);
+        ID3D12Resource* transformBuffer = i < vTransformBuffers.size() ? vTransformBuffers[i].Get() : nullptr;
         if (i < vIndexBuffers.size() && vIndexBuffers[i].second > 0)
         {
+            DXGI_FORMAT indexFormat = i < vIndexFormats.size() ? vIndexFormats[i] : DXGI_FORMAT_R32_UINT;
+            UINT64 indexOffsetInBytes = i < vFirstIndices.size() ? (UINT64)vFirstIndices[i] * (indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4) : 0;
             bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
-                vVertexBuffers[i].second, sizeof(Vertex),
-                vIndexBuffers[i].first.Get(), 0,
-                vIndexBuffers[i].second, nullptr, 0, true);
+                vVertexBuffers[i].second, vertexSize,
+                vIndexBuffers[i].first.Get(), indexOffsetInBytes,
+                vIndexBuffers[i].second, transformBuffer, 0, true, indexFormat, GetDxgiVertexFormat(vertexFormat));
         }
         else
         {
             bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
-                vVertexBuffers[i].second, sizeof(Vertex), 0,
-                0);
+                vVertexBuffers[i].second, vertexSize, transformBuffer,
+                0, true, GetDxgiVertexFormat(vertexFormat));
         }
     }
 
@@ -735,33 +735,40 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<TLASParams>& instanc
 {
     nv_helpers_dx12::TopLevelASGenerator m_topLevelASGenerator;
 
-    if (!updateOnly)
-    {
-        // Create the main acceleration structure that holds all instances of the scene.
-        // Similarly to the bottom-level AS generation, it is done in 3 steps: gathering
-        // the instances, computing the memory requirements for the AS, and building the
-        // AS itself
+    // Create the main acceleration structure that holds all instances of the scene.
+    // Similarly to the bottom-level AS generation, it is done in 3 steps: gathering
+    // the instances, computing the memory requirements for the AS, and building the
+    // AS itself
 
-        //Step one: Gather the instances
-        for (size_t i = 0; i < instances.size(); i++)
-        {
-            const TLASParams& instance = instances[i];
-            m_topLevelASGenerator.AddInstance(instance.blas.Get(), instance.transformMatrix, (UINT)i, instance.hitGroupIndex);
-        }
-
-        //Step two: Compute the memory requirements
-
-        // As for the bottom-level AS, the building the AS requires some scratch space
-        // to store temporary data in addition to the actual AS. In the case of the
-        // top-level AS, the instance descriptors also need to be stored in GPU
-        // memory. This call outputs the memory requirements for each (scratch,
-        // results, instance descriptors) so that the application can allocate the
-        // corresponding memory
-        UINT64 scratchSize, resultSize, instanceDescSize;
-        m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get(), true, &scratchSize, &resultSize, &instanceDescSize);
-
-        //Step three: Create the buffers and build the TLAS
+    //Step one: Gather the instances
+    //The generator writes the instance descriptors from this list on updates as well, so it is always filled.
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        const TLASParams& instance = instances[i];
+        m_topLevelASGenerator.AddInstance(instance.blas.Get(), instance.transformMatrix, (UINT)i, instance.hitGroupIndex);
+    }
 
+    //Step two: Compute the memory requirements
+
+    // As for the bottom-level AS, the building the AS requires some scratch space
+    // to store temporary data in addition to the actual AS. In the case of the
+    // top-level AS, the instance descriptors also need to be stored in GPU
+    // memory. This call outputs the memory requirements for each (scratch,
+    // results, instance descriptors) so that the application can allocate the
+    // corresponding memory
+    UINT64 scratchSize, resultSize, instanceDescSize;
+    m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get(), true, &scratchSize, &resultSize, &instanceDescSize);
+
+    //Step three: Create the buffers and build the TLAS
+
+    //The buffers of the previous build are reused when they are large enough. Keeping the same result buffer means
+    //the SRV in the descriptor heap stays valid, which lets the levels of detail change without recreating the heap.
+    bool buffersFit = m_topLevelASBuffers.pResult != nullptr &&
+        m_topLevelASBuffers.pScratch->GetDesc().Width >= scratchSize &&
+        m_topLevelASBuffers.pResult->GetDesc().Width >= resultSize &&
+        m_topLevelASBuffers.pInstanceDesc->GetDesc().Width >= instanceDescSize;
+    if (!updateOnly && !buffersFit)
+    {
         // Create the scratch and result buffers. Since the build is all done on GPU,
         // those can be allocated on the default heap
         m_topLevelASBuffers.pScratch = nv_helpers_dx12::CreateBuffer(m_device.Get(), scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nv_helpers_dx12::kDefaultHeapProps);
@@ -775,20 +782,102 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<TLASParams>& instanc
     m_topLevelASGenerator.Generate(m_commandList.Get(), m_topLevelASBuffers.pScratch.Get(), m_topLevelASBuffers.pResult.Get(), m_topLevelASBuffers.pInstanceDesc.Get(), updateOnly, m_topLevelASBuffers.pResult.Get());
 }
 
+std::vector<D3D12HelloTriangle::AccelerationStructureBuffers> D3D12HelloTriangle::CreateModelLodBottomLevelAS()
+{
+    std::vector<AccelerationStructureBuffers> buffers;
+    for (ModelPart& part : m_modelParts)
+    {
+        for (ModelLod& lod : part.lods)
+        {
+            buffers.push_back(CreateBottomLevelAS({ { m_modelVertexBuffer.Get(), m_modelVertexCount } }, { { m_modelIndexBuffer.Get(), lod.indexCount } }, { GetDxgiIndexFormat(m_modelIndexFormat) },
+                                                  { m_modelVertexFormat }, { m_modelTransformBuffer }, { lod.firstIndex }));
+            lod.blas = buffers.back().pResult;
+        }
+    }
+    return buffers;
+}
+
+void D3D12HelloTriangle::CreateSceneInstances(const ComPtr<ID3D12Resource>& planeBlas)
+{
+    const XMMATRIX modelPlacements[] = { XMMatrixIdentity(),
+                                         XMMatrixTranslation(-5.0f, 0.0f, 5.0f),
+                                         XMMatrixTranslation(-5.0f, 0.0f, 5.0f),
+                                         XMMatrixTranslation(-5.0f, 0.0f, -5.0f),
+                                         XMMatrixTranslation(5.0f, 0.0f, -5.0f),
+                                         XMMatrixTranslation(5.0f, 0.0f, 5.0f),
+    };
+    //Every part of every placement is its own instance that carries the material of the part, so a model with many materials is still drawn in one dispatch.
+    m_instances.clear();
+    for (size_t placement = 0; placement < _countof(modelPlacements); placement++)
+    {
+        for (UINT part = 0; part < (UINT)m_modelParts.size(); part++)
+        {
+            TLASParams instance(m_modelParts[part].lods[0].blas, modelPlacements[placement], 0, m_modelParts[part].materialIndex, true);
+            instance.modelPart = part;
+            //Only the first two placements reflect.
+            instance.reflective = placement < 2;
+            m_instances.push_back(instance);
+        }
+    }
+    m_instances.push_back(TLASParams(planeBlas, XMMatrixIdentity(), 2, 0));
+    m_instancesChanged = false;
+}
+
+void D3D12HelloTriangle::SelectModelLods()
+{
+    //Size of one world unit on screen at distance 1 from the camera, in pixels.
+    const float pixelsPerUnit = GetHeight() / (2.0f * tanf(m_fovAngleY * 0.5f));
+    glm::vec3 eye, center, up;
+    nv_helpers_dx12::CameraManip.getLookat(eye, center, up);
+    const XMVECTOR cameraPosition = XMVectorSet(eye.x, eye.y, eye.z, 1.0f);
+    const XMVECTOR sphereCenter = XMLoadFloat4(&m_modelBoundingSphere);
+
+    for (TLASParams& instance : m_instances)
+    {
+        if (!instance.usesModelLods)
+        {
+            continue;
+        }
+        //The largest axis scale of the instance makes the error and the radius larger in the same way.
+        float scale = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            scale = (std::max)(scale, XMVectorGetX(XMVector3Length(instance.transformMatrix.r[axis])));
+        }
+        XMVECTOR worldCenter = XMVector3Transform(XMVectorSetW(sphereCenter, 1.0f), instance.transformMatrix);
+        float distance = XMVectorGetX(XMVector3Length(worldCenter - cameraPosition)) - m_modelBoundingSphere.w * scale;
+
+        //Once the camera is inside the bounding sphere only the full model is used.
+        //Every part picks its own level, the levels of all of them stay under the same error on screen.
+        const std::vector<ModelLod>& lods = m_modelParts[instance.modelPart].lods;
+        UINT lod = 0;
+        if (distance > 0.0f)
+        {
+            for (UINT i = (UINT)lods.size() - 1; i > 0; i--)
+            {
+                if (lods[i].error * scale * pixelsPerUnit / distance <= m_lodPixelError)
+                {
+                    lod = i;
+                    break;
+                }
+            }
+        }
+        if (lod != instance.lod)
+        {
+            instance.lod = lod;
+            instance.blas = lods[lod].blas;
+            m_instancesChanged = true;
+        }
+    }
+}
+
 void D3D12HelloTriangle::CreateAccelerationStructures()
 {
-    // Build the BLAS from triangle vertex buffer
-    AccelerationStructureBuffers modelBottomLevelBuffers = CreateBottomLevelAS({ { m_modelVertexBuffer.Get(), m_modelVertexCount } }, { { m_modelIndexBuffer.Get(), m_modelIndexCount } });
+    // Build the BLAS from triangle vertex buffer, one per level of detail
+    std::vector<AccelerationStructureBuffers> modelBottomLevelBuffers = CreateModelLodBottomLevelAS();
     AccelerationStructureBuffers planeBottomLevelBuffers = CreateBottomLevelAS({ { m_planeBuffer.Get(), 6 } });
 
-    m_instances = { TLASParams(modelBottomLevelBuffers.pResult, XMMatrixIdentity(), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, -5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(5.0f, 0.0f, -5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(planeBottomLevelBuffers.pResult, XMMatrixIdentity(), 2, 0),
-    };
+    CreateSceneInstances(planeBottomLevelBuffers.pResult);
 
     CreateTopLevelAS(m_instances);
 
@@ -806,7 +895,7 @@ void D3D12HelloTriangle::CreateAccelerationStructures()
     ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
 
     // Store the AS buffers. The rest of the buffers will be released once we exit the function
-    m_bottomLevelAS = modelBottomLevelBuffers.pResult;
+    m_bottomLevelAS = m_modelParts[0].lods[0].blas;
 }
 
 ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateRayGenSignature()
@@ -851,6 +940,8 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateHitSignature()
             { 3 /*t3*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV /*Per-instance data*/, 3 },
             { 4 /*t4*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV /*Material array*/, 4 }
         });
+    //Size of one index in bytes and the vertex layout, the shader reads the mesh buffers depending on them.
+    rsg.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 1 /*b1*/, 0, 2);
     return rsg.Generate(m_device.Get(), true);
 }
 
@@ -1061,9 +1152,11 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
     m_sbtHelper.AddMissProgram(L"ShadowMiss", {});
 
     // Hit shader setup
+    //The mesh root constants are the fourth parameter of the hit signature, so they have to stay the fourth entry here.
     m_sbtHelper.AddHitGroup(L"HitGroup", { (void*)m_modelVertexBuffer->GetGPUVirtualAddress(),
                                            (void*)m_modelIndexBuffer->GetGPUVirtualAddress(),
                                            (void*)(heapPointer),
+                                           GetMeshConstants(m_modelIndexFormat, m_modelVertexFormat),
                                            (void*)m_perInstanceConstantBuffers[0]->GetGPUVirtualAddress(),
                                            (void*)m_instancePropertiesBuffer->GetGPUVirtualAddress(),
                                            (void*)materialsBuffer->GetGPUVirtualAddress(),
@@ -1077,6 +1170,7 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
             (void*)m_planeBuffer->GetGPUVirtualAddress(),
             (void*)m_globalConstantBuffer->GetGPUVirtualAddress(),
             heapPointer,
+            GetMeshConstants(IndexPacking::Format::UInt32, VertexQuantization::Format::Float), //The plane isn't indexed, the index size is only there to fill the root constants.
         });
 
     // Compute the size of the SBT given the number of shaders and their parameters
@@ -1151,9 +1245,7 @@ void D3D12HelloTriangle::UpdateCameraBuffer()
     const glm::mat4& mat = nv_helpers_dx12::CameraManip.getMatrix();
     memcpy(&matrices[0].r->m128_f32[0], glm::value_ptr(mat), 16 * sizeof(float));
 
-    float fovAngleY_degrees = 45.0f;
-    float fovAngleY = fovAngleY_degrees * XM_PI / 180.0f; //Convert fov angle degrees to radians
-    matrices[1] = XMMatrixPerspectiveFovRH(fovAngleY, m_aspectRatio, 0.1f, 1000.0f);
+    matrices[1] = XMMatrixPerspectiveFovRH(m_fovAngleY, m_aspectRatio, 0.1f, 1000.0f);
 
     // Raytracing has to do the contrary of rasterization: rays are defined in
     // camera space, and are transformed into world space. To do this, we need to
@@ -1198,6 +1290,9 @@ void D3D12HelloTriangle::UpdateInstancePropertiesBuffer()
         upper3x3.r[3].m128_f32[3] = 1.f;
         XMVECTOR det;
         current->objectToWorldNormal = XMMatrixTranspose(XMMatrixInverse(&det, upper3x3));
+        current->firstIndex = instance.usesModelLods ? m_modelParts[instance.modelPart].lods[instance.lod].firstIndex : 0;
+        current->materialIndex = instance.materialIndex;
+        current->reflective = instance.reflective ? 1 : 0;
         current++; //Go to the next instance's address
     }
     m_instancePropertiesBuffer->Unmap(0, nullptr);
@@ -1426,39 +1521,27 @@ void D3D12HelloTriangle::InitializeImGuiContext(bool darkTheme)
     //IM_ASSERT(font != nullptr);
 }
 
-// Compute face normals and distribute them as vertex normals
-void D3D12HelloTriangle::ComputeVertexNormals(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+bool D3D12HelloTriangle::LoadModelFile(const std::string& path, std::vector<Vertex>& vertices, std::vector<UINT>& indices, std::vector<MeshCache::Lod>& lods,
+    std::vector<MeshCache::Part>& parts, std::vector<MeshCache::Material>& modelMaterials)
 {
-    // Step 1: Initialize vertex normals to zero
-    std::vector<XMFLOAT3> tempNormals(vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
-
-    // Step 2: Iterate through each triangle and compute the face normal
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        uint32_t i0 = indices[i];
-        uint32_t i1 = indices[i + 1];
-        uint32_t i2 = indices[i + 2];
-
-        XMVECTOR v0 = XMLoadFloat3(&vertices[i0].position);
-        XMVECTOR v1 = XMLoadFloat3(&vertices[i1].position);
-        XMVECTOR v2 = XMLoadFloat3(&vertices[i2].position);
-
-        // Compute the face normal
-        XMVECTOR edge1 = v1 - v0;
-        XMVECTOR edge2 = v2 - v0;
-        XMVECTOR normal = XMVector3Normalize(XMVector3Cross(edge1, edge2));
-
-        // Accumulate the normal for each vertex of the triangle
-        XMStoreFloat3(&tempNormals[i0], XMVectorAdd(XMLoadFloat3(&tempNormals[i0]), normal));
-        XMStoreFloat3(&tempNormals[i1], XMVectorAdd(XMLoadFloat3(&tempNormals[i1]), normal));
-        XMStoreFloat3(&tempNormals[i2], XMVectorAdd(XMLoadFloat3(&tempNormals[i2]), normal));
+    static_assert(sizeof(Vertex) == sizeof(MeshCache::Vertex) &&
+        offsetof(Vertex, position) == offsetof(MeshCache::Vertex, position) &&
+        offsetof(Vertex, normal) == offsetof(MeshCache::Vertex, normal),
+        "The .rtmesh vertex layout must match the vertex buffer layout.");
+
+    ModelLoadTask task;
+    std::vector<MeshCache::Vertex> loadedVertices;
+    task.Start(path);
+    task.Wait();
+    if (!task.TakeResult(loadedVertices, indices, &lods, &parts, &modelMaterials))
+    {
+        return false;
     }
 
-    // Step 3: Normalize all vertex normals
-    for (size_t i = 0; i < vertices.size(); i++) {
-        XMVECTOR normal = XMLoadFloat3(&tempNormals[i]);
-        normal = XMVector3Normalize(normal);
-        XMStoreFloat3(&vertices[i].normal, -normal);
-    }
+    //The loaded data is already in the vertex buffer layout, so it is copied as is.
+    const Vertex* first = reinterpret_cast<const Vertex*>(loadedVertices.data());
+    vertices.assign(first, first + loadedVertices.size());
+    return true;
 }
 
 void D3D12HelloTriangle::CreateMaterialsBuffer()
@@ -1479,55 +1562,63 @@ void D3D12HelloTriangle::UpdateMaterialsBuffer()
     materialsBuffer->Unmap(0, nullptr);
 }
 
-void D3D12HelloTriangle::UpdateModelWithPendings()
+void D3D12HelloTriangle::UsePendingModelBuffers()
 {
+    const UINT vertexBufferSizeInBytes = ROUND_UP(pendingVertexCount * VertexQuantization::GetVertexSize(pendingVertexFormat), 256);
+    const UINT indexBufferSizeInBytes = ROUND_UP((UINT)IndexPacking::GetPackedSize(pendingIndexCount, pendingIndexFormat), 256);
+
+    //The old buffers are released here, the caller waited for the GPU to stop using them.
+    m_modelVertexBuffer = pendingVertexBuffer;
+    m_modelIndexBuffer = pendingIndexBuffer;
+    m_modelTransformBuffer = pendingTransformBuffer;
+    pendingVertexBuffer.Reset();
+    pendingIndexBuffer.Reset();
+    pendingTransformBuffer.Reset();
+    m_modelVertexCount = pendingVertexCount;
+    m_modelIndexFormat = pendingIndexFormat;
+    m_modelVertexFormat = pendingVertexFormat;
+    memcpy(m_modelDequantization, pendingDequantization, sizeof(m_modelDequantization));
+    m_modelBoundingSphere = pendingBoundingSphere;
+    //The materials of the previous model are dropped, the default material stays at index 0.
+    static_assert(sizeof(Material) == sizeof(MeshCache::Material), "The .rtmesh material layout must match the materials buffer layout.");
+    materials.resize(1);
+    for (const MeshCache::Material& material : pendingMaterials)
     {
-        const UINT vertexBufferSizeInBytes = ROUND_UP(pendingVertices.size() * sizeof(Vertex), 256);
-        const UINT indexBufferSizeInBytes = ROUND_UP(pendingIndices.size() * sizeof(UINT), 256);
-
-        //WaitForPreviousFrame();
-        if (m_modelVertexBuffer != nullptr)
-        {
-            m_modelVertexBuffer.Reset();
-        }
-        if (m_modelIndexBuffer != nullptr)
+        materials.push_back(Material(XMFLOAT3(material.albedo[0], material.albedo[1], material.albedo[2]), material.roughness, material.metallic, material.reflectivity));
+    }
+    //The BLAS of the levels are built by CreateModelLodBottomLevelAS().
+    m_modelParts.clear();
+    for (const MeshCache::Part& pendingPart : pendingParts)
+    {
+        ModelPart part;
+        part.materialIndex = pendingPart.material == MeshCache::NoMaterial ? 0 : 1 + pendingPart.material;
+        for (uint32_t i = pendingPart.firstLod; i < pendingPart.firstLod + pendingPart.lodCount; i++)
         {
-            m_modelIndexBuffer.Reset();
+            part.lods.push_back({ nullptr, pendingLods[i].firstIndex, pendingLods[i].indexCount, pendingLods[i].error });
         }
-        m_modelVertexBuffer = nv_helpers_dx12::CreateBuffer(m_device.Get(), vertexBufferSizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-        m_modelIndexBuffer = nv_helpers_dx12::CreateBuffer(m_device.Get(), indexBufferSizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-
-        // Copy the triangle data to the vertex buffer.
-        UINT8* pVertexDataBegin;
-        CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
-        ThrowIfFailed(m_modelVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-        memcpy(pVertexDataBegin, pendingVertices.data(), vertexBufferSizeInBytes);
-        m_modelVertexBuffer->Unmap(0, nullptr);
-        m_modelVertexCount = pendingVertices.size();
-
-        // Initialize the vertex buffer view.
-        m_modelVertexBufferView.BufferLocation = m_modelVertexBuffer->GetGPUVirtualAddress();
-        m_modelVertexBufferView.StrideInBytes = sizeof(Vertex);
-        m_modelVertexBufferView.SizeInBytes = vertexBufferSizeInBytes;
-
-        // Copy the triangle data to the index buffer.
-        UINT8* pIndexDataBegin;
-        ThrowIfFailed(m_modelIndexBuffer->Map(0, &readRange, (void**)&pIndexDataBegin));
-        memcpy(pIndexDataBegin, pendingIndices.data(), indexBufferSizeInBytes);
-        m_modelIndexBuffer->Unmap(0, nullptr);
-        m_modelIndexCount = pendingIndices.size();
-
-        // Initialize the index buffer view.
-        m_modelIndexBufferView.BufferLocation = m_modelIndexBuffer->GetGPUVirtualAddress();
-        m_modelIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-        m_modelIndexBufferView.SizeInBytes = indexBufferSizeInBytes;
+        m_modelParts.push_back(part);
     }
 
+    // Initialize the vertex buffer view.
+    m_modelVertexBufferView.BufferLocation = m_modelVertexBuffer->GetGPUVirtualAddress();
+    m_modelVertexBufferView.StrideInBytes = (UINT)VertexQuantization::GetVertexSize(m_modelVertexFormat);
+    m_modelVertexBufferView.SizeInBytes = vertexBufferSizeInBytes;
+
+    // Initialize the index buffer view.
+    m_modelIndexBufferView.BufferLocation = m_modelIndexBuffer->GetGPUVirtualAddress();
+    m_modelIndexBufferView.Format = GetDxgiIndexFormat(m_modelIndexFormat);
+    m_modelIndexBufferView.SizeInBytes = indexBufferSizeInBytes;
+}
+
+void D3D12HelloTriangle::UpdateModelWithPendings()
+{
+    UsePendingModelBuffers();
+
     // Reset command allocator and list before doing any GPU work
     ThrowIfFailed(m_commandAllocator->Reset());
     ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), nullptr));
 
-    AccelerationStructureBuffers modelBottomLevelBuffers = CreateBottomLevelAS({ { m_modelVertexBuffer.Get(), m_modelVertexCount } }, { { m_modelIndexBuffer.Get(), m_modelIndexCount } });
+    std::vector<AccelerationStructureBuffers> modelBottomLevelBuffers = CreateModelLodBottomLevelAS();
     AccelerationStructureBuffers planeBottomLevelBuffers = CreateBottomLevelAS({ { m_planeBuffer.Get(), 6 } });
 
     // Ensure BLAS creation is done before moving onto TLAS
@@ -1536,14 +1627,12 @@ void D3D12HelloTriangle::UpdateModelWithPendings()
     ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent));
     WaitForSingleObject(m_fenceEvent, INFINITE);
 
-    m_instances = { TLASParams(modelBottomLevelBuffers.pResult, XMMatrixIdentity(), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(-5.0f, 0.0f, -5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(5.0f, 0.0f, -5.0f), 0, 0),
-                    TLASParams(modelBottomLevelBuffers.pResult, XMMatrixTranslation(5.0f, 0.0f, 5.0f), 0, 0),
-                    TLASParams(planeBottomLevelBuffers.pResult, XMMatrixIdentity(), 2, 0),
-    };
+    CreateSceneInstances(planeBottomLevelBuffers.pResult);
+    m_bottomLevelAS = m_modelParts[0].lods[0].blas;
+    //The number of instances and materials depends on the parts of the model, so their buffers are made again.
+    CreateInstancePropertiesBuffer();
+    UpdateInstancePropertiesBuffer();
+    CreateMaterialsBuffer();
 
     // Rebuild TLAS
     CreateTopLevelAS(m_instances);
@@ -1567,30 +1656,77 @@ void D3D12HelloTriangle::UpdateModelWithPendings()
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
 }
 
-void D3D12HelloTriangle::QueueModelVertexAndIndexBufferUpdates(std::vector<XMFLOAT3>& vertexPoints, std::vector<UINT>& indices)
+bool D3D12HelloTriangle::CreatePendingModelBuffers(const MeshCache::Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices, const std::vector<MeshCache::Lod>& lods,
+    const std::vector<MeshCache::Part>& parts, const std::vector<MeshCache::Material>& modelMaterials)
 {
-     //Update the vertex and index buffers
-     {
-        std::vector<Vertex> vertices;
-        vertices.reserve(vertexPoints.size());
-        for (XMFLOAT3& vertexPoint : vertexPoints)
-        {
-            vertices.push_back(Vertex(vertexPoint));
-        }
+    //Creating committed resources is free threaded, so the upload buffers are made and filled here instead of on the render thread.
+    const VertexQuantization::Format vertexFormat = quantizeModelVertices ?
+        VertexQuantization::ChooseFormat(vertices, vertexCount, indices.data(), indices.size()) : VertexQuantization::Format::Float;
+    const VertexQuantization::Bounds bounds = VertexQuantization::ComputeBounds(vertices, vertexCount);
+    const float* halfExtent = bounds.halfExtent;
+    pendingBoundingSphere = XMFLOAT4(bounds.center[0], bounds.center[1], bounds.center[2],
+        sqrtf(halfExtent[0] * halfExtent[0] + halfExtent[1] * halfExtent[1] + halfExtent[2] * halfExtent[2]));
+    pendingLods = lods;
+    if (pendingLods.empty())
+    {
+        pendingLods.push_back({ 0, (uint32_t)indices.size(), 0.0f });
+    }
+    pendingParts = parts;
+    if (pendingParts.empty())
+    {
+        pendingParts.push_back({ 0, (uint32_t)pendingLods.size(), MeshCache::NoMaterial });
+    }
+    pendingMaterials = modelMaterials;
+    const UINT vertexBufferSizeInBytes = ROUND_UP(vertexCount * VertexQuantization::GetVertexSize(vertexFormat), 256);
+    const IndexPacking::Format indexFormat = IndexPacking::ChooseFormat(vertexCount);
+    const UINT indexBufferSizeInBytes = ROUND_UP((UINT)IndexPacking::GetPackedSize(indices.size(), indexFormat), 256);
+    pendingVertexBuffer = nv_helpers_dx12::CreateBuffer(m_device.Get(), vertexBufferSizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+    pendingIndexBuffer = nv_helpers_dx12::CreateBuffer(m_device.Get(), indexBufferSizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
 
-        ComputeVertexNormals(vertices, indices);
+    // Copy the triangle data to the vertex buffer.
+    UINT8* pVertexDataBegin;
+    CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
+    ThrowIfFailed(pendingVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
+    VertexQuantization::Encode(vertices, vertexCount, vertexFormat, bounds, pVertexDataBegin);
+    pendingVertexBuffer->Unmap(0, nullptr);
+    pendingVertexCount = (UINT)vertexCount;
+    pendingVertexFormat = vertexFormat;
+
+    //The BLAS is built from the snorm positions, this transform scales them back to the size of the model.
+    VertexQuantization::GetDequantizationTransform(bounds, pendingDequantization);
+    pendingTransformBuffer.Reset();
+    if (vertexFormat == VertexQuantization::Format::Quantized)
+    {
+        pendingTransformBuffer = nv_helpers_dx12::CreateBuffer(m_device.Get(), 256, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+        float* pTransform;
+        ThrowIfFailed(pendingTransformBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pTransform)));
+        memcpy(pTransform, pendingDequantization, sizeof(pendingDequantization));
+        pendingTransformBuffer->Unmap(0, nullptr);
+    }
 
-        //Clear all the data that might exist on the pending buffers.
-        pendingVertices.clear();
-        pendingIndices.clear();
-        for (Vertex& v : vertices)
-        {
-            pendingVertices.push_back(v);
-        }
-        for (UINT& index : indices)
-        {
-            pendingIndices.push_back(index);
-        }
-        pendingModelUpdate = true;
-     }
+    // Copy the triangle data to the index buffer.
+    UINT8* pIndexDataBegin;
+    ThrowIfFailed(pendingIndexBuffer->Map(0, &readRange, (void**)&pIndexDataBegin));
+    IndexPacking::Pack(indices.data(), indices.size(), indexFormat, pIndexDataBegin);
+    pendingIndexBuffer->Unmap(0, nullptr);
+    pendingIndexCount = (UINT)indices.size();
+    pendingIndexFormat = indexFormat;
+    return true;
+}
+
+DXGI_FORMAT D3D12HelloTriangle::GetDxgiIndexFormat(IndexPacking::Format format)
+{
+    return format == IndexPacking::Format::UInt16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+DXGI_FORMAT D3D12HelloTriangle::GetDxgiVertexFormat(VertexQuantization::Format format)
+{
+    //The BLAS ignores the fourth component of the quantized position.
+    return format == VertexQuantization::Format::Quantized ? DXGI_FORMAT_R16G16B16A16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+}
+
+void* D3D12HelloTriangle::GetMeshConstants(IndexPacking::Format indexFormat, VertexQuantization::Format vertexFormat)
+{
+    //The two root constants share one 8 byte shader record entry, indexSize first.
+    return (void*)(((uint64_t)vertexFormat << 32) | (uint64_t)indexFormat);
 }
@@ -0,0 +1,1299 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "GLTF_FileManager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    const uint32_t NoMaterial = MeshCache::NoMaterial;
+    const uint32_t GlbMagic = 0x46546C67; //"glTF"
+    const uint32_t GlbJsonChunk = 0x4E4F534A; //"JSON"
+    const uint32_t GlbBinaryChunk = 0x004E4942; //"BIN"
+
+    //glTF component types
+    const int ComponentByte = 5120;
+    const int ComponentUnsignedByte = 5121;
+    const int ComponentShort = 5122;
+    const int ComponentUnsignedShort = 5123;
+    const int ComponentUnsignedInt = 5125;
+    const int ComponentFloat = 5126;
+    const int ModeTriangles = 4;
+
+    //Nested arrays and objects deeper than this make the document invalid instead of overflowing the stack.
+    const int MaxJsonDepth = 64;
+
+    struct JsonValue
+    {
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> items;
+        std::vector<std::pair<std::string, JsonValue>> members;
+
+        //Returns the member with the given key, or nullptr if this isn't an object or has no such member.
+        const JsonValue* Find(const char* key) const
+        {
+            for (const std::pair<std::string, JsonValue>& member : members)
+            {
+                if (member.first == key)
+                {
+                    return &member.second;
+                }
+            }
+            return nullptr;
+        }
+
+        //Returns the items of an array member, or nullptr if there is no such array.
+        const std::vector<JsonValue>* FindArray(const char* key) const
+        {
+            const JsonValue* value = Find(key);
+            return value != nullptr && value->type == Type::Array ? &value->items : nullptr;
+        }
+
+        double GetNumber(const char* key, double defaultValue) const
+        {
+            const JsonValue* value = Find(key);
+            return value != nullptr && value->type == Type::Number ? value->number : defaultValue;
+        }
+
+        //Reads a non-negative integer member, which is how glTF references other objects.
+        bool GetIndex(const char* key, uint32_t& index) const
+        {
+            const JsonValue* value = Find(key);
+            if (value == nullptr || value->type != Type::Number || value->number < 0.0 || value->number >= (double)UINT32_MAX || value->number != std::floor(value->number))
+            {
+                return false;
+            }
+            index = (uint32_t)value->number;
+            return true;
+        }
+    };
+
+    //Recursive descent parser for the JSON part of a glTF file.
+    class JsonParser
+    {
+    public:
+        JsonParser(const char* begin, const char* end) : cursor(begin), end(end), depth(0)
+        {
+        }
+
+        bool ParseDocument(JsonValue& value)
+        {
+            if (!ParseValue(value))
+            {
+                return false;
+            }
+            SkipWhitespace();
+            return cursor == end;
+        }
+
+    private:
+        const char* cursor;
+        const char* end;
+        int depth;
+
+        void SkipWhitespace()
+        {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            {
+                cursor++;
+            }
+        }
+
+        bool ParseLiteral(const char* literal)
+        {
+            size_t length = strlen(literal);
+            if ((size_t)(end - cursor) < length || memcmp(cursor, literal, length) != 0)
+            {
+                return false;
+            }
+            cursor += length;
+            return true;
+        }
+
+        bool ParseValue(JsonValue& value)
+        {
+            SkipWhitespace();
+            if (cursor >= end)
+            {
+                return false;
+            }
+            switch (*cursor)
+            {
+            case '{':
+                return ParseObject(value);
+            case '[':
+                return ParseArray(value);
+            case '"':
+                value.type = JsonValue::Type::String;
+                return ParseString(value.string);
+            case 't':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return ParseLiteral("true");
+            case 'f':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = false;
+                return ParseLiteral("false");
+            case 'n':
+                value.type = JsonValue::Type::Null;
+                return ParseLiteral("null");
+            default:
+                value.type = JsonValue::Type::Number;
+                return ParseNumber(value.number);
+            }
+        }
+
+        bool ParseNumber(double& number)
+        {
+            //strtod needs a terminated string, a number is never longer than this in practice.
+            char buffer[64];
+            size_t length = 0;
+            while (cursor + length < end && length + 1 < sizeof(buffer) && strchr("+-0123456789.eE", cursor[length]) != nullptr && cursor[length] != '\0')
+            {
+                buffer[length] = cursor[length];
+                length++;
+            }
+            buffer[length] = '\0';
+            char* numberEnd = nullptr;
+            number = strtod(buffer, &numberEnd);
+            if (length == 0 || numberEnd != buffer + length)
+            {
+                return false;
+            }
+            cursor += length;
+            return true;
+        }
+
+        static void AppendUtf8(std::string& text, uint32_t codePoint)
+        {
+            if (codePoint < 0x80)
+            {
+                text += (char)codePoint;
+            }
+            else if (codePoint < 0x800)
+            {
+                text += (char)(0xC0 | (codePoint >> 6));
+                text += (char)(0x80 | (codePoint & 0x3F));
+            }
+            else if (codePoint < 0x10000)
+            {
+                text += (char)(0xE0 | (codePoint >> 12));
+                text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                text += (char)(0x80 | (codePoint & 0x3F));
+            }
+            else
+            {
+                text += (char)(0xF0 | (codePoint >> 18));
+                text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                text += (char)(0x80 | (codePoint & 0x3F));
+            }
+        }
+
+        bool ParseHex4(uint32_t& value)
+        {
+            if (end - cursor < 4)
+            {
+                return false;
+            }
+            value = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char c = *cursor++;
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                {
+                    value |= (uint32_t)(c - '0');
+                }
+                else if (c >= 'a' && c <= 'f')
+                {
+                    value |= (uint32_t)(c - 'a' + 10);
+                }
+                else if (c >= 'A' && c <= 'F')
+                {
+                    value |= (uint32_t)(c - 'A' + 10);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool ParseString(std::string& text)
+        {
+            cursor++; //Opening quote
+            text.clear();
+            while (cursor < end && *cursor != '"')
+            {
+                if (*cursor != '\\')
+                {
+                    text += *cursor++;
+                    continue;
+                }
+                cursor++;
+                if (cursor >= end)
+                {
+                    return false;
+                }
+                char escaped = *cursor++;
+                switch (escaped)
+                {
+                case '"': text += '"'; break;
+                case '\\': text += '\\'; break;
+                case '/': text += '/'; break;
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u':
+                {
+                    uint32_t codePoint;
+                    if (!ParseHex4(codePoint))
+                    {
+                        return false;
+                    }
+                    //A high surrogate is followed by the low surrogate of the same character.
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - cursor >= 6 && cursor[0] == '\\' && cursor[1] == 'u')
+                    {
+                        cursor += 2;
+                        uint32_t low;
+                        if (!ParseHex4(low))
+                        {
+                            return false;
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    AppendUtf8(text, codePoint);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            if (cursor >= end)
+            {
+                return false;
+            }
+            cursor++; //Closing quote
+            return true;
+        }
+
+        bool ParseArray(JsonValue& value)
+        {
+            if (++depth > MaxJsonDepth)
+            {
+                return false;
+            }
+            value.type = JsonValue::Type::Array;
+            cursor++;
+            SkipWhitespace();
+            if (cursor < end && *cursor == ']')
+            {
+                cursor++;
+                depth--;
+                return true;
+            }
+            while (true)
+            {
+                value.items.emplace_back();
+                if (!ParseValue(value.items.back()))
+                {
+                    return false;
+                }
+                SkipWhitespace();
+                if (cursor < end && *cursor == ',')
+                {
+                    cursor++;
+                    continue;
+                }
+                if (cursor < end && *cursor == ']')
+                {
+                    cursor++;
+                    depth--;
+                    return true;
+                }
+                return false;
+            }
+        }
+
+        bool ParseObject(JsonValue& value)
+        {
+            if (++depth > MaxJsonDepth)
+            {
+                return false;
+            }
+            value.type = JsonValue::Type::Object;
+            cursor++;
+            SkipWhitespace();
+            if (cursor < end && *cursor == '}')
+            {
+                cursor++;
+                depth--;
+                return true;
+            }
+            while (true)
+            {
+                SkipWhitespace();
+                if (cursor >= end || *cursor != '"')
+                {
+                    return false;
+                }
+                value.members.emplace_back();
+                if (!ParseString(value.members.back().first))
+                {
+                    return false;
+                }
+                SkipWhitespace();
+                if (cursor >= end || *cursor != ':')
+                {
+                    return false;
+                }
+                cursor++;
+                if (!ParseValue(value.members.back().second))
+                {
+                    return false;
+                }
+                SkipWhitespace();
+                if (cursor < end && *cursor == ',')
+                {
+                    cursor++;
+                    continue;
+                }
+                if (cursor < end && *cursor == '}')
+                {
+                    cursor++;
+                    depth--;
+                    return true;
+                }
+                return false;
+            }
+        }
+    };
+
+    inline uint32_t Read32(const char* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    bool DecodeBase64(const char* text, size_t length, std::vector<char>& bytes)
+    {
+        auto decodeCharacter = [](char c) -> int
+        {
+            if (c >= 'A' && c <= 'Z') return c - 'A';
+            if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if (c >= '0' && c <= '9') return c - '0' + 52;
+            if (c == '+') return 62;
+            if (c == '/') return 63;
+            return -1;
+        };
+        bytes.clear();
+        bytes.reserve(length / 4 * 3);
+        uint32_t accumulator = 0;
+        int bitCount = 0;
+        for (size_t i = 0; i < length && text[i] != '='; i++)
+        {
+            int value = decodeCharacter(text[i]);
+            if (value < 0)
+            {
+                return false;
+            }
+            accumulator = (accumulator << 6) | (uint32_t)value;
+            bitCount += 6;
+            if (bitCount >= 8)
+            {
+                bitCount -= 8;
+                bytes.push_back((char)((accumulator >> bitCount) & 0xFF));
+            }
+        }
+        return true;
+    }
+
+    //URIs of external files may have percent encoded characters like %20 for spaces.
+    std::string DecodeUri(const std::string& uri)
+    {
+        std::string decoded;
+        for (size_t i = 0; i < uri.size(); i++)
+        {
+            if (uri[i] == '%' && i + 2 < uri.size())
+            {
+                char hex[3] = { uri[i + 1], uri[i + 2], '\0' };
+                char* hexEnd = nullptr;
+                long value = strtol(hex, &hexEnd, 16);
+                if (hexEnd == hex + 2)
+                {
+                    decoded += (char)value;
+                    i += 2;
+                    continue;
+                }
+            }
+            decoded += uri[i];
+        }
+        return decoded;
+    }
+
+    struct BufferView
+    {
+        const char* data;
+        size_t byteLength;
+        size_t byteStride;
+    };
+
+    struct Accessor
+    {
+        //Null for an accessor without a buffer view, whose elements are all zero.
+        const char* data;
+        size_t stride;
+        size_t count;
+        int componentType;
+        int componentCount;
+        bool normalized;
+    };
+
+    size_t GetComponentSize(int componentType)
+    {
+        switch (componentType)
+        {
+        case ComponentByte:
+        case ComponentUnsignedByte:
+            return 1;
+        case ComponentShort:
+        case ComponentUnsignedShort:
+            return 2;
+        case ComponentUnsignedInt:
+        case ComponentFloat:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    int GetComponentCount(const std::string& type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT2") return 4;
+        if (type == "MAT3") return 9;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    //Reads one component as a float, applying the normalization of integer components.
+    inline float ReadComponent(const char* p, int componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case ComponentFloat:
+        {
+            float value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+        case ComponentByte:
+        {
+            float value = (float)*reinterpret_cast<const int8_t*>(p);
+            return normalized ? std::max(value / 127.0f, -1.0f) : value;
+        }
+        case ComponentUnsignedByte:
+        {
+            float value = (float)*reinterpret_cast<const uint8_t*>(p);
+            return normalized ? value / 255.0f : value;
+        }
+        case ComponentShort:
+        {
+            int16_t component;
+            memcpy(&component, p, sizeof(component));
+            return normalized ? std::max((float)component / 32767.0f, -1.0f) : (float)component;
+        }
+        case ComponentUnsignedShort:
+        {
+            uint16_t component;
+            memcpy(&component, p, sizeof(component));
+            return normalized ? (float)component / 65535.0f : (float)component;
+        }
+        default:
+        {
+            uint32_t component = Read32(p);
+            return normalized ? (float)((double)component / 4294967295.0) : (float)component;
+        }
+        }
+    }
+
+    inline uint32_t ReadIndex(const char* p, int componentType)
+    {
+        switch (componentType)
+        {
+        case ComponentUnsignedByte:
+            return *reinterpret_cast<const uint8_t*>(p);
+        case ComponentUnsignedShort:
+        {
+            uint16_t index;
+            memcpy(&index, p, sizeof(index));
+            return index;
+        }
+        default:
+            return Read32(p);
+        }
+    }
+
+    //Reads the first three components of an element.
+    inline void ReadVector3(const Accessor& accessor, size_t element, float value[3])
+    {
+        if (accessor.data == nullptr)
+        {
+            value[0] = value[1] = value[2] = 0.0f;
+            return;
+        }
+        const char* p = accessor.data + element * accessor.stride;
+        size_t componentSize = GetComponentSize(accessor.componentType);
+        for (int i = 0; i < 3; i++)
+        {
+            value[i] = ReadComponent(p + i * componentSize, accessor.componentType, accessor.normalized);
+        }
+    }
+
+    bool IsAligned(const void* p, size_t alignment)
+    {
+        return ((uintptr_t)p & (alignment - 1)) == 0;
+    }
+
+    //Matrices are 16 floats in the row vector layout of DirectXMath, which is how glTF stores its column vector matrices.
+    void MultiplyMatrices(const float a[16], const float b[16], float result[16])
+    {
+        float product[16];
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                product[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] + a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+            }
+        }
+        memcpy(result, product, sizeof(product));
+    }
+
+    bool ReadNumbers(const JsonValue* value, float* numbers, size_t count)
+    {
+        if (value == nullptr || value->type != JsonValue::Type::Array || value->items.size() != count)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (value->items[i].type != JsonValue::Type::Number)
+            {
+                return false;
+            }
+            numbers[i] = (float)value->items[i].number;
+        }
+        return true;
+    }
+
+    //Local transform of a node, either its matrix or its translation, rotation and scale.
+    void GetLocalTransform(const JsonValue& node, float transform[16])
+    {
+        if (ReadNumbers(node.Find("matrix"), transform, 16))
+        {
+            return;
+        }
+        float translation[3] = { 0.0f, 0.0f, 0.0f };
+        float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        float scale[3] = { 1.0f, 1.0f, 1.0f };
+        ReadNumbers(node.Find("translation"), translation, 3);
+        ReadNumbers(node.Find("rotation"), rotation, 4);
+        ReadNumbers(node.Find("scale"), scale, 3);
+        const float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+        //The rows are the scaled axes of the rotation, the last row is the translation.
+        const float rows[3][3] = {
+            { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w) },
+            { 2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w) },
+            { 2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y) },
+        };
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                transform[row * 4 + column] = rows[row][column] * scale[row];
+            }
+            transform[row * 4 + 3] = 0.0f;
+        }
+        transform[12] = translation[0];
+        transform[13] = translation[1];
+        transform[14] = translation[2];
+        transform[15] = 1.0f;
+    }
+
+    MeshCache::Material ConvertMaterial(const JsonValue& material)
+    {
+        MeshCache::Material converted = { { 1.0f, 1.0f, 1.0f }, 1.0f, 1.0f, 0.0f };
+        auto saturate = [](double value) { return (float)std::min(1.0, std::max(0.0, value)); };
+        const JsonValue* pbr = material.Find("pbrMetallicRoughness");
+        if (pbr != nullptr)
+        {
+            float baseColor[4];
+            if (ReadNumbers(pbr->Find("baseColorFactor"), baseColor, 4))
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    converted.albedo[i] = saturate(baseColor[i]);
+                }
+            }
+            converted.metallic = saturate(pbr->GetNumber("metallicFactor", 1.0));
+            converted.roughness = saturate(pbr->GetNumber("roughnessFactor", 1.0));
+        }
+        converted.reflectivity = converted.metallic * (1.0f - converted.roughness);
+        //Files written by WriteGlb() keep the reflectivity of the renderer in the extras of the material.
+        const JsonValue* extras = material.Find("extras");
+        if (extras != nullptr)
+        {
+            converted.reflectivity = saturate(extras->GetNumber("reflectivity", converted.reflectivity));
+        }
+        return converted;
+    }
+}
+
+struct GLTFFileManager::Document
+{
+    JsonValue root;
+};
+
+GLTFFileManager::GLTFFileManager()
+{
+}
+
+GLTFFileManager::~GLTFFileManager()
+{
+    Close();
+}
+
+bool GLTFFileManager::Load(const std::string& path)
+{
+    Close();
+    if (!file.Open(path))
+    {
+        return false;
+    }
+    size_t folderEnd = path.find_last_of("/\\");
+    const std::string folder = folderEnd == std::string::npos ? std::string() : path.substr(0, folderEnd + 1);
+
+    //A .glb file is a 12 byte header followed by a JSON chunk and an optional binary chunk, a .gltf file is only the JSON.
+    const char* json = file.Data();
+    size_t jsonSize = file.Size();
+    const char* binaryChunk = nullptr;
+    size_t binaryChunkSize = 0;
+    if (file.Size() >= 12 && Read32(file.Data()) == GlbMagic)
+    {
+        uint32_t version = Read32(file.Data() + 4);
+        uint32_t length = Read32(file.Data() + 8);
+        if (version != 2 || length > file.Size())
+        {
+            Close();
+            return false;
+        }
+        json = nullptr;
+        size_t offset = 12;
+        while (offset + 8 <= length)
+        {
+            uint32_t chunkLength = Read32(file.Data() + offset);
+            uint32_t chunkType = Read32(file.Data() + offset + 4);
+            offset += 8;
+            if (chunkLength > length - offset)
+            {
+                Close();
+                return false;
+            }
+            if (chunkType == GlbJsonChunk && json == nullptr)
+            {
+                json = file.Data() + offset;
+                jsonSize = chunkLength;
+            }
+            else if (chunkType == GlbBinaryChunk && binaryChunk == nullptr)
+            {
+                binaryChunk = file.Data() + offset;
+                binaryChunkSize = chunkLength;
+            }
+            //Chunks are padded to 4 bytes, so the data of every chunk stays 4 byte aligned.
+            offset += (chunkLength + 3) & ~3u;
+        }
+        if (json == nullptr)
+        {
+            Close();
+            return false;
+        }
+    }
+
+    Document document;
+    JsonParser parser(json, json + jsonSize);
+    if (!parser.ParseDocument(document.root) || document.root.type != JsonValue::Type::Object || !LoadDocument(document, folder, binaryChunk, binaryChunkSize))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool GLTFFileManager::LoadDocument(const Document& document, const std::string& folder, const char* binaryChunk, size_t binaryChunkSize)
+{
+    const JsonValue& root = document.root;
+    const std::vector<JsonValue> none;
+    auto getArray = [&root, &none](const char* key) -> const std::vector<JsonValue>&
+    {
+        const std::vector<JsonValue>* items = root.FindArray(key);
+        return items != nullptr ? *items : none;
+    };
+
+    //Buffers: the binary chunk of a .glb file, a data URI or a file beside the .gltf file.
+    std::vector<std::pair<const char*, size_t>> buffers;
+    for (const JsonValue& buffer : getArray("buffers"))
+    {
+        size_t byteLength = (size_t)buffer.GetNumber("byteLength", 0.0);
+        const JsonValue* uri = buffer.Find("uri");
+        const char* data = nullptr;
+        size_t size = 0;
+        if (uri == nullptr || uri->type != JsonValue::Type::String)
+        {
+            //Only the first buffer can be the binary chunk.
+            if (!buffers.empty() || binaryChunk == nullptr)
+            {
+                return false;
+            }
+            data = binaryChunk;
+            size = binaryChunkSize;
+        }
+        else if (uri->string.compare(0, 5, "data:") == 0)
+        {
+            size_t comma = uri->string.find(',');
+            if (comma == std::string::npos || uri->string.rfind(";base64", comma) == std::string::npos)
+            {
+                return false;
+            }
+            decodedBuffers.emplace_back();
+            if (!DecodeBase64(uri->string.data() + comma + 1, uri->string.size() - comma - 1, decodedBuffers.back()))
+            {
+                return false;
+            }
+            data = decodedBuffers.back().data();
+            size = decodedBuffers.back().size();
+        }
+        else
+        {
+            bufferFiles.push_back(std::make_unique<MemoryMappedFile>());
+            if (!bufferFiles.back()->Open(folder + DecodeUri(uri->string)))
+            {
+                return false;
+            }
+            data = bufferFiles.back()->Data();
+            size = bufferFiles.back()->Size();
+        }
+        if (byteLength > size)
+        {
+            return false;
+        }
+        buffers.push_back({ data, byteLength });
+    }
+
+    std::vector<BufferView> bufferViews;
+    for (const JsonValue& view : getArray("bufferViews"))
+    {
+        uint32_t buffer;
+        if (!view.GetIndex("buffer", buffer) || buffer >= buffers.size())
+        {
+            return false;
+        }
+        size_t byteOffset = (size_t)view.GetNumber("byteOffset", 0.0);
+        size_t byteLength = (size_t)view.GetNumber("byteLength", 0.0);
+        if (byteOffset > buffers[buffer].second || byteLength > buffers[buffer].second - byteOffset)
+        {
+            return false;
+        }
+        bufferViews.push_back({ buffers[buffer].first + byteOffset, byteLength, (size_t)view.GetNumber("byteStride", 0.0) });
+    }
+
+    std::vector<Accessor> accessors;
+    for (const JsonValue& accessor : getArray("accessors"))
+    {
+        const JsonValue* type = accessor.Find("type");
+        Accessor parsed;
+        parsed.componentType = (int)accessor.GetNumber("componentType", 0.0);
+        parsed.componentCount = type != nullptr ? GetComponentCount(type->string) : 0;
+        parsed.count = (size_t)accessor.GetNumber("count", 0.0);
+        const JsonValue* normalized = accessor.Find("normalized");
+        parsed.normalized = normalized != nullptr && normalized->type == JsonValue::Type::Bool && normalized->boolean;
+        size_t elementSize = GetComponentSize(parsed.componentType) * parsed.componentCount;
+        if (elementSize == 0 || accessor.Find("sparse") != nullptr)
+        {
+            return false;
+        }
+        parsed.data = nullptr;
+        parsed.stride = elementSize;
+        uint32_t view;
+        if (accessor.GetIndex("bufferView", view))
+        {
+            if (view >= bufferViews.size())
+            {
+                return false;
+            }
+            size_t byteOffset = (size_t)accessor.GetNumber("byteOffset", 0.0);
+            parsed.stride = bufferViews[view].byteStride != 0 ? bufferViews[view].byteStride : elementSize;
+            //The last element has to end inside the buffer view.
+            if (parsed.count > 0 && (byteOffset > bufferViews[view].byteLength ||
+                (parsed.count - 1) * parsed.stride + elementSize > bufferViews[view].byteLength - byteOffset))
+            {
+                return false;
+            }
+            parsed.data = bufferViews[view].data + byteOffset;
+        }
+        accessors.push_back(parsed);
+    }
+
+    for (const JsonValue& material : getArray("materials"))
+    {
+        materials.push_back(ConvertMaterial(material));
+    }
+
+    for (const JsonValue& mesh : getArray("meshes"))
+    {
+        Mesh parsedMesh = { (uint32_t)primitives.size(), 0 };
+        const std::vector<JsonValue>* meshPrimitives = mesh.FindArray("primitives");
+        for (size_t p = 0; meshPrimitives != nullptr && p < meshPrimitives->size(); p++)
+        {
+            //Points and lines are skipped, they don't go into an acceleration structure.
+            const JsonValue& primitive = (*meshPrimitives)[p];
+            const JsonValue* attributes = primitive.Find("attributes");
+            uint32_t positionAccessor;
+            if ((int)primitive.GetNumber("mode", ModeTriangles) != ModeTriangles || attributes == nullptr || !attributes->GetIndex("POSITION", positionAccessor))
+            {
+                continue;
+            }
+            uint32_t normalAccessor = UINT32_MAX;
+            attributes->GetIndex("NORMAL", normalAccessor);
+            if (positionAccessor >= accessors.size() || (normalAccessor != UINT32_MAX && normalAccessor >= accessors.size()))
+            {
+                return false;
+            }
+            const Accessor& positions = accessors[positionAccessor];
+            const Accessor* normals = normalAccessor != UINT32_MAX ? &accessors[normalAccessor] : nullptr;
+            if (positions.componentCount != 3 || (normals != nullptr && (normals->componentCount != 3 || normals->count != positions.count)))
+            {
+                return false;
+            }
+
+            Primitive parsed;
+            parsed.missingNormals = normals == nullptr;
+            //The vertices can be used in place when the normals follow the positions in the same 24 byte elements.
+            bool interleaved = normals != nullptr && positions.data != nullptr &&
+                positions.componentType == ComponentFloat && normals->componentType == ComponentFloat && !positions.normalized && !normals->normalized &&
+                positions.stride == sizeof(MeshCache::Vertex) && normals->stride == sizeof(MeshCache::Vertex) &&
+                normals->data == positions.data + 3 * sizeof(float) && IsAligned(positions.data, alignof(MeshCache::Vertex));
+            if (interleaved)
+            {
+                parsed.vertices = { reinterpret_cast<const MeshCache::Vertex*>(positions.data), positions.count };
+                parsed.verticesMapped = true;
+            }
+            else
+            {
+                convertedVertices.emplace_back(positions.count);
+                std::vector<MeshCache::Vertex>& vertices = convertedVertices.back();
+                for (size_t i = 0; i < positions.count; i++)
+                {
+                    ReadVector3(positions, i, vertices[i].position);
+                    if (normals != nullptr)
+                    {
+                        ReadVector3(*normals, i, vertices[i].normal);
+                    }
+                    else
+                    {
+                        vertices[i].normal[0] = 0.0f;
+                        vertices[i].normal[1] = 1.0f;
+                        vertices[i].normal[2] = 0.0f;
+                    }
+                }
+                parsed.vertices = { vertices.data(), vertices.size() };
+            }
+
+            uint32_t indexAccessor;
+            if (primitive.GetIndex("indices", indexAccessor))
+            {
+                if (indexAccessor >= accessors.size())
+                {
+                    return false;
+                }
+                const Accessor& indices = accessors[indexAccessor];
+                if (indices.componentCount != 1 || indices.data == nullptr ||
+                    (indices.componentType != ComponentUnsignedByte && indices.componentType != ComponentUnsignedShort && indices.componentType != ComponentUnsignedInt))
+                {
+                    return false;
+                }
+                //A trailing incomplete triangle isn't drawn.
+                size_t indexCount = indices.count / 3 * 3;
+                if (indices.componentType == ComponentUnsignedInt && indices.stride == sizeof(uint32_t) && IsAligned(indices.data, alignof(uint32_t)))
+                {
+                    parsed.indices = { reinterpret_cast<const uint32_t*>(indices.data), indexCount };
+                    parsed.indicesMapped = true;
+                }
+                else
+                {
+                    convertedIndices.emplace_back(indexCount);
+                    std::vector<uint32_t>& converted = convertedIndices.back();
+                    for (size_t i = 0; i < indexCount; i++)
+                    {
+                        converted[i] = ReadIndex(indices.data + i * indices.stride, indices.componentType);
+                    }
+                    parsed.indices = { converted.data(), converted.size() };
+                }
+                //Every index is checked once, the rest of the renderer trusts them.
+                for (uint32_t index : parsed.indices)
+                {
+                    if (index >= parsed.vertices.size)
+                    {
+                        return false;
+                    }
+                }
+            }
+            else
+            {
+                //Without indices every three vertices are a triangle.
+                convertedIndices.emplace_back(positions.count / 3 * 3);
+                std::vector<uint32_t>& converted = convertedIndices.back();
+                for (size_t i = 0; i < converted.size(); i++)
+                {
+                    converted[i] = (uint32_t)i;
+                }
+                parsed.indices = { converted.data(), converted.size() };
+            }
+
+            uint32_t material;
+            if (primitive.GetIndex("material", material))
+            {
+                if (material >= materials.size())
+                {
+                    return false;
+                }
+                parsed.material = material;
+            }
+            primitives.push_back(parsed);
+            parsedMesh.primitiveCount++;
+        }
+        meshes.push_back(parsedMesh);
+    }
+
+    //The instances are the nodes of the default scene that have a mesh. Without scenes, every node that isn't a child is a root.
+    const std::vector<JsonValue>& nodes = getArray("nodes");
+    std::vector<uint32_t> roots;
+    const std::vector<JsonValue>& scenes = getArray("scenes");
+    uint32_t scene = 0;
+    root.GetIndex("scene", scene);
+    if (scene < scenes.size())
+    {
+        const std::vector<JsonValue>* sceneNodes = scenes[scene].FindArray("nodes");
+        for (size_t i = 0; sceneNodes != nullptr && i < sceneNodes->size(); i++)
+        {
+            double node = (*sceneNodes)[i].number;
+            if (node < 0.0 || node >= (double)nodes.size())
+            {
+                return false;
+            }
+            roots.push_back((uint32_t)node);
+        }
+    }
+    else
+    {
+        std::vector<bool> isChild(nodes.size(), false);
+        for (const JsonValue& node : nodes)
+        {
+            const std::vector<JsonValue>* children = node.FindArray("children");
+            for (size_t i = 0; children != nullptr && i < children->size(); i++)
+            {
+                double child = (*children)[i].number;
+                if (child >= 0.0 && child < (double)nodes.size())
+                {
+                    isChild[(size_t)child] = true;
+                }
+            }
+        }
+        for (uint32_t node = 0; node < (uint32_t)nodes.size(); node++)
+        {
+            if (!isChild[node])
+            {
+                roots.push_back(node);
+            }
+        }
+    }
+
+    //Depth first over the node tree with the world transform of every node. A valid file has no cycles,
+    //a node that is reached more often than there are nodes means the file has one.
+    struct PendingNode
+    {
+        uint32_t node;
+        size_t depth;
+        float parentTransform[16];
+    };
+    std::vector<PendingNode> stack;
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it)
+    {
+        PendingNode pending = { *it, 0, { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+        stack.push_back(pending);
+    }
+    while (!stack.empty())
+    {
+        PendingNode pending = stack.back();
+        stack.pop_back();
+        if (pending.depth > nodes.size())
+        {
+            return false;
+        }
+        const JsonValue& node = nodes[pending.node];
+        float local[16];
+        GetLocalTransform(node, local);
+        Instance instance;
+        MultiplyMatrices(local, pending.parentTransform, instance.transform);
+        uint32_t mesh;
+        if (node.GetIndex("mesh", mesh))
+        {
+            if (mesh >= meshes.size())
+            {
+                return false;
+            }
+            instance.mesh = mesh;
+            instances.push_back(instance);
+        }
+        const std::vector<JsonValue>* children = node.FindArray("children");
+        for (size_t i = children != nullptr ? children->size() : 0; i > 0; i--)
+        {
+            double child = (*children)[i - 1].number;
+            if (child < 0.0 || child >= (double)nodes.size())
+            {
+                return false;
+            }
+            PendingNode childNode;
+            childNode.node = (uint32_t)child;
+            childNode.depth = pending.depth + 1;
+            memcpy(childNode.parentTransform, instance.transform, sizeof(instance.transform));
+            stack.push_back(childNode);
+        }
+    }
+    return true;
+}
+
+void GLTFFileManager::Close()
+{
+    primitives.clear();
+    meshes.clear();
+    instances.clear();
+    materials.clear();
+    convertedVertices.clear();
+    convertedIndices.clear();
+    decodedBuffers.clear();
+    bufferFiles.clear();
+    file.Close();
+}
+
+const std::vector<GLTFFileManager::Primitive>& GLTFFileManager::GetPrimitives() const
+{
+    return primitives;
+}
+
+const std::vector<GLTFFileManager::Mesh>& GLTFFileManager::GetMeshes() const
+{
+    return meshes;
+}
+
+const std::vector<GLTFFileManager::Instance>& GLTFFileManager::GetInstances() const
+{
+    return instances;
+}
+
+const std::vector<MeshCache::Material>& GLTFFileManager::GetMaterials() const
+{
+    return materials;
+}
+
+bool GLTFFileManager::IsGltfPath(const std::string& path)
+{
+    size_t extensionStart = path.find_last_of('.');
+    if (extensionStart == std::string::npos)
+    {
+        return false;
+    }
+    std::string extension = path.substr(extensionStart + 1);
+    for (char& c : extension)
+    {
+        c = (char)tolower((unsigned char)c);
+    }
+    return extension == "gltf" || extension == "glb";
+}
+
+bool GLTFFileManager::WriteGlb(const std::string& path, const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+    const MeshCache::Lod* lods, const MeshCache::Part* parts, size_t partCount, const MeshCache::Material* materials, size_t materialCount)
+{
+    //Without parts the whole index buffer is one part.
+    std::vector<MeshCache::Part> writtenParts(parts, parts + partCount);
+    std::vector<MeshCache::Lod> writtenLods;
+    if (writtenParts.empty() || lods == nullptr)
+    {
+        writtenParts = { { 0, 1, NoMaterial } };
+        writtenLods = { { 0, (uint32_t)indexCount, 0.0f } };
+        lods = writtenLods.data();
+    }
+
+    //The binary chunk holds the interleaved vertices followed by the indices of every part.
+    const size_t vertexBytes = vertexCount * sizeof(MeshCache::Vertex);
+    size_t writtenIndexCount = 0;
+    for (const MeshCache::Part& part : writtenParts)
+    {
+        writtenIndexCount += lods[part.firstLod].indexCount;
+    }
+    const size_t binaryLength = vertexBytes + writtenIndexCount * sizeof(uint32_t);
+
+    float minimum[3] = { 0.0f, 0.0f, 0.0f };
+    float maximum[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            minimum[axis] = i == 0 ? vertices[i].position[axis] : std::min(minimum[axis], vertices[i].position[axis]);
+            maximum[axis] = i == 0 ? vertices[i].position[axis] : std::max(maximum[axis], vertices[i].position[axis]);
+        }
+    }
+
+    //%.9g keeps every float exact when it is read back.
+    std::string json;
+    char number[64];
+    auto append = [&json](const char* text) { json += text; };
+    auto appendNumber = [&json, &number](double value)
+    {
+        snprintf(number, sizeof(number), "%.9g", value);
+        json += number;
+    };
+    append("{\"asset\":{\"version\":\"2.0\",\"generator\":\"RealTimeRayTracing\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],");
+    append("\"buffers\":[{\"byteLength\":");
+    appendNumber((double)binaryLength);
+    append("}],\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":");
+    appendNumber((double)vertexBytes);
+    append(",\"byteStride\":24,\"target\":34962},{\"buffer\":0,\"byteOffset\":");
+    appendNumber((double)vertexBytes);
+    append(",\"byteLength\":");
+    appendNumber((double)(writtenIndexCount * sizeof(uint32_t)));
+    append(",\"target\":34963}],\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"type\":\"VEC3\",\"count\":");
+    appendNumber((double)vertexCount);
+    append(",\"min\":[");
+    for (int axis = 0; axis < 3; axis++)
+    {
+        appendNumber(minimum[axis]);
+        append(axis < 2 ? "," : "],\"max\":[");
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        appendNumber(maximum[axis]);
+        append(axis < 2 ? "," : "]},");
+    }
+    append("{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"type\":\"VEC3\",\"count\":");
+    appendNumber((double)vertexCount);
+    append("}");
+    size_t indexOffset = 0;
+    for (const MeshCache::Part& part : writtenParts)
+    {
+        append(",{\"bufferView\":1,\"byteOffset\":");
+        appendNumber((double)(indexOffset * sizeof(uint32_t)));
+        append(",\"componentType\":5125,\"type\":\"SCALAR\",\"count\":");
+        appendNumber((double)lods[part.firstLod].indexCount);
+        append("}");
+        indexOffset += lods[part.firstLod].indexCount;
+    }
+    append("],\"meshes\":[{\"primitives\":[");
+    for (size_t p = 0; p < writtenParts.size(); p++)
+    {
+        append(p > 0 ? ",{" : "{");
+        append("\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":");
+        appendNumber((double)(2 + p));
+        if (writtenParts[p].material != NoMaterial && writtenParts[p].material < materialCount)
+        {
+            append(",\"material\":");
+            appendNumber(writtenParts[p].material);
+        }
+        append("}");
+    }
+    append("]}]");
+    if (materialCount > 0)
+    {
+        append(",\"materials\":[");
+        for (size_t m = 0; m < materialCount; m++)
+        {
+            const MeshCache::Material& material = materials[m];
+            append(m > 0 ? ",{" : "{");
+            append("\"pbrMetallicRoughness\":{\"baseColorFactor\":[");
+            for (int i = 0; i < 3; i++)
+            {
+                appendNumber(material.albedo[i]);
+                append(",");
+            }
+            append("1],\"metallicFactor\":");
+            appendNumber(material.metallic);
+            append(",\"roughnessFactor\":");
+            appendNumber(material.roughness);
+            append("},\"extras\":{\"reflectivity\":");
+            appendNumber(material.reflectivity);
+            append("}}");
+        }
+        append("]");
+    }
+    append("}");
+    //The JSON chunk is padded with spaces so the binary chunk starts 4 byte aligned.
+    while (json.size() % 4 != 0)
+    {
+        json += ' ';
+    }
+    const size_t paddedBinaryLength = (binaryLength + 3) & ~(size_t)3;
+    const size_t totalLength = 12 + 8 + json.size() + 8 + paddedBinaryLength;
+    if (totalLength > UINT32_MAX)
+    {
+        return false;
+    }
+
+    FILE* output = fopen(path.c_str(), "wb");
+    if (output == nullptr)
+    {
+        return false;
+    }
+    auto write32 = [output](uint32_t value) { return fwrite(&value, sizeof(value), 1, output) == 1; };
+    bool succeeded = write32(GlbMagic) && write32(2) && write32((uint32_t)totalLength);
+    succeeded = succeeded && write32((uint32_t)json.size()) && write32(GlbJsonChunk) && fwrite(json.data(), 1, json.size(), output) == json.size();
+    succeeded = succeeded && write32((uint32_t)paddedBinaryLength) && write32(GlbBinaryChunk);
+    succeeded = succeeded && fwrite(vertices, sizeof(MeshCache::Vertex), vertexCount, output) == vertexCount;
+    for (const MeshCache::Part& part : writtenParts)
+    {
+        const MeshCache::Lod& lod = lods[part.firstLod];
+        succeeded = succeeded && fwrite(indices + lod.firstIndex, sizeof(uint32_t), lod.indexCount, output) == lod.indexCount;
+    }
+    const char padding[4] = { 0, 0, 0, 0 };
+    succeeded = succeeded && fwrite(padding, 1, paddedBinaryLength - binaryLength, output) == paddedBinaryLength - binaryLength;
+    succeeded = fclose(output) == 0 && succeeded;
+    if (!succeeded)
+    {
+        remove(path.c_str());
+    }
+    return succeeded;
+}
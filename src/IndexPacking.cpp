@@ -0,0 +1,53 @@
+#include "IndexPacking.h"
+
+#include <cstring>
+
+IndexPacking::Format IndexPacking::ChooseFormat(size_t vertexCount)
+{
+    return vertexCount <= MaxUInt16VertexCount ? Format::UInt16 : Format::UInt32;
+}
+
+size_t IndexPacking::GetPackedSize(size_t indexCount, Format format)
+{
+    size_t size = indexCount * (size_t)format;
+    return (size + 3) & ~(size_t)3;
+}
+
+void IndexPacking::Pack(const uint32_t* indices, size_t indexCount, Format format, void* destination)
+{
+    //An empty mesh may not have an index array at all, and memcpy doesn't take a null pointer even for 0 bytes.
+    if (indexCount == 0)
+    {
+        return;
+    }
+    if (format == Format::UInt32)
+    {
+        memcpy(destination, indices, indexCount * sizeof(uint32_t));
+        return;
+    }
+
+    uint16_t* shortIndices = static_cast<uint16_t*>(destination);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        shortIndices[i] = (uint16_t)indices[i];
+    }
+    //An odd index count leaves half of the last 4 byte word unused.
+    if (indexCount % 2 == 1)
+    {
+        shortIndices[indexCount] = 0;
+    }
+}
+
+uint32_t IndexPacking::Unpack(const void* packed, Format format, size_t index)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(packed);
+    uint32_t word;
+    if (format == Format::UInt32)
+    {
+        memcpy(&word, bytes + index * 4, sizeof(word));
+        return word;
+    }
+    //Same as the shader: load the aligned 4 byte word that holds the index and pick its half.
+    memcpy(&word, bytes + ((index * 2) & ~(size_t)3), sizeof(word));
+    return (index & 1) ? (word >> 16) : (word & 0xFFFF);
+}
@@ -0,0 +1,145 @@
+#include "MemoryMappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFile::MemoryMappedFile()
+{
+    data = nullptr;
+    size = 0;
+    isOpen = false;
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    Close();
+}
+
+bool MemoryMappedFile::Open(const std::string& path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    isOpen = true;
+    //CreateFileMapping() fails for empty files, so an empty file is treated as an open file without any data.
+    if (fileSize.QuadPart == 0)
+    {
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+    mappingHandle = mapping;
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+    {
+        close(file);
+        return false;
+    }
+    isOpen = true;
+    //mmap() fails for empty files, so an empty file is treated as an open file without any data.
+    if (fileStat.st_size == 0)
+    {
+        close(file);
+        return true;
+    }
+    void* mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    //The mapping keeps its own reference to the file, so the descriptor is not needed anymore.
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        isOpen = false;
+        return false;
+    }
+    madvise(mapped, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapped);
+    size = (size_t)fileStat.st_size;
+#endif
+    return true;
+}
+
+void MemoryMappedFile::Close()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data != nullptr)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    isOpen = false;
+}
+
+const char* MemoryMappedFile::Data() const
+{
+    return data;
+}
+
+size_t MemoryMappedFile::Size() const
+{
+    return size;
+}
+
+bool MemoryMappedFile::IsOpen() const
+{
+    return isOpen;
+}
@@ -0,0 +1,456 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "MeshCache.h"
+#include "GLTF_FileManager.h"
+#include "MeshCodec.h"
+#include "OBJ_FileManager.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const char CacheMagic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+    //Layout of the start of a cache file. All the offsets are from the start of the file.
+    //The tables of the levels of detail, the parts and the materials follow the header in this order.
+    //The vertices and the indices are MeshCodec streams. The vertex stream ends where the index stream starts, the index stream at the end of the file.
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexStride;
+        uint64_t sourceSize;
+        uint64_t sourceHash;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t lodCount;
+        uint32_t partCount;
+        uint32_t materialCount;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(CacheHeader) == 72, "The cache header is part of the file format, its size must not change.");
+    static_assert(sizeof(MeshCache::Vertex) == 24, "The cached vertex is part of the file format, its size must not change.");
+    static_assert(sizeof(MeshCache::Lod) == 12, "The cached level of detail is part of the file format, its size must not change.");
+    static_assert(sizeof(MeshCache::Part) == 12, "The cached part is part of the file format, its size must not change.");
+    static_assert(sizeof(MeshCache::Material) == 24, "The cached material is part of the file format, its size must not change.");
+
+    uint64_t GetTablesSize(uint64_t lodCount, uint64_t partCount, uint64_t materialCount)
+    {
+        return lodCount * sizeof(MeshCache::Lod) + partCount * sizeof(MeshCache::Part) + materialCount * sizeof(MeshCache::Material);
+    }
+
+    size_t AlignToSection(size_t offset)
+    {
+        return (offset + MeshCache::SectionAlignment - 1) & ~(MeshCache::SectionAlignment - 1);
+    }
+
+    //XXH64 constants and helpers
+    const uint64_t Prime1 = 11400714785074694791ULL;
+    const uint64_t Prime2 = 14029467366897019727ULL;
+    const uint64_t Prime3 = 1609587929392839161ULL;
+    const uint64_t Prime4 = 9650029242287828579ULL;
+    const uint64_t Prime5 = 2870177450012600261ULL;
+
+    inline uint64_t RotateLeft(uint64_t value, int amount)
+    {
+        return (value << amount) | (value >> (64 - amount));
+    }
+
+    inline uint64_t Read64(const unsigned char* p)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t Read32(const unsigned char* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t Round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * Prime2;
+        accumulator = RotateLeft(accumulator, 31);
+        return accumulator * Prime1;
+    }
+
+    inline uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+    {
+        accumulator ^= Round(0, value);
+        return accumulator * Prime1 + Prime4;
+    }
+}
+
+MeshCache::MeshCache()
+{
+    sourceHash = 0;
+    sourceSize = 0;
+    sourceHashed = false;
+    vertices = nullptr;
+    vertexCount = 0;
+    indices = nullptr;
+    indexCount = 0;
+    lods = nullptr;
+    lodCount = 0;
+    parts = nullptr;
+    partCount = 0;
+    materials = nullptr;
+    materialCount = 0;
+}
+
+bool MeshCache::Open(const std::string& sourcePath, const std::string& cachePath)
+{
+    Close();
+    this->sourcePath = sourcePath;
+    this->cachePath = cachePath.empty() ? GetCachePath(sourcePath) : cachePath;
+    sourceHashed = false;
+
+    {
+        MemoryMappedFile source;
+        if (!source.Open(sourcePath))
+        {
+            return false;
+        }
+        sourceSize = source.Size();
+        sourceHash = HashBytes(source.Data(), source.Size());
+        //The materials are stored converted, so the material libraries of an OBJ file are part of the key as well:
+        //the name of every library and its contents, or the fact that it can't be read, are chained into the hash.
+        if (!GLTFFileManager::IsGltfPath(sourcePath))
+        {
+            size_t folderEnd = sourcePath.find_last_of("/\\");
+            const std::string folder = folderEnd == std::string::npos ? std::string() : sourcePath.substr(0, folderEnd + 1);
+            for (const std::string& library : OBJFileManager::FindMaterialLibraries(source.Data(), source.Size()))
+            {
+                sourceHash = HashBytes(library.data(), library.size(), sourceHash);
+                MemoryMappedFile libraryFile;
+                sourceHash = libraryFile.Open(folder + library) ? HashBytes(libraryFile.Data(), libraryFile.Size(), sourceHash) : ~sourceHash;
+            }
+        }
+        sourceHashed = true;
+    }
+    return MapCache(true);
+}
+
+bool MeshCache::OpenBaked(const std::string& cachePath)
+{
+    Close();
+    sourcePath.clear();
+    this->cachePath = cachePath;
+    sourceHashed = false;
+    return MapCache(false);
+}
+
+bool MeshCache::MapCache(bool checkSource)
+{
+    if (!file.Open(cachePath))
+    {
+        return false;
+    }
+
+    CacheHeader header;
+    if (file.Size() < sizeof(CacheHeader))
+    {
+        Close();
+        return false;
+    }
+    memcpy(&header, file.Data(), sizeof(CacheHeader));
+
+    bool valid = memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+        header.version == Version &&
+        header.vertexStride == sizeof(Vertex) &&
+        (!checkSource || (header.sourceSize == sourceSize && header.sourceHash == sourceHash)) &&
+        header.indexCount % 3 == 0 &&
+        header.vertexOffset % SectionAlignment == 0 &&
+        header.indexOffset % SectionAlignment == 0 &&
+        header.vertexOffset >= sizeof(CacheHeader) + GetTablesSize(header.lodCount, header.partCount, header.materialCount) &&
+        header.vertexOffset <= header.indexOffset &&
+        header.indexOffset <= file.Size();
+    const Lod* cachedLods = reinterpret_cast<const Lod*>(file.Data() + sizeof(CacheHeader));
+    const Part* cachedParts = reinterpret_cast<const Part*>(cachedLods + (valid ? header.lodCount : 0));
+    const Material* cachedMaterials = reinterpret_cast<const Material*>(cachedParts + (valid ? header.partCount : 0));
+    for (uint32_t i = 0; valid && i < header.lodCount; i++)
+    {
+        valid = cachedLods[i].firstIndex % 3 == 0 && cachedLods[i].indexCount % 3 == 0 &&
+            (uint64_t)cachedLods[i].firstIndex + cachedLods[i].indexCount <= header.indexCount;
+    }
+    for (uint32_t i = 0; valid && i < header.partCount; i++)
+    {
+        valid = cachedParts[i].lodCount > 0 && (uint64_t)cachedParts[i].firstLod + cachedParts[i].lodCount <= header.lodCount &&
+            (cachedParts[i].material == NoMaterial || cachedParts[i].material < header.materialCount);
+    }
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+    if (!checkSource)
+    {
+        sourceSize = header.sourceSize;
+        sourceHash = header.sourceHash;
+    }
+
+    //The vertices and indices are decoded, the tables are used in place. The mapping starts on a page boundary and the tables follow the header,
+    //so they are aligned.
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.Data());
+    decodedVertices.resize(header.vertexCount);
+    decodedIndices.resize(header.indexCount);
+    if (!MeshCodec::DecodeVertices(decodedVertices.data(), header.vertexCount, sizeof(Vertex), data + header.vertexOffset, header.indexOffset - header.vertexOffset) ||
+        !MeshCodec::DecodeIndices(decodedIndices.data(), header.indexCount, data + header.indexOffset, file.Size() - header.indexOffset))
+    {
+        Close();
+        return false;
+    }
+    //The codec only checks that the streams are well formed. An index past the last vertex would make the renderer read outside of
+    //the vertex buffer, so the cache is rejected like any other broken file.
+    uint32_t largestIndex = 0;
+    for (uint32_t index : decodedIndices)
+    {
+        largestIndex = std::max(largestIndex, index);
+    }
+    if (header.indexCount > 0 && largestIndex >= header.vertexCount)
+    {
+        Close();
+        return false;
+    }
+    vertices = decodedVertices.data();
+    vertexCount = header.vertexCount;
+    indices = decodedIndices.data();
+    indexCount = header.indexCount;
+    lods = header.lodCount > 0 ? cachedLods : nullptr;
+    lodCount = header.lodCount;
+    parts = header.partCount > 0 ? cachedParts : nullptr;
+    partCount = header.partCount;
+    materials = header.materialCount > 0 ? cachedMaterials : nullptr;
+    materialCount = header.materialCount;
+    return true;
+}
+
+void MeshCache::Close()
+{
+    file.Close();
+    decodedVertices.clear();
+    decodedVertices.shrink_to_fit();
+    decodedIndices.clear();
+    decodedIndices.shrink_to_fit();
+    vertices = nullptr;
+    vertexCount = 0;
+    indices = nullptr;
+    indexCount = 0;
+    lods = nullptr;
+    lodCount = 0;
+    parts = nullptr;
+    partCount = 0;
+    materials = nullptr;
+    materialCount = 0;
+}
+
+bool MeshCache::Write(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, const Lod* lods, size_t lodCount,
+    const Part* parts, size_t partCount, const Material* materials, size_t materialCount)
+{
+    if (!sourceHashed || vertexCount > UINT32_MAX || indexCount > UINT32_MAX || lodCount > UINT32_MAX || partCount > UINT32_MAX || materialCount > UINT32_MAX)
+    {
+        return false;
+    }
+
+    CacheHeader header = {};
+    memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = Version;
+    header.vertexStride = sizeof(Vertex);
+    header.sourceSize = sourceSize;
+    header.sourceHash = sourceHash;
+    header.vertexCount = (uint32_t)vertexCount;
+    header.indexCount = (uint32_t)indexCount;
+    header.lodCount = (uint32_t)lodCount;
+    header.partCount = (uint32_t)partCount;
+    header.materialCount = (uint32_t)materialCount;
+    std::vector<uint8_t> encodedVertices;
+    std::vector<uint8_t> encodedIndices;
+    MeshCodec::EncodeVertices(vertices, vertexCount, sizeof(Vertex), encodedVertices);
+    MeshCodec::EncodeIndices(indices, indexCount, encodedIndices);
+    header.vertexOffset = AlignToSection(sizeof(CacheHeader) + (size_t)GetTablesSize(lodCount, partCount, materialCount));
+    header.indexOffset = AlignToSection(header.vertexOffset + encodedVertices.size());
+
+    //The mapping of this cache has to be released before the file can be replaced on Windows.
+    Close();
+
+    const std::string temporaryPath = cachePath + ".tmp";
+    FILE* output = fopen(temporaryPath.c_str(), "wb");
+    if (output == nullptr)
+    {
+        return false;
+    }
+
+    const char padding[SectionAlignment] = { 0 };
+    size_t written = 0;
+    bool succeeded = fwrite(&header, sizeof(CacheHeader), 1, output) == 1;
+    written += sizeof(CacheHeader);
+    //A table can be left out (null with a count of 0), and fwrite() must not be given a null pointer even for nothing.
+    succeeded = succeeded && (lodCount == 0 || fwrite(lods, sizeof(Lod), lodCount, output) == lodCount);
+    written += lodCount * sizeof(Lod);
+    succeeded = succeeded && (partCount == 0 || fwrite(parts, sizeof(Part), partCount, output) == partCount);
+    written += partCount * sizeof(Part);
+    succeeded = succeeded && (materialCount == 0 || fwrite(materials, sizeof(Material), materialCount, output) == materialCount);
+    written += materialCount * sizeof(Material);
+    succeeded = succeeded && fwrite(padding, 1, header.vertexOffset - written, output) == header.vertexOffset - written;
+    written = header.vertexOffset;
+    succeeded = succeeded && fwrite(encodedVertices.data(), 1, encodedVertices.size(), output) == encodedVertices.size();
+    written += encodedVertices.size();
+    succeeded = succeeded && fwrite(padding, 1, header.indexOffset - written, output) == header.indexOffset - written;
+    succeeded = succeeded && fwrite(encodedIndices.data(), 1, encodedIndices.size(), output) == encodedIndices.size();
+    succeeded = fclose(output) == 0 && succeeded;
+
+    if (succeeded)
+    {
+        //rename() doesn't replace an existing file on Windows.
+        remove(cachePath.c_str());
+        succeeded = rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!succeeded)
+    {
+        remove(temporaryPath.c_str());
+    }
+    return succeeded;
+}
+
+const MeshCache::Vertex* MeshCache::GetVertices() const
+{
+    return vertices;
+}
+
+uint32_t MeshCache::GetVertexCount() const
+{
+    return vertexCount;
+}
+
+const uint32_t* MeshCache::GetIndices() const
+{
+    return indices;
+}
+
+uint32_t MeshCache::GetIndexCount() const
+{
+    return indexCount;
+}
+
+const MeshCache::Lod* MeshCache::GetLods() const
+{
+    return lods;
+}
+
+uint32_t MeshCache::GetLodCount() const
+{
+    return lodCount;
+}
+
+const MeshCache::Part* MeshCache::GetParts() const
+{
+    return parts;
+}
+
+uint32_t MeshCache::GetPartCount() const
+{
+    return partCount;
+}
+
+const MeshCache::Material* MeshCache::GetMaterials() const
+{
+    return materials;
+}
+
+uint32_t MeshCache::GetMaterialCount() const
+{
+    return materialCount;
+}
+
+void MeshCache::TakeStreams(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    vertices.swap(decodedVertices);
+    indices.swap(decodedIndices);
+    decodedVertices.clear();
+    decodedIndices.clear();
+    this->vertices = nullptr;
+    vertexCount = 0;
+    this->indices = nullptr;
+    indexCount = 0;
+}
+
+uint64_t MeshCache::GetSourceHash() const
+{
+    return sourceHash;
+}
+
+std::string MeshCache::GetCachePath(const std::string& sourcePath)
+{
+    //The extension stays, so model.obj and model.glb in the same folder get caches of their own.
+    return sourcePath + ".rtmesh";
+}
+
+uint64_t MeshCache::HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+        const unsigned char* limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        hash = MergeRound(hash, v1);
+        hash = MergeRound(hash, v2);
+        hash = MergeRound(hash, v3);
+        hash = MergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + Prime5;
+    }
+
+    hash += (uint64_t)size;
+
+    while (p + 8 <= end)
+    {
+        hash ^= Round(0, Read64(p));
+        hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= (uint64_t)Read32(p) * Prime1;
+        hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        hash ^= (*p) * Prime5;
+        hash = RotateLeft(hash, 11) * Prime1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,284 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE2
+#endif
+
+namespace
+{
+    const size_t GroupSize = 16;
+    const size_t BlockSize = MeshCodec::BlockVertexCount;
+    const size_t MaxWordCount = MeshCodec::MaxVertexSize / 4;
+    //Encoded size of a group for each of the 2 bit width codes: empty, 2 bits, 4 bits and 8 bits per byte.
+    const size_t GroupDataSize[4] = { 0, 4, 8, 16 };
+
+    inline uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline void Write32(uint8_t* p, uint32_t value)
+    {
+        memcpy(p, &value, sizeof(value));
+    }
+
+    inline uint64_t Read64(const uint8_t* p)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline void Write64(uint8_t* p, uint64_t value)
+    {
+        memcpy(p, &value, sizeof(value));
+    }
+
+    inline uint32_t ZigzagEncode(uint32_t delta)
+    {
+        return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+    }
+
+    inline uint32_t ZigzagDecode(uint32_t value)
+    {
+        return (value >> 1) ^ (0u - (value & 1));
+    }
+
+    //Appends a byte plane of groupCount groups: a 2 bit width code per group, four to a byte, followed by the data of the groups.
+    //The packing puts the bits of byte i of the group where the decoder's shifts and masks find them without moving bytes:
+    //with 2 bits, byte j of the data holds the bytes j, j + 4, j + 8 and j + 12 from the low bits up, with 4 bits it holds bytes j and j + 8.
+    void EncodePlane(const uint8_t* plane, size_t groupCount, std::vector<uint8_t>& encoded)
+    {
+        size_t header = encoded.size();
+        encoded.resize(header + (groupCount + 3) / 4, 0);
+        for (size_t group = 0; group < groupCount; group++)
+        {
+            const uint8_t* bytes = plane + group * GroupSize;
+            uint8_t used = 0;
+            for (size_t i = 0; i < GroupSize; i++)
+            {
+                used |= bytes[i];
+            }
+            uint8_t code = used == 0 ? 0 : used < 4 ? 1 : used < 16 ? 2 : 3;
+            encoded[header + group / 4] |= (uint8_t)(code << (2 * (group % 4)));
+            if (code == 1)
+            {
+                for (size_t j = 0; j < 4; j++)
+                {
+                    encoded.push_back((uint8_t)(bytes[j] | (bytes[j + 4] << 2) | (bytes[j + 8] << 4) | (bytes[j + 12] << 6)));
+                }
+            }
+            else if (code == 2)
+            {
+                for (size_t j = 0; j < 8; j++)
+                {
+                    encoded.push_back((uint8_t)(bytes[j] | (bytes[j + 8] << 4)));
+                }
+            }
+            else if (code == 3)
+            {
+                encoded.insert(encoded.end(), bytes, bytes + GroupSize);
+            }
+        }
+    }
+
+    //Decodes a byte plane written by EncodePlane(). The size of the whole plane is checked before any group is decoded.
+    bool DecodePlane(uint8_t* plane, size_t groupCount, const uint8_t*& cursor, const uint8_t* end)
+    {
+        const size_t headerSize = (groupCount + 3) / 4;
+        if ((size_t)(end - cursor) < headerSize)
+        {
+            return false;
+        }
+        const uint8_t* header = cursor;
+        size_t dataSize = 0;
+        for (size_t group = 0; group < groupCount; group++)
+        {
+            dataSize += GroupDataSize[(header[group / 4] >> (2 * (group % 4))) & 3];
+        }
+        if ((size_t)(end - cursor) - headerSize < dataSize)
+        {
+            return false;
+        }
+        const uint8_t* data = cursor + headerSize;
+        for (size_t group = 0; group < groupCount; group++)
+        {
+            uint8_t* bytes = plane + group * GroupSize;
+            switch ((header[group / 4] >> (2 * (group % 4))) & 3)
+            {
+            case 0:
+                Write64(bytes, 0);
+                Write64(bytes + 8, 0);
+                break;
+            case 1:
+            {
+                uint32_t packed = Read32(data);
+                Write32(bytes, packed & 0x03030303u);
+                Write32(bytes + 4, (packed >> 2) & 0x03030303u);
+                Write32(bytes + 8, (packed >> 4) & 0x03030303u);
+                Write32(bytes + 12, (packed >> 6) & 0x03030303u);
+                data += 4;
+                break;
+            }
+            case 2:
+            {
+                uint64_t packed = Read64(data);
+                Write64(bytes, packed & 0x0F0F0F0F0F0F0F0Full);
+                Write64(bytes + 8, (packed >> 4) & 0x0F0F0F0F0F0F0F0Full);
+                data += 8;
+                break;
+            }
+            default:
+                memcpy(bytes, data, GroupSize);
+                data += GroupSize;
+                break;
+            }
+        }
+        cursor = data;
+        return true;
+    }
+
+    //Turns the four byte planes of a column back into words, undoes the zigzag and adds up the differences, starting from previous.
+    //The words are written every stride bytes from destination.
+    void DecodeColumn(const uint8_t (*planes)[MeshCodec::BlockVertexCount], size_t count, uint8_t* destination, size_t stride, uint32_t& previous)
+    {
+        size_t v = 0;
+#ifdef MESH_CODEC_SSE2
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i running = _mm_set1_epi32((int)previous);
+        for (; v + GroupSize <= count; v += GroupSize)
+        {
+            __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + v));
+            __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + v));
+            __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2] + v));
+            __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[3] + v));
+            __m128i low01 = _mm_unpacklo_epi8(p0, p1);
+            __m128i high01 = _mm_unpackhi_epi8(p0, p1);
+            __m128i low23 = _mm_unpacklo_epi8(p2, p3);
+            __m128i high23 = _mm_unpackhi_epi8(p2, p3);
+            __m128i words[4] = {
+                _mm_unpacklo_epi16(low01, low23),
+                _mm_unpackhi_epi16(low01, low23),
+                _mm_unpacklo_epi16(high01, high23),
+                _mm_unpackhi_epi16(high01, high23),
+            };
+            for (int i = 0; i < 4; i++)
+            {
+                //Zigzag decode, then an inclusive prefix sum of the four differences on top of the last decoded word.
+                __m128i delta = _mm_xor_si128(_mm_srli_epi32(words[i], 1), _mm_sub_epi32(zero, _mm_and_si128(words[i], one)));
+                delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+                delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+                running = _mm_add_epi32(delta, _mm_shuffle_epi32(running, 0xFF));
+                uint8_t* out = destination + (v + i * 4) * stride;
+                Write32(out, (uint32_t)_mm_cvtsi128_si32(running));
+                Write32(out + stride, (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(running, 0x55)));
+                Write32(out + 2 * stride, (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(running, 0xAA)));
+                Write32(out + 3 * stride, (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(running, 0xFF)));
+            }
+        }
+        previous = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(running, 0xFF));
+#endif
+        for (; v < count; v++)
+        {
+            uint32_t word = planes[0][v] | ((uint32_t)planes[1][v] << 8) | ((uint32_t)planes[2][v] << 16) | ((uint32_t)planes[3][v] << 24);
+            previous += ZigzagDecode(word);
+            Write32(destination + v * stride, previous);
+        }
+    }
+}
+
+bool MeshCodec::EncodeVertices(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<uint8_t>& encoded)
+{
+    if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > MaxVertexSize)
+    {
+        return false;
+    }
+    const size_t wordCount = vertexSize / 4;
+    const uint8_t* source = static_cast<const uint8_t*>(vertices);
+    uint32_t previous[MaxWordCount] = {};
+    uint8_t planes[4][BlockVertexCount];
+    for (size_t blockStart = 0; blockStart < vertexCount; blockStart += BlockSize)
+    {
+        const size_t count = std::min(BlockSize, vertexCount - blockStart);
+        const size_t groupCount = (count + GroupSize - 1) / GroupSize;
+        for (size_t word = 0; word < wordCount; word++)
+        {
+            //The groups past the last vertex of the block are filled with zeros.
+            memset(planes, 0, sizeof(planes));
+            for (size_t v = 0; v < count; v++)
+            {
+                uint32_t value = Read32(source + (blockStart + v) * vertexSize + word * 4);
+                uint32_t zigzag = ZigzagEncode(value - previous[word]);
+                previous[word] = value;
+                planes[0][v] = (uint8_t)zigzag;
+                planes[1][v] = (uint8_t)(zigzag >> 8);
+                planes[2][v] = (uint8_t)(zigzag >> 16);
+                planes[3][v] = (uint8_t)(zigzag >> 24);
+            }
+            for (int plane = 0; plane < 4; plane++)
+            {
+                EncodePlane(planes[plane], groupCount, encoded);
+            }
+        }
+    }
+    return true;
+}
+
+bool MeshCodec::DecodeVertices(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* encoded, size_t encodedSize, size_t* bytesRead)
+{
+    if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > MaxVertexSize)
+    {
+        return false;
+    }
+    const size_t wordCount = vertexSize / 4;
+    uint8_t* output = static_cast<uint8_t*>(destination);
+    const uint8_t* cursor = encoded;
+    const uint8_t* end = encoded + encodedSize;
+    uint32_t previous[MaxWordCount] = {};
+    uint8_t planes[4][BlockVertexCount];
+    for (size_t blockStart = 0; blockStart < vertexCount; blockStart += BlockSize)
+    {
+        const size_t count = std::min(BlockSize, vertexCount - blockStart);
+        const size_t groupCount = (count + GroupSize - 1) / GroupSize;
+        for (size_t word = 0; word < wordCount; word++)
+        {
+            for (int plane = 0; plane < 4; plane++)
+            {
+                if (!DecodePlane(planes[plane], groupCount, cursor, end))
+                {
+                    return false;
+                }
+            }
+            DecodeColumn(planes, count, output + blockStart * vertexSize + word * 4, vertexSize, previous[word]);
+        }
+    }
+    if (bytesRead != nullptr)
+    {
+        *bytesRead = (size_t)(cursor - encoded);
+    }
+    return true;
+}
+
+size_t MeshCodec::GetMinimumEncodedSize(size_t vertexCount, size_t vertexSize)
+{
+    //Every byte plane of a block has at least its width codes, one byte per four groups of 16 vertices.
+    const size_t headerBytesPerPlane = (vertexCount + 4 * GroupSize - 1) / (4 * GroupSize);
+    return headerBytesPerPlane * (vertexSize / 4) * 4;
+}
+
+void MeshCodec::EncodeIndices(const uint32_t* indices, size_t indexCount, std::vector<uint8_t>& encoded)
+{
+    EncodeVertices(indices, indexCount, sizeof(uint32_t), encoded);
+}
+
+bool MeshCodec::DecodeIndices(uint32_t* destination, size_t indexCount, const uint8_t* encoded, size_t encodedSize, size_t* bytesRead)
+{
+    return DecodeVertices(destination, indexCount, sizeof(uint32_t), encoded, encodedSize, bytesRead);
+}
@@ -0,0 +1,402 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    const uint32_t UnusedVertex = UINT32_MAX;
+
+    struct VertexKey
+    {
+        uint32_t bits[6];
+
+        bool operator==(const VertexKey& other) const
+        {
+            return memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey& key) const
+        {
+            //FNV-1a over the six words.
+            uint64_t hash = 14695981039346656037ull;
+            for (uint32_t word : key.bits)
+            {
+                hash = (hash ^ word) * 1099511628211ull;
+            }
+            return (size_t)(hash ^ (hash >> 32));
+        }
+    };
+
+    VertexKey MakeKey(const MeshCache::Vertex& vertex)
+    {
+        VertexKey key;
+        memcpy(&key.bits[0], vertex.position, sizeof(vertex.position));
+        memcpy(&key.bits[3], vertex.normal, sizeof(vertex.normal));
+        for (uint32_t& word : key.bits)
+        {
+            //-0 and 0 are the same coordinate.
+            if (word == 0x80000000u)
+            {
+                word = 0;
+            }
+        }
+        return key;
+    }
+
+    bool IsCancelled(const std::atomic<bool>* cancelled)
+    {
+        return cancelled != nullptr && *cancelled;
+    }
+
+    void SetProgress(std::atomic<float>* progress, float value)
+    {
+        if (progress != nullptr)
+        {
+            *progress = value;
+        }
+    }
+}
+
+bool MeshOptimizer::Optimize(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, Report* report,
+    const std::atomic<bool>* cancelled, std::atomic<float>* progress)
+{
+    //A trailing incomplete triangle isn't drawn by anything, it would only shift every triangle after reordering.
+    std::vector<uint32_t> partIndexCounts = { (uint32_t)(indices.size() / 3 * 3) };
+    return Optimize(vertices, indices, partIndexCounts, report, cancelled, progress);
+}
+
+bool MeshOptimizer::Optimize(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& partIndexCounts, Report* report,
+    const std::atomic<bool>* cancelled, std::atomic<float>* progress)
+{
+    Report result;
+    result.inputVertexCount = vertices.size();
+    result.inputTriangleCount = indices.size() / 3;
+    if (report != nullptr)
+    {
+        result.before = AnalyzeVertexCache(indices, vertices.size());
+    }
+    size_t totalIndexCount = 0;
+    for (uint32_t count : partIndexCounts)
+    {
+        totalIndexCount += count;
+    }
+    indices.resize(std::min(indices.size(), totalIndexCount));
+
+    SetProgress(progress, 0.0f);
+    result.weldedVertexCount = WeldVertices(vertices, indices);
+    SetProgress(progress, 0.3f);
+    if (IsCancelled(cancelled))
+    {
+        return false;
+    }
+
+    //A single part is cleaned up in place, otherwise every part is copied out, cleaned up and appended to the new index buffer.
+    std::vector<uint32_t> output;
+    if (partIndexCounts.size() > 1)
+    {
+        output.reserve(indices.size());
+    }
+    size_t firstIndex = 0;
+    for (uint32_t& partIndexCount : partIndexCounts)
+    {
+        std::vector<uint32_t> part;
+        if (partIndexCounts.size() == 1)
+        {
+            part.swap(indices);
+        }
+        else
+        {
+            size_t count = std::min<size_t>(partIndexCount, indices.size() - firstIndex);
+            part.assign(indices.begin() + firstIndex, indices.begin() + firstIndex + count);
+            firstIndex += count;
+        }
+        result.degenerateTriangleCount += RemoveDegenerateTriangles(part);
+        result.duplicateTriangleCount += RemoveDuplicateTriangles(part);
+        OptimizeVertexCache(part, vertices.size());
+        partIndexCount = (uint32_t)part.size();
+        if (partIndexCounts.size() == 1)
+        {
+            output.swap(part);
+        }
+        else
+        {
+            output.insert(output.end(), part.begin(), part.end());
+        }
+        SetProgress(progress, 0.3f + 0.5f * (float)firstIndex / (float)std::max<size_t>(1, indices.size()));
+    }
+    indices.swap(output);
+    SetProgress(progress, 0.8f);
+    if (IsCancelled(cancelled))
+    {
+        return false;
+    }
+
+    OptimizeVertexFetch(vertices, indices);
+    SetProgress(progress, 1.0f);
+
+    if (report != nullptr)
+    {
+        result.outputVertexCount = vertices.size();
+        result.outputTriangleCount = indices.size() / 3;
+        result.after = AnalyzeVertexCache(indices, vertices.size());
+        *report = result;
+    }
+    return true;
+}
+
+size_t MeshOptimizer::WeldVertices(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> uniqueVertices;
+    uniqueVertices.reserve(vertices.size());
+    std::vector<uint32_t> remap(vertices.size());
+    uint32_t uniqueCount = 0;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = uniqueVertices.emplace(MakeKey(vertices[i]), uniqueCount);
+        if (inserted.second)
+        {
+            vertices[uniqueCount++] = vertices[i];
+        }
+        remap[i] = inserted.first->second;
+    }
+
+    size_t removedCount = vertices.size() - uniqueCount;
+    vertices.resize(uniqueCount);
+    for (uint32_t& index : indices)
+    {
+        index = remap[index];
+    }
+    return removedCount;
+}
+
+size_t MeshOptimizer::RemoveDegenerateTriangles(std::vector<uint32_t>& indices)
+{
+    size_t written = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a == b || b == c || a == c)
+        {
+            continue;
+        }
+        indices[written++] = a;
+        indices[written++] = b;
+        indices[written++] = c;
+    }
+    size_t removedCount = (indices.size() - written) / 3;
+    indices.resize(written);
+    return removedCount;
+}
+
+size_t MeshOptimizer::RemoveDuplicateTriangles(std::vector<uint32_t>& indices)
+{
+    //Every triangle is rotated so its smallest index comes first, which makes the same triangle with the same winding compare equal.
+    //Sorting the keys instead of hashing them keeps the first of the duplicates without a hash set of the whole mesh.
+    size_t triangleCount = indices.size() / 3;
+    std::vector<std::array<uint32_t, 4>> keys(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* triangle = &indices[t * 3];
+        size_t first = triangle[0] < triangle[1] ? (triangle[0] < triangle[2] ? 0 : 2) : (triangle[1] < triangle[2] ? 1 : 2);
+        keys[t] = { triangle[first], triangle[(first + 1) % 3], triangle[(first + 2) % 3], (uint32_t)t };
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<bool> isDuplicate(triangleCount, false);
+    for (size_t i = 1; i < triangleCount; i++)
+    {
+        //The sort puts the earliest triangle first among equal ones.
+        if (keys[i][0] == keys[i - 1][0] && keys[i][1] == keys[i - 1][1] && keys[i][2] == keys[i - 1][2])
+        {
+            isDuplicate[keys[i][3]] = true;
+        }
+    }
+
+    size_t written = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (isDuplicate[t])
+        {
+            continue;
+        }
+        indices[written++] = indices[t * 3];
+        indices[written++] = indices[t * 3 + 1];
+        indices[written++] = indices[t * 3 + 2];
+    }
+    size_t removedCount = triangleCount - written / 3;
+    indices.resize(written);
+    return removedCount;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+    {
+        return;
+    }
+
+    //Triangles around every vertex, in compressed rows: the triangles of vertex v are adjacency[offsets[v]] to adjacency[offsets[v + 1]].
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    //Tipsify: fan around a vertex until all its triangles are out, then move on to a vertex that is still in the cache
+    //and has triangles left, or to the most recently used vertex with triangles left when there is none.
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        liveTriangles[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEndStack;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    size_t scanCursor = 0;
+    int64_t fanningVertex = 0;
+    while (fanningVertex >= 0)
+    {
+        candidates.clear();
+        uint32_t vertex = (uint32_t)fanningVertex;
+        for (uint32_t a = offsets[vertex]; a < offsets[vertex + 1]; a++)
+        {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEndStack.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        //Pick the candidate that stays in the cache the longest once its remaining triangles are emitted.
+        fanningVertex = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+            {
+                continue;
+            }
+            int64_t priority = 0;
+            if ((int64_t)time - cacheTime[v] + 2 * (int64_t)liveTriangles[v] <= cacheSize)
+            {
+                priority = (int64_t)time - cacheTime[v];
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanningVertex = v;
+            }
+        }
+
+        if (fanningVertex < 0)
+        {
+            //Dead end: go back through the recently used vertices, then scan for any vertex with triangles left.
+            while (!deadEndStack.empty())
+            {
+                uint32_t v = deadEndStack.back();
+                deadEndStack.pop_back();
+                if (liveTriangles[v] > 0)
+                {
+                    fanningVertex = v;
+                    break;
+                }
+            }
+            while (fanningVertex < 0 && scanCursor < vertexCount)
+            {
+                if (liveTriangles[scanCursor] > 0)
+                {
+                    fanningVertex = (int64_t)scanCursor;
+                }
+                scanCursor++;
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UnusedVertex);
+    std::vector<MeshCache::Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == UnusedVertex)
+        {
+            remap[index] = (uint32_t)reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+MeshOptimizer::CacheStatistics MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+    CacheStatistics statistics;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || cacheSize == 0)
+    {
+        return statistics;
+    }
+
+    //FIFO cache: a vertex is in the cache if it missed less than cacheSize misses ago.
+    std::vector<uint64_t> missTime(vertexCount, 0);
+    std::vector<bool> isReferenced(vertexCount, false);
+    uint64_t misses = 0;
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        uint32_t v = indices[i];
+        if (!isReferenced[v])
+        {
+            isReferenced[v] = true;
+            referencedCount++;
+        }
+        if (missTime[v] == 0 || misses + 1 - missTime[v] > cacheSize)
+        {
+            misses++;
+            missTime[v] = misses;
+        }
+    }
+    statistics.acmr = (float)misses / triangleCount;
+    statistics.atvr = (float)misses / referencedCount;
+    return statistics;
+}
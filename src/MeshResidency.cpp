@@ -0,0 +1,362 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "MeshResidency.h"
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const char PackMagic[8] = { 'R', 'T', 'P', 'A', 'C', 'K', '\0', '\0' };
+    const size_t SectionAlignment = MeshCache::SectionAlignment;
+
+    //Layout of the start of a pack file. The mesh table is at tableOffset, after the streams of every mesh.
+    struct PackHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t meshCount;
+        uint64_t tableOffset;
+    };
+    static_assert(sizeof(PackHeader) == 24, "The pack header is part of the file format, its size must not change.");
+
+    //An entry of the mesh table. The offsets are from the start of the file, the sizes are the sizes of the MeshCodec streams.
+    struct PackEntry
+    {
+        uint64_t vertexOffset;
+        uint64_t vertexSize;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+    };
+    static_assert(sizeof(PackEntry) == 40, "The pack table entry is part of the file format, its size must not change.");
+
+    uint64_t AlignToSection(uint64_t offset)
+    {
+        return (offset + SectionAlignment - 1) & ~(uint64_t)(SectionAlignment - 1);
+    }
+
+    //Whether the range [offset, offset + size) is inside the first limit bytes of the file.
+    bool IsInside(uint64_t offset, uint64_t size, uint64_t limit)
+    {
+        return offset <= limit && size <= limit - offset;
+    }
+}
+
+MeshResidency::PackWriter::PackWriter() : output(nullptr), written(0), failed(false), meshCount(0)
+{
+}
+
+MeshResidency::PackWriter::~PackWriter()
+{
+    //A pack that was never finished is thrown away.
+    if (output != nullptr)
+    {
+        fclose(output);
+        remove((path + ".tmp").c_str());
+    }
+}
+
+bool MeshResidency::PackWriter::Open(const std::string& path)
+{
+    if (output != nullptr)
+    {
+        fclose(output);
+        remove((this->path + ".tmp").c_str());
+    }
+    this->path = path;
+    written = 0;
+    failed = false;
+    meshCount = 0;
+    table.clear();
+    output = fopen((path + ".tmp").c_str(), "wb");
+    if (output == nullptr)
+    {
+        return false;
+    }
+    //The header is written by Finish(), when the table offset is known.
+    WriteSection(std::vector<uint8_t>(sizeof(PackHeader), 0));
+    return !failed;
+}
+
+uint32_t MeshResidency::PackWriter::Add(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+{
+    if (output == nullptr || failed || meshCount == UINT32_MAX || vertexCount > UINT32_MAX || indexCount > UINT32_MAX || indexCount % 3 != 0)
+    {
+        return UINT32_MAX;
+    }
+    PackEntry entry = {};
+    entry.vertexCount = (uint32_t)vertexCount;
+    entry.indexCount = (uint32_t)indexCount;
+    encoded.clear();
+    MeshCodec::EncodeVertices(vertices, vertexCount, sizeof(MeshCache::Vertex), encoded);
+    entry.vertexSize = encoded.size();
+    entry.vertexOffset = WriteSection(encoded);
+    encoded.clear();
+    MeshCodec::EncodeIndices(indices, indexCount, encoded);
+    entry.indexSize = encoded.size();
+    entry.indexOffset = WriteSection(encoded);
+    if (failed)
+    {
+        return UINT32_MAX;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&entry);
+    table.insert(table.end(), bytes, bytes + sizeof(PackEntry));
+    return meshCount++;
+}
+
+bool MeshResidency::PackWriter::Finish()
+{
+    if (output == nullptr)
+    {
+        return false;
+    }
+    PackHeader header = {};
+    memcpy(header.magic, PackMagic, sizeof(PackMagic));
+    header.version = Version;
+    header.meshCount = meshCount;
+    header.tableOffset = WriteSection(table);
+    bool succeeded = !failed && fseek(output, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(PackHeader), 1, output) == 1;
+    succeeded = fclose(output) == 0 && succeeded;
+    output = nullptr;
+
+    const std::string temporaryPath = path + ".tmp";
+    if (succeeded)
+    {
+        //rename() doesn't replace an existing file on Windows.
+        remove(path.c_str());
+        succeeded = rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+    if (!succeeded)
+    {
+        remove(temporaryPath.c_str());
+    }
+    return succeeded;
+}
+
+uint64_t MeshResidency::PackWriter::WriteSection(const std::vector<uint8_t>& data)
+{
+    const char padding[SectionAlignment] = { 0 };
+    const uint64_t offset = written;
+    const uint64_t end = AlignToSection(written + data.size());
+    failed = failed || fwrite(data.data(), 1, data.size(), output) != data.size();
+    failed = failed || fwrite(padding, 1, (size_t)(end - written - data.size()), output) != end - written - data.size();
+    written = end;
+    return offset;
+}
+
+MeshResidency::MeshResidency() : budget(0), statistics()
+{
+}
+
+MeshResidency::~MeshResidency()
+{
+    Close();
+}
+
+bool MeshResidency::Open(const std::string& packPath, size_t budgetBytes)
+{
+    Close();
+    if (!file.Open(packPath) || file.Size() < sizeof(PackHeader))
+    {
+        file.Close();
+        return false;
+    }
+    PackHeader header;
+    memcpy(&header, file.Data(), sizeof(PackHeader));
+    const uint64_t fileSize = file.Size();
+    if (memcmp(header.magic, PackMagic, sizeof(PackMagic)) != 0 || header.version != Version ||
+        !IsInside(header.tableOffset, (uint64_t)header.meshCount * sizeof(PackEntry), fileSize))
+    {
+        file.Close();
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.Data());
+    std::vector<Entry> packEntries(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        PackEntry packEntry;
+        memcpy(&packEntry, data + header.tableOffset + (uint64_t)i * sizeof(PackEntry), sizeof(PackEntry));
+        //The streams have to be in front of the table. Their contents are checked by the decoder when the mesh is acquired, the counts are checked
+        //against the stream sizes here so that a damaged table can't make an acquire allocate far more memory than the pack could hold.
+        if (!IsInside(packEntry.vertexOffset, packEntry.vertexSize, header.tableOffset) ||
+            !IsInside(packEntry.indexOffset, packEntry.indexSize, header.tableOffset) || packEntry.indexCount % 3 != 0 ||
+            MeshCodec::GetMinimumEncodedSize(packEntry.vertexCount, sizeof(MeshCache::Vertex)) > packEntry.vertexSize ||
+            MeshCodec::GetMinimumEncodedSize(packEntry.indexCount, sizeof(uint32_t)) > packEntry.indexSize)
+        {
+            file.Close();
+            return false;
+        }
+        Entry& entry = packEntries[i];
+        entry.encodedVertices = data + packEntry.vertexOffset;
+        entry.encodedVertexSize = (size_t)packEntry.vertexSize;
+        entry.encodedIndices = data + packEntry.indexOffset;
+        entry.encodedIndexSize = (size_t)packEntry.indexSize;
+        entry.decodedSize = (size_t)packEntry.vertexCount * sizeof(MeshCache::Vertex) + (size_t)packEntry.indexCount * sizeof(uint32_t);
+        entry.state = State::Evicted;
+        entry.pinCount = 0;
+        entry.mesh = { nullptr, packEntry.vertexCount, nullptr, packEntry.indexCount };
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.swap(packEntries);
+    budget = budgetBytes;
+    return true;
+}
+
+void MeshResidency::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    leastRecentlyUsed.clear();
+    statistics = Statistics();
+    file.Close();
+}
+
+const MeshResidency::Mesh* MeshResidency::Acquire(uint32_t mesh)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (mesh >= entries.size())
+    {
+        return nullptr;
+    }
+    Entry& entry = entries[mesh];
+    while (entry.state == State::Loading)
+    {
+        loaded.wait(lock);
+    }
+    if (entry.state == State::Resident)
+    {
+        statistics.hits++;
+        if (entry.pinCount++ == 0)
+        {
+            leastRecentlyUsed.erase(entry.lruPosition);
+            statistics.pinnedBytes += entry.decodedSize;
+            statistics.pinnedMeshes++;
+        }
+        return &entry.mesh;
+    }
+
+    //The memory of the mesh is counted before it is decoded, so that the meshes decoded by other threads at the same time make room for it too.
+    statistics.misses++;
+    entry.state = State::Loading;
+    entry.pinCount = 1;
+    statistics.pinnedBytes += entry.decodedSize;
+    statistics.pinnedMeshes++;
+    EvictToFit(budget > entry.decodedSize ? budget - entry.decodedSize : 0);
+    statistics.residentBytes += entry.decodedSize;
+    statistics.residentMeshes++;
+    statistics.peakResidentBytes = std::max(statistics.peakResidentBytes, statistics.residentBytes);
+    lock.unlock();
+
+    std::vector<MeshCache::Vertex> vertices(entry.mesh.vertexCount);
+    std::vector<uint32_t> indices(entry.mesh.indexCount);
+    bool decoded = MeshCodec::DecodeVertices(vertices.data(), vertices.size(), sizeof(MeshCache::Vertex), entry.encodedVertices, entry.encodedVertexSize) &&
+        MeshCodec::DecodeIndices(indices.data(), indices.size(), entry.encodedIndices, entry.encodedIndexSize);
+    for (size_t i = 0; decoded && i < indices.size(); i++)
+    {
+        decoded = indices[i] < vertices.size();
+    }
+
+    lock.lock();
+    if (!decoded)
+    {
+        statistics.failures++;
+        statistics.pinnedBytes -= entry.decodedSize;
+        statistics.pinnedMeshes--;
+        statistics.residentBytes -= entry.decodedSize;
+        statistics.residentMeshes--;
+        entry.state = State::Evicted;
+        entry.pinCount = 0;
+        loaded.notify_all();
+        return nullptr;
+    }
+    entry.vertices.swap(vertices);
+    entry.indices.swap(indices);
+    entry.mesh.vertices = entry.vertices.data();
+    entry.mesh.indices = entry.indices.data();
+    entry.state = State::Resident;
+    statistics.bytesPagedIn += entry.decodedSize;
+    loaded.notify_all();
+    return &entry.mesh;
+}
+
+void MeshResidency::Release(uint32_t mesh)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mesh >= entries.size() || entries[mesh].pinCount == 0)
+    {
+        return;
+    }
+    Entry& entry = entries[mesh];
+    if (--entry.pinCount == 0)
+    {
+        leastRecentlyUsed.push_front(mesh);
+        entry.lruPosition = leastRecentlyUsed.begin();
+        statistics.pinnedBytes -= entry.decodedSize;
+        statistics.pinnedMeshes--;
+        EvictToFit(budget);
+    }
+}
+
+void MeshResidency::SetBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = budgetBytes;
+    EvictToFit(budget);
+}
+
+size_t MeshResidency::GetBudget() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+uint32_t MeshResidency::GetMeshCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (uint32_t)entries.size();
+}
+
+size_t MeshResidency::GetMeshSize(uint32_t mesh) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return mesh < entries.size() ? entries[mesh].decodedSize : 0;
+}
+
+MeshResidency::Statistics MeshResidency::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void MeshResidency::ResetCounters()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    statistics.hits = 0;
+    statistics.misses = 0;
+    statistics.evictions = 0;
+    statistics.failures = 0;
+    statistics.bytesPagedIn = 0;
+    statistics.peakResidentBytes = statistics.residentBytes;
+}
+
+void MeshResidency::EvictToFit(size_t budgetBytes)
+{
+    while (statistics.residentBytes > budgetBytes && !leastRecentlyUsed.empty())
+    {
+        Entry& entry = entries[leastRecentlyUsed.back()];
+        leastRecentlyUsed.pop_back();
+        std::vector<MeshCache::Vertex>().swap(entry.vertices);
+        std::vector<uint32_t>().swap(entry.indices);
+        entry.mesh.vertices = nullptr;
+        entry.mesh.indices = nullptr;
+        entry.state = State::Evicted;
+        statistics.residentBytes -= entry.decodedSize;
+        statistics.residentMeshes--;
+        statistics.evictions++;
+    }
+}
@@ -0,0 +1,453 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    //Border planes count this many times as much as the planes of the triangles, so the outline of an open mesh moves last.
+    const double BorderWeight = 10.0;
+    //A collapse is rejected if it turns a triangle by more than about 75 degrees.
+    const double MinNormalCosine = 0.25;
+
+    enum class VertexKind : uint8_t
+    {
+        Interior,
+        Border,
+        Locked
+    };
+
+    //Symmetric 4x4 matrix of the sum of squared distances to a set of planes.
+    struct Quadric
+    {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+
+        static Quadric FromPlane(double nx, double ny, double nz, double d, double weight)
+        {
+            Quadric q;
+            q.a00 = nx * nx * weight; q.a01 = nx * ny * weight; q.a02 = nx * nz * weight;
+            q.a11 = ny * ny * weight; q.a12 = ny * nz * weight; q.a22 = nz * nz * weight;
+            q.b0 = nx * d * weight; q.b1 = ny * d * weight; q.b2 = nz * d * weight;
+            q.c = d * d * weight;
+            return q;
+        }
+
+        void Add(const Quadric& other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+        }
+
+        double Evaluate(const float p[3]) const
+        {
+            double x = p[0], y = p[1], z = p[2];
+            double result = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            //Rounding can make the sum of squares slightly negative.
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+
+        bool operator<(const Collapse& other) const
+        {
+            return cost < other.cost;
+        }
+    };
+
+    void Subtract(const float a[3], const float b[3], double result[3])
+    {
+        result[0] = (double)a[0] - b[0];
+        result[1] = (double)a[1] - b[1];
+        result[2] = (double)a[2] - b[2];
+    }
+
+    void Cross(const double a[3], const double b[3], double result[3])
+    {
+        result[0] = a[1] * b[2] - a[2] * b[1];
+        result[1] = a[2] * b[0] - a[0] * b[2];
+        result[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    double Dot(const double a[3], const double b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    uint64_t EdgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    //Sorted undirected edges of the triangles. Equal keys follow each other, so the length of a run is the number of triangles on the edge.
+    std::vector<uint64_t> CollectEdges(const std::vector<uint32_t>& indices)
+    {
+        std::vector<uint64_t> edges(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            edges[i] = EdgeKey(indices[i], indices[i + 1]);
+            edges[i + 1] = EdgeKey(indices[i + 1], indices[i + 2]);
+            edges[i + 2] = EdgeKey(indices[i + 2], indices[i]);
+        }
+        std::sort(edges.begin(), edges.end());
+        return edges;
+    }
+
+    //State of a simplification that can be continued with smaller and smaller targets, which is how the levels of detail of a chain are made.
+    class Simplification
+    {
+    public:
+        Simplification(const std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices)
+            : vertices(vertices), quadrics(vertices.size()), kinds(vertices.size(), VertexKind::Interior), passStamps(vertices.size(), 0),
+              indices(indices.begin(), indices.begin() + indices.size() / 3 * 3), error(0.0), pass(0)
+        {
+            ClassifyVertices();
+            ComputeQuadrics();
+        }
+
+        /// <returns>Returns false if cancelled.</returns>
+        bool Reduce(size_t targetIndexCount, double maxError, const std::atomic<bool>* cancelled)
+        {
+            const double maxCost = maxError * maxError;
+            while (indices.size() > targetIndexCount)
+            {
+                if (cancelled != nullptr && *cancelled)
+                {
+                    return false;
+                }
+                size_t trianglesToRemove = (indices.size() - targetIndexCount) / 3;
+                size_t triangleCount = indices.size() / 3;
+                if (RunPass(std::max<size_t>(1, trianglesToRemove / 2), maxCost) == 0)
+                {
+                    break;
+                }
+                //When almost every collapse is blocked (a triangle soup, or a mesh that is mostly border) the passes would
+                //only remove a handful of triangles each while still costing a full sort, so the reduction stops there.
+                size_t removedCount = triangleCount - indices.size() / 3;
+                if (removedCount < trianglesToRemove / 20)
+                {
+                    break;
+                }
+            }
+            return true;
+        }
+
+        const std::vector<uint32_t>& GetIndices() const
+        {
+            return indices;
+        }
+
+        float GetError() const
+        {
+            return (float)std::sqrt(error);
+        }
+
+    private:
+        void ClassifyVertices()
+        {
+            std::vector<uint64_t> edges = CollectEdges(indices);
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t runEnd = i;
+                while (runEnd < edges.size() && edges[runEnd] == edges[i])
+                {
+                    runEnd++;
+                }
+                size_t triangleCount = runEnd - i;
+                uint32_t a = (uint32_t)(edges[i] >> 32);
+                uint32_t b = (uint32_t)edges[i];
+                if (triangleCount > 2)
+                {
+                    kinds[a] = kinds[b] = VertexKind::Locked;
+                }
+                else if (triangleCount == 1)
+                {
+                    if (kinds[a] != VertexKind::Locked) kinds[a] = VertexKind::Border;
+                    if (kinds[b] != VertexKind::Locked) kinds[b] = VertexKind::Border;
+                }
+                i = runEnd;
+            }
+        }
+
+        void ComputeQuadrics()
+        {
+            std::vector<uint64_t> edges = CollectEdges(indices);
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+                const float* p0 = vertices[corners[0]].position;
+                double e1[3], e2[3], normal[3];
+                Subtract(vertices[corners[1]].position, p0, e1);
+                Subtract(vertices[corners[2]].position, p0, e2);
+                Cross(e1, e2, normal);
+                double length = std::sqrt(Dot(normal, normal));
+                if (length == 0.0)
+                {
+                    continue;
+                }
+                for (double& component : normal)
+                {
+                    component /= length;
+                }
+                double d = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+                Quadric plane = Quadric::FromPlane(normal[0], normal[1], normal[2], d, 1.0);
+                for (uint32_t corner : corners)
+                {
+                    quadrics[corner].Add(plane);
+                }
+
+                //A border edge gets a plane through it that stands perpendicular to its triangle, which keeps the border from moving inwards.
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t a = corners[e];
+                    uint32_t b = corners[(e + 1) % 3];
+                    uint64_t key = EdgeKey(a, b);
+                    auto range = std::equal_range(edges.begin(), edges.end(), key);
+                    if (range.second - range.first != 1)
+                    {
+                        continue;
+                    }
+                    double edge[3], borderNormal[3];
+                    Subtract(vertices[b].position, vertices[a].position, edge);
+                    Cross(edge, normal, borderNormal);
+                    double borderLength = std::sqrt(Dot(borderNormal, borderNormal));
+                    if (borderLength == 0.0)
+                    {
+                        continue;
+                    }
+                    for (double& component : borderNormal)
+                    {
+                        component /= borderLength;
+                    }
+                    const float* pa = vertices[a].position;
+                    double borderD = -(borderNormal[0] * pa[0] + borderNormal[1] * pa[1] + borderNormal[2] * pa[2]);
+                    Quadric border = Quadric::FromPlane(borderNormal[0], borderNormal[1], borderNormal[2], borderD, BorderWeight);
+                    quadrics[a].Add(border);
+                    quadrics[b].Add(border);
+                }
+            }
+        }
+
+        bool CanCollapse(uint32_t from, bool isBorderEdge) const
+        {
+            switch (kinds[from])
+            {
+            case VertexKind::Interior: return true;
+            case VertexKind::Border: return isBorderEdge;
+            default: return false;
+            }
+        }
+
+        //Checks the triangles around from that stay after the collapse. None of them may get degenerate or turn too far.
+        bool FlipsTriangles(uint32_t from, uint32_t to) const
+        {
+            for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++)
+            {
+                const uint32_t* triangle = &indices[adjacency[a] * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                {
+                    continue;
+                }
+                int corner = triangle[0] == from ? 0 : (triangle[1] == from ? 1 : 2);
+                const float* p1 = vertices[triangle[(corner + 1) % 3]].position;
+                const float* p2 = vertices[triangle[(corner + 2) % 3]].position;
+                double e1[3], e2[3], before[3], after[3];
+                Subtract(p1, vertices[from].position, e1);
+                Subtract(p2, vertices[from].position, e2);
+                Cross(e1, e2, before);
+                Subtract(p1, vertices[to].position, e1);
+                Subtract(p2, vertices[to].position, e2);
+                Cross(e1, e2, after);
+                double lengths = std::sqrt(Dot(before, before) * Dot(after, after));
+                if (lengths == 0.0 || Dot(before, after) < MinNormalCosine * lengths)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void BuildAdjacency()
+        {
+            offsets.assign(vertices.size() + 1, 0);
+            for (uint32_t index : indices)
+            {
+                offsets[index + 1]++;
+            }
+            for (size_t v = 0; v < vertices.size(); v++)
+            {
+                offsets[v + 1] += offsets[v];
+            }
+            adjacency.resize(indices.size());
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+            }
+        }
+
+        //Collapses the cheapest edges whose surroundings don't overlap, at most maxCollapses of them.
+        //Returns the number of collapses.
+        size_t RunPass(size_t maxCollapses, double maxCost)
+        {
+            pass++;
+            std::vector<uint64_t> edges = CollectEdges(indices);
+            std::vector<Collapse> candidates;
+            candidates.reserve(edges.size());
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t runEnd = i;
+                while (runEnd < edges.size() && edges[runEnd] == edges[i])
+                {
+                    runEnd++;
+                }
+                size_t triangleCount = runEnd - i;
+                uint32_t a = (uint32_t)(edges[i] >> 32);
+                uint32_t b = (uint32_t)edges[i];
+                i = runEnd;
+                if (triangleCount > 2)
+                {
+                    continue;
+                }
+                bool isBorderEdge = triangleCount == 1;
+                if (CanCollapse(a, isBorderEdge))
+                {
+                    Quadric q = quadrics[a];
+                    q.Add(quadrics[b]);
+                    candidates.push_back({ q.Evaluate(vertices[b].position), a, b });
+                }
+                if (CanCollapse(b, isBorderEdge))
+                {
+                    Quadric q = quadrics[a];
+                    q.Add(quadrics[b]);
+                    candidates.push_back({ q.Evaluate(vertices[a].position), b, a });
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+            BuildAdjacency();
+
+            std::vector<uint32_t> remap(vertices.size());
+            for (size_t v = 0; v < remap.size(); v++)
+            {
+                remap[v] = (uint32_t)v;
+            }
+
+            size_t collapseCount = 0;
+            for (const Collapse& collapse : candidates)
+            {
+                if (collapseCount >= maxCollapses || collapse.cost > maxCost)
+                {
+                    break;
+                }
+                if (passStamps[collapse.from] == pass || passStamps[collapse.to] == pass || FlipsTriangles(collapse.from, collapse.to))
+                {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].Add(quadrics[collapse.from]);
+                error = std::max(error, collapse.cost);
+                //The triangles around the collapsed vertex change, so none of their vertices is touched again in this pass.
+                for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+                {
+                    const uint32_t* triangle = &indices[adjacency[a] * 3];
+                    passStamps[triangle[0]] = passStamps[triangle[1]] = passStamps[triangle[2]] = pass;
+                }
+                collapseCount++;
+            }
+
+            size_t written = 0;
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+                if (a == b || b == c || a == c)
+                {
+                    continue;
+                }
+                indices[written++] = a;
+                indices[written++] = b;
+                indices[written++] = c;
+            }
+            indices.resize(written);
+            return collapseCount;
+        }
+
+        const std::vector<MeshCache::Vertex>& vertices;
+        std::vector<Quadric> quadrics;
+        std::vector<VertexKind> kinds;
+        std::vector<uint32_t> passStamps;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> adjacency;
+        double error;
+        uint32_t pass;
+    };
+}
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices,
+    size_t targetIndexCount, float maxError, float* resultError)
+{
+    Simplification simplification(vertices, indices);
+    simplification.Reduce(targetIndexCount, maxError, nullptr);
+    if (resultError != nullptr)
+    {
+        *resultError = simplification.GetError();
+    }
+    return simplification.GetIndices();
+}
+
+bool MeshSimplifier::BuildLodChain(const std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshCache::Lod>& lods,
+    size_t maxLevelCount, float reduction, size_t minTriangleCount, const std::atomic<bool>* cancelled, std::atomic<float>* progress)
+{
+    std::vector<MeshCache::Lod> chain;
+    std::vector<uint32_t> chainIndices(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    chain.push_back({ 0, (uint32_t)chainIndices.size(), 0.0f });
+
+    Simplification simplification(vertices, chainIndices);
+    for (size_t level = 1; level < maxLevelCount; level++)
+    {
+        size_t previousIndexCount = chain.back().indexCount;
+        size_t targetIndexCount = (size_t)(previousIndexCount / 3 * reduction) * 3;
+        if (targetIndexCount / 3 < minTriangleCount)
+        {
+            break;
+        }
+        if (!simplification.Reduce(targetIndexCount, DBL_MAX, cancelled))
+        {
+            return false;
+        }
+        //The collapses left are blocked by the border, the flip check or non manifold edges. Another level would look the same.
+        std::vector<uint32_t> levelIndices = simplification.GetIndices();
+        if (levelIndices.size() > previousIndexCount - previousIndexCount / 10)
+        {
+            break;
+        }
+
+        MeshOptimizer::OptimizeVertexCache(levelIndices, vertices.size());
+        chain.push_back({ (uint32_t)chainIndices.size(), (uint32_t)levelIndices.size(), simplification.GetError() });
+        chainIndices.insert(chainIndices.end(), levelIndices.begin(), levelIndices.end());
+        if (progress != nullptr)
+        {
+            *progress = (float)level / (maxLevelCount - 1);
+        }
+    }
+
+    indices.swap(chainIndices);
+    lods.swap(chain);
+    if (progress != nullptr)
+    {
+        *progress = 1.0f;
+    }
+    return true;
+}
@@ -0,0 +1,907 @@
+#include "ModelLoadTask.h"
+#include "GLTF_FileManager.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MODEL_LOAD_TASK_SSE2
+#endif
+
+namespace
+{
+    //How many triangles or vertices a thread processes at once while generating normals, which is also how often the cancellation flag is checked.
+    //The batches don't depend on the thread count.
+    const size_t NormalBatchSize = 64 * 1024;
+    //Below this many threads, including the calling one, the extra passes of the parallel normal generation cost more than the threads save.
+    const unsigned int MinParallelNormalThreads = 4;
+    //The corners are first split into this many bits worth of buckets of neighbouring vertices before every bucket is sorted on its own.
+    const int BucketBits = 11;
+    //The prefix sum over the bucket counts is split into groups of this many neighbouring buckets, each scanned by one thread.
+    const size_t BucketScanGroupSize = 64;
+    static_assert(((size_t)1 << BucketBits) % BucketScanGroupSize == 0, "The bucket scan groups have to cover every bucket.");
+    //Levels of detail of a loaded model: up to 6 levels, each with half the triangles of the previous one and at least 64 triangles.
+    const size_t MaxLodCount = 6;
+    const float LodReduction = 0.5f;
+    const size_t MinLodTriangleCount = 64;
+    const uint32_t NoMaterial = MeshCache::NoMaterial;
+
+    //Materials that only differ in what the renderer doesn't use (names, ambient colors, textures) become one material.
+    uint32_t FindOrAddMaterial(std::vector<MeshCache::Material>& materials, const MeshCache::Material& material)
+    {
+        size_t index = 0;
+        while (index < materials.size() && memcmp(&materials[index], &material, sizeof(material)) != 0)
+        {
+            index++;
+        }
+        if (index == materials.size())
+        {
+            materials.push_back(material);
+        }
+        return (uint32_t)index;
+    }
+
+    //Stable sorts the triangles by the material they use, so every material gets one part. The parts are in the order the file first uses their material.
+    //materialOfName maps the material names of the groups to the index of their converted material.
+    void GroupTrianglesByMaterial(std::vector<uint32_t>& indices, const std::vector<OBJFileManager::MaterialGroups::Range>& ranges,
+        const std::vector<uint32_t>& materialOfName, std::vector<uint32_t>& partMaterials, std::vector<uint32_t>& partIndexCounts)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        std::vector<uint32_t> rangeParts(ranges.size(), NoMaterial);
+        std::unordered_map<uint32_t, uint32_t> partOfMaterial;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            size_t first = std::min<size_t>(ranges[i].firstTriangle, triangleCount);
+            size_t end = i + 1 < ranges.size() ? std::min<size_t>(ranges[i + 1].firstTriangle, triangleCount) : triangleCount;
+            if (end <= first)
+            {
+                continue;
+            }
+            uint32_t material = ranges[i].material == OBJFileManager::MissingIndex ? NoMaterial : materialOfName[ranges[i].material];
+            auto inserted = partOfMaterial.emplace(material, (uint32_t)partMaterials.size());
+            if (inserted.second)
+            {
+                partMaterials.push_back(material);
+                partIndexCounts.push_back(0);
+            }
+            rangeParts[i] = inserted.first->second;
+            partIndexCounts[rangeParts[i]] += (uint32_t)((end - first) * 3);
+        }
+        if (partMaterials.empty())
+        {
+            partMaterials.push_back(NoMaterial);
+            partIndexCounts.push_back((uint32_t)(triangleCount * 3));
+        }
+        if (partMaterials.size() == 1)
+        {
+            return;
+        }
+
+        std::vector<size_t> partCursors(partMaterials.size(), 0);
+        for (size_t part = 1; part < partMaterials.size(); part++)
+        {
+            partCursors[part] = partCursors[part - 1] + partIndexCounts[part - 1];
+        }
+        std::vector<uint32_t> grouped(triangleCount * 3);
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            if (rangeParts[i] == NoMaterial)
+            {
+                continue;
+            }
+            size_t first = ranges[i].firstTriangle;
+            size_t end = i + 1 < ranges.size() ? std::min<size_t>(ranges[i + 1].firstTriangle, triangleCount) : triangleCount;
+            std::copy(indices.begin() + first * 3, indices.begin() + end * 3, grouped.begin() + partCursors[rangeParts[i]]);
+            partCursors[rangeParts[i]] += (end - first) * 3;
+        }
+        indices.swap(grouped);
+    }
+
+    inline void Normalize(float v[3])
+    {
+        //Same as XMVector3Normalize(), a zero vector stays zero instead of becoming NaN.
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length > 0.0f)
+        {
+            v[0] /= length;
+            v[1] /= length;
+            v[2] /= length;
+        }
+    }
+
+    void ComputeFaceNormal(const MeshCache::Vertex* vertices, const uint32_t* triangle, float normal[3])
+    {
+        const float* p0 = vertices[triangle[0]].position;
+        const float* p1 = vertices[triangle[1]].position;
+        const float* p2 = vertices[triangle[2]].position;
+        float edge1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float edge2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        normal[0] = edge1[1] * edge2[2] - edge1[2] * edge2[1];
+        normal[1] = edge1[2] * edge2[0] - edge1[0] * edge2[2];
+        normal[2] = edge1[0] * edge2[1] - edge1[1] * edge2[0];
+        Normalize(normal);
+    }
+
+    //Unit normals of the triangles [first, end). The SSE2 path does four triangles at once with the same operations in the same order
+    //as ComputeFaceNormal(), so both give the same bits and the result doesn't depend on where a batch starts.
+    void ComputeFaceNormals(const MeshCache::Vertex* vertices, const uint32_t* indices, size_t first, size_t end, float* normals)
+    {
+        size_t t = first;
+#ifdef MODEL_LOAD_TASK_SSE2
+        for (; t + 4 <= end; t += 4)
+        {
+            //Positions of the three corners of the four triangles, one coordinate per register.
+            __m128 p[3][3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const float* a = vertices[indices[t * 3 + corner]].position;
+                const float* b = vertices[indices[t * 3 + 3 + corner]].position;
+                const float* c = vertices[indices[t * 3 + 6 + corner]].position;
+                const float* d = vertices[indices[t * 3 + 9 + corner]].position;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    p[corner][axis] = _mm_setr_ps(a[axis], b[axis], c[axis], d[axis]);
+                }
+            }
+            __m128 e1x = _mm_sub_ps(p[1][0], p[0][0]), e1y = _mm_sub_ps(p[1][1], p[0][1]), e1z = _mm_sub_ps(p[1][2], p[0][2]);
+            __m128 e2x = _mm_sub_ps(p[2][0], p[0][0]), e2y = _mm_sub_ps(p[2][1], p[0][1]), e2z = _mm_sub_ps(p[2][2], p[0][2]);
+            __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+            __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+            __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+            //Like Normalize(), a zero normal stays zero.
+            __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+            __m128 safeLength = _mm_or_ps(_mm_and_ps(nonZero, length), _mm_andnot_ps(nonZero, _mm_set1_ps(1.0f)));
+            nx = _mm_div_ps(nx, safeLength);
+            ny = _mm_div_ps(ny, safeLength);
+            nz = _mm_div_ps(nz, safeLength);
+
+            alignas(16) float x[4], y[4], z[4];
+            _mm_store_ps(x, nx);
+            _mm_store_ps(y, ny);
+            _mm_store_ps(z, nz);
+            for (int i = 0; i < 4; i++)
+            {
+                normals[(t + i) * 3] = x[i];
+                normals[(t + i) * 3 + 1] = y[i];
+                normals[(t + i) * 3 + 2] = z[i];
+            }
+        }
+#endif
+        for (; t < end; t++)
+        {
+            ComputeFaceNormal(vertices, &indices[t * 3], &normals[t * 3]);
+        }
+    }
+
+    //Angle of a triangle at one of its corners, corner is 3 * triangle + the corner in the triangle.
+    float GetCornerAngle(const MeshCache::Vertex* vertices, const uint32_t* indices, uint32_t corner)
+    {
+        uint32_t triangle = corner / 3 * 3;
+        const float* p = vertices[indices[corner]].position;
+        const float* p1 = vertices[indices[triangle + (corner + 1) % 3]].position;
+        const float* p2 = vertices[indices[triangle + (corner + 2) % 3]].position;
+        float e1[3] = { p1[0] - p[0], p1[1] - p[1], p1[2] - p[2] };
+        float e2[3] = { p2[0] - p[0], p2[1] - p[1], p2[2] - p[2] };
+        float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float dot = e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2];
+        //atan2 stays accurate for the very thin corners where acos of the normalized dot product loses most of its digits.
+        return std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot);
+    }
+
+    //Single threaded vertex normals: every triangle adds its normal to its three vertices. Every vertex gets the same additions
+    //in the same order as in the rows of the parallel version, so both give the same bits.
+    bool ScatterVertexNormals(std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices, ModelLoadTask::NormalWeighting weighting,
+        const std::atomic<bool>* cancelled, std::atomic<float>* progress)
+    {
+        for (MeshCache::Vertex& vertex : vertices)
+        {
+            vertex.normal[0] = 0.0f;
+            vertex.normal[1] = 0.0f;
+            vertex.normal[2] = 0.0f;
+        }
+
+        const size_t triangleCount = indices.size() / 3;
+        std::vector<float> faceNormals(std::min(triangleCount, NormalBatchSize) * 3);
+        for (size_t batchStart = 0; batchStart < triangleCount; batchStart += NormalBatchSize)
+        {
+            if (cancelled != nullptr && *cancelled)
+            {
+                return false;
+            }
+            const size_t batchEnd = std::min(triangleCount, batchStart + NormalBatchSize);
+            ComputeFaceNormals(vertices.data(), indices.data() + batchStart * 3, 0, batchEnd - batchStart, faceNormals.data());
+            for (size_t i = batchStart * 3; i < batchEnd * 3; i++)
+            {
+                const float* normal = &faceNormals[(i / 3 - batchStart) * 3];
+                float weight = weighting == ModelLoadTask::NormalWeighting::Angle ? GetCornerAngle(vertices.data(), indices.data(), (uint32_t)i) : 1.0f;
+                float* vertexNormal = vertices[indices[i]].normal;
+                vertexNormal[0] += normal[0] * weight;
+                vertexNormal[1] += normal[1] * weight;
+                vertexNormal[2] += normal[2] * weight;
+            }
+            if (progress != nullptr)
+            {
+                *progress = (float)batchEnd / (float)triangleCount;
+            }
+        }
+
+        //They are flipped to match the winding of the loaded models.
+        for (MeshCache::Vertex& vertex : vertices)
+        {
+            Normalize(vertex.normal);
+            vertex.normal[0] = -vertex.normal[0];
+            vertex.normal[1] = -vertex.normal[1];
+            vertex.normal[2] = -vertex.normal[2];
+        }
+        if (progress != nullptr)
+        {
+            *progress = 1.0f;
+        }
+        return true;
+    }
+}
+
+ModelLoadTask::ModelLoadTask()
+{
+    stage = Stage::Idle;
+    stageProgress = 0.0f;
+    for (double& seconds : stageSeconds)
+    {
+        seconds = 0.0;
+    }
+    resultTaken = false;
+    optimized = false;
+}
+
+ModelLoadTask::~ModelLoadTask()
+{
+    Cancel();
+    Wait();
+}
+
+void ModelLoadTask::SetPrepareBuffersFunction(PrepareBuffersFunction function)
+{
+    prepareBuffers = function;
+}
+
+bool ModelLoadTask::Start(const std::string& path, const std::string& cachePath)
+{
+    if (IsRunning())
+    {
+        return false;
+    }
+    Wait();
+
+    this->path = path;
+    this->cachePath = cachePath;
+    vertices.clear();
+    indices.clear();
+    lods.clear();
+    parts.clear();
+    materials.clear();
+    resultTaken = false;
+    optimized = false;
+    stageProgress = 0.0f;
+    parseProgress.totalBytes = 0;
+    parseProgress.processedBytes = 0;
+    parseProgress.cancelled = false;
+    for (double& seconds : stageSeconds)
+    {
+        seconds = 0.0;
+    }
+    //The stage is set before the thread starts so that IsRunning() is true as soon as this returns.
+    stageStart = std::chrono::steady_clock::now();
+    stage = Stage::Parsing;
+    worker = std::thread([this]() { Run(); });
+    return true;
+}
+
+void ModelLoadTask::Cancel()
+{
+    parseProgress.cancelled = true;
+}
+
+void ModelLoadTask::Wait()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+bool ModelLoadTask::IsRunning() const
+{
+    Stage current = stage;
+    return current == Stage::Parsing || current == Stage::Optimizing || current == Stage::ComputingNormals ||
+        current == Stage::GeneratingLods || current == Stage::PreparingBuffers;
+}
+
+double ModelLoadTask::GetStageSeconds(Stage stage) const
+{
+    if (stage < Stage::Parsing || stage > Stage::PreparingBuffers)
+    {
+        return 0.0;
+    }
+    return stageSeconds[(int)stage - (int)Stage::Parsing];
+}
+
+void ModelLoadTask::EnterStage(Stage next)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Stage current = stage;
+    if (current >= Stage::Parsing && current <= Stage::PreparingBuffers)
+    {
+        stageSeconds[(int)current - (int)Stage::Parsing] += std::chrono::duration<double>(now - stageStart).count();
+    }
+    stageStart = now;
+    stage = next;
+}
+
+ModelLoadTask::Stage ModelLoadTask::GetStage() const
+{
+    return stage;
+}
+
+float ModelLoadTask::GetStageProgress() const
+{
+    if (stage == Stage::Parsing)
+    {
+        return parseProgress.GetFraction();
+    }
+    return stageProgress;
+}
+
+const std::string& ModelLoadTask::GetPath() const
+{
+    return path;
+}
+
+bool ModelLoadTask::TakeResult(std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshCache::Lod>* lods,
+    std::vector<MeshCache::Part>* parts, std::vector<MeshCache::Material>* materials)
+{
+    //Finished is stored after the result is written, so the result is complete once it is seen here.
+    if (stage != Stage::Finished || resultTaken)
+    {
+        return false;
+    }
+    vertices = std::move(this->vertices);
+    indices = std::move(this->indices);
+    if (lods != nullptr)
+    {
+        *lods = std::move(this->lods);
+    }
+    if (parts != nullptr)
+    {
+        *parts = std::move(this->parts);
+    }
+    if (materials != nullptr)
+    {
+        *materials = std::move(this->materials);
+    }
+    resultTaken = true;
+    return true;
+}
+
+bool ModelLoadTask::GetOptimizationReport(MeshOptimizer::Report& report) const
+{
+    if (stage != Stage::Finished || !optimized)
+    {
+        return false;
+    }
+    report = optimizationReport;
+    return true;
+}
+
+const char* ModelLoadTask::GetStageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Idle: return "Idle";
+    case Stage::Parsing: return "Parsing";
+    case Stage::Optimizing: return "Optimizing";
+    case Stage::ComputingNormals: return "Computing normals";
+    case Stage::GeneratingLods: return "Generating LODs";
+    case Stage::PreparingBuffers: return "Preparing buffers";
+    case Stage::Finished: return "Finished";
+    case Stage::Failed: return "Failed";
+    case Stage::Cancelled: return "Cancelled";
+    }
+    return "";
+}
+
+void ModelLoadTask::Run()
+{
+    bool succeeded = false;
+    try
+    {
+        succeeded = RunStages();
+    }
+    catch (...)
+    {
+        //An exception can't leave the thread, running out of memory on a huge model is just a failed load.
+        succeeded = false;
+    }
+
+    if (succeeded)
+    {
+        EnterStage(Stage::Finished);
+    }
+    else
+    {
+        vertices.clear();
+        vertices.shrink_to_fit();
+        indices.clear();
+        indices.shrink_to_fit();
+        lods.clear();
+        parts.clear();
+        materials.clear();
+        EnterStage(parseProgress.cancelled ? Stage::Cancelled : Stage::Failed);
+    }
+}
+
+bool ModelLoadTask::RunStages()
+{
+    MeshCache cache;
+    //A baked .rtmesh file is loaded on its own, there is no source to check it against or to fall back to.
+    const bool baked = path.size() >= 7 && path.compare(path.size() - 7, 7, ".rtmesh") == 0;
+    bool cacheHit = baked ? cache.OpenBaked(path) : cache.Open(path, cachePath);
+    if (baked && !cacheHit)
+    {
+        return false;
+    }
+    if (cacheHit)
+    {
+        //The cache already holds the optimized mesh, its normals, its levels of detail and its materials, so the middle stages are skipped.
+        cache.TakeStreams(vertices, indices);
+        lods.assign(cache.GetLods(), cache.GetLods() + cache.GetLodCount());
+        parts.assign(cache.GetParts(), cache.GetParts() + cache.GetPartCount());
+        materials.assign(cache.GetMaterials(), cache.GetMaterials() + cache.GetMaterialCount());
+        cache.Close();
+    }
+    else
+    {
+        std::vector<OBJFileManager::MaterialGroups::Range> materialRanges;
+        std::vector<uint32_t> materialOfName;
+        if (GLTFFileManager::IsGltfPath(path))
+        {
+            if (!LoadGltfFile(materialRanges, materialOfName))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            OBJFileManager ofm = OBJFileManager();
+            std::vector<objl::Vertex> modelFileVertices;
+            OBJFileManager::MaterialGroups materialGroups;
+            if (!ofm.LoadObjFile(path, modelFileVertices, indices, &parseProgress, &materialGroups))
+            {
+                return false;
+            }
+
+            vertices.resize(modelFileVertices.size());
+            for (size_t i = 0; i < modelFileVertices.size(); i++)
+            {
+                const objl::Vector3& position = modelFileVertices[i].Position;
+                vertices[i] = { { position.X, position.Y, position.Z }, { 0.0f, 1.0f, 0.0f } };
+            }
+            modelFileVertices.clear();
+            modelFileVertices.shrink_to_fit();
+            materialRanges.swap(materialGroups.ranges);
+            materialOfName = ImportMaterials(materialGroups);
+        }
+
+        std::vector<uint32_t> partMaterials;
+        std::vector<uint32_t> partIndexCounts;
+        GroupTrianglesByMaterial(indices, materialRanges, materialOfName, partMaterials, partIndexCounts);
+
+        //The normals are generated after welding, so corners that only differed in their texture coordinates share a smooth normal.
+        //The vertices are welded across the parts as well, so the normals are smooth where two materials meet.
+        stageProgress = 0.0f;
+        EnterStage(Stage::Optimizing);
+        if (!MeshOptimizer::Optimize(vertices, indices, partIndexCounts, &optimizationReport, &parseProgress.cancelled, &stageProgress))
+        {
+            return false;
+        }
+        optimized = true;
+
+        stageProgress = 0.0f;
+        EnterStage(Stage::ComputingNormals);
+        if (!ComputeVertexNormals(vertices, indices, NormalWeighting::Face, &parseProgress.cancelled, &stageProgress))
+        {
+            return false;
+        }
+
+        //Every part gets its own chain, so a part never loses its triangles to a neighbouring material. The borders between parts are open borders
+        //for the simplifier, they only slide along themselves and stay within the error of the level.
+        stageProgress = 0.0f;
+        EnterStage(Stage::GeneratingLods);
+        std::vector<uint32_t> partIndices;
+        std::vector<MeshCache::Lod> partLods;
+        std::vector<uint32_t> chains;
+        const bool singlePart = partMaterials.size() == 1;
+        const size_t totalIndexCount = indices.size();
+        size_t firstIndex = 0;
+        for (size_t part = 0; part < partMaterials.size(); part++)
+        {
+            //A single part is simplified in place.
+            if (singlePart)
+            {
+                partIndices.swap(indices);
+            }
+            else
+            {
+                partIndices.assign(indices.begin() + firstIndex, indices.begin() + firstIndex + partIndexCounts[part]);
+            }
+            firstIndex += partIndexCounts[part];
+            //A single part reports the progress of its chain, otherwise the progress goes up as the parts finish.
+            std::atomic<float>* progress = singlePart ? &stageProgress : nullptr;
+            if (!MeshSimplifier::BuildLodChain(vertices, partIndices, partLods, MaxLodCount, LodReduction, MinLodTriangleCount, &parseProgress.cancelled, progress))
+            {
+                return false;
+            }
+            if (partLods.empty())
+            {
+                partLods.push_back({ 0, (uint32_t)partIndices.size(), 0.0f });
+            }
+            parts.push_back({ (uint32_t)lods.size(), (uint32_t)partLods.size(), partMaterials[part] });
+            for (MeshCache::Lod lod : partLods)
+            {
+                lod.firstIndex += (uint32_t)chains.size();
+                lods.push_back(lod);
+            }
+            if (singlePart)
+            {
+                chains.swap(partIndices);
+            }
+            else
+            {
+                chains.insert(chains.end(), partIndices.begin(), partIndices.end());
+            }
+            stageProgress = (float)firstIndex / (float)std::max<size_t>(1, totalIndexCount);
+        }
+        indices.swap(chains);
+        //Not being able to write the cache (for example in a read only folder) only means the next load parses the file again.
+        cache.Write(vertices.data(), vertices.size(), indices.data(), indices.size(), lods.data(), lods.size(), parts.data(), parts.size(), materials.data(), materials.size());
+    }
+    if (lods.empty())
+    {
+        lods.push_back({ 0, (uint32_t)indices.size(), 0.0f });
+    }
+    if (parts.empty())
+    {
+        parts.push_back({ 0, (uint32_t)lods.size(), NoMaterial });
+    }
+    if (parseProgress.cancelled)
+    {
+        return false;
+    }
+
+    stageProgress = 0.0f;
+    EnterStage(Stage::PreparingBuffers);
+    if (prepareBuffers != nullptr && !prepareBuffers(vertices, indices, lods, parts, materials))
+    {
+        return false;
+    }
+    stageProgress = 1.0f;
+    //Cancelling after the buffers are ready still drops the model, the caller asked for the old one to stay.
+    return !parseProgress.cancelled;
+}
+
+std::vector<uint32_t> ModelLoadTask::ImportMaterials(const OBJFileManager::MaterialGroups& groups)
+{
+    //The libraries are relative to the folder of the model. The first library that defines a name wins.
+    size_t folderEnd = path.find_last_of("/\\");
+    const std::string folder = folderEnd == std::string::npos ? std::string() : path.substr(0, folderEnd + 1);
+    //The names of the materials are views of strings owned by the loader, so one loader reads every library.
+    //A library that can't be read adds nothing and leaves its materials on the default material.
+    objl::Loader loader;
+    for (const std::string& library : groups.libraries)
+    {
+        loader.LoadMaterials(folder + library);
+    }
+    std::unordered_map<std::string_view, const objl::Material*> libraryMaterials;
+    for (const objl::Material& material : loader.LoadedMaterials)
+    {
+        libraryMaterials.emplace(material.name, &material);
+    }
+
+    std::vector<uint32_t> materialOfName(groups.names.size(), NoMaterial);
+    for (size_t i = 0; i < groups.names.size(); i++)
+    {
+        auto found = libraryMaterials.find(groups.names[i]);
+        if (found == libraryMaterials.end())
+        {
+            continue;
+        }
+        materialOfName[i] = FindOrAddMaterial(materials, ConvertMaterial(*found->second));
+    }
+    return materialOfName;
+}
+
+bool ModelLoadTask::LoadGltfFile(std::vector<OBJFileManager::MaterialGroups::Range>& ranges, std::vector<uint32_t>& materialOfName)
+{
+    GLTFFileManager gfm;
+    if (!gfm.Load(path))
+    {
+        return false;
+    }
+    const std::vector<GLTFFileManager::Primitive>& primitives = gfm.GetPrimitives();
+    const std::vector<GLTFFileManager::Mesh>& meshes = gfm.GetMeshes();
+    const std::vector<GLTFFileManager::Instance>& instances = gfm.GetInstances();
+
+    //The renderer has one model, so every instance of the scene is baked into it with its transform.
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (const GLTFFileManager::Instance& instance : instances)
+    {
+        const GLTFFileManager::Mesh& mesh = meshes[instance.mesh];
+        for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; p++)
+        {
+            vertexCount += primitives[p].vertices.size;
+            indexCount += primitives[p].indices.size;
+        }
+    }
+    if (vertexCount > UINT32_MAX || indexCount > UINT32_MAX)
+    {
+        return false;
+    }
+    //The progress counts indices instead of bytes here. It goes up to twice the total like the two passes of the OBJ parser.
+    parseProgress.totalBytes = indexCount;
+    vertices.reserve(vertexCount);
+    indices.reserve(indexCount);
+    for (const GLTFFileManager::Instance& instance : instances)
+    {
+        const float* m = instance.transform;
+        //A mirroring transform turns the triangles inside out, swapping two corners turns them back.
+        const bool mirrored = m[0] * (m[5] * m[10] - m[6] * m[9]) - m[1] * (m[4] * m[10] - m[6] * m[8]) + m[2] * (m[4] * m[9] - m[5] * m[8]) < 0.0f;
+        const GLTFFileManager::Mesh& mesh = meshes[instance.mesh];
+        for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; p++)
+        {
+            const GLTFFileManager::Primitive& primitive = primitives[p];
+            ranges.push_back({ (uint32_t)(indices.size() / 3), primitive.material == NoMaterial ? OBJFileManager::MissingIndex : primitive.material });
+            const uint32_t firstVertex = (uint32_t)vertices.size();
+            //The normals are generated after welding like the normals of OBJ files.
+            for (const MeshCache::Vertex& vertex : primitive.vertices)
+            {
+                const float x = vertex.position[0], y = vertex.position[1], z = vertex.position[2];
+                vertices.push_back({ { x * m[0] + y * m[4] + z * m[8] + m[12], x * m[1] + y * m[5] + z * m[9] + m[13], x * m[2] + y * m[6] + z * m[10] + m[14] }, { 0.0f, 1.0f, 0.0f } });
+            }
+            for (size_t i = 0; i < primitive.indices.size; i += 3)
+            {
+                indices.push_back(firstVertex + primitive.indices[i]);
+                indices.push_back(firstVertex + primitive.indices[mirrored ? i + 2 : i + 1]);
+                indices.push_back(firstVertex + primitive.indices[mirrored ? i + 1 : i + 2]);
+            }
+            parseProgress.processedBytes = 2 * indices.size();
+            if (parseProgress.cancelled)
+            {
+                return false;
+            }
+        }
+    }
+
+    //The material indices of the primitives take the place of the material names of an OBJ file.
+    for (const MeshCache::Material& material : gfm.GetMaterials())
+    {
+        materialOfName.push_back(FindOrAddMaterial(materials, material));
+    }
+    return true;
+}
+
+MeshCache::Material ModelLoadTask::ConvertMaterial(const objl::Material& material)
+{
+    auto saturate = [](float value) { return std::min(1.0f, std::max(0.0f, value)); };
+    MeshCache::Material converted;
+    converted.albedo[0] = saturate(material.Kd.X);
+    converted.albedo[1] = saturate(material.Kd.Y);
+    converted.albedo[2] = saturate(material.Kd.Z);
+    //The hit shader squares the roughness to get the GGX width, and sqrt(2 / (Ns + 2)) is the width that matches a Blinn-Phong exponent of Ns.
+    converted.roughness = material.Pr >= 0.0f ? saturate(material.Pr) : std::pow(2.0f / (std::max(material.Ns, 0.0f) + 2.0f), 0.25f);
+    converted.metallic = material.Pm >= 0.0f ? saturate(material.Pm) : 0.0f;
+    //Illumination models 3 to 9 all have reflections.
+    bool reflective = material.illum >= 3 && material.illum <= 9;
+    converted.reflectivity = reflective ? saturate(std::max(material.Ks.X, std::max(material.Ks.Y, material.Ks.Z))) : 0.0f;
+    return converted;
+}
+
+bool ModelLoadTask::ComputeVertexNormals(std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices, NormalWeighting weighting,
+    const std::atomic<bool>* cancelled, std::atomic<float>* progress, ThreadPool* pool)
+{
+    //Two phases so that no two threads ever add to the same vertex: the triangles around every vertex are gathered into
+    //compressed rows first, then every vertex sums the normals of its own row. Each row is summed in ascending corner order,
+    //which is the order the serial scatter adds them in, so the result doesn't depend on the thread count or on which of the two runs.
+    if (pool == nullptr)
+    {
+        pool = &ThreadPool::Shared();
+    }
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount <= NormalBatchSize || pool->GetThreadCount() + 1 < MinParallelNormalThreads)
+    {
+        return ScatterVertexNormals(vertices, indices, weighting, cancelled, progress);
+    }
+    const size_t vertexCount = vertices.size();
+    const size_t triangleBatchCount = (triangleCount + NormalBatchSize - 1) / NormalBatchSize;
+    const size_t vertexBatchCount = (vertexCount + NormalBatchSize - 1) / NormalBatchSize;
+    //Every pass over the triangles and over the vertices counts as one step of the progress.
+    const size_t totalSteps = std::max<size_t>(1, triangleBatchCount * 3 + vertexBatchCount);
+    std::atomic<size_t> finishedSteps{ 0 };
+    auto finishStep = [&finishedSteps, totalSteps, progress]()
+    {
+        size_t finished = ++finishedSteps;
+        if (progress != nullptr)
+        {
+            *progress = (float)finished / (float)totalSteps;
+        }
+    };
+    auto isCancelled = [cancelled]() { return cancelled != nullptr && *cancelled; };
+    //Runs body(first, end) over batches of count items in parallel and reports whether the pass ran to the end.
+    auto runBatches = [pool, &finishStep, &isCancelled](size_t count, const std::function<void(size_t, size_t)>& body)
+    {
+        pool->ParallelFor((count + NormalBatchSize - 1) / NormalBatchSize, [&](size_t batch)
+            {
+                if (isCancelled())
+                {
+                    return;
+                }
+                body(batch * NormalBatchSize, std::min(count, (batch + 1) * NormalBatchSize));
+                finishStep();
+            });
+        return !isCancelled();
+    };
+
+    // Step 1: Compute the unit normal of every triangle
+    std::vector<float> faceNormals(triangleCount * 3);
+    if (!runBatches(triangleCount, [&](size_t first, size_t end) { ComputeFaceNormals(vertices.data(), indices.data(), first, end, faceNormals.data()); }))
+    {
+        return false;
+    }
+
+    // Step 2: Sort the corners (3 * triangle + corner) into rows by their vertex, stable so every row stays in ascending corner order.
+    //The first pass is a radix pass over the upper vertex bits that splits the corners into buckets of neighbouring vertices:
+    //every batch counts its digits in parallel, a prefix sum over the counts in digit-major order tells every batch where its corners go,
+    //then the batches scatter in parallel. The second pass sorts every bucket on its own with a counting sort whose counts fit in the cache,
+    //and those counts give the row offsets. Only the corner is stored, the second pass looks its vertex up in indices again.
+    //No two threads ever write to the same place, so no atomics are needed.
+    const size_t cornerCount = triangleCount * 3;
+    int vertexBits = 0;
+    while (vertexBits < 32 && ((uint64_t)1 << vertexBits) < vertexCount)
+    {
+        vertexBits++;
+    }
+    const int bucketShift = std::max(0, vertexBits - BucketBits);
+    const size_t bucketCount = (size_t)1 << BucketBits;
+    std::vector<uint32_t> bucketCounts(triangleBatchCount * bucketCount);
+    if (!runBatches(triangleCount, [&](size_t first, size_t end)
+        {
+            uint32_t* counts = &bucketCounts[first / NormalBatchSize * bucketCount];
+            for (size_t i = first * 3; i < end * 3; i++)
+            {
+                counts[indices[i] >> bucketShift]++;
+            }
+        }))
+    {
+        return false;
+    }
+    //The prefix sum runs in three parts: every group of buckets adds up its counts over all batches in parallel, a serial scan over
+    //the bucket totals gives the bucket starts, then every group turns its counts into the scatter cursors of the batches in parallel.
+    //The groups walk the batches in order, so every pass reads whole runs of neighbouring counts. Only the short scan over the buckets is serial.
+    std::vector<uint32_t> bucketStarts(bucketCount + 1);
+    const size_t scanGroupCount = bucketCount / BucketScanGroupSize;
+    pool->ParallelFor(scanGroupCount, [&](size_t group)
+        {
+            uint32_t* totals = &bucketStarts[group * BucketScanGroupSize];
+            for (size_t batch = 0; batch < triangleBatchCount; batch++)
+            {
+                const uint32_t* counts = &bucketCounts[batch * bucketCount + group * BucketScanGroupSize];
+                for (size_t bucket = 0; bucket < BucketScanGroupSize; bucket++)
+                {
+                    totals[bucket] += counts[bucket];
+                }
+            }
+        });
+    uint32_t offset = 0;
+    for (size_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        uint32_t total = bucketStarts[bucket];
+        bucketStarts[bucket] = offset;
+        offset += total;
+    }
+    bucketStarts[bucketCount] = offset;
+    pool->ParallelFor(scanGroupCount, [&](size_t group)
+        {
+            uint32_t cursors[BucketScanGroupSize];
+            memcpy(cursors, &bucketStarts[group * BucketScanGroupSize], sizeof(cursors));
+            for (size_t batch = 0; batch < triangleBatchCount; batch++)
+            {
+                uint32_t* counts = &bucketCounts[batch * bucketCount + group * BucketScanGroupSize];
+                for (size_t bucket = 0; bucket < BucketScanGroupSize; bucket++)
+                {
+                    uint32_t count = counts[bucket];
+                    counts[bucket] = cursors[bucket];
+                    cursors[bucket] += count;
+                }
+            }
+        });
+    std::vector<uint32_t> corners(cornerCount);
+    if (!runBatches(triangleCount, [&](size_t first, size_t end)
+        {
+            uint32_t* cursors = &bucketCounts[first / NormalBatchSize * bucketCount];
+            for (size_t i = first * 3; i < end * 3; i++)
+            {
+                corners[cursors[indices[i] >> bucketShift]++] = (uint32_t)i;
+            }
+        }))
+    {
+        return false;
+    }
+    bucketCounts.clear();
+    bucketCounts.shrink_to_fit();
+
+    std::vector<uint32_t> offsets(vertexCount + 1);
+    pool->ParallelFor(bucketCount, [&](size_t bucket)
+        {
+            const size_t firstVertex = std::min(vertexCount, bucket << bucketShift);
+            const size_t endVertex = std::min(vertexCount, (bucket + 1) << bucketShift);
+            if (isCancelled() || firstVertex == endVertex)
+            {
+                return;
+            }
+            //The bucket is copied out and sorted back into its place in corners.
+            std::vector<uint32_t> bucketCorners(corners.begin() + bucketStarts[bucket], corners.begin() + bucketStarts[bucket + 1]);
+            std::vector<uint32_t> cursors(endVertex - firstVertex, 0);
+            for (uint32_t corner : bucketCorners)
+            {
+                cursors[indices[corner] - firstVertex]++;
+            }
+            uint32_t rowStart = bucketStarts[bucket];
+            for (size_t v = firstVertex; v < endVertex; v++)
+            {
+                offsets[v] = rowStart;
+                rowStart += cursors[v - firstVertex];
+                cursors[v - firstVertex] = offsets[v];
+            }
+            for (uint32_t corner : bucketCorners)
+            {
+                corners[cursors[indices[corner] - firstVertex]++] = corner;
+            }
+        });
+    if (isCancelled())
+    {
+        return false;
+    }
+    offsets[vertexCount] = (uint32_t)cornerCount;
+
+    // Step 3: Every vertex sums the normals of its triangles and normalizes the sum. They are flipped to match the winding of the loaded models.
+    bool finished = runBatches(vertexCount, [&](size_t first, size_t end)
+        {
+            for (size_t v = first; v < end; v++)
+            {
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++)
+                {
+                    uint32_t corner = corners[i];
+                    const float* normal = &faceNormals[corner / 3 * 3];
+                    float weight = weighting == NormalWeighting::Angle ? GetCornerAngle(vertices.data(), indices.data(), corner) : 1.0f;
+                    sum[0] += normal[0] * weight;
+                    sum[1] += normal[1] * weight;
+                    sum[2] += normal[2] * weight;
+                }
+                Normalize(sum);
+                vertices[v].normal[0] = -sum[0];
+                vertices[v].normal[1] = -sum[1];
+                vertices[v].normal[2] = -sum[2];
+            }
+        });
+    if (finished && progress != nullptr)
+    {
+        *progress = 1.0f;
+    }
+    return finished;
+}
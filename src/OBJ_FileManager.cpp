@@ -1,71 +1,691 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "OBJ_FileManager.h"
+#include "OBJ_ParseUtils.h"
+#include "MemoryMappedFile.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <cstdio>
-#include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 using namespace objl;
+using namespace objl::parse;
 
-bool OBJFileManager::LoadObjFile(std::string path, std::vector<objl::Vertex>& vertices, std::vector<unsigned int>& indices)
+namespace
 {
-    std::ifstream file(path);
-    if (!file.good())
+    typedef OBJFileManager::FaceCorner FaceCorner;
+    const uint32_t MissingIndex = OBJFileManager::MissingIndex;
+
+    inline bool IsKeywordLine(const char* line, const char* end, const char* keyword, size_t keywordLength)
     {
-        return false;
+        return (size_t)(end - line) > keywordLength && memcmp(line, keyword, keywordLength) == 0 && (line[keywordLength] == ' ' || line[keywordLength] == '\t');
+    }
+
+    inline bool IsVertexLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "v", 1);
+    }
+
+    inline bool IsTexCoordLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "vt", 2);
+    }
+
+    inline bool IsNormalLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "vn", 2);
+    }
+
+    inline bool IsFaceLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "f", 1);
+    }
+
+    inline bool IsUseMaterialLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "usemtl", 6);
+    }
+
+    inline bool IsMaterialLibraryLine(const char* line, const char* end)
+    {
+        return IsKeywordLine(line, end, "mtllib", 6);
+    }
+
+    inline void ParseVector3(const char* cursor, const char* lineEnd, Vector3& value)
+    {
+        cursor = ParseFloat(cursor, lineEnd, value.X);
+        cursor = ParseFloat(cursor, lineEnd, value.Y);
+        cursor = ParseFloat(cursor, lineEnd, value.Z);
+    }
+
+    inline void ParseVector2(const char* cursor, const char* lineEnd, Vector2& value)
+    {
+        cursor = ParseFloat(cursor, lineEnd, value.X);
+        cursor = ParseFloat(cursor, lineEnd, value.Y);
+    }
+
+    //A piece of the file that is parsed on its own thread.
+    struct ObjChunk
+    {
+        TextChunk text;
+        size_t positionCount = 0;
+        size_t texCoordCount = 0;
+        size_t normalCount = 0;
+        size_t triangleCount = 0;
+        //Number of attributes and triangles in all the chunks before this one.
+        size_t firstPosition = 0;
+        size_t firstTexCoord = 0;
+        size_t firstNormal = 0;
+        size_t firstTriangle = 0;
+        //Set if any face corner references a texture coordinate or a normal.
+        bool hasCornerAttributes = false;
+        //Cleared if a face references an attribute that doesn't exist.
+        bool valid = true;
+        //usemtl statements as the index of the next triangle in this chunk and the material name, and the mtllib statements.
+        //They point into the mapped file.
+        std::vector<std::pair<size_t, std::string_view>> materialSwitches;
+        std::vector<std::string_view> materialLibraries;
+    };
+
+    size_t CountFaceCorners(const char* cursor, const char* lineEnd)
+    {
+        size_t cornerCount = 0;
+        while (true)
+        {
+            cursor = SkipInlineWhitespace(cursor, lineEnd);
+            if (cursor >= lineEnd)
+            {
+                return cornerCount;
+            }
+            cursor = SkipToken(cursor, lineEnd);
+            cornerCount++;
+        }
     }
-    std::string str;
-    unsigned int max_index = 0;
-    while (std::getline(file, str))
+
+    //Parses one "v", "v/vt", "v//vn" or "v/vt/vn" token of a face. Indices that are not in the token are written as 0.
+    const char* ParseFaceCorner(const char* cursor, const char* lineEnd, long long (&values)[3])
     {
-        if (str.length() < 2)
+        values[0] = values[1] = values[2] = 0;
+        cursor = ParseInt(cursor, lineEnd, values[0]);
+        for (int i = 1; i < 3 && cursor < lineEnd && *cursor == '/'; i++)
         {
-            continue;
+            cursor++;
+            if (cursor < lineEnd && *cursor != '/' && !IsInlineWhitespace(*cursor))
+            {
+                cursor = ParseInt(cursor, lineEnd, values[i]);
+            }
         }
-        std::string data = std::string(str.c_str() + 1);
-        std::stringstream ss = std::stringstream(data);
-        if (str[0] == 'v' && str[1] == ' ') //vertex
+        return SkipToken(cursor, lineEnd);
+    }
+
+    //OBJ indices are 1-based. Negative indices are relative to the last attribute read so far.
+    inline bool ResolveIndex(long long index, size_t readCount, size_t totalCount, uint32_t& resolved)
+    {
+        long long resolvedIndex = index < 0 ? (long long)readCount + index : index - 1;
+        if (resolvedIndex < 0 || resolvedIndex >= (long long)totalCount || resolvedIndex >= (long long)MissingIndex)
+        {
+            return false;
+        }
+        resolved = (uint32_t)resolvedIndex;
+        return true;
+    }
+
+    //Parses the corners of a face line and passes every triangle of its fan to emitTriangle(a, b, c).
+    //Polygons are triangulated as a fan around their first corner, so a triangle keeps its corner order.
+    //readCounts and totalCounts hold the number of positions, texture coordinates and normals read before the line and in total.
+    //Returns false if a corner references an attribute that doesn't exist or emitTriangle returns false.
+    template <class EmitTriangle>
+    bool ParseFace(const char* line, const char* lineEnd, const size_t (&readCounts)[3], const size_t (&totalCounts)[3], bool& hasCornerAttributes, EmitTriangle emitTriangle)
+    {
+        FaceCorner firstCorner = {};
+        FaceCorner previousCorner = {};
+        size_t cornerIndex = 0;
+        const char* cursor = SkipInlineWhitespace(line + 1, lineEnd);
+        while (cursor < lineEnd)
+        {
+            long long values[3];
+            cursor = ParseFaceCorner(cursor, lineEnd, values);
+            cursor = SkipInlineWhitespace(cursor, lineEnd);
+
+            FaceCorner corner = { MissingIndex, MissingIndex, MissingIndex };
+            bool valid = ResolveIndex(values[0], readCounts[0], totalCounts[0], corner.position);
+            if (values[1] != 0)
+            {
+                valid = valid && ResolveIndex(values[1], readCounts[1], totalCounts[1], corner.texCoord);
+                hasCornerAttributes = true;
+            }
+            if (values[2] != 0)
+            {
+                valid = valid && ResolveIndex(values[2], readCounts[2], totalCounts[2], corner.normal);
+                hasCornerAttributes = true;
+            }
+            if (!valid)
+            {
+                return false;
+            }
+
+            if (cornerIndex == 0)
+            {
+                firstCorner = corner;
+            }
+            else if (cornerIndex >= 2 && !emitTriangle(firstCorner, previousCorner, corner))
+            {
+                return false;
+            }
+            previousCorner = corner;
+            cornerIndex++;
+        }
+        return true;
+    }
+
+    void CountChunkLines(ObjChunk& chunk)
+    {
+        for (const char* line = chunk.text.begin; line < chunk.text.end; line = NextLine(line, chunk.text.end))
+        {
+            const char* lineEnd = LineEnd(line, chunk.text.end);
+            if (IsVertexLine(line, lineEnd))
+            {
+                chunk.positionCount++;
+            }
+            else if (IsTexCoordLine(line, lineEnd))
+            {
+                chunk.texCoordCount++;
+            }
+            else if (IsNormalLine(line, lineEnd))
+            {
+                chunk.normalCount++;
+            }
+            else if (IsFaceLine(line, lineEnd))
+            {
+                size_t cornerCount = CountFaceCorners(line + 1, lineEnd);
+                if (cornerCount >= 3)
+                {
+                    chunk.triangleCount += cornerCount - 2;
+                }
+            }
+        }
+    }
+
+    //Output arrays of the whole file. Every chunk writes to its own part of them.
+    struct ObjArrays
+    {
+        Vector3* positions;
+        Vector2* texCoords;
+        Vector3* normals;
+        FaceCorner* corners;
+        size_t positionCount;
+        size_t texCoordCount;
+        size_t normalCount;
+    };
+
+    void ParseChunkLines(ObjChunk& chunk, const ObjArrays& arrays)
+    {
+        //Relative (negative) indices refer to the attributes read before the face in the whole file,
+        //so the counters start from the number of attributes in the previous chunks.
+        size_t positionsRead = chunk.firstPosition;
+        size_t texCoordsRead = chunk.firstTexCoord;
+        size_t normalsRead = chunk.firstNormal;
+        FaceCorner* cornerOut = arrays.corners + chunk.firstTriangle * 3;
+        for (const char* line = chunk.text.begin; line < chunk.text.end; line = NextLine(line, chunk.text.end))
+        {
+            const char* lineEnd = LineEnd(line, chunk.text.end);
+            if (IsVertexLine(line, lineEnd))
+            {
+                ParseVector3(line + 1, lineEnd, arrays.positions[positionsRead++]);
+            }
+            else if (IsTexCoordLine(line, lineEnd))
+            {
+                ParseVector2(line + 2, lineEnd, arrays.texCoords[texCoordsRead++]);
+            }
+            else if (IsNormalLine(line, lineEnd))
+            {
+                ParseVector3(line + 2, lineEnd, arrays.normals[normalsRead++]);
+            }
+            else if (IsFaceLine(line, lineEnd))
+            {
+                const size_t readCounts[3] = { positionsRead, texCoordsRead, normalsRead };
+                const size_t totalCounts[3] = { arrays.positionCount, arrays.texCoordCount, arrays.normalCount };
+                bool valid = ParseFace(line, lineEnd, readCounts, totalCounts, chunk.hasCornerAttributes,
+                    [&cornerOut](const FaceCorner& a, const FaceCorner& b, const FaceCorner& c)
+                    {
+                        cornerOut[0] = a;
+                        cornerOut[1] = b;
+                        cornerOut[2] = c;
+                        cornerOut += 3;
+                        return true;
+                    });
+                if (!valid)
+                {
+                    chunk.valid = false;
+                    return;
+                }
+            }
+            else if (IsUseMaterialLine(line, lineEnd))
+            {
+                size_t triangle = (size_t)(cornerOut - arrays.corners) / 3 - chunk.firstTriangle;
+                chunk.materialSwitches.emplace_back(triangle, Tail(std::string_view(line, (size_t)(TrimmedLineEnd(line, lineEnd) - line))));
+            }
+            else if (IsMaterialLibraryLine(line, lineEnd))
+            {
+                chunk.materialLibraries.push_back(Tail(std::string_view(line, (size_t)(TrimmedLineEnd(line, lineEnd) - line))));
+            }
+        }
+    }
+
+    //Joins the usemtl and mtllib statements of the chunks into material groups.
+    void CollectMaterialGroups(const std::vector<ObjChunk>& chunks, OBJFileManager::MaterialGroups& groups)
+    {
+        typedef OBJFileManager::MaterialGroups::Range Range;
+        groups = OBJFileManager::MaterialGroups();
+        groups.ranges.push_back({ 0, MissingIndex });
+        std::unordered_map<std::string_view, uint32_t> materialIndices;
+        for (const ObjChunk& chunk : chunks)
+        {
+            for (std::string_view library : chunk.materialLibraries)
+            {
+                groups.libraries.emplace_back(library);
+            }
+            for (const std::pair<size_t, std::string_view>& materialSwitch : chunk.materialSwitches)
+            {
+                auto inserted = materialIndices.emplace(materialSwitch.second, (uint32_t)groups.names.size());
+                if (inserted.second)
+                {
+                    groups.names.emplace_back(materialSwitch.second);
+                }
+                Range range = { (uint32_t)(chunk.firstTriangle + materialSwitch.first), inserted.first->second };
+                //A switch before any triangle of the previous material replaces it.
+                if (groups.ranges.back().firstTriangle == range.firstTriangle)
+                {
+                    groups.ranges.pop_back();
+                }
+                if (groups.ranges.empty() || groups.ranges.back().material != range.material)
+                {
+                    groups.ranges.push_back(range);
+                }
+            }
+        }
+    }
+
+    inline size_t HashCorner(const FaceCorner& corner)
+    {
+        uint64_t hash = corner.position * 0x9E3779B97F4A7C15ULL;
+        hash ^= (corner.texCoord + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+        hash ^= (corner.normal + 0x85EBCA77C2B2AE63ULL) * 0x165667B19E3779F9ULL;
+        return (size_t)(hash ^ (hash >> 29));
+    }
+
+    //Gives every distinct (position, texture coordinate, normal) triple one vertex, in the order the triples are first used.
+    void WeldCorners(const std::vector<FaceCorner>& corners, const std::vector<Vector3>& positions, const std::vector<Vector2>& texCoords, const std::vector<Vector3>& normals,
+        std::vector<objl::Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        //Open addressing table that holds indices into weldedCorners. It is kept at most half full.
+        size_t capacity = 16;
+        while (capacity < positions.size() * 2)
         {
-            float x, y, z;
-            ss >> x >> y >> z;
-            objl::Vertex v;
-            v.Position = objl::Vector3(x, y, z);
-            vertices.push_back(v);
+            capacity *= 2;
         }
-        else if (str[0] == 'f' && str[1] == ' ') //face
+        std::vector<uint32_t> slots(capacity, MissingIndex);
+        std::vector<FaceCorner> weldedCorners;
+        weldedCorners.reserve(positions.size());
+
+        const size_t firstIndex = indices.size();
+        indices.resize(firstIndex + corners.size());
+        for (size_t i = 0; i < corners.size(); i++)
         {
-            unsigned int i0, i1, i2;
-            ss >> i0 >> i1 >> i2;
-            i0--;
-            i1--;
-            i2--;
-            unsigned int currentMax = 0;
-            if (i0 > i1 && i0 > i2)
+            const FaceCorner& corner = corners[i];
+            size_t slot = HashCorner(corner) & (capacity - 1);
+            while (slots[slot] != MissingIndex && !(weldedCorners[slots[slot]] == corner))
             {
-                currentMax = i0;
+                slot = (slot + 1) & (capacity - 1);
             }
-            if (i1 > i0 && i1 > i2)
+            if (slots[slot] != MissingIndex)
             {
-                currentMax = i1;
+                indices[firstIndex + i] = slots[slot];
+                continue;
             }
-            if (i2 > i1 && i2 > i0)
+
+            slots[slot] = (uint32_t)weldedCorners.size();
+            indices[firstIndex + i] = slots[slot];
+            weldedCorners.push_back(corner);
+            if (weldedCorners.size() * 2 > capacity)
             {
-                currentMax = i2;
+                capacity *= 2;
+                slots.assign(capacity, MissingIndex);
+                for (size_t j = 0; j < weldedCorners.size(); j++)
+                {
+                    size_t newSlot = HashCorner(weldedCorners[j]) & (capacity - 1);
+                    while (slots[newSlot] != MissingIndex)
+                    {
+                        newSlot = (newSlot + 1) & (capacity - 1);
+                    }
+                    slots[newSlot] = (uint32_t)j;
+                }
             }
+        }
 
-            if (currentMax > max_index)
+        const size_t firstVertex = vertices.size();
+        vertices.resize(firstVertex + weldedCorners.size());
+        for (size_t i = 0; i < weldedCorners.size(); i++)
+        {
+            const FaceCorner& corner = weldedCorners[i];
+            objl::Vertex& vertex = vertices[firstVertex + i];
+            vertex.Position = positions[corner.position];
+            if (corner.texCoord != MissingIndex)
             {
-                max_index = currentMax;
+                vertex.TextureCoordinate = texCoords[corner.texCoord];
             }
-            
-            indices.push_back(i0);
-            indices.push_back(i1);
-            indices.push_back(i2);
+            if (corner.normal != MissingIndex)
+            {
+                vertex.Normal = normals[corner.normal];
+            }
+        }
+    }
+}
+
+float OBJFileManager::LoadProgress::GetFraction() const
+{
+    uint64_t total = totalBytes.load();
+    if (total == 0)
+    {
+        return 0.0f;
+    }
+    return std::min(1.0f, (float)((double)processedBytes.load() / (2.0 * (double)total)));
+}
+
+bool OBJFileManager::LoadObjFile(std::string path, std::vector<objl::Vertex>& vertices, std::vector<unsigned int>& indices, LoadProgress* progress,
+    MaterialGroups* materials)
+{
+    MemoryMappedFile file;
+    if (!file.Open(path))
+    {
+        return false;
+    }
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+
+    //Small files end up in a single chunk, which is the same as parsing them serially.
+    //When someone follows the load, the file is split finer than the thread count so that progress and cancellation
+    //are noticed every few megabytes. The chunk count doesn't change the result.
+    ThreadPool& pool = ThreadPool::Shared();
+    size_t maxChunks = pool.GetThreadCount();
+    if (progress != nullptr)
+    {
+        maxChunks = std::max<size_t>(maxChunks * 4, 64);
+        progress->totalBytes = file.Size();
+        progress->processedBytes = 0;
+    }
+    std::vector<TextChunk> textChunks = SplitIntoLineChunks(begin, end, maxChunks);
+    std::vector<ObjChunk> chunks(textChunks.size());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i].text = textChunks[i];
+    }
+
+    //Runs a pass over one chunk unless the load was cancelled, then reports the chunk as processed.
+    auto runPass = [progress, &chunks](size_t i, const auto& pass)
+    {
+        if (progress != nullptr && progress->cancelled)
+        {
+            return;
+        }
+        pass(chunks[i]);
+        if (progress != nullptr)
+        {
+            progress->processedBytes += (uint64_t)(chunks[i].text.end - chunks[i].text.begin);
         }
-        else
+    };
+    auto isCancelled = [progress]() { return progress != nullptr && progress->cancelled; };
+
+    //First pass: count the attributes and triangles so that the arrays are allocated exactly once.
+    pool.ParallelFor(chunks.size(), [&runPass](size_t i)
+        {
+            runPass(i, [](ObjChunk& chunk) { CountChunkLines(chunk); });
+        });
+    if (isCancelled())
+    {
+        return false;
+    }
+
+    size_t positionCount = 0;
+    size_t texCoordCount = 0;
+    size_t normalCount = 0;
+    size_t triangleCount = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.firstPosition = positionCount;
+        chunk.firstTexCoord = texCoordCount;
+        chunk.firstNormal = normalCount;
+        chunk.firstTriangle = triangleCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+        triangleCount += chunk.triangleCount;
+    }
+
+    std::vector<Vector3> positions(positionCount);
+    std::vector<Vector2> texCoords(texCoordCount);
+    std::vector<Vector3> normals(normalCount);
+    std::vector<FaceCorner> corners(triangleCount * 3);
+    ObjArrays arrays = { positions.data(), texCoords.data(), normals.data(), corners.data(), positionCount, texCoordCount, normalCount };
+
+    //Second pass: every chunk parses its lines in place and writes straight into its own part of the arrays.
+    pool.ParallelFor(chunks.size(), [&runPass, &arrays](size_t i)
         {
-            continue;
+            runPass(i, [&arrays](ObjChunk& chunk) { ParseChunkLines(chunk, arrays); });
+        });
+    if (isCancelled())
+    {
+        return false;
+    }
+
+    bool hasCornerAttributes = false;
+    for (const ObjChunk& chunk : chunks)
+    {
+        if (!chunk.valid)
+        {
+            return false;
         }
+        hasCornerAttributes = hasCornerAttributes || chunk.hasCornerAttributes;
+    }
+    if (materials != nullptr)
+    {
+        CollectMaterialGroups(chunks, *materials);
     }
+
+    if (!hasCornerAttributes)
+    {
+        //Faces only reference positions, so every position is already a unique vertex and no welding is needed.
+        const size_t firstVertex = vertices.size();
+        vertices.resize(firstVertex + positionCount);
+        for (size_t i = 0; i < positionCount; i++)
+        {
+            vertices[firstVertex + i].Position = positions[i];
+        }
+        const size_t firstIndex = indices.size();
+        indices.resize(firstIndex + corners.size());
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            indices[firstIndex + i] = corners[i].position;
+        }
+        return true;
+    }
+
+    WeldCorners(corners, positions, texCoords, normals, vertices, indices);
     return true;
-}
\ No newline at end of file
+}
+
+std::vector<std::string> OBJFileManager::FindMaterialLibraries(const char* data, size_t size)
+{
+    std::vector<std::string> libraries;
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end)
+    {
+        const char* lineEnd = LineEnd(line, end);
+        if (IsMaterialLibraryLine(line, lineEnd))
+        {
+            libraries.emplace_back(Tail(std::string_view(line, (size_t)(TrimmedLineEnd(line, lineEnd) - line))));
+        }
+        line = lineEnd == end ? end : lineEnd + 1;
+    }
+    return libraries;
+}
+
+OBJFileManager::StreamSettings OBJFileManager::StreamSettings::FromMemoryBudget(size_t budgetInBytes)
+{
+    //A quarter of the budget goes to reading, the rest is shared by the triangles (36 bytes each) and the attributes (32 bytes each).
+    StreamSettings settings;
+    settings.readBlockSize = std::max<size_t>(budgetInBytes / 4, 64 * 1024);
+    size_t chunkBytes = budgetInBytes - std::min(budgetInBytes, settings.readBlockSize);
+    settings.trianglesPerChunk = std::max<size_t>(chunkBytes / 2 / (3 * sizeof(FaceCorner)), 1024);
+    settings.attributesPerChunk = std::max<size_t>(chunkBytes / 2 / (2 * sizeof(Vector3) + sizeof(Vector2)), 1024);
+    return settings;
+}
+
+bool OBJFileManager::StreamObjFile(const std::string& path, const StreamSettings& settings, const std::function<bool(const StreamChunk& chunk)>& consumer)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<char> block(std::max<size_t>(settings.readBlockSize, 1));
+    std::vector<Vector3> positions;
+    std::vector<Vector2> texCoords;
+    std::vector<Vector3> normals;
+    std::vector<FaceCorner> corners;
+    const size_t trianglesPerChunk = std::max<size_t>(settings.trianglesPerChunk, 1);
+    const size_t attributesPerChunk = std::max<size_t>(settings.attributesPerChunk, 1);
+    positions.reserve(attributesPerChunk);
+    corners.reserve(trianglesPerChunk * 3);
+
+    //Number of attributes and triangles in the chunks that are already passed to the consumer.
+    size_t firstPosition = 0;
+    size_t firstTexCoord = 0;
+    size_t firstNormal = 0;
+    size_t firstTriangle = 0;
+
+    auto flush = [&]()
+    {
+        if (positions.empty() && texCoords.empty() && normals.empty() && corners.empty())
+        {
+            return true;
+        }
+        StreamChunk chunk;
+        chunk.positions = positions.data();
+        chunk.positionCount = positions.size();
+        chunk.firstPosition = firstPosition;
+        chunk.texCoords = texCoords.data();
+        chunk.texCoordCount = texCoords.size();
+        chunk.firstTexCoord = firstTexCoord;
+        chunk.normals = normals.data();
+        chunk.normalCount = normals.size();
+        chunk.firstNormal = firstNormal;
+        chunk.corners = corners.data();
+        chunk.triangleCount = corners.size() / 3;
+        chunk.firstTriangle = firstTriangle;
+        bool keepGoing = consumer(chunk);
+
+        firstPosition += positions.size();
+        firstTexCoord += texCoords.size();
+        firstNormal += normals.size();
+        firstTriangle += corners.size() / 3;
+        positions.clear();
+        texCoords.clear();
+        normals.clear();
+        corners.clear();
+        return keepGoing;
+    };
+
+    auto emitTriangle = [&](const FaceCorner& a, const FaceCorner& b, const FaceCorner& c)
+    {
+        corners.push_back(a);
+        corners.push_back(b);
+        corners.push_back(c);
+        return corners.size() < trianglesPerChunk * 3 || flush();
+    };
+
+    bool succeeded = true;
+    bool endOfFile = false;
+    size_t filled = 0;
+    while (succeeded && !endOfFile)
+    {
+        size_t requested = block.size() - filled;
+        size_t read = fread(block.data() + filled, 1, requested, file);
+        filled += read;
+        if (read < requested)
+        {
+            endOfFile = true;
+            succeeded = ferror(file) == 0;
+        }
+
+        //Only whole lines are parsed, the rest of the block is moved to its start and completed by the next read.
+        const char* begin = block.data();
+        const char* end = begin + filled;
+        const char* parseEnd = end;
+        if (!endOfFile)
+        {
+            while (parseEnd > begin && parseEnd[-1] != '\n')
+            {
+                parseEnd--;
+            }
+            if (parseEnd == begin)
+            {
+                //A single line doesn't fit in the block.
+                block.resize(block.size() * 2);
+                continue;
+            }
+        }
+
+        for (const char* line = begin; succeeded && line < parseEnd; line = NextLine(line, parseEnd))
+        {
+            const char* lineEnd = LineEnd(line, parseEnd);
+            if (IsVertexLine(line, lineEnd))
+            {
+                positions.emplace_back();
+                ParseVector3(line + 1, lineEnd, positions.back());
+            }
+            else if (IsTexCoordLine(line, lineEnd))
+            {
+                texCoords.emplace_back();
+                ParseVector2(line + 2, lineEnd, texCoords.back());
+            }
+            else if (IsNormalLine(line, lineEnd))
+            {
+                normals.emplace_back();
+                ParseVector3(line + 2, lineEnd, normals.back());
+            }
+            else if (IsFaceLine(line, lineEnd))
+            {
+                //Attributes that come later in the file are not known yet, so the indices can only go up to the ones read so far.
+                const size_t readCounts[3] = { firstPosition + positions.size(), firstTexCoord + texCoords.size(), firstNormal + normals.size() };
+                bool hasCornerAttributes = false;
+                succeeded = ParseFace(line, lineEnd, readCounts, readCounts, hasCornerAttributes, emitTriangle);
+                continue;
+            }
+            else
+            {
+                continue;
+            }
+
+            if (positions.size() + texCoords.size() + normals.size() >= attributesPerChunk)
+            {
+                succeeded = flush();
+            }
+        }
+
+        filled = (size_t)(end - parseEnd);
+        memmove(block.data(), parseEnd, filled);
+    }
+
+    fclose(file);
+    //The consumer stopping at the last chunk doesn't matter since the whole file was read.
+    if (succeeded)
+    {
+        flush();
+    }
+    return succeeded;
+}
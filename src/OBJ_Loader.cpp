@@ -1,4 +1,10 @@
 #include "OBJ_Loader.h"
+#include "OBJ_ParseUtils.h"
+#include "MemoryMappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <climits>
 
 using namespace objl;
 
@@ -97,11 +103,12 @@ Vector3 Vector3::operator/(const float& other) const
 //Material implementations
 Material::Material()
 {
-    name;
     Ns = 0.0f;
     Ni = 0.0f;
     d = 0.0f;
     illum = 0;
+    Pr = -1.0f;
+    Pm = -1.0f;
 }
 //----------------------------------------------------------
 
@@ -110,13 +117,11 @@ Material::Material()
 //Mesh implementations
 Mesh::Mesh()
 {
-
-}
-
-Mesh::Mesh(std::vector<Vertex>& _Vertices, std::vector<unsigned int>& _Indices)
-{
-    Vertices = _Vertices;
-    Indices = _Indices;
+    VertexStart = 0;
+    VertexCount = 0;
+    IndexStart = 0;
+    IndexCount = 0;
+    MaterialIndex = NoMaterial;
 }
 //----------------------------------------------------------
 
@@ -295,14 +300,18 @@ inline std::string algorithm::firstToken(const std::string& in)
 
 // Get element at given index position
 template <class T>
-inline const T& algorithm::getElement(const std::vector<T>& elements, std::string& index)
+inline bool algorithm::getElement(const std::vector<T>& elements, size_t visibleCount, std::string_view index, T& element)
 {
-    int idx = std::stoi(index);
+    long long idx = 0;
+    parse::ParseInt(index.data(), index.data() + index.size(), idx);
     if (idx < 0)
-        idx = int(elements.size()) + idx;
+        idx = (long long)visibleCount + idx;
     else
         idx--;
-    return elements[idx];
+    if (idx < 0 || idx >= (long long)elements.size())
+        return false;
+    element = elements[idx];
+    return true;
 }
 //----------------------------------------------------------
 
@@ -310,6 +319,78 @@ inline const T& algorithm::getElement(const std::vector<T>& elements, std::strin
 //----------------------------------------------------------
 //Loader class implementations
 
+namespace
+{
+    // Kinds of lines that have to be handled in file order
+    //	after the chunks of the file are parsed in parallel
+    enum class LineEventType
+    {
+        // A face, its vertices and indices are already generated
+        Face,
+        // An o, g, usemtl or mtllib line
+        Statement
+    };
+
+    struct LineEvent
+    {
+        LineEventType Type;
+        // Line contents of a statement
+        const char* Line;
+        size_t LineLength;
+        // Number of vertices and indices generated from a face
+        unsigned int VertexCount;
+        unsigned int IndexCount;
+    };
+
+    // Parse the three components of a material color, the
+    //	color is left as it is unless there are exactly three
+    bool ParseColor(std::string_view values, Vector3& color)
+    {
+        const char* cursor = values.data();
+        const char* end = values.data() + values.size();
+        std::string_view components[3];
+        for (int i = 0; i < 3; i++)
+        {
+            components[i] = parse::NextToken(cursor, end);
+            if (components[i].empty())
+                return false;
+        }
+        if (!parse::NextToken(cursor, end).empty())
+            return false;
+
+        float* outputs[3] = { &color.X, &color.Y, &color.Z };
+        for (int i = 0; i < 3; i++)
+        {
+            parse::ParseFloat(components[i].data(), components[i].data() + components[i].size(), *outputs[i]);
+        }
+        return true;
+    }
+}
+
+struct Loader::FileChunk
+{
+    parse::TextChunk Text;
+
+    // Attributes defined in the chunk
+    std::vector<Vector3> Positions;
+    std::vector<Vector2> TCoords;
+    std::vector<Vector3> Normals;
+
+    // Attributes defined in all the chunks before this one
+    AttributeCounts First;
+
+    // Face vertices and triangulated face indices, the indices
+    //	are relative to the first vertex of their face
+    std::vector<Vertex> FaceVertices;
+    std::vector<unsigned int> FaceIndices;
+
+    // Faces and statements in file order
+    std::vector<LineEvent> Events;
+
+    // Whether a face of the chunk references an attribute
+    //	that doesn't exist, which fails the whole file
+    bool Failed = false;
+};
 
 Loader::Loader()
 {
@@ -320,6 +401,33 @@ Loader::~Loader()
     LoadedMeshes.clear();
 }
 
+const Vertex* Loader::GetMeshVertices(const Mesh& mesh) const
+{
+    return LoadedVertices.data() + mesh.VertexStart;
+}
+
+const unsigned int* Loader::GetMeshIndices(const Mesh& mesh) const
+{
+    return LoadedIndices.data() + mesh.IndexStart;
+}
+
+const Material& Loader::GetMeshMaterial(const Mesh& mesh) const
+{
+    static const Material defaultMaterial;
+    return mesh.MaterialIndex < LoadedMaterials.size() ? LoadedMaterials[mesh.MaterialIndex] : defaultMaterial;
+}
+
+std::string_view Loader::Intern(std::string_view text)
+{
+    auto found = InternedLookup.find(text);
+    if (found != InternedLookup.end())
+        return *found;
+    InternedStrings.emplace_back(text);
+    std::string_view interned = InternedStrings.back();
+    InternedLookup.insert(interned);
+    return interned;
+}
+
 // Load a file into the loader
 //
 // If file is loaded return true
@@ -333,236 +441,266 @@ bool Loader::LoadFile(std::string Path)
         return false;
 
 
-    std::ifstream file(Path);
+    MemoryMappedFile file;
 
-    if (!file.is_open())
+    if (!file.Open(Path))
         return false;
 
     LoadedMeshes.clear();
     LoadedVertices.clear();
     LoadedIndices.clear();
 
+    // Split the file into chunks of whole lines, small
+    //	files end up in a single chunk and are parsed serially
+    ThreadPool& pool = ThreadPool::Shared();
+    std::vector<parse::TextChunk> textChunks = parse::SplitIntoLineChunks(file.Data(), file.Data() + file.Size(), pool.GetThreadCount());
+    std::vector<FileChunk> chunks(textChunks.size());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i].Text = textChunks[i];
+    }
+
+    // Parse the attributes of every chunk in parallel
+    pool.ParallelFor(chunks.size(), [this, &chunks](size_t i) { ParseChunkAttributes(chunks[i]); });
+
+    // Merge the attributes in file order and remember where each
+    //	chunk starts, relative indices are rebased on those counts
     std::vector<Vector3> Positions;
     std::vector<Vector2> TCoords;
     std::vector<Vector3> Normals;
 
-    std::vector<Vertex> Vertices;
-    std::vector<unsigned int> Indices;
+    AttributeCounts totalCounts;
+    for (FileChunk& chunk : chunks)
+    {
+        chunk.First = totalCounts;
+        totalCounts.Positions += chunk.Positions.size();
+        totalCounts.TCoords += chunk.TCoords.size();
+        totalCounts.Normals += chunk.Normals.size();
+    }
+    Positions.reserve(totalCounts.Positions);
+    TCoords.reserve(totalCounts.TCoords);
+    Normals.reserve(totalCounts.Normals);
+    for (FileChunk& chunk : chunks)
+    {
+        Positions.insert(Positions.end(), chunk.Positions.begin(), chunk.Positions.end());
+        TCoords.insert(TCoords.end(), chunk.TCoords.begin(), chunk.TCoords.end());
+        Normals.insert(Normals.end(), chunk.Normals.begin(), chunk.Normals.end());
+        chunk.Positions = std::vector<Vector3>();
+        chunk.TCoords = std::vector<Vector2>();
+        chunk.Normals = std::vector<Vector3>();
+    }
+
+    // Generate the face vertices and indices of every chunk in parallel
+    pool.ParallelFor(chunks.size(), [this, &chunks, &Positions, &TCoords, &Normals](size_t i)
+        {
+            chunks[i].Failed = !ParseChunkFaces(chunks[i], Positions, TCoords, Normals);
+        });
+    for (const FileChunk& chunk : chunks)
+    {
+        if (chunk.Failed)
+            return false;
+    }
+
+    // Walk the faces and statements in file order to build the meshes.
+    //	The faces of a chunk are contiguous in file order, so the
+    //	geometry of every chunk is appended to LoadedVertices and
+    //	LoadedIndices at once and released, the meshes only record
+    //	their ranges of it. A file parsed as a single chunk hands
+    //	its geometry over without copying it
+    if (chunks.size() > 1)
+    {
+        size_t totalVertexCount = 0;
+        size_t totalIndexCount = 0;
+        for (const FileChunk& chunk : chunks)
+        {
+            totalVertexCount += chunk.FaceVertices.size();
+            totalIndexCount += chunk.FaceIndices.size();
+        }
+        LoadedVertices.reserve(totalVertexCount);
+        LoadedIndices.reserve(totalIndexCount);
+    }
 
-    std::vector<std::string> MeshMatNames;
+    std::vector<std::string_view> MeshMatNames;
 
     bool listening = false;
     std::string meshname;
 
-    Mesh tempMesh;
+    // Geometry of the faces walked so far, and the start of
+    //	the geometry of the mesh that is being built
+    size_t walkedVertexCount = 0;
+    size_t walkedIndexCount = 0;
+    size_t meshVertexStart = 0;
+    size_t meshIndexStart = 0;
+
+    auto addMesh = [&](const std::string& name)
+    {
+        Mesh mesh;
+        mesh.MeshName = Intern(name);
+        mesh.VertexStart = (unsigned int)meshVertexStart;
+        mesh.VertexCount = (unsigned int)(walkedVertexCount - meshVertexStart);
+        mesh.IndexStart = (unsigned int)meshIndexStart;
+        mesh.IndexCount = (unsigned int)(walkedIndexCount - meshIndexStart);
+        LoadedMeshes.push_back(mesh);
+        meshVertexStart = walkedVertexCount;
+        meshIndexStart = walkedIndexCount;
+    };
+    auto meshHasGeometry = [&]()
+    {
+        return walkedIndexCount > meshIndexStart && walkedVertexCount > meshVertexStart;
+    };
 
 #ifdef OBJL_CONSOLE_OUTPUT
     const unsigned int outputEveryNth = 1000;
     unsigned int outputIndicator = outputEveryNth;
 #endif
 
-    std::string curline;
-    while (std::getline(file, curline))
+    for (FileChunk& chunk : chunks)
     {
-#ifdef OBJL_CONSOLE_OUTPUT
-        if ((outputIndicator = ((outputIndicator + 1) % outputEveryNth)) == 1)
+        if (chunks.size() == 1)
         {
-            if (!meshname.empty())
-            {
-                std::cout
-                    << "\r- " << meshname
-                    << "\t| vertices > " << Positions.size()
-                    << "\t| texcoords > " << TCoords.size()
-                    << "\t| normals > " << Normals.size()
-                    << "\t| triangles > " << (Vertices.size() / 3)
-                    << (!MeshMatNames.empty() ? "\t| material: " + MeshMatNames.back() : "");
-            }
+            LoadedVertices = std::move(chunk.FaceVertices);
+            LoadedIndices = std::move(chunk.FaceIndices);
         }
-#endif
+        else
+        {
+            LoadedVertices.insert(LoadedVertices.end(), chunk.FaceVertices.begin(), chunk.FaceVertices.end());
+            LoadedIndices.insert(LoadedIndices.end(), chunk.FaceIndices.begin(), chunk.FaceIndices.end());
+        }
+        chunk.FaceVertices = std::vector<Vertex>();
+        chunk.FaceIndices = std::vector<unsigned int>();
 
-        // Generate a Mesh Object or Prepare for an object to be created
-        if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g" || curline[0] == 'g')
+        for (const LineEvent& event : chunk.Events)
         {
-            if (!listening)
+#ifdef OBJL_CONSOLE_OUTPUT
+            if ((outputIndicator = ((outputIndicator + 1) % outputEveryNth)) == 1)
             {
-                listening = true;
-
-                if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g")
-                {
-                    meshname = algorithm::tail(curline);
-                }
-                else
+                if (!meshname.empty())
                 {
-                    meshname = "unnamed";
+                    std::cout
+                        << "\r- " << meshname
+                        << "\t| vertices > " << Positions.size()
+                        << "\t| texcoords > " << TCoords.size()
+                        << "\t| normals > " << Normals.size()
+                        << "\t| triangles > " << ((walkedVertexCount - meshVertexStart) / 3)
+                        << (!MeshMatNames.empty() ? "\t| material: " + std::string(MeshMatNames.back()) : "");
                 }
             }
-            else
-            {
-                // Generate the mesh to put into the array
+#endif
 
-                if (!Indices.empty() && !Vertices.empty())
+            // Add a Face (vertices & indices)
+            if (event.Type == LineEventType::Face)
+            {
+                // The vertices are in place already, the indices are
+                //	made relative to the first vertex of the file
+                for (unsigned int i = 0; i < event.IndexCount; i++)
                 {
-                    // Create Mesh
-                    tempMesh = Mesh(Vertices, Indices);
-                    tempMesh.MeshName = meshname;
+                    LoadedIndices[walkedIndexCount + i] += (unsigned int)walkedVertexCount;
+                }
 
-                    // Insert Mesh
-                    LoadedMeshes.push_back(tempMesh);
+                walkedVertexCount += event.VertexCount;
+                walkedIndexCount += event.IndexCount;
+                continue;
+            }
 
-                    // Cleanup
-                    Vertices.clear();
-                    Indices.clear();
-                    meshname.clear();
+            std::string_view curline(event.Line, event.LineLength);
+            std::string_view firstToken = parse::FirstToken(curline);
 
-                    meshname = algorithm::tail(curline);
-                }
-                else
+            // Generate a Mesh Object or Prepare for an object to be created
+            if (firstToken == "o" || firstToken == "g" || curline[0] == 'g')
+            {
+                if (!listening)
                 {
-                    if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g")
+                    listening = true;
+
+                    if (firstToken == "o" || firstToken == "g")
                     {
-                        meshname = algorithm::tail(curline);
+                        meshname = parse::Tail(curline);
                     }
                     else
                     {
                         meshname = "unnamed";
                     }
                 }
-            }
-#ifdef OBJL_CONSOLE_OUTPUT
-            std::cout << std::endl;
-            outputIndicator = 0;
-#endif
-        }
-        // Generate a Vertex Position
-        if (algorithm::firstToken(curline) == "v")
-        {
-            std::vector<std::string> spos;
-            Vector3 vpos;
-            algorithm::split(algorithm::tail(curline), spos, " ");
-
-            vpos.X = std::stof(spos[0]);
-            vpos.Y = std::stof(spos[1]);
-            vpos.Z = std::stof(spos[2]);
-
-            Positions.push_back(vpos);
-        }
-        // Generate a Vertex Texture Coordinate
-        if (algorithm::firstToken(curline) == "vt")
-        {
-            std::vector<std::string> stex;
-            Vector2 vtex;
-            algorithm::split(algorithm::tail(curline), stex, " ");
-
-            vtex.X = std::stof(stex[0]);
-            vtex.Y = std::stof(stex[1]);
-
-            TCoords.push_back(vtex);
-        }
-        // Generate a Vertex Normal;
-        if (algorithm::firstToken(curline) == "vn")
-        {
-            std::vector<std::string> snor;
-            Vector3 vnor;
-            algorithm::split(algorithm::tail(curline), snor, " ");
-
-            vnor.X = std::stof(snor[0]);
-            vnor.Y = std::stof(snor[1]);
-            vnor.Z = std::stof(snor[2]);
+                else
+                {
+                    // Generate the mesh to put into the array
 
-            Normals.push_back(vnor);
-        }
-        // Generate a Face (vertices & indices)
-        if (algorithm::firstToken(curline) == "f")
-        {
-            // Generate the vertices
-            std::vector<Vertex> vVerts;
-            GenVerticesFromRawOBJ(vVerts, Positions, TCoords, Normals, curline);
+                    if (meshHasGeometry())
+                    {
+                        // Create Mesh
+                        addMesh(meshname);
 
-            // Add Vertices
-            for (int i = 0; i < int(vVerts.size()); i++)
-            {
-                Vertices.push_back(vVerts[i]);
+                        // Cleanup
+                        meshname.clear();
 
-                LoadedVertices.push_back(vVerts[i]);
+                        meshname = parse::Tail(curline);
+                    }
+                    else
+                    {
+                        if (firstToken == "o" || firstToken == "g")
+                        {
+                            meshname = parse::Tail(curline);
+                        }
+                        else
+                        {
+                            meshname = "unnamed";
+                        }
+                    }
+                }
+#ifdef OBJL_CONSOLE_OUTPUT
+                std::cout << std::endl;
+                outputIndicator = 0;
+#endif
             }
-
-            std::vector<unsigned int> iIndices;
-
-            VertexTriangluation(iIndices, vVerts);
-
-            // Add Indices
-            for (int i = 0; i < int(iIndices.size()); i++)
+            // Get Mesh Material Name
+            if (firstToken == "usemtl")
             {
-                unsigned int indnum = (unsigned int)((Vertices.size()) - vVerts.size()) + iIndices[i];
-                Indices.push_back(indnum);
-
-                indnum = (unsigned int)((LoadedVertices.size()) - vVerts.size()) + iIndices[i];
-                LoadedIndices.push_back(indnum);
-
-            }
-        }
-        // Get Mesh Material Name
-        if (algorithm::firstToken(curline) == "usemtl")
-        {
-            MeshMatNames.push_back(algorithm::tail(curline));
+                MeshMatNames.push_back(Intern(parse::Tail(curline)));
 
-            // Create new Mesh, if Material changes within a group
-            if (!Indices.empty() && !Vertices.empty())
-            {
-                // Create Mesh
-                tempMesh = Mesh(Vertices, Indices);
-                tempMesh.MeshName = meshname;
-                int i = 2;
-                while (1) {
-                    tempMesh.MeshName = meshname + "_" + std::to_string(i);
-
-                    for (auto& m : LoadedMeshes)
-                        if (m.MeshName == tempMesh.MeshName)
-                            continue;
-                    break;
+                // Create new Mesh, if Material changes within a group
+                if (meshHasGeometry())
+                {
+                    // Create Mesh
+                    addMesh(meshname + "_2");
                 }
 
-                // Insert Mesh
-                LoadedMeshes.push_back(tempMesh);
-
-                // Cleanup
-                Vertices.clear();
-                Indices.clear();
-            }
-
 #ifdef OBJL_CONSOLE_OUTPUT
-            outputIndicator = 0;
+                outputIndicator = 0;
 #endif
-        }
-        // Load Materials
-        if (algorithm::firstToken(curline) == "mtllib")
-        {
-            // Generate LoadedMaterial
+            }
+            // Load Materials
+            if (firstToken == "mtllib")
+            {
+                // Generate LoadedMaterial
 
-            // Generate a path to the material file
-            std::vector<std::string> temp;
-            algorithm::split(Path, temp, "/");
+                // Generate a path to the material file
+                std::vector<std::string> temp;
+                algorithm::split(Path, temp, "/");
 
-            std::string pathtomat = "";
+                std::string pathtomat = "";
 
-            if (temp.size() != 1)
-            {
-                for (int i = 0; i < temp.size() - 1; i++)
+                if (!temp.empty() && temp.size() != 1)
                 {
-                    pathtomat += temp[i] + "/";
+                    for (size_t i = 0; i < temp.size() - 1; i++)
+                    {
+                        pathtomat += temp[i] + "/";
+                    }
                 }
-            }
 
 
-            pathtomat += algorithm::tail(curline);
+                pathtomat += parse::Tail(curline);
 
 #ifdef OBJL_CONSOLE_OUTPUT
-            std::cout << std::endl << "- find materials in: " << pathtomat << std::endl;
+                std::cout << std::endl << "- find materials in: " << pathtomat << std::endl;
 #endif
 
-            // Load Materials
-            LoadMaterials(pathtomat);
+                // Load Materials
+                LoadMaterials(pathtomat);
+            }
         }
+
+        // The chunk is merged, release its statements
+        chunk.Events = std::vector<LineEvent>();
     }
 
 #ifdef OBJL_CONSOLE_OUTPUT
@@ -571,30 +709,25 @@ bool Loader::LoadFile(std::string Path)
 
     // Deal with last mesh
 
-    if (!Indices.empty() && !Vertices.empty())
+    if (meshHasGeometry())
     {
         // Create Mesh
-        tempMesh = Mesh(Vertices, Indices);
-        tempMesh.MeshName = meshname;
-
-        // Insert Mesh
-        LoadedMeshes.push_back(tempMesh);
+        addMesh(meshname);
     }
 
-    file.close();
+    file.Close();
 
-    // Set Materials for each Mesh
-    for (int i = 0; i < MeshMatNames.size(); i++)
+    // Set Materials for each Mesh, a file can name more
+    //	materials than it has meshes
+    for (size_t i = 0; i < MeshMatNames.size() && i < LoadedMeshes.size(); i++)
     {
-        std::string matname = MeshMatNames[i];
-
         // Find corresponding material name in loaded materials
-        // when found copy material variables into mesh material
-        for (int j = 0; j < LoadedMaterials.size(); j++)
+        //	when found point the mesh at it
+        for (size_t j = 0; j < LoadedMaterials.size(); j++)
         {
-            if (LoadedMaterials[j].name == matname)
+            if (LoadedMaterials[j].name == MeshMatNames[i])
             {
-                LoadedMeshes[i].MeshMaterial = LoadedMaterials[j];
+                LoadedMeshes[i].MaterialIndex = (unsigned int)j;
                 break;
             }
         }
@@ -610,37 +743,150 @@ bool Loader::LoadFile(std::string Path)
     }
 }
 
+// Parse the vertex positions, texture coordinates and
+//	normals in a chunk
+void Loader::ParseChunkAttributes(FileChunk& chunk)
+{
+    for (const char* line = chunk.Text.begin; line < chunk.Text.end; line = parse::NextLine(line, chunk.Text.end))
+    {
+        const char* lineEnd = parse::TrimmedLineEnd(line, chunk.Text.end);
+        const char* cursor = line;
+        std::string_view firstToken = parse::NextToken(cursor, lineEnd);
+
+        // Generate a Vertex Position
+        if (firstToken == "v")
+        {
+            Vector3 vpos;
+            cursor = parse::ParseFloat(cursor, lineEnd, vpos.X);
+            cursor = parse::ParseFloat(cursor, lineEnd, vpos.Y);
+            cursor = parse::ParseFloat(cursor, lineEnd, vpos.Z);
+
+            chunk.Positions.push_back(vpos);
+        }
+        // Generate a Vertex Texture Coordinate
+        else if (firstToken == "vt")
+        {
+            Vector2 vtex;
+            cursor = parse::ParseFloat(cursor, lineEnd, vtex.X);
+            cursor = parse::ParseFloat(cursor, lineEnd, vtex.Y);
+
+            chunk.TCoords.push_back(vtex);
+        }
+        // Generate a Vertex Normal;
+        else if (firstToken == "vn")
+        {
+            Vector3 vnor;
+            cursor = parse::ParseFloat(cursor, lineEnd, vnor.X);
+            cursor = parse::ParseFloat(cursor, lineEnd, vnor.Y);
+            cursor = parse::ParseFloat(cursor, lineEnd, vnor.Z);
+
+            chunk.Normals.push_back(vnor);
+        }
+    }
+}
+
+// Generate the face vertices and indices of a chunk and
+//	record the lines that have to be handled in file order
+bool Loader::ParseChunkFaces(FileChunk& chunk,
+    const std::vector<Vector3>& iPositions,
+    const std::vector<Vector2>& iTCoords,
+    const std::vector<Vector3>& iNormals)
+{
+    AttributeCounts counts = chunk.First;
+    std::vector<Vertex> vVerts;
+    std::vector<unsigned int> iIndices;
+    for (const char* line = chunk.Text.begin; line < chunk.Text.end; line = parse::NextLine(line, chunk.Text.end))
+    {
+        const char* lineEnd = parse::TrimmedLineEnd(line, chunk.Text.end);
+        std::string_view curline(line, (size_t)(lineEnd - line));
+        std::string_view firstToken = parse::FirstToken(curline);
+
+        // Attributes are only counted, they are already parsed
+        if (firstToken == "v")
+        {
+            counts.Positions++;
+        }
+        else if (firstToken == "vt")
+        {
+            counts.TCoords++;
+        }
+        else if (firstToken == "vn")
+        {
+            counts.Normals++;
+        }
+        // Generate a Face (vertices & indices)
+        else if (firstToken == "f")
+        {
+            // Generate the vertices
+            vVerts.clear();
+            if (!GenVerticesFromRawOBJ(vVerts, iPositions, iTCoords, iNormals, counts, curline))
+                return false;
+
+            iIndices.clear();
+            VertexTriangluation(iIndices, vVerts);
+
+            chunk.FaceVertices.insert(chunk.FaceVertices.end(), vVerts.begin(), vVerts.end());
+            chunk.FaceIndices.insert(chunk.FaceIndices.end(), iIndices.begin(), iIndices.end());
+            chunk.Events.push_back({ LineEventType::Face, nullptr, 0, (unsigned int)vVerts.size(), (unsigned int)iIndices.size() });
+        }
+        // Mesh, material and material library statements
+        else if (firstToken == "o" || firstToken == "g" || (!curline.empty() && curline[0] == 'g')
+            || firstToken == "usemtl" || firstToken == "mtllib")
+        {
+            chunk.Events.push_back({ LineEventType::Statement, line, curline.size(), 0, 0 });
+        }
+    }
+    return true;
+}
+
 // Generate vertices from a list of positions, 
 //	tcoords, normals and a face line
-void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
+bool Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
     const std::vector<Vector3>& iPositions,
     const std::vector<Vector2>& iTCoords,
     const std::vector<Vector3>& iNormals,
-    std::string icurline)
+    const AttributeCounts& iCounts,
+    std::string_view icurline)
 {
-    std::vector<std::string> sface, svert;
     Vertex vVert;
-    algorithm::split(algorithm::tail(icurline), sface, " ");
+    std::string_view sface = parse::Tail(icurline);
+    const char* cursor = sface.data();
+    const char* end = sface.data() + sface.size();
 
     bool noNormal = false;
 
     // For every given vertex do this
-    for (int i = 0; i < int(sface.size()); i++)
+    while (true)
     {
+        std::string_view corner = parse::NextToken(cursor, end);
+        if (corner.empty())
+            break;
+
         // See What type the vertex is.
-        int vtype;
+        int vtype = 0;
 
-        algorithm::split(sface[i], svert, "/");
+        // Split the corner at the slashes, "v//vn" has an empty middle part
+        std::string_view svert[3];
+        size_t svertCount = 0;
+        while (svertCount < 3)
+        {
+            size_t slash = corner.find('/');
+            svert[svertCount++] = corner.substr(0, slash);
+            if (slash == std::string_view::npos)
+                break;
+            corner.remove_prefix(slash + 1);
+        }
+        const size_t svertSize = svertCount;
 
         // Check for just position - v1
-        if (svert.size() == 1)
+        if (svertSize == 1)
         {
             // Only position
             vtype = 1;
         }
 
         // Check for position & texture - v1/vt1
-        if (svert.size() == 2)
+        if (svertSize == 2)
         {
             // Position & Texture
             vtype = 2;
@@ -648,9 +894,9 @@ void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
 
         // Check for Position, Texture and Normal - v1/vt1/vn1
         // or if Position and Normal - v1//vn1
-        if (svert.size() == 3)
+        if (svertSize == 3)
         {
-            if (svert[1] != "")
+            if (!svert[1].empty())
             {
                 // Position, Texture, and Normal
                 vtype = 4;
@@ -667,7 +913,8 @@ void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
         {
         case 1: // P
         {
-            vVert.Position = algorithm::getElement(iPositions, svert[0]);
+            if (!algorithm::getElement(iPositions, iCounts.Positions, svert[0], vVert.Position))
+                return false;
             vVert.TextureCoordinate = Vector2(0, 0);
             noNormal = true;
             oVerts.push_back(vVert);
@@ -675,25 +922,28 @@ void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
         }
         case 2: // P/T
         {
-            vVert.Position = algorithm::getElement(iPositions, svert[0]);
-            vVert.TextureCoordinate = algorithm::getElement(iTCoords, svert[1]);
+            if (!algorithm::getElement(iPositions, iCounts.Positions, svert[0], vVert.Position)
+                || !algorithm::getElement(iTCoords, iCounts.TCoords, svert[1], vVert.TextureCoordinate))
+                return false;
             noNormal = true;
             oVerts.push_back(vVert);
             break;
         }
         case 3: // P//N
         {
-            vVert.Position = algorithm::getElement(iPositions, svert[0]);
+            if (!algorithm::getElement(iPositions, iCounts.Positions, svert[0], vVert.Position)
+                || !algorithm::getElement(iNormals, iCounts.Normals, svert[2], vVert.Normal))
+                return false;
             vVert.TextureCoordinate = Vector2(0, 0);
-            vVert.Normal = algorithm::getElement(iNormals, svert[2]);
             oVerts.push_back(vVert);
             break;
         }
         case 4: // P/T/N
         {
-            vVert.Position = algorithm::getElement(iPositions, svert[0]);
-            vVert.TextureCoordinate = algorithm::getElement(iTCoords, svert[1]);
-            vVert.Normal = algorithm::getElement(iNormals, svert[2]);
+            if (!algorithm::getElement(iPositions, iCounts.Positions, svert[0], vVert.Position)
+                || !algorithm::getElement(iTCoords, iCounts.TCoords, svert[1], vVert.TextureCoordinate)
+                || !algorithm::getElement(iNormals, iCounts.Normals, svert[2], vVert.Normal))
+                return false;
             oVerts.push_back(vVert);
             break;
         }
@@ -707,7 +957,7 @@ void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
     // take care of missing normals
     // these may not be truly acurate but it is the 
     // best they get for not compiling a mesh with normals	
-    if (noNormal)
+    if (noNormal && oVerts.size() >= 3)
     {
         Vector3 A = oVerts[0].Position - oVerts[1].Position;
         Vector3 B = oVerts[2].Position - oVerts[1].Position;
@@ -719,10 +969,100 @@ void Loader::GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
             oVerts[i].Normal = normal;
         }
     }
+    return true;
+}
+
+namespace
+{
+    // Reused buffers of the ear clipper, so triangulating
+    //	a face doesn't allocate once they are large enough
+    struct TriangulationScratch
+    {
+        std::vector<float> X;
+        std::vector<float> Y;
+        std::vector<unsigned int> Prev;
+        std::vector<unsigned int> Next;
+        std::vector<unsigned char> Reflex;
+    };
+
+    // Twice the signed area of the 2D triangle abc,
+    //	positive if it is counter clockwise
+    inline float SignedArea2D(const TriangulationScratch& s, unsigned int a, unsigned int b, unsigned int c)
+    {
+        return (s.X[b] - s.X[a]) * (s.Y[c] - s.Y[a]) - (s.Y[b] - s.Y[a]) * (s.X[c] - s.X[a]);
+    }
+
+    // Check if point p is within or on the
+    //	counter clockwise 2D triangle abc
+    inline bool InTriangle2D(const TriangulationScratch& s, unsigned int p, unsigned int a, unsigned int b, unsigned int c)
+    {
+        return SignedArea2D(s, a, b, p) >= 0 && SignedArea2D(s, b, c, p) >= 0 && SignedArea2D(s, c, a, p) >= 0;
+    }
+
+    inline bool SamePoint2D(const TriangulationScratch& s, unsigned int a, unsigned int b)
+    {
+        return s.X[a] == s.X[b] && s.Y[a] == s.Y[b];
+    }
+
+    // Check if the vertex at cur can be clipped
+    //
+    // strictness 0 only accepts proper ears, 1 also accepts
+    //	zero area ears and 2 accepts anything so that faces
+    //	that are not simple polygons are still closed
+    //
+    // A reflex vertex at the same point as a corner of the ear,
+    //	where a face touches itself, only stops being in the way
+    //	once the test is relaxed, before that it could be the
+    //	corner of a part of the face the ear reaches over
+    bool IsEar(const TriangulationScratch& s, unsigned int cur, int strictness)
+    {
+        if (strictness >= 2)
+            return true;
+
+        unsigned int prev = s.Prev[cur];
+        unsigned int next = s.Next[cur];
+        float area = SignedArea2D(s, prev, cur, next);
+        if (area < 0 || (area == 0 && strictness == 0))
+            return false;
+
+        // Only reflex vertices can be inside a convex corner
+        for (unsigned int p = s.Next[next]; p != prev; p = s.Next[p])
+        {
+            if (s.Reflex[p]
+                && (strictness == 0 || (!SamePoint2D(s, p, prev) && !SamePoint2D(s, p, cur) && !SamePoint2D(s, p, next)))
+                && InTriangle2D(s, p, prev, cur, next))
+                return false;
+        }
+        return true;
+    }
+
+    inline float Component(const Vector3& v, int axis)
+    {
+        return axis == 0 ? v.X : (axis == 1 ? v.Y : v.Z);
+    }
+
+    // Newell normal of a polygon, valid for concave polygons too
+    Vector3 PolygonNormal(const std::vector<Vertex>& iVerts)
+    {
+        Vector3 normal;
+        for (size_t i = 0; i < iVerts.size(); i++)
+        {
+            const Vector3& a = iVerts[i].Position;
+            const Vector3& b = iVerts[(i + 1) % iVerts.size()].Position;
+            normal.X += (a.Y - b.Y) * (a.Z + b.Z);
+            normal.Y += (a.Z - b.Z) * (a.X + b.X);
+            normal.Z += (a.X - b.X) * (a.Y + b.Y);
+        }
+        return normal;
+    }
 }
 
 // Triangulate a list of vertices into a face by printing
 //	inducies corresponding with triangles within it
+//
+// Triangles and quads are handled directly, larger polygons
+//	are ear clipped on a linked list of their vertices in the
+//	plane of the polygon. Triangles keep the winding of the face
 void Loader::VertexTriangluation(std::vector<unsigned int>& oIndices,
     const std::vector<Vertex>& iVerts)
 {
@@ -742,165 +1082,125 @@ void Loader::VertexTriangluation(std::vector<unsigned int>& oIndices,
         return;
     }
 
-    // Create a list of vertices
-    std::vector<Vertex> tVerts = iVerts;
+    Vector3 normal = PolygonNormal(iVerts);
 
-    while (true)
+    // A quad is split along the 1-3 diagonal unless
+    //	that diagonal is outside of it, which happens
+    //	when corner 0 or 2 is reflex
+    if (iVerts.size() == 4)
     {
-        // For every vertex
-        for (int i = 0; i < int(tVerts.size()); i++)
+        const Vector3& p0 = iVerts[0].Position;
+        const Vector3& p1 = iVerts[1].Position;
+        const Vector3& p2 = iVerts[2].Position;
+        const Vector3& p3 = iVerts[3].Position;
+        bool reflex0 = math::DotV3(math::CrossV3(p0 - p3, p1 - p0), normal) < 0;
+        bool reflex2 = math::DotV3(math::CrossV3(p2 - p1, p3 - p2), normal) < 0;
+        if (reflex0 || reflex2)
         {
-            // pPrev = the previous vertex in the list
-            Vertex pPrev;
-            if (i == 0)
-            {
-                pPrev = tVerts[tVerts.size() - 1];
-            }
-            else
-            {
-                pPrev = tVerts[i - 1];
-            }
-
-            // pCur = the current vertex;
-            Vertex pCur = tVerts[i];
-
-            // pNext = the next vertex in the list
-            Vertex pNext;
-            if (i == tVerts.size() - 1)
-            {
-                pNext = tVerts[0];
-            }
-            else
-            {
-                pNext = tVerts[i + 1];
-            }
-
-            // Check to see if there are only 3 verts left
-            // if so this is the last triangle
-            if (tVerts.size() == 3)
-            {
-                // Create a triangle from pCur, pPrev, pNext
-                for (int j = 0; j < int(tVerts.size()); j++)
-                {
-                    if (iVerts[j].Position == pCur.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == pPrev.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == pNext.Position)
-                        oIndices.push_back(j);
-                }
-
-                tVerts.clear();
-                break;
-            }
-            if (tVerts.size() == 4)
-            {
-                // Create a triangle from pCur, pPrev, pNext
-                for (int j = 0; j < int(iVerts.size()); j++)
-                {
-                    if (iVerts[j].Position == pCur.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == pPrev.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == pNext.Position)
-                        oIndices.push_back(j);
-                }
-
-                Vector3 tempVec;
-                for (int j = 0; j < int(tVerts.size()); j++)
-                {
-                    if (tVerts[j].Position != pCur.Position
-                        && tVerts[j].Position != pPrev.Position
-                        && tVerts[j].Position != pNext.Position)
-                    {
-                        tempVec = tVerts[j].Position;
-                        break;
-                    }
-                }
-
-                // Create a triangle from pCur, pPrev, pNext
-                for (int j = 0; j < int(iVerts.size()); j++)
-                {
-                    if (iVerts[j].Position == pPrev.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == pNext.Position)
-                        oIndices.push_back(j);
-                    if (iVerts[j].Position == tempVec)
-                        oIndices.push_back(j);
-                }
-
-                tVerts.clear();
-                break;
-            }
-
-            // If Vertex is not an interior vertex
-            float angle = math::AngleBetweenV3(pPrev.Position - pCur.Position, pNext.Position - pCur.Position) * (180 / 3.14159265359);
-            if (angle <= 0 && angle >= 180)
-                continue;
+            unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+            oIndices.insert(oIndices.end(), quad, quad + 6);
+        }
+        else
+        {
+            unsigned int quad[6] = { 0, 1, 3, 1, 2, 3 };
+            oIndices.insert(oIndices.end(), quad, quad + 6);
+        }
+        return;
+    }
 
-            // If any vertices are within this triangle
-            bool inTri = false;
-            for (int j = 0; j < int(iVerts.size()); j++)
-            {
-                if (algorithm::inTriangle(iVerts[j].Position, pPrev.Position, pCur.Position, pNext.Position)
-                    && iVerts[j].Position != pPrev.Position
-                    && iVerts[j].Position != pCur.Position
-                    && iVerts[j].Position != pNext.Position)
-                {
-                    inTri = true;
-                    break;
-                }
-            }
-            if (inTri)
-                continue;
+    // Project the polygon onto the axis plane it is most
+    //	aligned with, ordering the axes so it is counter clockwise
+    float ax = fabsf(normal.X), ay = fabsf(normal.Y), az = fabsf(normal.Z);
+    int uAxis, vAxis;
+    float facing;
+    if (ax >= ay && ax >= az)
+    {
+        uAxis = 1; vAxis = 2; facing = normal.X;
+    }
+    else if (ay >= az)
+    {
+        uAxis = 2; vAxis = 0; facing = normal.Y;
+    }
+    else
+    {
+        uAxis = 0; vAxis = 1; facing = normal.Z;
+    }
+    if (facing < 0)
+    {
+        std::swap(uAxis, vAxis);
+    }
 
-            // Create a triangle from pCur, pPrev, pNext
-            for (int j = 0; j < int(iVerts.size()); j++)
-            {
-                if (iVerts[j].Position == pCur.Position)
-                    oIndices.push_back(j);
-                if (iVerts[j].Position == pPrev.Position)
-                    oIndices.push_back(j);
-                if (iVerts[j].Position == pNext.Position)
-                    oIndices.push_back(j);
-            }
+    thread_local TriangulationScratch s;
+    const unsigned int n = (unsigned int)iVerts.size();
+    s.X.resize(n);
+    s.Y.resize(n);
+    s.Prev.resize(n);
+    s.Next.resize(n);
+    s.Reflex.resize(n);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        s.X[i] = Component(iVerts[i].Position, uAxis);
+        s.Y[i] = Component(iVerts[i].Position, vAxis);
+        s.Prev[i] = i == 0 ? n - 1 : i - 1;
+        s.Next[i] = i == n - 1 ? 0 : i + 1;
+    }
+    for (unsigned int i = 0; i < n; i++)
+    {
+        s.Reflex[i] = SignedArea2D(s, s.Prev[i], i, s.Next[i]) <= 0;
+    }
 
-            // Delete pCur from the list
-            for (int j = 0; j < int(tVerts.size()); j++)
+    unsigned int remaining = n;
+    unsigned int cur = 0;
+    unsigned int visited = 0;
+    int strictness = 0;
+    while (remaining > 3)
+    {
+        if (!IsEar(s, cur, strictness))
+        {
+            cur = s.Next[cur];
+            // A whole loop without an ear, relax the test
+            if (++visited >= remaining)
             {
-                if (tVerts[j].Position == pCur.Position)
-                {
-                    tVerts.erase(tVerts.begin() + j);
-                    break;
-                }
+                strictness++;
+                visited = 0;
             }
-
-            // reset i to the start
-            // -1 since loop will add 1 to it
-            i = -1;
+            continue;
         }
 
-        // if no triangles were created
-        if (oIndices.size() == 0)
-            break;
-
-        // if no more vertices
-        if (tVerts.size() == 0)
-            break;
+        unsigned int prev = s.Prev[cur];
+        unsigned int next = s.Next[cur];
+        oIndices.push_back(prev);
+        oIndices.push_back(cur);
+        oIndices.push_back(next);
+
+        // Remove cur from the list
+        s.Next[prev] = next;
+        s.Prev[next] = prev;
+        remaining--;
+        s.Reflex[prev] = SignedArea2D(s, s.Prev[prev], prev, next) <= 0;
+        s.Reflex[next] = SignedArea2D(s, prev, next, s.Next[next]) <= 0;
+
+        cur = next;
+        visited = 0;
+        strictness = 0;
     }
+
+    oIndices.push_back(s.Prev[cur]);
+    oIndices.push_back(cur);
+    oIndices.push_back(s.Next[cur]);
 }
 
 // Load Materials from .mtl file
 bool Loader::LoadMaterials(std::string path)
 {
     // If the file is not a material file return false
-    if (path.substr(path.size() - 4, path.size()) != ".mtl")
+    if (path.size() < 4 || path.substr(path.size() - 4, path.size()) != ".mtl")
         return false;
 
-    std::ifstream file(path);
+    MemoryMappedFile file;
 
     // If the file is not found return false
-    if (!file.is_open())
+    if (!file.Open(path))
         return false;
 
     Material tempMaterial;
@@ -908,11 +1208,15 @@ bool Loader::LoadMaterials(std::string path)
     bool listening = false;
 
     // Go through each line looking for material variables
-    std::string curline;
-    while (std::getline(file, curline))
+    const char* fileEnd = file.Data() + file.Size();
+    for (const char* line = file.Data(); line < fileEnd; line = parse::NextLine(line, fileEnd))
     {
+        const char* lineEnd = parse::TrimmedLineEnd(line, fileEnd);
+        std::string_view curline(line, (size_t)(lineEnd - line));
+        std::string_view firstToken = parse::FirstToken(curline);
+
         // new material and material name
-        if (algorithm::firstToken(curline) == "newmtl")
+        if (firstToken == "newmtl")
         {
             if (!listening)
             {
@@ -920,11 +1224,11 @@ bool Loader::LoadMaterials(std::string path)
 
                 if (curline.size() > 7)
                 {
-                    tempMaterial.name = algorithm::tail(curline);
+                    tempMaterial.name = Intern(parse::Tail(curline));
                 }
                 else
                 {
-                    tempMaterial.name = "none";
+                    tempMaterial.name = Intern("none");
                 }
             }
             else
@@ -939,102 +1243,96 @@ bool Loader::LoadMaterials(std::string path)
 
                 if (curline.size() > 7)
                 {
-                    tempMaterial.name = algorithm::tail(curline);
+                    tempMaterial.name = Intern(parse::Tail(curline));
                 }
                 else
                 {
-                    tempMaterial.name = "none";
+                    tempMaterial.name = Intern("none");
                 }
             }
         }
         // Ambient Color
-        if (algorithm::firstToken(curline) == "Ka")
+        if (firstToken == "Ka")
         {
-            std::vector<std::string> temp;
-            algorithm::split(algorithm::tail(curline), temp, " ");
-
-            if (temp.size() != 3)
-                continue;
-
-            tempMaterial.Ka.X = std::stof(temp[0]);
-            tempMaterial.Ka.Y = std::stof(temp[1]);
-            tempMaterial.Ka.Z = std::stof(temp[2]);
+            ParseColor(parse::Tail(curline), tempMaterial.Ka);
         }
         // Diffuse Color
-        if (algorithm::firstToken(curline) == "Kd")
+        if (firstToken == "Kd")
         {
-            std::vector<std::string> temp;
-            algorithm::split(algorithm::tail(curline), temp, " ");
-
-            if (temp.size() != 3)
-                continue;
-
-            tempMaterial.Kd.X = std::stof(temp[0]);
-            tempMaterial.Kd.Y = std::stof(temp[1]);
-            tempMaterial.Kd.Z = std::stof(temp[2]);
+            ParseColor(parse::Tail(curline), tempMaterial.Kd);
         }
         // Specular Color
-        if (algorithm::firstToken(curline) == "Ks")
+        if (firstToken == "Ks")
         {
-            std::vector<std::string> temp;
-            algorithm::split(algorithm::tail(curline), temp, " ");
-
-            if (temp.size() != 3)
-                continue;
-
-            tempMaterial.Ks.X = std::stof(temp[0]);
-            tempMaterial.Ks.Y = std::stof(temp[1]);
-            tempMaterial.Ks.Z = std::stof(temp[2]);
+            ParseColor(parse::Tail(curline), tempMaterial.Ks);
         }
         // Specular Exponent
-        if (algorithm::firstToken(curline) == "Ns")
+        if (firstToken == "Ns")
         {
-            tempMaterial.Ns = std::stof(algorithm::tail(curline));
+            std::string_view tail = parse::Tail(curline);
+            parse::ParseFloat(tail.data(), tail.data() + tail.size(), tempMaterial.Ns);
         }
         // Optical Density
-        if (algorithm::firstToken(curline) == "Ni")
+        if (firstToken == "Ni")
         {
-            tempMaterial.Ni = std::stof(algorithm::tail(curline));
+            std::string_view tail = parse::Tail(curline);
+            parse::ParseFloat(tail.data(), tail.data() + tail.size(), tempMaterial.Ni);
         }
         // Dissolve
-        if (algorithm::firstToken(curline) == "d")
+        if (firstToken == "d")
         {
-            tempMaterial.d = std::stof(algorithm::tail(curline));
+            std::string_view tail = parse::Tail(curline);
+            parse::ParseFloat(tail.data(), tail.data() + tail.size(), tempMaterial.d);
         }
         // Illumination
-        if (algorithm::firstToken(curline) == "illum")
+        if (firstToken == "illum")
+        {
+            std::string_view tail = parse::Tail(curline);
+            long long illum = 0;
+            parse::ParseInt(tail.data(), tail.data() + tail.size(), illum);
+            tempMaterial.illum = (int)std::max<long long>(INT_MIN, std::min<long long>(INT_MAX, illum));
+        }
+        // PBR Roughness
+        if (firstToken == "Pr")
+        {
+            std::string_view tail = parse::Tail(curline);
+            parse::ParseFloat(tail.data(), tail.data() + tail.size(), tempMaterial.Pr);
+        }
+        // PBR Metallic
+        if (firstToken == "Pm")
         {
-            tempMaterial.illum = std::stoi(algorithm::tail(curline));
+            std::string_view tail = parse::Tail(curline);
+            parse::ParseFloat(tail.data(), tail.data() + tail.size(), tempMaterial.Pm);
         }
         // Ambient Texture Map
-        if (algorithm::firstToken(curline) == "map_Ka")
+        if (firstToken == "map_Ka")
         {
-            tempMaterial.map_Ka = algorithm::tail(curline);
+            tempMaterial.map_Ka = Intern(parse::Tail(curline));
         }
         // Diffuse Texture Map
-        if (algorithm::firstToken(curline) == "map_Kd")
+        if (firstToken == "map_Kd")
         {
-            tempMaterial.map_Kd = algorithm::tail(curline);
+            tempMaterial.map_Kd = Intern(parse::Tail(curline));
         }
         // Specular Texture Map
-        if (algorithm::firstToken(curline) == "map_Ks")
+        if (firstToken == "map_Ks")
         {
-            tempMaterial.map_Ks = algorithm::tail(curline);
+            tempMaterial.map_Ks = Intern(parse::Tail(curline));
         }
         // Specular Hightlight Map
-        if (algorithm::firstToken(curline) == "map_Ns")
+        if (firstToken == "map_Ns")
         {
-            tempMaterial.map_Ns = algorithm::tail(curline);
+            tempMaterial.map_Ns = Intern(parse::Tail(curline));
         }
         // Alpha Texture Map
-        if (algorithm::firstToken(curline) == "map_d")
+        if (firstToken == "map_d")
         {
-            tempMaterial.map_d = algorithm::tail(curline);
+            tempMaterial.map_d = Intern(parse::Tail(curline));
         }
         // Bump Map
-        if (algorithm::firstToken(curline) == "map_Bump" || algorithm::firstToken(curline) == "map_bump" || algorithm::firstToken(curline) == "bump")
+        if (firstToken == "map_Bump" || firstToken == "map_bump" || firstToken == "bump")
         {
-            tempMaterial.map_bump = algorithm::tail(curline);
+            tempMaterial.map_bump = Intern(parse::Tail(curline));
         }
     }
 
@@ -0,0 +1,439 @@
+#include "RayKernels.h"
+
+#include <atomic>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define RAY_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+//MSVC compiles intrinsics of any instruction set without flags.
+#define RAY_KERNELS_TARGET(instructionSet)
+#else
+#include <cpuid.h>
+//GCC and Clang compile the kernels of each instruction set for that instruction set only, the rest of the program stays on the baseline.
+#define RAY_KERNELS_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#endif
+#endif
+
+namespace
+{
+    typedef RayKernels::InstructionSet InstructionSet;
+    typedef RayKernels::CullMode CullMode;
+    const uint32_t Width = RayKernels::Width;
+
+    //The scalar kernels are written with the same operations in the same order as the vector ones, so all of them give the same bits.
+    //std::min and std::max are not used because their choice on NaN differs from minps and maxps. min(a, b) here is minps(a, b).
+    inline float Min(float a, float b)
+    {
+        return a < b ? a : b;
+    }
+
+    inline float Max(float a, float b)
+    {
+        return a > b ? a : b;
+    }
+
+    inline float Dot(float a0, float a1, float a2, float b0, float b1, float b2)
+    {
+        return a0 * b0 + a1 * b1 + a2 * b2;
+    }
+
+    int IntersectTrianglesScalar(const RayKernels::TrianglePacket& triangles, const float origin[3], const float direction[3], CullMode cull,
+        float& t, float& u, float& v)
+    {
+        int hitLane = -1;
+        for (uint32_t lane = 0; lane < Width; lane++)
+        {
+            const float v0[3] = { triangles.v0[0][lane], triangles.v0[1][lane], triangles.v0[2][lane] };
+            const float edge1[3] = { triangles.edge1[0][lane], triangles.edge1[1][lane], triangles.edge1[2][lane] };
+            const float edge2[3] = { triangles.edge2[0][lane], triangles.edge2[1][lane], triangles.edge2[2][lane] };
+            if (RayKernels::IntersectTriangle(v0, edge1, edge2, origin, direction, cull, t, u, v))
+            {
+                hitLane = (int)lane;
+            }
+        }
+        return hitLane;
+    }
+
+    uint32_t IntersectBoxScalarPacket(const RayKernels::RayPacket& rays, const float boundsMin[3], const float boundsMax[3], float tEnter[Width])
+    {
+        uint32_t mask = 0;
+        for (uint32_t lane = 0; lane < Width; lane++)
+        {
+            const float origin[3] = { rays.origin[0][lane], rays.origin[1][lane], rays.origin[2][lane] };
+            const float inverseDirection[3] = { rays.inverseDirection[0][lane], rays.inverseDirection[1][lane], rays.inverseDirection[2][lane] };
+            tEnter[lane] = RayKernels::IntersectBoxScalar(boundsMin, boundsMax, origin, inverseDirection, rays.tMax[lane]);
+            mask |= tEnter[lane] >= 0.0f ? 1u << lane : 0u;
+        }
+        return mask;
+    }
+
+#ifdef RAY_KERNELS_X86
+    InstructionSet DetectInstructionSet()
+    {
+        unsigned int leaf1[4] = {};
+        unsigned int leaf7[4] = {};
+        unsigned long long enabledStates = 0;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int registers[4];
+        __cpuid(registers, 0);
+        const unsigned int maxLeaf = (unsigned int)registers[0];
+        __cpuid(registers, 1);
+        for (int i = 0; i < 4; i++)
+        {
+            leaf1[i] = (unsigned int)registers[i];
+        }
+        if (maxLeaf >= 7)
+        {
+            __cpuidex(registers, 7, 0);
+            for (int i = 0; i < 4; i++)
+            {
+                leaf7[i] = (unsigned int)registers[i];
+            }
+        }
+        //Bit 27 of ECX: the OS uses XSAVE, so XGETBV can be run.
+        if (leaf1[2] & (1u << 27))
+        {
+            enabledStates = _xgetbv(0);
+        }
+#else
+        const unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+        __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+        if (maxLeaf >= 7)
+        {
+            __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+        }
+        if (leaf1[2] & (1u << 27))
+        {
+            unsigned int low, high;
+            __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            enabledStates = ((unsigned long long)high << 32) | low;
+        }
+#endif
+        //AVX2 also needs the OS to save the upper halves of the registers (bits 1 and 2 of XCR0).
+        const bool avx2 = (leaf7[1] & (1u << 5)) != 0 && (enabledStates & 6) == 6;
+        const bool sse41 = (leaf1[2] & (1u << 19)) != 0;
+        return avx2 ? InstructionSet::Avx2 : sse41 ? InstructionSet::Sse4 : InstructionSet::Scalar;
+    }
+
+    //Lane i of the result is the smallest of all the lanes of value.
+    RAY_KERNELS_TARGET("sse4.1") inline __m128 HorizontalMin(__m128 value)
+    {
+        value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
+    //Four lanes of the triangle test. Returns the lanes that are hit in [0, tBest) as all ones, and the t, u and v of every lane.
+    RAY_KERNELS_TARGET("sse4.1") inline __m128 IntersectTriangles4(const RayKernels::TrianglePacket& triangles, uint32_t first, const __m128 origin[3],
+        const __m128 direction[3], CullMode cull, __m128 tBest, __m128& t, __m128& u, __m128& v)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 edge1[3], edge2[3], s[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            edge1[axis] = _mm_load_ps(&triangles.edge1[axis][first]);
+            edge2[axis] = _mm_load_ps(&triangles.edge2[axis][first]);
+            s[axis] = _mm_sub_ps(origin[axis], _mm_load_ps(&triangles.v0[axis][first]));
+        }
+        const __m128 p0 = _mm_sub_ps(_mm_mul_ps(direction[1], edge2[2]), _mm_mul_ps(direction[2], edge2[1]));
+        const __m128 p1 = _mm_sub_ps(_mm_mul_ps(direction[2], edge2[0]), _mm_mul_ps(direction[0], edge2[2]));
+        const __m128 p2 = _mm_sub_ps(_mm_mul_ps(direction[0], edge2[1]), _mm_mul_ps(direction[1], edge2[0]));
+        const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1[0], p0), _mm_mul_ps(edge1[1], p1)), _mm_mul_ps(edge1[2], p2));
+        __m128 valid = cull == CullMode::BackFacing ? _mm_cmpgt_ps(determinant, zero) : _mm_cmpneq_ps(determinant, zero);
+        const __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+        u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p0), _mm_mul_ps(s[1], p1)), _mm_mul_ps(s[2], p2)), inverseDeterminant);
+        const __m128 q0 = _mm_sub_ps(_mm_mul_ps(s[1], edge1[2]), _mm_mul_ps(s[2], edge1[1]));
+        const __m128 q1 = _mm_sub_ps(_mm_mul_ps(s[2], edge1[0]), _mm_mul_ps(s[0], edge1[2]));
+        const __m128 q2 = _mm_sub_ps(_mm_mul_ps(s[0], edge1[1]), _mm_mul_ps(s[1], edge1[0]));
+        v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], q0), _mm_mul_ps(direction[1], q1)), _mm_mul_ps(direction[2], q2)), inverseDeterminant);
+        t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2[0], q0), _mm_mul_ps(edge2[1], q1)), _mm_mul_ps(edge2[2], q2)), inverseDeterminant);
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        return _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, tBest)));
+    }
+
+    RAY_KERNELS_TARGET("sse4.1") int IntersectTrianglesSse4(const RayKernels::TrianglePacket& triangles, const float origin[3], const float direction[3],
+        CullMode cull, float& t, float& u, float& v)
+    {
+        const __m128 rayOrigin[3] = { _mm_set1_ps(origin[0]), _mm_set1_ps(origin[1]), _mm_set1_ps(origin[2]) };
+        const __m128 rayDirection[3] = { _mm_set1_ps(direction[0]), _mm_set1_ps(direction[1]), _mm_set1_ps(direction[2]) };
+        const __m128 tBest = _mm_set1_ps(t);
+        __m128 tLow, uLow, vLow, tHigh, uHigh, vHigh;
+        const __m128 validLow = IntersectTriangles4(triangles, 0, rayOrigin, rayDirection, cull, tBest, tLow, uLow, vLow);
+        const __m128 validHigh = IntersectTriangles4(triangles, 4, rayOrigin, rayDirection, cull, tBest, tHigh, uHigh, vHigh);
+        const int mask = _mm_movemask_ps(validLow) | _mm_movemask_ps(validHigh) << 4;
+        if (mask == 0)
+        {
+            return -1;
+        }
+        //The closest hit, and the lowest lane among the hits at that distance.
+        const __m128 infinity = _mm_set1_ps(INFINITY);
+        const __m128 closest = HorizontalMin(_mm_min_ps(_mm_blendv_ps(infinity, tLow, validLow), _mm_blendv_ps(infinity, tHigh, validHigh)));
+        const int closestMask = mask & (_mm_movemask_ps(_mm_cmpeq_ps(tLow, closest)) | _mm_movemask_ps(_mm_cmpeq_ps(tHigh, closest)) << 4);
+        int lane = 0;
+        while (!(closestMask & (1 << lane)))
+        {
+            lane++;
+        }
+        alignas(16) float values[3][Width];
+        _mm_store_ps(values[0], tLow);
+        _mm_store_ps(values[0] + 4, tHigh);
+        _mm_store_ps(values[1], uLow);
+        _mm_store_ps(values[1] + 4, uHigh);
+        _mm_store_ps(values[2], vLow);
+        _mm_store_ps(values[2] + 4, vHigh);
+        t = values[0][lane];
+        u = values[1][lane];
+        v = values[2][lane];
+        return lane;
+    }
+
+    RAY_KERNELS_TARGET("avx2") int IntersectTrianglesAvx2(const RayKernels::TrianglePacket& triangles, const float origin[3], const float direction[3],
+        CullMode cull, float& t, float& u, float& v)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 d[3] = { _mm256_set1_ps(direction[0]), _mm256_set1_ps(direction[1]), _mm256_set1_ps(direction[2]) };
+        //Loaded one by one rather than in a loop over arrays: GCC copied the arrays through the stack in halves, which stalled every load.
+        const __m256 edge1[3] = { _mm256_load_ps(triangles.edge1[0]), _mm256_load_ps(triangles.edge1[1]), _mm256_load_ps(triangles.edge1[2]) };
+        const __m256 edge2[3] = { _mm256_load_ps(triangles.edge2[0]), _mm256_load_ps(triangles.edge2[1]), _mm256_load_ps(triangles.edge2[2]) };
+        const __m256 s[3] = {
+            _mm256_sub_ps(_mm256_set1_ps(origin[0]), _mm256_load_ps(triangles.v0[0])),
+            _mm256_sub_ps(_mm256_set1_ps(origin[1]), _mm256_load_ps(triangles.v0[1])),
+            _mm256_sub_ps(_mm256_set1_ps(origin[2]), _mm256_load_ps(triangles.v0[2])),
+        };
+        const __m256 p0 = _mm256_sub_ps(_mm256_mul_ps(d[1], edge2[2]), _mm256_mul_ps(d[2], edge2[1]));
+        const __m256 p1 = _mm256_sub_ps(_mm256_mul_ps(d[2], edge2[0]), _mm256_mul_ps(d[0], edge2[2]));
+        const __m256 p2 = _mm256_sub_ps(_mm256_mul_ps(d[0], edge2[1]), _mm256_mul_ps(d[1], edge2[0]));
+        const __m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1[0], p0), _mm256_mul_ps(edge1[1], p1)), _mm256_mul_ps(edge1[2], p2));
+        __m256 valid = cull == CullMode::BackFacing ? _mm256_cmp_ps(determinant, zero, _CMP_GT_OQ) : _mm256_cmp_ps(determinant, zero, _CMP_NEQ_UQ);
+        const __m256 inverseDeterminant = _mm256_div_ps(one, determinant);
+        const __m256 uLanes = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s[0], p0), _mm256_mul_ps(s[1], p1)), _mm256_mul_ps(s[2], p2)), inverseDeterminant);
+        const __m256 q0 = _mm256_sub_ps(_mm256_mul_ps(s[1], edge1[2]), _mm256_mul_ps(s[2], edge1[1]));
+        const __m256 q1 = _mm256_sub_ps(_mm256_mul_ps(s[2], edge1[0]), _mm256_mul_ps(s[0], edge1[2]));
+        const __m256 q2 = _mm256_sub_ps(_mm256_mul_ps(s[0], edge1[1]), _mm256_mul_ps(s[1], edge1[0]));
+        const __m256 vLanes = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], q0), _mm256_mul_ps(d[1], q1)), _mm256_mul_ps(d[2], q2)), inverseDeterminant);
+        const __m256 tLanes = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge2[0], q0), _mm256_mul_ps(edge2[1], q1)), _mm256_mul_ps(edge2[2], q2)), inverseDeterminant);
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(uLanes, zero, _CMP_GE_OQ), _mm256_cmp_ps(uLanes, one, _CMP_LE_OQ)));
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(vLanes, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(uLanes, vLanes), one, _CMP_LE_OQ)));
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(tLanes, zero, _CMP_GE_OQ), _mm256_cmp_ps(tLanes, _mm256_set1_ps(t), _CMP_LT_OQ)));
+        const int mask = _mm256_movemask_ps(valid);
+        if (mask == 0)
+        {
+            return -1;
+        }
+        //The closest hit, and the lowest lane among the hits at that distance.
+        __m256 closest = _mm256_blendv_ps(_mm256_set1_ps(INFINITY), tLanes, valid);
+        closest = _mm256_min_ps(closest, _mm256_permute_ps(closest, _MM_SHUFFLE(2, 3, 0, 1)));
+        closest = _mm256_min_ps(closest, _mm256_permute_ps(closest, _MM_SHUFFLE(1, 0, 3, 2)));
+        closest = _mm256_min_ps(closest, _mm256_permute2f128_ps(closest, closest, 1));
+        const int closestMask = mask & _mm256_movemask_ps(_mm256_cmp_ps(tLanes, closest, _CMP_EQ_OQ));
+        int lane = 0;
+        while (!(closestMask & (1 << lane)))
+        {
+            lane++;
+        }
+        alignas(32) float values[3][Width];
+        _mm256_store_ps(values[0], tLanes);
+        _mm256_store_ps(values[1], uLanes);
+        _mm256_store_ps(values[2], vLanes);
+        t = values[0][lane];
+        u = values[1][lane];
+        v = values[2][lane];
+        return lane;
+    }
+
+    RAY_KERNELS_TARGET("sse4.1") uint32_t IntersectBoxSse4(const RayKernels::RayPacket& rays, const float boundsMin[3], const float boundsMax[3], float tEnter[Width])
+    {
+        uint32_t mask = 0;
+        for (uint32_t first = 0; first < Width; first += 4)
+        {
+            __m128 enter = _mm_setzero_ps();
+            __m128 exit = _mm_load_ps(&rays.tMax[first]);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const __m128 origin = _mm_load_ps(&rays.origin[axis][first]);
+                const __m128 inverseDirection = _mm_load_ps(&rays.inverseDirection[axis][first]);
+                const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMin[axis]), origin), inverseDirection);
+                const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boundsMax[axis]), origin), inverseDirection);
+                enter = _mm_max_ps(_mm_min_ps(t0, t1), enter);
+                exit = _mm_min_ps(_mm_max_ps(t0, t1), exit);
+            }
+            const __m128 hit = _mm_cmple_ps(enter, exit);
+            _mm_storeu_ps(&tEnter[first], _mm_blendv_ps(_mm_set1_ps(-1.0f), enter, hit));
+            mask |= (uint32_t)_mm_movemask_ps(hit) << first;
+        }
+        return mask;
+    }
+
+    RAY_KERNELS_TARGET("avx2") uint32_t IntersectBoxAvx2(const RayKernels::RayPacket& rays, const float boundsMin[3], const float boundsMax[3], float tEnter[Width])
+    {
+        __m256 enter = _mm256_setzero_ps();
+        __m256 exit = _mm256_load_ps(rays.tMax);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const __m256 origin = _mm256_load_ps(rays.origin[axis]);
+            const __m256 inverseDirection = _mm256_load_ps(rays.inverseDirection[axis]);
+            const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMin[axis]), origin), inverseDirection);
+            const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMax[axis]), origin), inverseDirection);
+            enter = _mm256_max_ps(_mm256_min_ps(t0, t1), enter);
+            exit = _mm256_min_ps(_mm256_max_ps(t0, t1), exit);
+        }
+        const __m256 hit = _mm256_cmp_ps(enter, exit, _CMP_LE_OQ);
+        _mm256_storeu_ps(tEnter, _mm256_blendv_ps(_mm256_set1_ps(-1.0f), enter, hit));
+        return (uint32_t)_mm256_movemask_ps(hit);
+    }
+#else
+    InstructionSet DetectInstructionSet()
+    {
+        return InstructionSet::Scalar;
+    }
+#endif
+
+    const InstructionSet SupportedInstructionSet = DetectInstructionSet();
+    std::atomic<InstructionSet> currentInstructionSet(SupportedInstructionSet);
+}
+
+void RayKernels::TrianglePacket::Clear()
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (uint32_t lane = 0; lane < Width; lane++)
+        {
+            v0[axis][lane] = 0.0f;
+            edge1[axis][lane] = 0.0f;
+            edge2[axis][lane] = 0.0f;
+        }
+    }
+}
+
+void RayKernels::TrianglePacket::Set(uint32_t lane, const float corner0[3], const float corner1[3], const float corner2[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        v0[axis][lane] = corner0[axis];
+        edge1[axis][lane] = corner1[axis] - corner0[axis];
+        edge2[axis][lane] = corner2[axis] - corner0[axis];
+    }
+}
+
+void RayKernels::RayPacket::Set(uint32_t lane, const float rayOrigin[3], const float direction[3], float rayTMax)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        origin[axis][lane] = rayOrigin[axis];
+        inverseDirection[axis][lane] = 1.0f / direction[axis];
+    }
+    tMax[lane] = rayTMax;
+}
+
+RayKernels::InstructionSet RayKernels::GetSupportedInstructionSet()
+{
+    return SupportedInstructionSet;
+}
+
+RayKernels::InstructionSet RayKernels::GetInstructionSet()
+{
+    return currentInstructionSet.load(std::memory_order_relaxed);
+}
+
+RayKernels::InstructionSet RayKernels::SetInstructionSet(InstructionSet instructionSet)
+{
+    InstructionSet used = (int)instructionSet <= (int)SupportedInstructionSet ? instructionSet : SupportedInstructionSet;
+    currentInstructionSet.store(used, std::memory_order_relaxed);
+    return used;
+}
+
+const char* RayKernels::GetName(InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case InstructionSet::Sse4:
+        return "SSE4.1";
+    case InstructionSet::Avx2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+bool RayKernels::IntersectTriangle(const float v0[3], const float edge1[3], const float edge2[3], const float origin[3], const float direction[3],
+    CullMode cull, float& t, float& u, float& v)
+{
+    const float p0 = direction[1] * edge2[2] - direction[2] * edge2[1];
+    const float p1 = direction[2] * edge2[0] - direction[0] * edge2[2];
+    const float p2 = direction[0] * edge2[1] - direction[1] * edge2[0];
+    const float determinant = Dot(edge1[0], edge1[1], edge1[2], p0, p1, p2);
+    //The triangle faces the ray when the determinant is positive. A determinant of 0 is a ray in the plane of the triangle.
+    if (cull == CullMode::BackFacing ? !(determinant > 0.0f) : !(determinant != 0.0f))
+    {
+        return false;
+    }
+    const float inverseDeterminant = 1.0f / determinant;
+    const float s0 = origin[0] - v0[0];
+    const float s1 = origin[1] - v0[1];
+    const float s2 = origin[2] - v0[2];
+    const float hitU = Dot(s0, s1, s2, p0, p1, p2) * inverseDeterminant;
+    const float q0 = s1 * edge1[2] - s2 * edge1[1];
+    const float q1 = s2 * edge1[0] - s0 * edge1[2];
+    const float q2 = s0 * edge1[1] - s1 * edge1[0];
+    const float hitV = Dot(direction[0], direction[1], direction[2], q0, q1, q2) * inverseDeterminant;
+    const float hitT = Dot(edge2[0], edge2[1], edge2[2], q0, q1, q2) * inverseDeterminant;
+    //Written as what has to hold, so that NaN fails every test.
+    if (!(hitU >= 0.0f && hitU <= 1.0f && hitV >= 0.0f && hitU + hitV <= 1.0f && hitT >= 0.0f && hitT < t))
+    {
+        return false;
+    }
+    t = hitT;
+    u = hitU;
+    v = hitV;
+    return true;
+}
+
+int RayKernels::IntersectTriangles(const TrianglePacket& triangles, const float origin[3], const float direction[3], CullMode cull, float& t, float& u, float& v)
+{
+    switch (GetInstructionSet())
+    {
+#ifdef RAY_KERNELS_X86
+    case InstructionSet::Avx2:
+        return IntersectTrianglesAvx2(triangles, origin, direction, cull, t, u, v);
+    case InstructionSet::Sse4:
+        return IntersectTrianglesSse4(triangles, origin, direction, cull, t, u, v);
+#endif
+    default:
+        return IntersectTrianglesScalar(triangles, origin, direction, cull, t, u, v);
+    }
+}
+
+float RayKernels::IntersectBoxScalar(const float boundsMin[3], const float boundsMax[3], const float origin[3], const float inverseDirection[3], float tMax)
+{
+    float enter = 0.0f;
+    float exit = tMax;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float t0 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+        const float t1 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+        //A ray that lies in the plane of a side of the box gives a NaN, which Min() and Max() drop here because it is their first argument.
+        enter = Max(Min(t0, t1), enter);
+        exit = Min(Max(t0, t1), exit);
+    }
+    return enter <= exit ? enter : -1.0f;
+}
+
+uint32_t RayKernels::IntersectBox(const RayPacket& rays, const float boundsMin[3], const float boundsMax[3], float tEnter[Width])
+{
+    switch (GetInstructionSet())
+    {
+#ifdef RAY_KERNELS_X86
+    case InstructionSet::Avx2:
+        return IntersectBoxAvx2(rays, boundsMin, boundsMax, tEnter);
+    case InstructionSet::Sse4:
+        return IntersectBoxSse4(rays, boundsMin, boundsMax, tEnter);
+#endif
+    default:
+        return IntersectBoxScalarPacket(rays, boundsMin, boundsMax, tEnter);
+    }
+}
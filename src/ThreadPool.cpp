@@ -0,0 +1,142 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    stopping = false;
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0) //hardware_concurrency() is allowed to return 0 if it can't tell
+    {
+        threadCount = 1;
+    }
+    workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            //Remaining jobs are still run when the pool is stopping so that no future is left without a value.
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (count == 1)
+    {
+        body(0);
+        return;
+    }
+
+    //The state is shared with the helper jobs because a helper might only get to run after this call has returned,
+    //for example when all the workers are busy. Such a helper finds no work left and exits without touching body.
+    struct SharedState
+    {
+        std::atomic<size_t> nextIndex{ 0 };
+        size_t finishedCount = 0;
+        std::exception_ptr firstException;
+        std::mutex mutex;
+        std::condition_variable allFinished;
+    };
+    std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+    const std::function<void(size_t)>* bodyPointer = &body;
+
+    auto runIndices = [state, bodyPointer, count]()
+    {
+        while (true)
+        {
+            size_t index = state->nextIndex.fetch_add(1);
+            if (index >= count)
+            {
+                return;
+            }
+            std::exception_ptr exception;
+            try
+            {
+                (*bodyPointer)(index);
+            }
+            catch (...)
+            {
+                exception = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (exception && !state->firstException)
+            {
+                state->firstException = exception;
+            }
+            if (++state->finishedCount == count)
+            {
+                state->allFinished.notify_all();
+            }
+        }
+    };
+
+    size_t helperCount = std::min(count - 1, workers.size());
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        for (size_t i = 0; i < helperCount; i++)
+        {
+            jobs.push(runIndices);
+        }
+    }
+    jobAvailable.notify_all();
+
+    runIndices();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->allFinished.wait(lock, [&state, count]() { return state->finishedCount == count; });
+    if (state->firstException)
+    {
+        std::rethrow_exception(state->firstException);
+    }
+}
+
+unsigned int ThreadPool::GetThreadCount() const
+{
+    return (unsigned int)workers.size();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,176 @@
+#include "TopLevelBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    //Inverse of an affine transform given as the first three rows of a matrix that multiplies column vectors.
+    bool InvertAffine(const float m[3][4], float inverse[3][4])
+    {
+        const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        const float determinant = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+        if (!(determinant != 0.0f) || !std::isfinite(determinant))
+        {
+            return false;
+        }
+        const float inverseDeterminant = 1.0f / determinant;
+        inverse[0][0] = c00 * inverseDeterminant;
+        inverse[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inverseDeterminant;
+        inverse[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inverseDeterminant;
+        inverse[1][0] = c01 * inverseDeterminant;
+        inverse[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inverseDeterminant;
+        inverse[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inverseDeterminant;
+        inverse[2][0] = c02 * inverseDeterminant;
+        inverse[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inverseDeterminant;
+        inverse[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inverseDeterminant;
+        for (int row = 0; row < 3; row++)
+        {
+            inverse[row][3] = -(inverse[row][0] * m[0][3] + inverse[row][1] * m[1][3] + inverse[row][2] * m[2][3]);
+            for (int column = 0; column < 4; column++)
+            {
+                if (!std::isfinite(inverse[row][column]))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    //World bounds of the transformed root box of the bottom level hierarchy: each row of the matrix takes the smaller and the larger
+    //of its products with the two sides of the box on every axis, which gives the same box as transforming its eight corners.
+    Bvh::Bounds GetWorldBounds(const TopLevelBvh::Instance& instance)
+    {
+        const Bvh::Node& root = instance.blas->GetNodes()[0];
+        Bvh::Bounds bounds;
+        for (int row = 0; row < 3; row++)
+        {
+            bounds.min[row] = instance.transform[row][3];
+            bounds.max[row] = instance.transform[row][3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float a = instance.transform[row][axis] * root.boundsMin[axis];
+                const float b = instance.transform[row][axis] * root.boundsMax[axis];
+                bounds.min[row] += std::min(a, b);
+                bounds.max[row] += std::max(a, b);
+            }
+        }
+        return bounds;
+    }
+}
+
+TopLevelBvh::TopLevelBvh()
+{
+}
+
+bool TopLevelBvh::Build(const Instance* instances, size_t instanceCount, const Bvh::Settings* settings, ThreadPool* pool)
+{
+    Clear();
+    if (instanceCount == 0 || instanceCount > UINT32_MAX / 2)
+    {
+        return false;
+    }
+    records.resize(instanceCount);
+    std::vector<Bvh::Bounds> bounds(instanceCount);
+    for (size_t i = 0; i < instanceCount; i++)
+    {
+        const Instance& instance = instances[i];
+        if (instance.blas == nullptr || instance.blas->GetNodeCount() == 0 || !InvertAffine(instance.transform, records[i].worldToObject))
+        {
+            Clear();
+            return false;
+        }
+        records[i].instance = instance;
+        bounds[i] = GetWorldBounds(instance);
+    }
+    if (!hierarchy.BuildFromBounds(bounds.data(), instanceCount, settings, pool))
+    {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+void TopLevelBvh::Clear()
+{
+    records = std::vector<Record>();
+    hierarchy.Clear();
+}
+
+const TopLevelBvh::Instance& TopLevelBvh::GetInstance(uint32_t instance) const
+{
+    return records[instance].instance;
+}
+
+uint32_t TopLevelBvh::GetInstanceCount() const
+{
+    return (uint32_t)records.size();
+}
+
+const Bvh& TopLevelBvh::GetHierarchy() const
+{
+    return hierarchy;
+}
+
+size_t TopLevelBvh::GetMemorySize() const
+{
+    return records.capacity() * sizeof(Record) + hierarchy.GetNodeCount() * sizeof(Bvh::Node) + hierarchy.GetTriangleCount() * sizeof(uint32_t);
+}
+
+void TopLevelBvh::ToObjectSpace(uint32_t instance, const float origin[3], const float direction[3], float objectOrigin[3], float objectDirection[3]) const
+{
+    const float (&m)[3][4] = records[instance].worldToObject;
+    for (int row = 0; row < 3; row++)
+    {
+        objectOrigin[row] = m[row][0] * origin[0] + m[row][1] * origin[1] + m[row][2] * origin[2] + m[row][3];
+        objectDirection[row] = m[row][0] * direction[0] + m[row][1] * direction[1] + m[row][2] * direction[2];
+    }
+}
+
+bool TopLevelBvh::Intersect(const float origin[3], const float direction[3], float tMax, Hit& hit, RayKernels::CullMode cull) const
+{
+    const uint32_t* order = hierarchy.GetTriangleIndices();
+    bool found = false;
+    hierarchy.VisitLeaves(origin, direction, tMax, [&](uint32_t first, uint32_t count, float& closest)
+        {
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const uint32_t index = order[i];
+                float objectOrigin[3], objectDirection[3];
+                ToObjectSpace(index, origin, direction, objectOrigin, objectDirection);
+                //An instance before the one that was hit also takes a hit at the same distance.
+                const float instanceTMax = found && index < hit.instance ? std::nextafter(closest, FLT_MAX) : closest;
+                Bvh::Hit instanceHit;
+                if (records[index].instance.blas->Intersect(objectOrigin, objectDirection, instanceTMax, instanceHit, cull))
+                {
+                    closest = instanceHit.t;
+                    hit = { instanceHit.t, index, instanceHit.triangle, instanceHit.u, instanceHit.v };
+                    found = true;
+                }
+            }
+            return false;
+        });
+    return found;
+}
+
+bool TopLevelBvh::Occluded(const float origin[3], const float direction[3], float tMax, RayKernels::CullMode cull) const
+{
+    const uint32_t* order = hierarchy.GetTriangleIndices();
+    return hierarchy.VisitLeaves(origin, direction, tMax, [&](uint32_t first, uint32_t count, float& closest)
+        {
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                float objectOrigin[3], objectDirection[3];
+                ToObjectSpace(order[i], origin, direction, objectOrigin, objectDirection);
+                if (records[order[i]].instance.blas->Occluded(objectOrigin, objectDirection, closest, cull))
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+}
@@ -1,4 +1,5 @@
 #include "UIConstructor.h"
+#include "ModelLoadTask.h"
 
 UIConstructor::UIConstructor()
 {
@@ -15,7 +16,8 @@ UIConstructor::UIConstructor()
     albedo[2] = 1.0f;
     roughness = 0.5f;
     metallic = 0.5f;
-    modelUpdateFunction = nullptr;
+    reflectivity = 0.5f;
+    modelLoadTask = nullptr;
     modelFileLoadFeedbackMessage = "";
 }
 
@@ -49,37 +51,53 @@ void UIConstructor::Construct()
     ImGui::Begin("File Selection");
     ImGui::InputText("File Path", newModelFilePath, 120);
 
+    //The model is loaded in the background, so only one load can run at a time.
+    bool loading = modelLoadTask != nullptr && modelLoadTask->IsRunning();
+    ImGui::BeginDisabled(loading);
     if (ImGui::Button("Load Model File", ImVec2(120, 20)))
     {
-        if (modelUpdateFunction == nullptr)
+        if (modelLoadTask == nullptr)
         {
-            modelFileLoadFeedbackMessage = "No function is set to update the model parameters";
+            modelFileLoadFeedbackMessage = "No model loader is set to update the model";
         }
-        else
+        else if (modelLoadTask->Start(std::string(newModelFilePath)))
         {
-            OBJFileManager ofm = OBJFileManager();
-            std::vector<objl::Vertex> vertices;
-            std::vector<UINT> indices;
-            bool loaded = ofm.LoadObjFile(std::string(newModelFilePath), vertices, indices);
-            if (loaded)
-            {
-                std::vector<XMFLOAT3> vertexPoints;
-                vertexPoints.reserve(vertices.size());
-                for (objl::Vertex& vertex : vertices)
-                {
-                    objl::Vector3 position = vertex.Position;
-                    vertexPoints.push_back(XMFLOAT3(position.X, position.Y, position.Z));
-                }
-                modelUpdateFunction(vertexPoints, indices);
-                modelFileLoadFeedbackMessage = "Succesfully loaded the file.";
-            }
-            else
-            {
-                modelFileLoadFeedbackMessage = "Couldn't load file. Check if the file exists.";
-            }
+            loading = true;
         }
     }
-    ImGui::Text(modelFileLoadFeedbackMessage.data());
+    ImGui::EndDisabled();
+
+    if (loading)
+    {
+        ModelLoadTask::Stage stage = modelLoadTask->GetStage();
+        float progress = modelLoadTask->GetStageProgress();
+        char progressString[65] = { 0 };
+        _snprintf_s(progressString, 64, "%s (%d%%)", ModelLoadTask::GetStageName(stage), (int)(progress * 100.0f));
+        ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), progressString);
+        if (ImGui::Button("Cancel", ImVec2(120, 20)))
+        {
+            modelLoadTask->Cancel();
+        }
+        modelFileLoadFeedbackMessage = "Loading " + modelLoadTask->GetPath();
+    }
+    else if (modelLoadTask != nullptr)
+    {
+        switch (modelLoadTask->GetStage())
+        {
+        case ModelLoadTask::Stage::Finished:
+            modelFileLoadFeedbackMessage = "Succesfully loaded the file.";
+            break;
+        case ModelLoadTask::Stage::Failed:
+            modelFileLoadFeedbackMessage = "Couldn't load file. Check if the file exists.";
+            break;
+        case ModelLoadTask::Stage::Cancelled:
+            modelFileLoadFeedbackMessage = "Loading was cancelled, the previous model is kept.";
+            break;
+        default:
+            break;
+        }
+    }
+    ImGui::Text("%s", modelFileLoadFeedbackMessage.data());
     ImGui::End();
 
     //Lighting controls
@@ -134,9 +152,9 @@ float UIConstructor::GetMetallic()
     return metallic;
 }
 
-void UIConstructor::SetModelUpdateFunction(std::function<void(std::vector<XMFLOAT3>& vertices, std::vector<UINT>& indices)> function)
+void UIConstructor::SetModelLoadTask(ModelLoadTask* task)
 {
-    modelUpdateFunction = function;
+    modelLoadTask = task;
 }
 
 float UIConstructor::GetReflectivity()
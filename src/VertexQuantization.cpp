@@ -0,0 +1,202 @@
+#include "VertexQuantization.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+static const float SnormMax = 32767.0f;
+
+static int16_t ToSnorm16(float value)
+{
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return (int16_t)std::lround(value * SnormMax);
+}
+
+//Same conversion the GPU does for SNORM formats: -32768 and -32767 both map to -1.
+static float FromSnorm16(int16_t value)
+{
+    return std::max(value / SnormMax, -1.0f);
+}
+
+static float SignNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+VertexQuantization::Bounds VertexQuantization::ComputeBounds(const MeshCache::Vertex* vertices, size_t vertexCount)
+{
+    float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            minimum[axis] = std::min(minimum[axis], vertices[i].position[axis]);
+            maximum[axis] = std::max(maximum[axis], vertices[i].position[axis]);
+        }
+    }
+
+    Bounds bounds;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (vertexCount == 0)
+        {
+            minimum[axis] = maximum[axis] = 0.0f;
+        }
+        bounds.center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+        bounds.halfExtent[axis] = (maximum[axis] - minimum[axis]) * 0.5f;
+        if (bounds.halfExtent[axis] <= 0.0f)
+        {
+            bounds.halfExtent[axis] = 1.0f;
+        }
+    }
+    return bounds;
+}
+
+void VertexQuantization::EncodePosition(const float position[3], const Bounds& bounds, int16_t encoded[4])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        encoded[axis] = ToSnorm16((position[axis] - bounds.center[axis]) / bounds.halfExtent[axis]);
+    }
+    encoded[3] = 0;
+}
+
+void VertexQuantization::DecodePosition(const int16_t encoded[4], const Bounds& bounds, float position[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        position[axis] = FromSnorm16(encoded[axis]) * bounds.halfExtent[axis] + bounds.center[axis];
+    }
+}
+
+void VertexQuantization::EncodeNormal(const float normal[3], int16_t encoded[2])
+{
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    if (length == 0.0f)
+    {
+        encoded[0] = encoded[1] = 0;
+        return;
+    }
+
+    //Project onto the octahedron, then fold the lower half over the diagonals.
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if (normal[2] < 0.0f)
+    {
+        float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+        float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+    encoded[0] = ToSnorm16(x);
+    encoded[1] = ToSnorm16(y);
+}
+
+void VertexQuantization::DecodeNormal(const int16_t encoded[2], float normal[3])
+{
+    //Has to stay the same as DecodeOctahedralNormal in Hit.hlsl and shaders.hlsl.
+    float x = FromSnorm16(encoded[0]);
+    float y = FromSnorm16(encoded[1]);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+
+    float length = std::sqrt(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+float VertexQuantization::GetPositionErrorBound(const Bounds& bounds, int axis)
+{
+    //Half a step from the rounding plus the float rounding of the coordinates around the center.
+    return bounds.halfExtent[axis] / SnormMax * 0.5f + (std::fabs(bounds.center[axis]) + bounds.halfExtent[axis]) * FLT_EPSILON * 2.0f;
+}
+
+float VertexQuantization::GetNormalErrorBound()
+{
+    //Half a step of rounding on both octahedral coordinates is about 2.2e-5 long, and the octahedron is stretched by up to about 3
+    //when it is mapped back onto the sphere, which gives about 6.5e-5 radians (0.0037 degrees) at worst.
+    return 7e-5f;
+}
+
+void VertexQuantization::GetDequantizationTransform(const Bounds& bounds, float transform[12])
+{
+    memset(transform, 0, sizeof(float) * 12);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        transform[axis * 4 + axis] = bounds.halfExtent[axis];
+        transform[axis * 4 + 3] = bounds.center[axis];
+    }
+}
+
+VertexQuantization::Format VertexQuantization::ChooseFormat(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+{
+    if (vertexCount == 0)
+    {
+        return Format::Float;
+    }
+
+    Bounds bounds = ComputeBounds(vertices, vertexCount);
+    std::vector<int16_t> positions(vertexCount * 4);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        EncodePosition(vertices[i].position, bounds, &positions[i * 4]);
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const float* p0 = vertices[indices[i + 0]].position;
+        const float* p1 = vertices[indices[i + 1]].position;
+        const float* p2 = vertices[indices[i + 2]].position;
+        float a[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float b[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        bool isDegenerate = a[1] * b[2] - a[2] * b[1] == 0.0f &&
+                            a[2] * b[0] - a[0] * b[2] == 0.0f &&
+                            a[0] * b[1] - a[1] * b[0] == 0.0f;
+        if (isDegenerate)
+        {
+            //The triangle doesn't hit anything in either format.
+            continue;
+        }
+
+        //The quantized positions are integers, so the cross product is exact.
+        const int16_t* q0 = &positions[indices[i + 0] * 4];
+        const int16_t* q1 = &positions[indices[i + 1] * 4];
+        const int16_t* q2 = &positions[indices[i + 2] * 4];
+        int64_t qa[3] = { q1[0] - q0[0], q1[1] - q0[1], q1[2] - q0[2] };
+        int64_t qb[3] = { q2[0] - q0[0], q2[1] - q0[1], q2[2] - q0[2] };
+        bool collapses = qa[1] * qb[2] - qa[2] * qb[1] == 0 &&
+                         qa[2] * qb[0] - qa[0] * qb[2] == 0 &&
+                         qa[0] * qb[1] - qa[1] * qb[0] == 0;
+        if (collapses)
+        {
+            return Format::Float;
+        }
+    }
+    return Format::Quantized;
+}
+
+size_t VertexQuantization::GetVertexSize(Format format)
+{
+    return format == Format::Quantized ? QuantizedVertexSize : FloatVertexSize;
+}
+
+void VertexQuantization::Encode(const MeshCache::Vertex* vertices, size_t vertexCount, Format format, const Bounds& bounds, void* destination)
+{
+    if (format == Format::Float)
+    {
+        memcpy(destination, vertices, vertexCount * FloatVertexSize);
+        return;
+    }
+
+    QuantizedVertex* quantizedVertices = static_cast<QuantizedVertex*>(destination);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        EncodePosition(vertices[i].position, bounds, quantizedVertices[i].position);
+        EncodeNormal(vertices[i].normal, quantizedVertices[i].normal);
+    }
+}
@@ -0,0 +1,390 @@
+//Offline baker of model folders.
+//Every .obj, .gltf and .glb file under the input folder is loaded with ModelLoadTask, which welds, optimizes and simplifies the mesh
+//and computes its normals, and its .rtmesh file is written to the same relative path under the output folder with .rtmesh added, so
+//model.obj and model.glb bake to files of their own. The renderer loads baked .rtmesh files directly, without their sources.
+//Several models are baked at once, one ModelLoadTask per job.
+//A model whose .rtmesh file is up to date (same format version and same hash of the model file contents and its material libraries) is skipped.
+//Like the cache beside a model, the hash doesn't cover the .bin files of a glTF model, so --force rebakes after one of those changes.
+//Every model is reported with the time of its stages as it finishes, and manifest.json in the output folder lists all of them.
+//
+//Usage: asset_baker [--jobs N] [--force] [--manifest FILE] <input folder> <output folder>
+
+#include "MeshCache.h"
+#include "ModelLoadTask.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    enum class Status
+    {
+        Pending,
+        Baked,
+        Skipped,
+        Failed
+    };
+
+    const char* GetStatusName(Status status)
+    {
+        switch (status)
+        {
+        case Status::Baked: return "baked";
+        case Status::Skipped: return "skipped";
+        case Status::Failed: return "failed";
+        default: return "pending";
+        }
+    }
+
+    //The stages of ModelLoadTask that are reported, in the order they run.
+    const ModelLoadTask::Stage TimedStages[] = {
+        ModelLoadTask::Stage::Parsing,
+        ModelLoadTask::Stage::Optimizing,
+        ModelLoadTask::Stage::ComputingNormals,
+        ModelLoadTask::Stage::GeneratingLods,
+        ModelLoadTask::Stage::PreparingBuffers,
+    };
+    const size_t TimedStageCount = sizeof(TimedStages) / sizeof(TimedStages[0]);
+
+    struct Model
+    {
+        std::string relativePath;
+        fs::path sourcePath;
+        fs::path outputPath;
+        uint64_t sourceBytes = 0;
+        Status status = Status::Pending;
+        std::string error;
+        uint64_t sourceHash = 0;
+        uint32_t vertexCount = 0;
+        uint32_t triangleCount = 0;
+        uint32_t lodCount = 0;
+        uint32_t partCount = 0;
+        uint32_t materialCount = 0;
+        double milliseconds = 0.0;
+        double stageMilliseconds[TimedStageCount] = {};
+    };
+
+    struct Job
+    {
+        ModelLoadTask task;
+        Model* model = nullptr;
+        Clock::time_point start;
+    };
+
+    bool IsModelFile(const fs::path& path)
+    {
+        std::string extension = path.extension().string();
+        for (char& c : extension)
+        {
+            c = (char)tolower((unsigned char)c);
+        }
+        return extension == ".obj" || extension == ".gltf" || extension == ".glb";
+    }
+
+    //Reads the counts of a valid .rtmesh file, which is what the manifest lists for every model.
+    void ReadCounts(const MeshCache& cache, Model& model)
+    {
+        model.sourceHash = cache.GetSourceHash();
+        model.vertexCount = cache.GetVertexCount();
+        model.lodCount = std::max(1u, cache.GetLodCount());
+        model.partCount = std::max(1u, cache.GetPartCount());
+        model.materialCount = cache.GetMaterialCount();
+        model.triangleCount = 0;
+        if (cache.GetPartCount() == 0)
+        {
+            model.triangleCount = cache.GetLodCount() > 0 ? cache.GetLods()[0].indexCount / 3 : cache.GetIndexCount() / 3;
+            return;
+        }
+        for (uint32_t i = 0; i < cache.GetPartCount(); i++)
+        {
+            model.triangleCount += cache.GetLods()[cache.GetParts()[i].firstLod].indexCount / 3;
+        }
+    }
+
+    void PrintModel(const Model& model)
+    {
+        if (model.status == Status::Failed)
+        {
+            printf("  failed   %9.1f ms  %s: %s\n", model.milliseconds, model.relativePath.c_str(), model.error.c_str());
+        }
+        else if (model.status == Status::Skipped)
+        {
+            printf("  skipped  %9.1f ms  %s (up to date, %u triangles)\n", model.milliseconds, model.relativePath.c_str(), model.triangleCount);
+        }
+        else
+        {
+            printf("  baked    %9.1f ms  %s (%u vertices, %u triangles, %u parts, %u levels)   parse %.1f, optimize %.1f, normals %.1f, lods and write %.1f, finish %.1f ms\n",
+                model.milliseconds, model.relativePath.c_str(), model.vertexCount, model.triangleCount, model.partCount, model.lodCount,
+                model.stageMilliseconds[0], model.stageMilliseconds[1], model.stageMilliseconds[2], model.stageMilliseconds[3], model.stageMilliseconds[4]);
+        }
+        fflush(stdout);
+    }
+
+    std::string EscapeJson(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned int)c);
+                escaped += code;
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    bool WriteManifest(const fs::path& path, const std::vector<Model>& models)
+    {
+        //Written under a temporary name and renamed like the .rtmesh files, so a reader never sees half a manifest.
+        const fs::path temporaryPath = path.string() + ".tmp";
+        FILE* output = fopen(temporaryPath.string().c_str(), "w");
+        if (output == nullptr)
+        {
+            return false;
+        }
+        fprintf(output, "{\n");
+        fprintf(output, "  \"baker\": \"asset_baker\",\n");
+        fprintf(output, "  \"formatVersion\": 1,\n");
+        fprintf(output, "  \"meshVersion\": %u,\n", MeshCache::Version);
+        fprintf(output, "  \"models\": [");
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            const Model& model = models[i];
+            fprintf(output, "%s\n    {\n", i == 0 ? "" : ",");
+            fprintf(output, "      \"source\": \"%s\",\n", EscapeJson(fs::path(model.relativePath).generic_string()).c_str());
+            fprintf(output, "      \"status\": \"%s\",\n", GetStatusName(model.status));
+            fprintf(output, "      \"sourceBytes\": %llu,\n", (unsigned long long)model.sourceBytes);
+            fprintf(output, "      \"milliseconds\": %.3f", model.milliseconds);
+            if (model.status == Status::Failed)
+            {
+                fprintf(output, ",\n      \"error\": \"%s\"\n    }", EscapeJson(model.error).c_str());
+                continue;
+            }
+            fprintf(output, ",\n      \"mesh\": \"%s\",\n", EscapeJson(fs::path(model.relativePath + ".rtmesh").generic_string()).c_str());
+            fprintf(output, "      \"sourceHash\": \"%016llx\",\n", (unsigned long long)model.sourceHash);
+            fprintf(output, "      \"vertices\": %u,\n", model.vertexCount);
+            fprintf(output, "      \"triangles\": %u,\n", model.triangleCount);
+            fprintf(output, "      \"parts\": %u,\n", model.partCount);
+            fprintf(output, "      \"materials\": %u,\n", model.materialCount);
+            fprintf(output, "      \"levelsOfDetail\": %u", model.lodCount);
+            if (model.status == Status::Baked)
+            {
+                fprintf(output, ",\n      \"stageMilliseconds\": { \"parse\": %.3f, \"optimize\": %.3f, \"normals\": %.3f, \"lods\": %.3f, \"finish\": %.3f }",
+                    model.stageMilliseconds[0], model.stageMilliseconds[1], model.stageMilliseconds[2], model.stageMilliseconds[3], model.stageMilliseconds[4]);
+            }
+            fprintf(output, "\n    }");
+        }
+        fprintf(output, "%s]\n}\n", models.empty() ? "" : "\n  ");
+        bool succeeded = fclose(output) == 0;
+        std::error_code error;
+        fs::rename(temporaryPath, path, error);
+        if (!succeeded || error)
+        {
+            fs::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    void FinishJob(Job& job)
+    {
+        Model& model = *job.model;
+        for (size_t i = 0; i < TimedStageCount; i++)
+        {
+            model.stageMilliseconds[i] = job.task.GetStageSeconds(TimedStages[i]) * 1000.0;
+        }
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        bool loaded = job.task.GetStage() == ModelLoadTask::Stage::Finished && job.task.TakeResult(vertices, indices);
+        //ModelLoadTask doesn't fail when the cache can't be written, so the written file is checked against the source.
+        MeshCache written;
+        if (!loaded)
+        {
+            model.status = Status::Failed;
+            model.error = "the model could not be loaded";
+        }
+        else if (!written.Open(model.sourcePath.string(), model.outputPath.string()))
+        {
+            model.status = Status::Failed;
+            model.error = "writing " + model.outputPath.string() + " failed";
+        }
+        else
+        {
+            model.status = Status::Baked;
+            ReadCounts(written, model);
+        }
+        model.milliseconds = MillisecondsSince(job.start);
+        job.model = nullptr;
+        PrintModel(model);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int jobCount = std::max(1u, std::thread::hardware_concurrency());
+    bool force = false;
+    std::string manifestPath;
+    std::vector<std::string> folders;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--jobs" && i + 1 < argc)
+        {
+            jobCount = (unsigned int)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--force")
+        {
+            force = true;
+        }
+        else if (argument == "--manifest" && i + 1 < argc)
+        {
+            manifestPath = argv[++i];
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            folders.push_back(argument);
+        }
+        else
+        {
+            folders.clear();
+            break;
+        }
+    }
+    if (folders.size() != 2)
+    {
+        fprintf(stderr,
+            "Usage: asset_baker [options] <input folder> <output folder>\n"
+            "  --jobs <n>         Models baked at once (default: hardware threads)\n"
+            "  --force            Bake every model, even the ones whose .rtmesh file is up to date\n"
+            "  --manifest <file>  Where the manifest is written (default: <output folder>/manifest.json)\n");
+        return argc == 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h") ? 0 : 1;
+    }
+    const fs::path inputFolder = folders[0];
+    const fs::path outputFolder = folders[1];
+    if (manifestPath.empty())
+    {
+        manifestPath = (outputFolder / "manifest.json").string();
+    }
+
+    //The models are sorted so the manifest lists them in the same order on every run.
+    std::error_code error;
+    std::vector<Model> models;
+    for (fs::recursive_directory_iterator it(inputFolder, fs::directory_options::skip_permission_denied, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->is_regular_file(error) && IsModelFile(it->path()))
+        {
+            Model model;
+            model.sourcePath = it->path();
+            model.relativePath = fs::relative(it->path(), inputFolder, error).string();
+            model.outputPath = outputFolder / fs::path(model.relativePath + ".rtmesh");
+            model.sourceBytes = it->file_size(error);
+            models.push_back(model);
+        }
+    }
+    if (error)
+    {
+        fprintf(stderr, "Couldn't read %s: %s\n", inputFolder.string().c_str(), error.message().c_str());
+        return 1;
+    }
+    std::sort(models.begin(), models.end(), [](const Model& a, const Model& b) { return a.relativePath < b.relativePath; });
+
+    printf("Baking %zu models from %s to %s with %u jobs\n", models.size(), inputFolder.string().c_str(), outputFolder.string().c_str(), jobCount);
+    Clock::time_point start = Clock::now();
+    std::vector<std::unique_ptr<Job>> jobs;
+    for (unsigned int i = 0; i < jobCount; i++)
+    {
+        jobs.push_back(std::make_unique<Job>());
+    }
+    size_t next = 0;
+    size_t running = 0;
+    while (next < models.size() || running > 0)
+    {
+        for (std::unique_ptr<Job>& job : jobs)
+        {
+            if (job->model != nullptr && !job->task.IsRunning())
+            {
+                FinishJob(*job);
+                running--;
+            }
+            //Up to date models are skipped right away, the free job moves on to the next model.
+            while (job->model == nullptr && next < models.size())
+            {
+                Model& model = models[next++];
+                if (model.status == Status::Failed)
+                {
+                    PrintModel(model);
+                    continue;
+                }
+                Clock::time_point modelStart = Clock::now();
+                MeshCache existing;
+                if (!force && existing.Open(model.sourcePath.string(), model.outputPath.string()))
+                {
+                    model.status = Status::Skipped;
+                    ReadCounts(existing, model);
+                    model.milliseconds = MillisecondsSince(modelStart);
+                    PrintModel(model);
+                    continue;
+                }
+                existing.Close();
+                fs::create_directories(model.outputPath.parent_path(), error);
+                //A forced bake must not pick up the old file.
+                fs::remove(model.outputPath, error);
+                job->model = &model;
+                job->start = modelStart;
+                job->task.Start(model.sourcePath.string(), model.outputPath.string());
+                running++;
+            }
+        }
+        if (running > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    double totalTime = MillisecondsSince(start);
+
+    size_t counts[4] = {};
+    double bakeTime = 0.0;
+    for (const Model& model : models)
+    {
+        counts[(int)model.status]++;
+        bakeTime += model.status == Status::Baked ? model.milliseconds : 0.0;
+    }
+    printf("%zu baked, %zu skipped, %zu failed in %.1f ms (%.1f ms of baking)\n",
+        counts[(int)Status::Baked], counts[(int)Status::Skipped], counts[(int)Status::Failed], totalTime, bakeTime);
+
+    fs::create_directories(fs::path(manifestPath).parent_path(), error);
+    if (!WriteManifest(manifestPath, models))
+    {
+        fprintf(stderr, "Couldn't write %s\n", manifestPath.c_str());
+        return 1;
+    }
+    printf("Manifest written to %s\n", manifestPath.c_str());
+    return counts[(int)Status::Failed] == 0 ? 0 : 1;
+}
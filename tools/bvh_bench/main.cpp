@@ -0,0 +1,315 @@
+//Benchmark of the CPU BVH builder, the reference for the bottom level acceleration structures the driver builds.
+//Every model is loaded with ModelLoadTask and the hierarchy is built over the full detail level of all its parts, the same vertices and indices
+//CreateBottomLevelAS gets. A generated torus is added so that the parallel subtree builds run (the bundled models are below the threshold).
+//The build is timed with pools of 1 worker up to the hardware thread count and for several bin counts, and every build has to give the same
+//nodes as the first one. The node count, depth, leaf sizes and SAH cost of each bin count are reported, the hierarchy is validated, and the
+//closest hits of random rays are compared with testing every triangle.
+//
+//Usage: bvh_bench [--triangles N] [--rays N] [--repeat N] [model.obj ...]    (models/teapot.obj and models/rabbit.obj when no model is given)
+
+#include "Bvh.h"
+#include "ModelLoadTask.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Brute force tests of the ray check are capped at about this many ray-triangle tests per model.
+    const double BruteForceBudget = 2e8;
+
+    struct Mesh
+    {
+        std::string name;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    //Fastest of repeat runs in seconds.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return std::max(best, 1e-9);
+    }
+
+    //Torus of about triangleCount triangles with a wavy surface.
+    Mesh GenerateTorus(size_t triangleCount)
+    {
+        Mesh mesh;
+        size_t side = std::max<size_t>(3, (size_t)std::sqrt((double)triangleCount / 2.0));
+        mesh.name = "torus " + std::to_string(side) + "x" + std::to_string(side);
+        mesh.vertices.resize(side * side);
+        const double pi = 3.14159265358979323846;
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                double u = 2.0 * pi * i / side;
+                double v = 2.0 * pi * j / side;
+                double r = 1.0 + 0.05 * std::sin(7.0 * u) * std::cos(5.0 * v);
+                MeshCache::Vertex& vertex = mesh.vertices[i * side + j];
+                vertex.position[0] = (float)((3.0 + r * std::cos(v)) * std::cos(u));
+                vertex.position[1] = (float)((3.0 + r * std::cos(v)) * std::sin(u));
+                vertex.position[2] = (float)(r * std::sin(v));
+            }
+        }
+        mesh.indices.reserve(side * side * 6);
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                uint32_t a = (uint32_t)(i * side + j);
+                uint32_t b = (uint32_t)(((i + 1) % side) * side + j);
+                uint32_t c = (uint32_t)(((i + 1) % side) * side + (j + 1) % side);
+                uint32_t d = (uint32_t)(i * side + (j + 1) % side);
+                mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+            }
+        }
+        return mesh;
+    }
+
+    //The full detail level of every part, which is what the renderer builds its bottom level acceleration structures from.
+    bool LoadModel(const std::string& path, Mesh& mesh)
+    {
+        ModelLoadTask task;
+        std::vector<uint32_t> indices;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        task.Start(path);
+        task.Wait();
+        if (!task.TakeResult(mesh.vertices, indices, &lods, &parts))
+        {
+            return false;
+        }
+        mesh.name = path;
+        for (const MeshCache::Part& part : parts)
+        {
+            const MeshCache::Lod& lod = lods[part.firstLod];
+            mesh.indices.insert(mesh.indices.end(), indices.begin() + lod.firstIndex, indices.begin() + lod.firstIndex + lod.indexCount);
+        }
+        return true;
+    }
+
+    bool SameHierarchy(const Bvh& a, const Bvh& b)
+    {
+        return a.GetNodeCount() == b.GetNodeCount() && a.GetTriangleCount() == b.GetTriangleCount() &&
+            memcmp(a.GetNodes(), b.GetNodes(), a.GetNodeCount() * sizeof(Bvh::Node)) == 0 &&
+            memcmp(a.GetTriangleIndices(), b.GetTriangleIndices(), a.GetTriangleCount() * sizeof(uint32_t)) == 0;
+    }
+
+    //The same triangle test the hierarchy uses, on the triangles of the index array in order.
+    bool IntersectAll(const Mesh& mesh, const float origin[3], const float direction[3], Bvh::Hit& hit)
+    {
+        bool found = false;
+        for (size_t triangle = 0; triangle < mesh.indices.size() / 3; triangle++)
+        {
+            const float* v0 = mesh.vertices[mesh.indices[3 * triangle]].position;
+            const float* v1 = mesh.vertices[mesh.indices[3 * triangle + 1]].position;
+            const float* v2 = mesh.vertices[mesh.indices[3 * triangle + 2]].position;
+            const float edge1[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+            const float edge2[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+            if (RayKernels::IntersectTriangle(v0, edge1, edge2, origin, direction, RayKernels::CullMode::None, hit.t, hit.u, hit.v))
+            {
+                hit.triangle = (uint32_t)triangle;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    //Rays from a sphere around the model towards random points inside its bounds. The closest hit has to be at the same distance as the one
+    //found by testing every triangle (the triangle may differ where two triangles are hit at the same distance, at a shared edge).
+    bool CheckRays(const Mesh& mesh, const Bvh& bvh, uint32_t rayCount)
+    {
+        const Bvh::Node& root = bvh.GetNodes()[0];
+        float center[3];
+        float radius = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            center[axis] = 0.5f * (root.boundsMin[axis] + root.boundsMax[axis]);
+            radius = std::max(radius, root.boundsMax[axis] - root.boundsMin[axis]);
+        }
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<float> rays(6 * (size_t)rayCount);
+        for (uint32_t ray = 0; ray < rayCount; ray++)
+        {
+            float* origin = &rays[6 * (size_t)ray];
+            float* direction = origin + 3;
+            float onSphere[3] = { unit(random), unit(random), unit(random) };
+            float length = std::max(1e-6f, std::sqrt(onSphere[0] * onSphere[0] + onSphere[1] * onSphere[1] + onSphere[2] * onSphere[2]));
+            for (int axis = 0; axis < 3; axis++)
+            {
+                origin[axis] = center[axis] + 2.0f * radius * onSphere[axis] / length;
+                float target = root.boundsMin[axis] + (root.boundsMax[axis] - root.boundsMin[axis]) * 0.5f * (unit(random) + 1.0f);
+                direction[axis] = target - origin[axis];
+            }
+        }
+
+        std::vector<Bvh::Hit> hits(rayCount);
+        std::vector<uint8_t> hitFound(rayCount);
+        const double traversalTime = BestTime(3, [&]()
+            {
+                for (uint32_t ray = 0; ray < rayCount; ray++)
+                {
+                    hitFound[ray] = bvh.Intersect(&rays[6 * (size_t)ray], &rays[6 * (size_t)ray + 3], FLT_MAX, hits[ray]);
+                }
+            });
+
+        const uint32_t checkedCount = (uint32_t)std::min<double>(rayCount, std::max(64.0, BruteForceBudget / (double)bvh.GetTriangleCount()));
+        uint32_t mismatches = 0;
+        uint32_t hitCount = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t ray = 0; ray < checkedCount; ray++)
+        {
+            Bvh::Hit expected = { FLT_MAX, UINT32_MAX, 0.0f, 0.0f };
+            bool expectedFound = IntersectAll(mesh, &rays[6 * (size_t)ray], &rays[6 * (size_t)ray + 3], expected);
+            hitCount += expectedFound ? 1 : 0;
+            mismatches += expectedFound != (hitFound[ray] != 0) || (expectedFound && expected.t != hits[ray].t) ? 1 : 0;
+        }
+        const double bruteForceTime = std::max(1e-9, std::chrono::duration<double>(Clock::now() - start).count());
+
+        printf("  rays: %u traced at %.2f Mrays/s, %u checked against every triangle (%u hit) at %.4f Mrays/s: %s\n", rayCount, rayCount / traversalTime / 1e6,
+            checkedCount, hitCount, checkedCount / bruteForceTime / 1e6, mismatches == 0 ? "same closest hits" : (std::to_string(mismatches) + " MISMATCHES").c_str());
+        return mismatches == 0;
+    }
+
+    bool Run(const Mesh& mesh, int repeat, uint32_t rayCount)
+    {
+        const size_t triangleCount = mesh.indices.size() / 3;
+        printf("%s: %zu vertices, %zu triangles\n", mesh.name.c_str(), mesh.vertices.size(), triangleCount);
+
+        unsigned int hardwareThreads = std::max(4u, std::thread::hardware_concurrency());
+        std::vector<unsigned int> workerCounts;
+        for (unsigned int workers = 1; workers < hardwareThreads; workers *= 2)
+        {
+            workerCounts.push_back(workers);
+        }
+        workerCounts.push_back(hardwareThreads);
+
+        bool succeeded = true;
+        Bvh checked;
+        const uint32_t binCounts[] = { 8, 16, 32 };
+        for (uint32_t binCount : binCounts)
+        {
+            Bvh::Settings settings;
+            settings.binCount = binCount;
+            Bvh first;
+            double firstTime = 0.0;
+            for (unsigned int workers : workerCounts)
+            {
+                ThreadPool pool(workers);
+                Bvh bvh;
+                bool built = true;
+                double time = BestTime(repeat, [&]() { built = bvh.Build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), &settings, &pool) && built; });
+                if (!built)
+                {
+                    printf("  %u bins: build failed\n", binCount);
+                    return false;
+                }
+                bool deterministic = true;
+                if (first.GetNodeCount() == 0)
+                {
+                    first = bvh;
+                    firstTime = time;
+                }
+                else
+                {
+                    deterministic = SameHierarchy(first, bvh);
+                    succeeded = deterministic && succeeded;
+                }
+                std::string label = std::to_string(binCount) + " bins, " + std::to_string(workers) + (workers == 1 ? " worker" : " workers");
+                printf("  %-22s %10.2f ms %8.2f Mtris/s   x%.2f   %s\n", label.c_str(), time * 1000.0, triangleCount / time / 1e6, firstTime / time,
+                    deterministic ? "same nodes as 1 worker" : "DIFFERENT FROM 1 WORKER");
+            }
+
+            Bvh::Statistics statistics = first.ComputeStatistics();
+            bool valid = first.Validate();
+            succeeded = valid && succeeded;
+            printf("  %-22s %u nodes, %u leaves, depth %u, %.2f triangles per leaf (at most %u), SAH cost %.2f, %s\n", "", statistics.nodeCount,
+                statistics.leafCount, statistics.maxDepth, statistics.averageLeafSize, statistics.maxLeafSize, statistics.sahCost, valid ? "valid" : "INVALID");
+            if (binCount == Bvh::Settings().binCount)
+            {
+                checked = first;
+            }
+        }
+        succeeded = CheckRays(mesh, checked, rayCount) && succeeded;
+        printf("\n");
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangleCount = 2000000;
+    uint32_t rayCount = 100000;
+    int repeat = 3;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--triangles" && i + 1 < argc)
+        {
+            triangleCount = (size_t)std::max(0LL, atoll(argv[++i]));
+        }
+        else if (argument == "--rays" && i + 1 < argc)
+        {
+            rayCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: bvh_bench [--triangles N] [--rays N] [--repeat N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+
+    bool succeeded = true;
+    for (const std::string& path : paths)
+    {
+        Mesh mesh;
+        if (!LoadModel(path, mesh))
+        {
+            printf("%s: load failed\n", path.c_str());
+            succeeded = false;
+            continue;
+        }
+        succeeded = Run(mesh, repeat, rayCount) && succeeded;
+    }
+    if (triangleCount > 0)
+    {
+        succeeded = Run(GenerateTorus(triangleCount), repeat, rayCount) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
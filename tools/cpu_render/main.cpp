@@ -0,0 +1,337 @@
+//Headless render of the startup scene of the renderer with CpuRenderer, for machines without DXR.
+//The scene is the one CreateSceneInstances() makes: every part of the model at six placements, the first two of them reflective, and the plane,
+//lit and shaded like the ray tracing shaders, seen from where the camera starts. Every instance uses the full detail level of its part.
+//The image is rendered with pools of 1 worker up to the hardware thread count, every pool has to give the same pixels, and the speed is reported
+//in Mrays/s counting the primary, reflection and shadow rays. The image can be written as a binary PPM and compared with a reference image.
+//
+//Usage: cpu_render [--width N] [--height N] [--tile N] [--repeat N] [--eye X,Y,Z] [--center X,Y,Z] [--output image.ppm]
+//                  [--reference image.ppm [--tolerance N]] [model.obj]    (models/teapot.obj when no model is given)
+
+#include "Bvh.h"
+#include "CpuRenderer.h"
+#include "ModelLoadTask.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Fastest of repeat runs in seconds.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return std::max(best, 1e-9);
+    }
+
+    bool ParseVector(const char* text, float value[3])
+    {
+        return sscanf(text, "%f,%f,%f", &value[0], &value[1], &value[2]) == 3;
+    }
+
+    //The meshes the scene points at.
+    struct SceneData
+    {
+        std::vector<MeshCache::Vertex> modelVertices;
+        std::vector<uint32_t> modelIndices;
+        std::vector<MeshCache::Vertex> planeVertices;
+        std::vector<uint32_t> planeIndices;
+        std::vector<std::unique_ptr<Bvh>> hierarchies;
+        CpuRenderer::Scene scene;
+    };
+
+    void SetTranslation(CpuRenderer::Instance& instance, float x, float y, float z)
+    {
+        const float transform[3][4] = { { 1.0f, 0.0f, 0.0f, x }, { 0.0f, 1.0f, 0.0f, y }, { 0.0f, 0.0f, 1.0f, z } };
+        std::copy(&transform[0][0], &transform[0][0] + 12, &instance.transform[0][0]);
+    }
+
+    uint32_t AddMesh(SceneData& data, const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+    {
+        std::unique_ptr<Bvh> bvh(new Bvh());
+        if (!bvh->Build(vertices, vertexCount, indices, indexCount))
+        {
+            return UINT32_MAX;
+        }
+        data.scene.meshes.push_back({ bvh.get(), vertices, indices });
+        data.hierarchies.push_back(std::move(bvh));
+        return (uint32_t)data.scene.meshes.size() - 1;
+    }
+
+    bool LoadScene(const std::string& path, SceneData& data)
+    {
+        ModelLoadTask task;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        std::vector<MeshCache::Material> modelMaterials;
+        task.Start(path);
+        task.Wait();
+        if (!task.TakeResult(data.modelVertices, data.modelIndices, &lods, &parts, &modelMaterials))
+        {
+            return false;
+        }
+
+        //The default material with the values the UI starts with, then the materials of the model.
+        data.scene.materials.push_back({ { 1.0f, 1.0f, 1.0f }, 0.5f, 0.5f, 0.5f });
+        data.scene.materials.insert(data.scene.materials.end(), modelMaterials.begin(), modelMaterials.end());
+
+        //CreateSceneInstances(), including the two placements at the same position.
+        const float modelPlacements[][3] = { { 0.0f, 0.0f, 0.0f }, { -5.0f, 0.0f, 5.0f }, { -5.0f, 0.0f, 5.0f }, { -5.0f, 0.0f, -5.0f }, { 5.0f, 0.0f, -5.0f }, { 5.0f, 0.0f, 5.0f } };
+        std::vector<uint32_t> partMeshes;
+        for (const MeshCache::Part& part : parts)
+        {
+            const MeshCache::Lod& lod = lods[part.firstLod];
+            partMeshes.push_back(AddMesh(data, data.modelVertices.data(), data.modelVertices.size(), data.modelIndices.data() + lod.firstIndex, lod.indexCount));
+            if (partMeshes.back() == UINT32_MAX)
+            {
+                return false;
+            }
+        }
+        for (size_t placement = 0; placement < sizeof(modelPlacements) / sizeof(modelPlacements[0]); placement++)
+        {
+            for (size_t part = 0; part < parts.size(); part++)
+            {
+                CpuRenderer::Instance instance;
+                instance.mesh = partMeshes[part];
+                SetTranslation(instance, modelPlacements[placement][0], modelPlacements[placement][1], modelPlacements[placement][2]);
+                instance.hitGroupIndex = CpuRenderer::ModelHitGroup;
+                instance.materialIndex = parts[part].material == MeshCache::NoMaterial ? 0 : 1 + parts[part].material;
+                instance.reflective = placement < 2;
+                data.scene.instances.push_back(instance);
+            }
+        }
+
+        //CreatePlaneVB().
+        const float planeScale = 40.0f;
+        const float planeCorners[6][3] = { { -planeScale, -1.0f, +planeScale }, { +planeScale, -1.0f, +planeScale }, { -planeScale, -1.0f, -planeScale },
+                                           { -planeScale, -1.0f, -planeScale }, { +planeScale, -1.0f, +planeScale }, { +planeScale, -1.0f, -planeScale } };
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            MeshCache::Vertex vertex = { { planeCorners[i][0], planeCorners[i][1], planeCorners[i][2] }, { 0.0f, 1.0f, 0.0f } };
+            data.planeVertices.push_back(vertex);
+            data.planeIndices.push_back(i);
+        }
+        CpuRenderer::Instance plane;
+        plane.mesh = AddMesh(data, data.planeVertices.data(), data.planeVertices.size(), data.planeIndices.data(), data.planeIndices.size());
+        SetTranslation(plane, 0.0f, 0.0f, 0.0f);
+        plane.hitGroupIndex = CpuRenderer::PlaneHitGroup;
+        plane.materialIndex = 0;
+        plane.reflective = false;
+        data.scene.instances.push_back(plane);
+        return true;
+    }
+
+    //Binary PPM, the alpha channel is dropped.
+    bool WritePpm(const std::string& path, const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        fprintf(file, "P6\n%u %u\n255\n", width, height);
+        std::vector<uint8_t> row((size_t)width * 3);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                std::copy(&pixels[((size_t)y * width + x) * 4], &pixels[((size_t)y * width + x) * 4] + 3, &row[(size_t)x * 3]);
+            }
+            fwrite(row.data(), 1, row.size(), file);
+        }
+        return fclose(file) == 0;
+    }
+
+    bool ReadPpm(const std::string& path, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        unsigned int maxValue = 0;
+        bool succeeded = fscanf(file, "P6 %u %u %u", &width, &height, &maxValue) == 3 && maxValue == 255 && fgetc(file) != EOF;
+        std::vector<uint8_t> rgb;
+        if (succeeded)
+        {
+            rgb.resize((size_t)width * height * 3);
+            succeeded = fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+        }
+        fclose(file);
+        if (!succeeded)
+        {
+            return false;
+        }
+        pixels.resize((size_t)width * height * 4);
+        for (size_t pixel = 0; pixel < (size_t)width * height; pixel++)
+        {
+            std::copy(&rgb[pixel * 3], &rgb[pixel * 3] + 3, &pixels[pixel * 4]);
+            pixels[pixel * 4 + 3] = 255;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    CpuRenderer::Settings settings;
+    //The camera the renderer starts with.
+    CpuRenderer::Camera camera = { { 1.5f, 1.5f, 1.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, 45.0f * 3.14159265f / 180.0f, 0.1f, 1000.0f };
+    int repeat = 3;
+    int tolerance = 0;
+    std::string model = "models/teapot.obj";
+    std::string outputPath;
+    std::string referencePath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool valid = true;
+        if (argument == "--width" && i + 1 < argc)
+        {
+            settings.width = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--height" && i + 1 < argc)
+        {
+            settings.height = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--tile" && i + 1 < argc)
+        {
+            settings.tileSize = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--eye" && i + 1 < argc)
+        {
+            valid = ParseVector(argv[++i], camera.eye);
+        }
+        else if (argument == "--center" && i + 1 < argc)
+        {
+            valid = ParseVector(argv[++i], camera.center);
+        }
+        else if (argument == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (argument == "--reference" && i + 1 < argc)
+        {
+            referencePath = argv[++i];
+        }
+        else if (argument == "--tolerance" && i + 1 < argc)
+        {
+            tolerance = std::max(0, atoi(argv[++i]));
+        }
+        else if (argument.empty() || argument[0] == '-')
+        {
+            valid = false;
+        }
+        else
+        {
+            model = argument;
+        }
+        if (!valid)
+        {
+            fprintf(stderr, "Usage: cpu_render [--width N] [--height N] [--tile N] [--repeat N] [--eye X,Y,Z] [--center X,Y,Z] [--output image.ppm]\n"
+                "                  [--reference image.ppm [--tolerance N]] [model.obj]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+
+    SceneData data;
+    Clock::time_point loadStart = Clock::now();
+    if (!LoadScene(model, data))
+    {
+        fprintf(stderr, "Can't load %s\n", model.c_str());
+        return 1;
+    }
+    size_t triangleCount = 0;
+    for (const CpuRenderer::Instance& instance : data.scene.instances)
+    {
+        triangleCount += data.scene.meshes[instance.mesh].bvh->GetTriangleCount();
+    }
+    printf("%s: %zu meshes, %zu instances, %zu triangles in the scene, loaded and built in %.1f ms\n", model.c_str(), data.scene.meshes.size(),
+        data.scene.instances.size(), triangleCount, 1000.0 * std::chrono::duration<double>(Clock::now() - loadStart).count());
+    printf("%ux%u pixels in %ux%u tiles\n", settings.width, settings.height, settings.tileSize, settings.tileSize);
+
+    const unsigned int maxWorkers = std::max(4u, std::thread::hardware_concurrency());
+    std::vector<uint8_t> firstPixels;
+    bool succeeded = true;
+    double singleWorkerTime = 0.0;
+    for (unsigned int workers = 1; workers <= maxWorkers; workers *= 2)
+    {
+        ThreadPool pool(workers);
+        std::vector<uint8_t> pixels;
+        CpuRenderer::Statistics statistics = {};
+        double time = BestTime(repeat, [&]() { CpuRenderer::Render(data.scene, camera, pixels, &settings, &pool, &statistics); });
+        singleWorkerTime = workers == 1 ? time : singleWorkerTime;
+        const uint64_t rays = statistics.primaryRays + statistics.reflectionRays + statistics.shadowRays;
+        bool same = firstPixels.empty() || pixels == firstPixels;
+        succeeded = succeeded && same;
+        printf("  %2u worker%s %10.2f ms %8.2f Mrays/s   x%.2f   %u of %u tiles stolen   %s\n", workers, workers == 1 ? " " : "s", 1000.0 * time,
+            rays / time / 1e6, singleWorkerTime / time, statistics.stolenTiles, statistics.tileCount,
+            firstPixels.empty() ? "" : same ? "same pixels as 1 worker" : "DIFFERENT PIXELS");
+        if (firstPixels.empty())
+        {
+            printf("             %llu primary, %llu reflection and %llu shadow rays\n", (unsigned long long)statistics.primaryRays,
+                (unsigned long long)statistics.reflectionRays, (unsigned long long)statistics.shadowRays);
+            firstPixels = pixels;
+        }
+    }
+
+    if (!outputPath.empty())
+    {
+        if (!WritePpm(outputPath, firstPixels, settings.width, settings.height))
+        {
+            fprintf(stderr, "Can't write %s\n", outputPath.c_str());
+            return 1;
+        }
+        printf("wrote %s\n", outputPath.c_str());
+    }
+    if (!referencePath.empty())
+    {
+        std::vector<uint8_t> reference;
+        uint32_t width = 0, height = 0;
+        if (!ReadPpm(referencePath, reference, width, height))
+        {
+            fprintf(stderr, "Can't read %s\n", referencePath.c_str());
+            return 1;
+        }
+        if (width != settings.width || height != settings.height)
+        {
+            printf("%s is %ux%u, not %ux%u\n", referencePath.c_str(), width, height, settings.width, settings.height);
+            return 1;
+        }
+        int maxDifference = 0;
+        size_t differentPixels = 0;
+        for (size_t pixel = 0; pixel < (size_t)width * height; pixel++)
+        {
+            int difference = 0;
+            for (int channel = 0; channel < 3; channel++)
+            {
+                difference = std::max(difference, std::abs((int)firstPixels[pixel * 4 + channel] - (int)reference[pixel * 4 + channel]));
+            }
+            maxDifference = std::max(maxDifference, difference);
+            differentPixels += difference > tolerance ? 1 : 0;
+        }
+        printf("%s: %zu pixels differ by more than %d, largest difference %d\n", referencePath.c_str(), differentPixels, tolerance, maxDifference);
+        succeeded = succeeded && differentPixels == 0;
+    }
+    return succeeded ? 0 : 1;
+}
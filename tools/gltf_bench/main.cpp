@@ -0,0 +1,242 @@
+//Round trip test and benchmark of the glTF importer.
+//Every OBJ model is loaded with ModelLoadTask and written as a .glb file in the work directory (model.roundtrip.glb), which is also where
+//the .rtmesh caches of the loads go, so nothing is written beside the models. The .glb file is read back with
+//GLTFFileManager and checked to give the same vertices, full detail indices and materials bit for bit, without copying any of them.
+//The written file is then loaded once more through ModelLoadTask, which has to give the same triangle count as the OBJ model.
+//Last, reading the .glb file is timed against copying its bytes with memcpy and against parsing the OBJ model.
+//.glb and .gltf models are only read and timed.
+//
+//Usage: gltf_bench [--repeat N] [--work-dir <dir>] [model.obj|model.glb|model.gltf ...]    (models/teapot.obj and models/rabbit.obj when no model is given)
+
+#include "GLTF_FileManager.h"
+#include "MemoryMappedFile.h"
+#include "ModelLoadTask.h"
+#include "OBJ_FileManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    //Fastest of repeat runs, the first run also brings the file into the page cache.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = MillisecondsSince(start);
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return best;
+    }
+
+    //Reads every vertex and index once, so the pages of a memory mapped file are really loaded.
+    float Touch(const GLTFFileManager& gfm)
+    {
+        float sum = 0.0f;
+        for (const GLTFFileManager::Primitive& primitive : gfm.GetPrimitives())
+        {
+            for (const MeshCache::Vertex& vertex : primitive.vertices)
+            {
+                sum += vertex.position[0] + vertex.normal[0];
+            }
+            for (uint32_t index : primitive.indices)
+            {
+                sum += (float)(index & 1);
+            }
+        }
+        return sum;
+    }
+
+    void PrintTimes(const std::string& path, const std::string& objPath, int repeat)
+    {
+        MemoryMappedFile file;
+        file.Open(path);
+        std::vector<char> copy(file.Size());
+        double memcpyTime = BestTime(repeat, [&]() { memcpy(copy.data(), file.Data(), file.Size()); });
+
+        volatile float sink = 0.0f;
+        double loadTime = BestTime(repeat, [&]() { GLTFFileManager gfm; gfm.Load(path); });
+        double touchTime = BestTime(repeat, [&]() { GLTFFileManager gfm; gfm.Load(path); sink = sink + Touch(gfm); });
+        printf("  %.2f MB   load %.3f ms, load and read every vertex and index %.3f ms, memcpy of the file %.3f ms\n",
+            (double)file.Size() / (1024.0 * 1024.0), loadTime, touchTime, memcpyTime);
+        if (!objPath.empty())
+        {
+            double objTime = BestTime(repeat, [&]()
+                {
+                    OBJFileManager ofm;
+                    std::vector<objl::Vertex> vertices;
+                    std::vector<unsigned int> indices;
+                    ofm.LoadObjFile(objPath, vertices, indices);
+                });
+            printf("  OBJ parse %.3f ms (%.1fx the .glb load with reading)\n", objTime, objTime / std::max(touchTime, 1e-6));
+        }
+    }
+
+    bool RunGltf(const std::string& path, int repeat)
+    {
+        GLTFFileManager gfm;
+        if (!gfm.Load(path))
+        {
+            printf("%s: load failed\n", path.c_str());
+            return false;
+        }
+        size_t mappedVertices = 0;
+        size_t mappedIndices = 0;
+        size_t triangleCount = 0;
+        for (const GLTFFileManager::Primitive& primitive : gfm.GetPrimitives())
+        {
+            mappedVertices += primitive.verticesMapped ? 1 : 0;
+            mappedIndices += primitive.indicesMapped ? 1 : 0;
+            triangleCount += primitive.indices.size / 3;
+        }
+        printf("%s\n  %zu meshes, %zu primitives, %zu instances, %zu materials, %zu triangles\n  %zu primitives with mapped vertices, %zu with mapped indices\n",
+            path.c_str(), gfm.GetMeshes().size(), gfm.GetPrimitives().size(), gfm.GetInstances().size(), gfm.GetMaterials().size(), triangleCount,
+            mappedVertices, mappedIndices);
+        PrintTimes(path, std::string(), repeat);
+        printf("\n");
+        return true;
+    }
+
+    bool RunObj(const std::string& path, int repeat, const fs::path& workDirectory)
+    {
+        ModelLoadTask task;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        std::vector<MeshCache::Material> materials;
+        task.Start(path, (workDirectory / (fs::path(path).filename().string() + ".rtmesh")).string());
+        task.Wait();
+        if (!task.TakeResult(vertices, indices, &lods, &parts, &materials))
+        {
+            printf("%s: load failed\n", path.c_str());
+            return false;
+        }
+
+        std::string glbPath = (workDirectory / (fs::path(path).stem().string() + ".roundtrip.glb")).string();
+        Clock::time_point start = Clock::now();
+        if (!GLTFFileManager::WriteGlb(glbPath, vertices.data(), vertices.size(), indices.data(), indices.size(),
+            lods.data(), parts.data(), parts.size(), materials.data(), materials.size()))
+        {
+            printf("%s: writing %s failed\n", path.c_str(), glbPath.c_str());
+            return false;
+        }
+        double writeTime = MillisecondsSince(start);
+
+        size_t triangleCount = 0;
+        for (const MeshCache::Part& part : parts)
+        {
+            triangleCount += lods[part.firstLod].indexCount / 3;
+        }
+        printf("%s -> %s\n  %zu vertices, %zu triangles, %zu parts, %zu materials, written in %.2f ms\n",
+            path.c_str(), glbPath.c_str(), vertices.size(), triangleCount, parts.size(), materials.size(), writeTime);
+
+        //Every part comes back as a primitive that points into the file and holds the same bits.
+        GLTFFileManager gfm;
+        bool succeeded = gfm.Load(glbPath) && gfm.GetInstances().size() == 1 && gfm.GetPrimitives().size() == parts.size() &&
+            gfm.GetMaterials().size() == materials.size();
+        if (succeeded && !materials.empty())
+        {
+            succeeded = memcmp(gfm.GetMaterials().data(), materials.data(), materials.size() * sizeof(MeshCache::Material)) == 0;
+        }
+        for (size_t p = 0; succeeded && p < parts.size(); p++)
+        {
+            const GLTFFileManager::Primitive& primitive = gfm.GetPrimitives()[p];
+            const MeshCache::Lod& lod = lods[parts[p].firstLod];
+            succeeded = primitive.verticesMapped && primitive.indicesMapped && primitive.material == parts[p].material &&
+                primitive.vertices.size == vertices.size() && memcmp(primitive.vertices.data, vertices.data(), vertices.size() * sizeof(MeshCache::Vertex)) == 0 &&
+                primitive.indices.size == lod.indexCount && memcmp(primitive.indices.data, indices.data() + lod.firstIndex, lod.indexCount * sizeof(uint32_t)) == 0;
+        }
+        gfm.Close();
+        printf("  round trip: %s\n", succeeded ? "identical, vertices and indices mapped" : "MISMATCH");
+
+        //The .glb file goes through the whole load like any other model, without a cache of its own.
+        remove(MeshCache::GetCachePath(glbPath).c_str());
+        std::vector<MeshCache::Vertex> glbVertices;
+        std::vector<uint32_t> glbIndices;
+        std::vector<MeshCache::Lod> glbLods;
+        std::vector<MeshCache::Part> glbParts;
+        task.Start(glbPath);
+        task.Wait();
+        size_t glbTriangleCount = 0;
+        if (task.TakeResult(glbVertices, glbIndices, &glbLods, &glbParts))
+        {
+            for (const MeshCache::Part& part : glbParts)
+            {
+                glbTriangleCount += glbLods[part.firstLod].indexCount / 3;
+            }
+        }
+        remove(MeshCache::GetCachePath(glbPath).c_str());
+        printf("  ModelLoadTask on the .glb file: %zu triangles, %zu parts%s\n", glbTriangleCount, glbParts.size(),
+            glbTriangleCount == triangleCount && glbParts.size() == parts.size() ? "" : " (MISMATCH)");
+        succeeded = succeeded && glbTriangleCount == triangleCount && glbParts.size() == parts.size();
+
+        PrintTimes(glbPath, path, repeat);
+        printf("\n");
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 5;
+    fs::path workDirectory;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: gltf_bench [--repeat N] [--work-dir <dir>] [model.obj|model.glb|model.gltf ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "gltf_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+
+    bool succeeded = true;
+    for (const std::string& path : paths)
+    {
+        succeeded = (GLTFFileManager::IsGltfPath(path) ? RunGltf(path, repeat) : RunObj(path, repeat, workDirectory)) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
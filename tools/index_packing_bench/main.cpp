@@ -0,0 +1,222 @@
+//Check and benchmark of the 16/32 bit index packing.
+//ChooseFormat is checked around the 65536 vertex boundary, then indices are packed and unpacked again in both formats for index
+//counts with and without the zero word that pads an odd number of 16 bit indices, with indices at both ends of the vertex range.
+//Every index has to come back unchanged through IndexPacking::Unpack, which reads the data the way the hit shader does, and through
+//a plain 16 or 32 bit read, which is how the input assembler reads the index buffer. The padding has to be zero and nothing past the
+//packed size may be written. Last, the indices of the bundled models are packed with the format their vertex count gets and the
+//packing speed and the saved bytes are reported.
+//
+//Usage: index_packing_bench [model.obj ...]
+
+#include "IndexPacking.h"
+#include "OBJ_Loader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Bytes after the packed data that Pack must leave alone.
+    const size_t GuardSize = 16;
+    const unsigned char GuardByte = 0xCD;
+
+    int failures = 0;
+
+    //Keeps the timed packing from being optimized away.
+    volatile unsigned sink = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    const char* GetFormatName(IndexPacking::Format format)
+    {
+        return format == IndexPacking::Format::UInt16 ? "UInt16" : "UInt32";
+    }
+
+    void RunFormatChecks()
+    {
+        const size_t limit = IndexPacking::MaxUInt16VertexCount;
+        Check(limit == 65536, "16 bit indices address 65536 vertices");
+        Check(IndexPacking::ChooseFormat(1) == IndexPacking::Format::UInt16, "ChooseFormat(1)");
+        Check(IndexPacking::ChooseFormat(limit - 1) == IndexPacking::Format::UInt16, "ChooseFormat(65535)");
+        Check(IndexPacking::ChooseFormat(limit) == IndexPacking::Format::UInt16, "ChooseFormat(65536)");
+        Check(IndexPacking::ChooseFormat(limit + 1) == IndexPacking::Format::UInt32, "ChooseFormat(65537)");
+        Check(IndexPacking::ChooseFormat((size_t)UINT32_MAX + 1) == IndexPacking::Format::UInt32, "ChooseFormat(2^32)");
+
+        for (IndexPacking::Format format : { IndexPacking::Format::UInt16, IndexPacking::Format::UInt32 })
+        {
+            for (size_t indexCount = 0; indexCount < 16; indexCount++)
+            {
+                const size_t size = IndexPacking::GetPackedSize(indexCount, format);
+                const size_t used = indexCount * (size_t)format;
+                Check(size % 4 == 0 && size >= used && size < used + 4,
+                    std::string("GetPackedSize(") + std::to_string(indexCount) + ", " + GetFormatName(format) + ")");
+            }
+        }
+    }
+
+    //Packs the indices into a buffer with guard bytes after it and checks that every way of reading them back gives the same indices.
+    void CheckRoundTrip(const std::vector<uint32_t>& indices, IndexPacking::Format format, const std::string& name)
+    {
+        const size_t packedSize = IndexPacking::GetPackedSize(indices.size(), format);
+        const size_t usedSize = indices.size() * (size_t)format;
+        std::vector<unsigned char> packed(packedSize + GuardSize, GuardByte);
+        IndexPacking::Pack(indices.data(), indices.size(), format, packed.data());
+
+        size_t unpackErrors = 0;
+        size_t readErrors = 0;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            if (IndexPacking::Unpack(packed.data(), format, i) != indices[i])
+            {
+                unpackErrors++;
+            }
+            uint32_t value;
+            if (format == IndexPacking::Format::UInt16)
+            {
+                uint16_t shortValue;
+                memcpy(&shortValue, packed.data() + i * 2, sizeof(shortValue));
+                value = shortValue;
+            }
+            else
+            {
+                memcpy(&value, packed.data() + i * 4, sizeof(value));
+            }
+            if (value != indices[i])
+            {
+                readErrors++;
+            }
+        }
+        Check(unpackErrors == 0, name + ": " + std::to_string(unpackErrors) + " indices differ after Unpack");
+        Check(readErrors == 0, name + ": " + std::to_string(readErrors) + " indices differ when read as an index buffer");
+
+        bool paddingZero = true;
+        for (size_t i = usedSize; i < packedSize; i++)
+        {
+            paddingZero = paddingZero && packed[i] == 0;
+        }
+        Check(paddingZero, name + ": the padding isn't zero");
+
+        bool guardIntact = true;
+        for (size_t i = packedSize; i < packed.size(); i++)
+        {
+            guardIntact = guardIntact && packed[i] == GuardByte;
+        }
+        Check(guardIntact, name + ": written past the packed size");
+    }
+
+    void RunRoundTripChecks()
+    {
+        std::mt19937 random(7);
+        const size_t vertexCounts[] = { 1, 3, 255, 256, 65535, 65536, 65537, 1u << 20 };
+        const size_t indexCounts[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 2999, 3000, 30001 };
+        int cases = 0;
+        for (size_t vertexCount : vertexCounts)
+        {
+            const IndexPacking::Format chosen = IndexPacking::ChooseFormat(vertexCount);
+            std::uniform_int_distribution<uint32_t> distribution(0, (uint32_t)(vertexCount - 1));
+            for (size_t indexCount : indexCounts)
+            {
+                //The first and last vertex are always referenced, so the top bit of a 16 bit index is covered at 65536 vertices.
+                std::vector<uint32_t> indices(indexCount);
+                for (size_t i = 0; i < indexCount; i++)
+                {
+                    indices[i] = i == 0 ? (uint32_t)(vertexCount - 1) : (i == 1 ? 0 : distribution(random));
+                }
+                const std::string name = std::to_string(indexCount) + " indices of " + std::to_string(vertexCount) + " vertices";
+                CheckRoundTrip(indices, chosen, name + " as " + GetFormatName(chosen));
+                cases++;
+                //32 bit indices have to work for any mesh, the format ChooseFormat picks or not.
+                if (chosen != IndexPacking::Format::UInt32)
+                {
+                    CheckRoundTrip(indices, IndexPacking::Format::UInt32, name + " as UInt32");
+                    cases++;
+                }
+            }
+        }
+
+        //All 16 bit values, in an odd count so that the last one shares its word with the padding.
+        std::vector<uint32_t> all(IndexPacking::MaxUInt16VertexCount + 1);
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            all[i] = (uint32_t)(i % IndexPacking::MaxUInt16VertexCount);
+        }
+        CheckRoundTrip(all, IndexPacking::Format::UInt16, "every 16 bit value");
+        cases++;
+        printf("%d round trips checked\n", cases);
+    }
+
+    void RunModel(const std::string& path)
+    {
+        objl::Loader loader;
+        std::streambuf* output = std::cout.rdbuf(nullptr);
+        const bool loaded = loader.LoadFile(path);
+        std::cout.rdbuf(output);
+        std::cout.clear();
+        if (!loaded)
+        {
+            Check(false, path + ": failed to load");
+            return;
+        }
+
+        const std::vector<uint32_t> indices(loader.LoadedIndices.begin(), loader.LoadedIndices.end());
+        const IndexPacking::Format format = IndexPacking::ChooseFormat(loader.LoadedVertices.size());
+        CheckRoundTrip(indices, format, path);
+
+        const size_t packedSize = IndexPacking::GetPackedSize(indices.size(), format);
+        std::vector<unsigned char> packed(packedSize + 4);
+        const int repeats = 200;
+        const Clock::time_point start = Clock::now();
+        for (int i = 0; i < repeats; i++)
+        {
+            IndexPacking::Pack(indices.data(), indices.size(), format, packed.data());
+            sink = packed[i % packed.size()];
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count() / repeats;
+        const size_t fullSize = IndexPacking::GetPackedSize(indices.size(), IndexPacking::Format::UInt32);
+        printf("%-24s %9zu vertices %9zu indices  %-6s %10zu bytes (%5.1f%% of 32 bit)  pack %8.3f ms %7.2f GB/s\n", path.c_str(),
+            loader.LoadedVertices.size(), indices.size(), GetFormatName(format), packedSize, 100.0 * packedSize / fullSize, seconds * 1000.0,
+            indices.size() * sizeof(uint32_t) / seconds / 1e9);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--help" || argument == "-h" || argument.rfind("--", 0) == 0)
+        {
+            fprintf(stderr, "Usage: index_packing_bench [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+        models.push_back(argument);
+    }
+    if (models.empty())
+    {
+        models = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+
+    RunFormatChecks();
+    RunRoundTripChecks();
+    for (const std::string& model : models)
+    {
+        RunModel(model);
+    }
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
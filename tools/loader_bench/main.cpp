@@ -0,0 +1,837 @@
+//Benchmark of the model loaders.
+//Every loader is run on the models in the repository and on generated grid meshes of increasing size.
+//Each run happens in its own child process, so the peak RSS and the allocation count belong to that run alone
+//and a loader that runs out of memory on a huge file only fails its own entry.
+//
+//Usage: loader_bench [options] [extra.obj ...]    (loader_bench --help lists the options)
+
+#include "MeshCache.h"
+#include "ModelLoadTask.h"
+#include "OBJ_FileManager.h"
+#include "OBJ_Loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+//Allocation counting. Every operator new form ends up in the replaceable operator new(size_t) below,
+//except the aligned ones, which none of the loaders use.
+namespace
+{
+    std::atomic<uint64_t> allocationCount{ 0 };
+    std::atomic<uint64_t> allocatedBytes{ 0 };
+}
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+namespace
+{
+    //Bump when the generated files change so that old ones in the work directory are regenerated.
+    const int GeneratorVersion = 1;
+
+    struct LoadResult
+    {
+        bool succeeded = false;
+        uint64_t vertexCount = 0;
+        uint64_t triangleCount = 0;
+    };
+
+    //A way of loading a model. prepare runs untimed in a process of its own before every measured run.
+    struct Loader
+    {
+        const char* name;
+        const char* description;
+        std::function<void(const std::string& path)> prepare;
+        std::function<LoadResult(const std::string& path)> load;
+    };
+
+    //The meshes of objl::Loader are views of its vertex and index arrays. They have to cover both arrays in order without gaps,
+    //and the indices of a mesh have to point at its own vertices, which is what the vertex and index lists of the meshes used to hold.
+    bool AreMeshViewsValid(const objl::Loader& loader)
+    {
+        size_t vertexEnd = 0;
+        size_t indexEnd = 0;
+        for (const objl::Mesh& mesh : loader.LoadedMeshes)
+        {
+            if (mesh.VertexStart != vertexEnd || mesh.IndexStart != indexEnd ||
+                (mesh.MaterialIndex != objl::NoMaterial && mesh.MaterialIndex >= loader.LoadedMaterials.size()))
+            {
+                return false;
+            }
+            vertexEnd += mesh.VertexCount;
+            indexEnd += mesh.IndexCount;
+            const unsigned int* indices = loader.GetMeshIndices(mesh);
+            for (unsigned int i = 0; i < mesh.IndexCount; i++)
+            {
+                if (indices[i] < mesh.VertexStart || indices[i] >= mesh.VertexStart + mesh.VertexCount)
+                {
+                    return false;
+                }
+            }
+        }
+        return vertexEnd == loader.LoadedVertices.size() && indexEnd == loader.LoadedIndices.size();
+    }
+
+    std::vector<Loader> GetLoaders()
+    {
+        std::vector<Loader> loaders;
+        loaders.push_back({ "objl", "objl::Loader::LoadFile, meshes and materials, mesh views are checked", nullptr,
+            [](const std::string& path)
+            {
+                objl::Loader loader;
+                LoadResult result;
+                result.succeeded = loader.LoadFile(path) && AreMeshViewsValid(loader);
+                result.vertexCount = loader.LoadedVertices.size();
+                result.triangleCount = loader.LoadedIndices.size() / 3;
+                return result;
+            } });
+        loaders.push_back({ "obj-file-manager", "OBJFileManager::LoadObjFile, welded vertices and indices", nullptr,
+            [](const std::string& path)
+            {
+                OBJFileManager manager;
+                std::vector<objl::Vertex> vertices;
+                std::vector<unsigned int> indices;
+                LoadResult result;
+                result.succeeded = manager.LoadObjFile(path, vertices, indices);
+                result.vertexCount = vertices.size();
+                result.triangleCount = indices.size() / 3;
+                return result;
+            } });
+        loaders.push_back({ "obj-stream", "OBJFileManager::StreamObjFile with the default settings, chunks are only counted", nullptr,
+            [](const std::string& path)
+            {
+                OBJFileManager manager;
+                LoadResult result;
+                result.succeeded = manager.StreamObjFile(path, OBJFileManager::StreamSettings(),
+                    [&result](const OBJFileManager::StreamChunk& chunk)
+                    {
+                        result.vertexCount += chunk.positionCount;
+                        result.triangleCount += chunk.triangleCount;
+                        return true;
+                    });
+                return result;
+            } });
+
+        auto loadWithTask = [](const std::string& path)
+        {
+            ModelLoadTask task;
+            std::vector<MeshCache::Vertex> vertices;
+            std::vector<uint32_t> indices;
+            std::vector<MeshCache::Lod> lods;
+            std::vector<MeshCache::Part> parts;
+            task.Start(path);
+            task.Wait();
+            LoadResult result;
+            result.succeeded = task.TakeResult(vertices, indices, &lods, &parts);
+            result.vertexCount = vertices.size();
+            //The indices hold every level of detail of every part, only the full detail level of the parts is counted.
+            result.triangleCount = 0;
+            for (const MeshCache::Part& part : parts)
+            {
+                result.triangleCount += lods[part.firstLod].indexCount / 3;
+            }
+            return result;
+        };
+        loaders.push_back({ "model-task", "ModelLoadTask without a cache: parse, optimization, normals, levels of detail and writing the .rtmesh cache",
+            [](const std::string& path)
+            {
+                remove(MeshCache::GetCachePath(path).c_str());
+            },
+            loadWithTask });
+        loaders.push_back({ "model-task-cached", "ModelLoadTask with an up to date .rtmesh cache",
+            [loadWithTask](const std::string& path)
+            {
+                MeshCache cache;
+                if (!cache.Open(path))
+                {
+                    loadWithTask(path);
+                }
+            },
+            loadWithTask });
+        return loaders;
+    }
+
+    //What a measured child process sends back to the parent.
+    struct RunRecord
+    {
+        int succeeded;
+        int signal;
+        uint64_t vertexCount;
+        uint64_t triangleCount;
+        double seconds;
+        uint64_t peakRssBytes;
+        uint64_t baselineRssBytes;
+        uint64_t allocationCount;
+        uint64_t allocatedBytes;
+    };
+
+    uint64_t GetCurrentRssBytes()
+    {
+#ifdef __linux__
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm == nullptr)
+        {
+            return 0;
+        }
+        unsigned long long sizePages = 0;
+        unsigned long long residentPages = 0;
+        int read = fscanf(statm, "%llu %llu", &sizePages, &residentPages);
+        fclose(statm);
+        return read == 2 ? residentPages * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+        return 0;
+#endif
+    }
+
+    uint64_t GetPeakRssBytes()
+    {
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return (uint64_t)usage.ru_maxrss;
+#else
+        return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+    }
+
+    bool WriteAll(int fd, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            ssize_t written = write(fd, bytes, size);
+            if (written <= 0)
+            {
+                return false;
+            }
+            bytes += written;
+            size -= (size_t)written;
+        }
+        return true;
+    }
+
+    //Runs work in a child process. Returns the record it sent, or a failed record with the signal that killed it.
+    RunRecord RunInChild(const std::function<RunRecord()>& work)
+    {
+        RunRecord record = {};
+        int pipeEnds[2];
+        if (pipe(pipeEnds) != 0)
+        {
+            return record;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close(pipeEnds[0]);
+            //Loaders may print progress (objl does), which would end up in the middle of the table or the JSON.
+            int devNull = open("/dev/null", O_WRONLY);
+            if (devNull >= 0)
+            {
+                dup2(devNull, STDOUT_FILENO);
+                close(devNull);
+            }
+            RunRecord childRecord = {};
+            try
+            {
+                childRecord = work();
+            }
+            catch (...)
+            {
+                childRecord.succeeded = 0;
+            }
+            WriteAll(pipeEnds[1], &childRecord, sizeof(childRecord));
+            close(pipeEnds[1]);
+            //Skip the static destructors, the shared thread pool of the child doesn't need to be joined.
+            _exit(0);
+        }
+        close(pipeEnds[1]);
+        if (child < 0)
+        {
+            close(pipeEnds[0]);
+            return record;
+        }
+
+        size_t received = 0;
+        while (received < sizeof(record))
+        {
+            ssize_t count = read(pipeEnds[0], reinterpret_cast<char*>(&record) + received, sizeof(record) - received);
+            if (count <= 0)
+            {
+                break;
+            }
+            received += (size_t)count;
+        }
+        close(pipeEnds[0]);
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (received != sizeof(record))
+        {
+            record = {};
+            record.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+        }
+        return record;
+    }
+
+    RunRecord MeasureLoad(const Loader& loader, const std::string& path)
+    {
+        if (loader.prepare != nullptr)
+        {
+            RunInChild([&loader, &path]()
+                {
+                    loader.prepare(path);
+                    RunRecord record = {};
+                    record.succeeded = 1;
+                    return record;
+                });
+        }
+
+        return RunInChild([&loader, &path]()
+            {
+                RunRecord record = {};
+                record.baselineRssBytes = GetCurrentRssBytes();
+                allocationCount = 0;
+                allocatedBytes = 0;
+                auto start = std::chrono::steady_clock::now();
+                LoadResult result = loader.load(path);
+                auto end = std::chrono::steady_clock::now();
+                record.allocationCount = allocationCount;
+                record.allocatedBytes = allocatedBytes;
+                record.seconds = std::chrono::duration<double>(end - start).count();
+                record.peakRssBytes = GetPeakRssBytes();
+                record.succeeded = result.succeeded ? 1 : 0;
+                record.vertexCount = result.vertexCount;
+                record.triangleCount = result.triangleCount;
+                return record;
+            });
+    }
+
+    //Writes a flat grid of quads, each split into two triangles.
+    //The "v" format only has positions, the "vtn" format also gives every vertex a texture coordinate and shares one normal.
+    bool GenerateGridObj(const std::string& path, uint64_t triangleCount, const std::string& faceFormat, const std::string& header)
+    {
+        const uint64_t quadCount = (triangleCount + 1) / 2;
+        const uint64_t columns = std::max<uint64_t>(1, (uint64_t)std::ceil(std::sqrt((double)quadCount)));
+        const uint64_t rows = (quadCount + columns - 1) / columns;
+        const bool withAttributes = faceFormat == "vtn";
+
+        const std::string temporaryPath = path + ".tmp";
+        FILE* output = fopen(temporaryPath.c_str(), "wb");
+        if (output == nullptr)
+        {
+            return false;
+        }
+        std::vector<char> buffer(1 << 20);
+        setvbuf(output, buffer.data(), _IOFBF, buffer.size());
+
+        fprintf(output, "%s\n", header.c_str());
+        for (uint64_t z = 0; z <= rows; z++)
+        {
+            for (uint64_t x = 0; x <= columns; x++)
+            {
+                //A gentle height field so that the normals aren't all the same.
+                float height = 0.05f * std::sin(0.37f * (float)x) * std::cos(0.23f * (float)z);
+                fprintf(output, "v %.5f %.5f %.5f\n", (float)x * 0.01f, height, (float)z * 0.01f);
+            }
+        }
+        if (withAttributes)
+        {
+            for (uint64_t z = 0; z <= rows; z++)
+            {
+                for (uint64_t x = 0; x <= columns; x++)
+                {
+                    fprintf(output, "vt %.5f %.5f\n", (float)x / (float)columns, (float)z / (float)rows);
+                }
+            }
+            fprintf(output, "vn 0 1 0\n");
+        }
+
+        uint64_t quadsWritten = 0;
+        for (uint64_t z = 0; z < rows && quadsWritten < quadCount; z++)
+        {
+            for (uint64_t x = 0; x < columns && quadsWritten < quadCount; x++, quadsWritten++)
+            {
+                //1-based indices of the corners of the quad
+                uint64_t a = z * (columns + 1) + x + 1;
+                uint64_t b = a + 1;
+                uint64_t c = a + columns + 1;
+                uint64_t d = c + 1;
+                if (withAttributes)
+                {
+                    fprintf(output, "f %llu/%llu/1 %llu/%llu/1 %llu/%llu/1\n", (unsigned long long)a, (unsigned long long)a,
+                        (unsigned long long)c, (unsigned long long)c, (unsigned long long)b, (unsigned long long)b);
+                    fprintf(output, "f %llu/%llu/1 %llu/%llu/1 %llu/%llu/1\n", (unsigned long long)b, (unsigned long long)b,
+                        (unsigned long long)c, (unsigned long long)c, (unsigned long long)d, (unsigned long long)d);
+                }
+                else
+                {
+                    fprintf(output, "f %llu %llu %llu\n", (unsigned long long)a, (unsigned long long)c, (unsigned long long)b);
+                    fprintf(output, "f %llu %llu %llu\n", (unsigned long long)b, (unsigned long long)c, (unsigned long long)d);
+                }
+            }
+        }
+
+        bool succeeded = ferror(output) == 0;
+        succeeded = fclose(output) == 0 && succeeded;
+        if (succeeded)
+        {
+            remove(path.c_str());
+            succeeded = rename(temporaryPath.c_str(), path.c_str()) == 0;
+        }
+        if (!succeeded)
+        {
+            remove(temporaryPath.c_str());
+        }
+        return succeeded;
+    }
+
+    bool FileStartsWith(const std::string& path, const std::string& line)
+    {
+        FILE* input = fopen(path.c_str(), "rb");
+        if (input == nullptr)
+        {
+            return false;
+        }
+        std::vector<char> firstLine(line.size() + 1);
+        size_t read = fread(firstLine.data(), 1, firstLine.size(), input);
+        fclose(input);
+        return read == firstLine.size() && memcmp(firstLine.data(), line.data(), line.size()) == 0 && firstLine.back() == '\n';
+    }
+
+    //Returns the path of the generated grid with the given triangle count, writing it if it doesn't exist yet.
+    std::string GetGeneratedFile(const fs::path& workDirectory, uint64_t triangleCount, const std::string& faceFormat)
+    {
+        const std::string name = "grid_" + std::to_string(triangleCount) + "_" + faceFormat + ".obj";
+        const std::string path = (workDirectory / name).string();
+        const std::string header = "# loader_bench grid, generator " + std::to_string(GeneratorVersion) +
+            ", " + std::to_string(triangleCount) + " triangles, " + faceFormat;
+        if (!FileStartsWith(path, header))
+        {
+            fprintf(stderr, "Generating %s\n", path.c_str());
+            if (!GenerateGridObj(path, triangleCount, faceFormat, header))
+            {
+                fprintf(stderr, "Couldn't write %s\n", path.c_str());
+                return "";
+            }
+        }
+        return path;
+    }
+
+    bool ParseCount(const std::string& text, uint64_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+        {
+            return false;
+        }
+        std::string suffix(end);
+        if (suffix == "K" || suffix == "k")
+        {
+            value *= 1e3;
+        }
+        else if (suffix == "M" || suffix == "m")
+        {
+            value *= 1e6;
+        }
+        else if (!suffix.empty())
+        {
+            return false;
+        }
+        count = (uint64_t)std::llround(value);
+        return true;
+    }
+
+    std::vector<std::string> SplitList(const std::string& text)
+    {
+        std::vector<std::string> items;
+        size_t start = 0;
+        while (start <= text.size())
+        {
+            size_t comma = text.find(',', start);
+            if (comma == std::string::npos)
+            {
+                comma = text.size();
+            }
+            if (comma > start)
+            {
+                items.push_back(text.substr(start, comma - start));
+            }
+            start = comma + 1;
+        }
+        return items;
+    }
+
+    std::string EscapeJson(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned int)c);
+                escaped += code;
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    struct BenchmarkFile
+    {
+        std::string path;
+        std::string source; //"model", "generated" or "argument"
+        uint64_t bytes;
+    };
+
+    struct BenchmarkResult
+    {
+        std::string loader;
+        BenchmarkFile file;
+        std::vector<RunRecord> runs;
+        bool succeeded;
+        std::string error;
+        RunRecord summary; //Median time, largest peak RSS, allocations of the first run
+    };
+
+    BenchmarkResult Summarize(const std::string& loader, const BenchmarkFile& file, const std::vector<RunRecord>& runs)
+    {
+        BenchmarkResult result;
+        result.loader = loader;
+        result.file = file;
+        result.runs = runs;
+        result.succeeded = !runs.empty();
+        result.summary = {};
+        for (const RunRecord& run : runs)
+        {
+            if (!run.succeeded)
+            {
+                result.succeeded = false;
+                result.error = run.signal != 0 ? "killed by signal " + std::to_string(run.signal) + (run.signal == SIGKILL ? " (out of memory?)" : "") : "load failed";
+                return result;
+            }
+        }
+
+        std::vector<double> seconds;
+        for (const RunRecord& run : runs)
+        {
+            seconds.push_back(run.seconds);
+            result.summary.peakRssBytes = std::max(result.summary.peakRssBytes, run.peakRssBytes);
+        }
+        std::sort(seconds.begin(), seconds.end());
+        result.summary.seconds = seconds[seconds.size() / 2];
+        result.summary.succeeded = 1;
+        result.summary.vertexCount = runs[0].vertexCount;
+        result.summary.triangleCount = runs[0].triangleCount;
+        result.summary.baselineRssBytes = runs[0].baselineRssBytes;
+        result.summary.allocationCount = runs[0].allocationCount;
+        result.summary.allocatedBytes = runs[0].allocatedBytes;
+        return result;
+    }
+
+    void WriteJson(FILE* output, const std::vector<BenchmarkResult>& results, int repeat)
+    {
+        fprintf(output, "{\n");
+        fprintf(output, "  \"benchmark\": \"loader_bench\",\n");
+        fprintf(output, "  \"formatVersion\": 1,\n");
+        fprintf(output, "  \"hardwareThreads\": %u,\n", std::thread::hardware_concurrency());
+#ifdef __VERSION__
+        fprintf(output, "  \"compiler\": \"%s\",\n", EscapeJson(__VERSION__).c_str());
+#endif
+        fprintf(output, "  \"repeat\": %d,\n", repeat);
+        fprintf(output, "  \"results\": [");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchmarkResult& result = results[i];
+            const RunRecord& summary = result.summary;
+            fprintf(output, "%s\n    {\n", i == 0 ? "" : ",");
+            fprintf(output, "      \"loader\": \"%s\",\n", EscapeJson(result.loader).c_str());
+            fprintf(output, "      \"file\": \"%s\",\n", EscapeJson(result.file.path).c_str());
+            fprintf(output, "      \"source\": \"%s\",\n", result.file.source.c_str());
+            fprintf(output, "      \"fileBytes\": %llu,\n", (unsigned long long)result.file.bytes);
+            fprintf(output, "      \"succeeded\": %s,\n", result.succeeded ? "true" : "false");
+            if (!result.succeeded)
+            {
+                fprintf(output, "      \"error\": \"%s\"\n    }", EscapeJson(result.error).c_str());
+                continue;
+            }
+            const double seconds = std::max(summary.seconds, 1e-9);
+            double minSeconds = summary.seconds;
+            fprintf(output, "      \"runSeconds\": [");
+            for (size_t run = 0; run < result.runs.size(); run++)
+            {
+                fprintf(output, "%s%.6f", run == 0 ? "" : ", ", result.runs[run].seconds);
+                minSeconds = std::min(minSeconds, result.runs[run].seconds);
+            }
+            fprintf(output, "],\n");
+            fprintf(output, "      \"secondsMedian\": %.6f,\n", summary.seconds);
+            fprintf(output, "      \"secondsMin\": %.6f,\n", minSeconds);
+            fprintf(output, "      \"vertices\": %llu,\n", (unsigned long long)summary.vertexCount);
+            fprintf(output, "      \"triangles\": %llu,\n", (unsigned long long)summary.triangleCount);
+            fprintf(output, "      \"megabytesPerSecond\": %.3f,\n", (double)result.file.bytes / 1e6 / seconds);
+            fprintf(output, "      \"trianglesPerSecond\": %.1f,\n", (double)summary.triangleCount / seconds);
+            fprintf(output, "      \"peakRssBytes\": %llu,\n", (unsigned long long)summary.peakRssBytes);
+            fprintf(output, "      \"baselineRssBytes\": %llu,\n", (unsigned long long)summary.baselineRssBytes);
+            fprintf(output, "      \"allocations\": %llu,\n", (unsigned long long)summary.allocationCount);
+            fprintf(output, "      \"allocatedBytes\": %llu\n", (unsigned long long)summary.allocatedBytes);
+            fprintf(output, "    }");
+        }
+        fprintf(output, "\n  ]\n}\n");
+    }
+
+    void PrintResult(FILE* output, const BenchmarkResult& result)
+    {
+        const std::string fileName = fs::path(result.file.path).filename().string();
+        if (!result.succeeded)
+        {
+            fprintf(output, "%-18s %-28s %s\n", result.loader.c_str(), fileName.c_str(), result.error.c_str());
+            return;
+        }
+        const RunRecord& summary = result.summary;
+        const double seconds = std::max(summary.seconds, 1e-9);
+        fprintf(output, "%-18s %-28s %10.3f %10.1f %12.2f %12.1f %12llu\n", result.loader.c_str(), fileName.c_str(),
+            summary.seconds * 1e3, (double)result.file.bytes / 1e6 / seconds, (double)summary.triangleCount / seconds / 1e6,
+            (double)summary.peakRssBytes / (1024.0 * 1024.0), (unsigned long long)summary.allocationCount);
+    }
+
+    void PrintUsage(const std::vector<Loader>& loaders)
+    {
+        printf(
+            "Usage: loader_bench [options] [extra.obj ...]\n"
+            "  --models <dir>       Directory with teapot.obj and rabbit.obj (default: models)\n"
+            "  --sizes <list>       Triangle counts of the generated grids, K and M suffixes allowed,\n"
+            "                       or \"none\" (default: 10K,100K,1M,10M,50M)\n"
+            "  --face-format <f>    Corners of the generated faces: v or vtn (default: v)\n"
+            "  --work-dir <dir>     Where the generated files are kept between runs (default: <temp>/loader_bench)\n"
+            "  --loaders <list>     Loaders to run (default: all)\n"
+            "  --repeat <n>         Measured runs per loader and file, the median is reported (default: 3)\n"
+            "  --json <file>        Write the results as JSON, \"-\" writes them to stdout\n"
+            "Loaders:\n");
+        for (const Loader& loader : loaders)
+        {
+            printf("  %-18s %s\n", loader.name, loader.description);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::vector<Loader> allLoaders = GetLoaders();
+
+    std::string modelsDirectory = "models";
+    std::string sizesText = "10K,100K,1M,10M,50M";
+    std::string faceFormat = "v";
+    std::string loadersText;
+    std::string jsonPath;
+    fs::path workDirectory;
+    int repeat = 3;
+    std::vector<std::string> extraFiles;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--help" || argument == "-h")
+        {
+            PrintUsage(allLoaders);
+            return 0;
+        }
+        else if (argument == "--models" && hasValue)
+        {
+            modelsDirectory = argv[++i];
+        }
+        else if (argument == "--sizes" && hasValue)
+        {
+            sizesText = argv[++i];
+        }
+        else if (argument == "--face-format" && hasValue)
+        {
+            faceFormat = argv[++i];
+        }
+        else if (argument == "--work-dir" && hasValue)
+        {
+            workDirectory = argv[++i];
+        }
+        else if (argument == "--loaders" && hasValue)
+        {
+            loadersText = argv[++i];
+        }
+        else if (argument == "--repeat" && hasValue)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--json" && hasValue)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            extraFiles.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argument.c_str());
+            PrintUsage(allLoaders);
+            return 1;
+        }
+    }
+
+    if (faceFormat != "v" && faceFormat != "vtn")
+    {
+        fprintf(stderr, "Unknown face format %s\n", faceFormat.c_str());
+        return 1;
+    }
+
+    std::vector<const Loader*> loaders;
+    if (loadersText.empty())
+    {
+        for (const Loader& loader : allLoaders)
+        {
+            loaders.push_back(&loader);
+        }
+    }
+    else
+    {
+        for (const std::string& name : SplitList(loadersText))
+        {
+            auto found = std::find_if(allLoaders.begin(), allLoaders.end(), [&name](const Loader& loader) { return name == loader.name; });
+            if (found == allLoaders.end())
+            {
+                fprintf(stderr, "Unknown loader %s\n", name.c_str());
+                return 1;
+            }
+            loaders.push_back(&*found);
+        }
+    }
+
+    std::vector<BenchmarkFile> files;
+    auto addFile = [&files](const std::string& path, const char* source)
+    {
+        std::error_code error;
+        uint64_t bytes = fs::file_size(path, error);
+        if (error)
+        {
+            fprintf(stderr, "Skipping %s, it can't be read\n", path.c_str());
+            return;
+        }
+        files.push_back({ path, source, bytes });
+    };
+    addFile((fs::path(modelsDirectory) / "teapot.obj").string(), "model");
+    addFile((fs::path(modelsDirectory) / "rabbit.obj").string(), "model");
+
+    if (sizesText != "none")
+    {
+        if (workDirectory.empty())
+        {
+            workDirectory = fs::temp_directory_path() / "loader_bench";
+        }
+        std::error_code error;
+        fs::create_directories(workDirectory, error);
+        for (const std::string& sizeText : SplitList(sizesText))
+        {
+            uint64_t triangleCount = 0;
+            if (!ParseCount(sizeText, triangleCount))
+            {
+                fprintf(stderr, "Invalid size %s\n", sizeText.c_str());
+                return 1;
+            }
+            std::string path = GetGeneratedFile(workDirectory, triangleCount, faceFormat);
+            if (!path.empty())
+            {
+                addFile(path, "generated");
+            }
+        }
+    }
+    for (const std::string& path : extraFiles)
+    {
+        addFile(path, "argument");
+    }
+
+    //The table goes to stderr when stdout carries the JSON.
+    FILE* table = jsonPath == "-" ? stderr : stdout;
+    fprintf(table, "%-18s %-28s %10s %10s %12s %12s %12s\n", "loader", "file", "ms", "MB/s", "Mtris/s", "peak RSS MiB", "allocations");
+
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkFile& file : files)
+    {
+        for (const Loader* loader : loaders)
+        {
+            std::vector<RunRecord> runs;
+            for (int run = 0; run < repeat; run++)
+            {
+                runs.push_back(MeasureLoad(*loader, file.path));
+                if (!runs.back().succeeded)
+                {
+                    break;
+                }
+            }
+            results.push_back(Summarize(loader->name, file, runs));
+            PrintResult(table, results.back());
+        }
+    }
+
+    if (!jsonPath.empty())
+    {
+        FILE* output = jsonPath == "-" ? stdout : fopen(jsonPath.c_str(), "w");
+        if (output == nullptr)
+        {
+            fprintf(stderr, "Couldn't write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        WriteJson(output, results, repeat);
+        if (output != stdout)
+        {
+            fclose(output);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,331 @@
+//Check that objl::Loader, which keeps the geometry of all its meshes in LoadedVertices and LoadedIndices and makes every mesh a view
+//of them, loads the same data as the loader before that change, where every Mesh owned its vertices, its mesh local indices and a
+//copy of its material. The data of the old loader is kept as hashes it gave for the bundled models and for a generated file with
+//many objects, meshes that usemtl splits in two, three materials, meshes without a material, relative indices and faces with and
+//without texture coordinates. The Loaded* arrays have to hash the same, and so do the meshes, each with its name, vertices, indices
+//less its VertexStart and material values, the way the old loader held them. The meshes are hashed again through the Loader the
+//loader is moved to, which owns the interned strings from then on. The geometry and material memory the loader keeps is reported.
+//
+//Usage: loader_equivalence_bench [--work-dir <dir>]
+
+#include "MeshCache.h"
+#include "OBJ_Loader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    //Side of the grid of quads each generated object is made of.
+    const int GridSide = 48;
+    const int ObjectCount = 64;
+    const int MaterialCount = 3;
+
+    int failures = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    bool WriteFile(const std::string& path, const std::string& contents)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+        return (bool)file;
+    }
+
+    //The loaders report every mesh they load on std::cout, which would bury the results.
+    class QuietOutput
+    {
+    public:
+        QuietOutput() : output(std::cout.rdbuf(nullptr))
+        {
+        }
+        ~QuietOutput()
+        {
+            std::cout.rdbuf(output);
+            std::cout.clear();
+        }
+
+    private:
+        std::streambuf* output;
+    };
+
+    std::string GenerateMtl()
+    {
+        std::string text;
+        for (int i = 0; i < MaterialCount; i++)
+        {
+            const std::string index = std::to_string(i);
+            text += "newmtl material_" + index + "\n";
+            text += "Ka 0.1 0.1 0." + index + "\nKd 0." + index + " 0.5 0.25\nKs 0.5 0.5 0.5\n";
+            text += "Ns " + std::to_string(10 * i + 1) + "\nNi 1.45\nd 0." + std::to_string(9 - i) + "\nillum " + index + "\n";
+            if (i != 1)
+            {
+                text += "Pr 0." + index + "5\nPm 0.75\n";
+                text += "map_Kd textures/diffuse_" + index + ".png\nmap_bump textures/normal_" + index + ".png\n";
+            }
+            text += "map_Ka textures/ambient.png\nmap_Ks textures/specular.png\nmap_Ns textures/shininess.png\nmap_d textures/alpha.png\n\n";
+        }
+        return text;
+    }
+
+    //Objects made of a grid of quads each. Some are g groups instead of o objects, some start without a material, every one switches
+    //its material halfway, and the second half uses relative indices and triangles. Every other object has texture coordinates.
+    std::string GenerateObj(const std::string& mtlName)
+    {
+        std::string text = "mtllib " + mtlName + "\n";
+        char line[128];
+        long long positionCount = 0;
+        long long tcoordCount = 0;
+        const int side = GridSide + 1;
+        for (int object = 0; object < ObjectCount; object++)
+        {
+            text += (object % 5 == 4 ? "g group_" : "o object_") + std::to_string(object) + "\n";
+            if (object % 7 != 0)
+            {
+                text += "usemtl material_" + std::to_string(object % MaterialCount) + "\n";
+            }
+            const bool textured = object % 2 == 0;
+            const long long firstPosition = positionCount + 1;
+            const long long firstTCoord = tcoordCount + 1;
+            for (int y = 0; y < side; y++)
+            {
+                for (int x = 0; x < side; x++)
+                {
+                    snprintf(line, sizeof(line), "v %.4f %.4f %.4f\n", x * 0.02 + object, ((x * 7 + y * 3 + object) % 11) * 0.01, y * 0.02);
+                    text += line;
+                    if (textured)
+                    {
+                        snprintf(line, sizeof(line), "vt %.4f %.4f\n", x / (double)GridSide, y / (double)GridSide);
+                        text += line;
+                    }
+                }
+            }
+            positionCount += side * side;
+            tcoordCount += textured ? side * side : 0;
+            snprintf(line, sizeof(line), "vn 0 1 0\nvn 0.%d 0.8 0\n", object % 6);
+            text += line;
+
+            for (int y = 0; y < GridSide; y++)
+            {
+                if (y == GridSide / 2)
+                {
+                    text += "usemtl material_" + std::to_string((object + 1) % MaterialCount) + "\n";
+                }
+                for (int x = 0; x < GridSide; x++)
+                {
+                    const long long corner = y * side + x;
+                    const long long corners[4] = { corner, corner + 1, corner + side + 1, corner + side };
+                    if (y < GridSide / 2)
+                    {
+                        text += "f";
+                        for (long long c : corners)
+                        {
+                            if (textured)
+                            {
+                                snprintf(line, sizeof(line), " %lld/%lld/%d", firstPosition + c, firstTCoord + c, x % 2 == 0 ? -1 : -2);
+                            }
+                            else
+                            {
+                                snprintf(line, sizeof(line), " %lld//-1", firstPosition + c);
+                            }
+                            text += line;
+                        }
+                        text += "\n";
+                    }
+                    else
+                    {
+                        //Relative indices count back from the last position defined so far.
+                        long long relative[4];
+                        for (int i = 0; i < 4; i++)
+                        {
+                            relative[i] = firstPosition + corners[i] - positionCount - 1;
+                        }
+                        snprintf(line, sizeof(line), "f %lld %lld %lld\nf %lld %lld %lld\n",
+                            relative[0], relative[1], relative[2], relative[0], relative[2], relative[3]);
+                        text += line;
+                    }
+                }
+            }
+        }
+        return text;
+    }
+
+    //Counts and hashes of the data a loader holds after loading a file.
+    struct LoaderHashes
+    {
+        size_t meshCount;
+        size_t vertexCount;
+        size_t indexCount;
+        size_t materialCount;
+        //Every mesh with its name, vertices, mesh local indices and material, in order.
+        uint64_t meshes;
+        uint64_t vertices;
+        uint64_t indices;
+        uint64_t materials;
+    };
+
+    //What the loader before the meshes became views gave for the fixtures, on a little endian machine.
+    struct ExpectedHashes
+    {
+        const char* name;
+        LoaderHashes hashes;
+    };
+
+    const ExpectedHashes expectedHashes[] =
+    {
+        { "models/teapot.obj", { 1, 18960, 18960, 0, 0x31bbfcee245d6889ull, 0xc0ba3fca05b48f69ull, 0xbf84d258b7ccafb9ull, 0 } },
+        { "models/rabbit.obj", { 1, 14904, 14904, 0, 0x65666e494d1df0b0ull, 0x685d8395632cac6bull, 0x0860df1c86ac6d9cull, 0 } },
+        //The generated file, written to the work directory.
+        { "objects.obj", { 128, 737280, 884736, 3, 0xb77b4347c8c970c6ull, 0x8434e84ea774ed9eull, 0xe6b4bb622a1ab8a8ull, 0x3fc0eff6e31d78edull } },
+    };
+
+    uint64_t HashString(std::string_view text, uint64_t seed)
+    {
+        const uint64_t size = text.size();
+        return MeshCache::HashBytes(text.data(), text.size(), MeshCache::HashBytes(&size, sizeof(size), seed));
+    }
+
+    uint64_t HashMaterial(const objl::Material& material, uint64_t seed)
+    {
+        //The strings were std::strings in the old loader, so the members are hashed one by one instead of the whole struct.
+        seed = HashString(material.name, seed);
+        seed = MeshCache::HashBytes(&material.Ka, sizeof(material.Ka), seed);
+        seed = MeshCache::HashBytes(&material.Kd, sizeof(material.Kd), seed);
+        seed = MeshCache::HashBytes(&material.Ks, sizeof(material.Ks), seed);
+        const float numbers[5] = { material.Ns, material.Ni, material.d, material.Pr, material.Pm };
+        seed = MeshCache::HashBytes(numbers, sizeof(numbers), seed);
+        seed = MeshCache::HashBytes(&material.illum, sizeof(material.illum), seed);
+        const std::string_view maps[6] = { material.map_Ka, material.map_Kd, material.map_Ks, material.map_Ns, material.map_d, material.map_bump };
+        for (std::string_view map : maps)
+        {
+            seed = HashString(map, seed);
+        }
+        return seed;
+    }
+
+    LoaderHashes HashLoader(const objl::Loader& loader)
+    {
+        LoaderHashes hashes = {};
+        hashes.meshCount = loader.LoadedMeshes.size();
+        hashes.vertexCount = loader.LoadedVertices.size();
+        hashes.indexCount = loader.LoadedIndices.size();
+        hashes.materialCount = loader.LoadedMaterials.size();
+        hashes.vertices = MeshCache::HashBytes(loader.LoadedVertices.data(), loader.LoadedVertices.size() * sizeof(objl::Vertex));
+        hashes.indices = MeshCache::HashBytes(loader.LoadedIndices.data(), loader.LoadedIndices.size() * sizeof(unsigned int));
+        for (const objl::Material& material : loader.LoadedMaterials)
+        {
+            hashes.materials = HashMaterial(material, hashes.materials);
+        }
+
+        std::vector<unsigned int> localIndices;
+        for (const objl::Mesh& mesh : loader.LoadedMeshes)
+        {
+            const uint64_t counts[2] = { mesh.VertexCount, mesh.IndexCount };
+            const unsigned int* indices = loader.GetMeshIndices(mesh);
+            localIndices.resize(mesh.IndexCount);
+            for (size_t i = 0; i < localIndices.size(); i++)
+            {
+                localIndices[i] = indices[i] - mesh.VertexStart;
+            }
+            hashes.meshes = HashString(mesh.MeshName, hashes.meshes);
+            hashes.meshes = MeshCache::HashBytes(counts, sizeof(counts), hashes.meshes);
+            hashes.meshes = MeshCache::HashBytes(loader.GetMeshVertices(mesh), mesh.VertexCount * sizeof(objl::Vertex), hashes.meshes);
+            hashes.meshes = MeshCache::HashBytes(localIndices.data(), localIndices.size() * sizeof(unsigned int), hashes.meshes);
+            hashes.meshes = HashMaterial(loader.GetMeshMaterial(mesh), hashes.meshes);
+        }
+        return hashes;
+    }
+
+    void CompareHashes(const LoaderHashes& hashes, const LoaderHashes& expected, const std::string& name)
+    {
+        Check(hashes.meshCount == expected.meshCount, name + ": " + std::to_string(hashes.meshCount) + " meshes instead of " +
+            std::to_string(expected.meshCount));
+        Check(hashes.vertexCount == expected.vertexCount && hashes.vertices == expected.vertices, name + ": LoadedVertices differ");
+        Check(hashes.indexCount == expected.indexCount && hashes.indices == expected.indices, name + ": LoadedIndices differ");
+        Check(hashes.materialCount == expected.materialCount && hashes.materials == expected.materials, name + ": LoadedMaterials differ");
+        Check(hashes.meshes == expected.meshes, name + ": the names, vertices, indices or materials of the meshes differ");
+    }
+
+    //Bytes of geometry, meshes and materials the loader keeps after loading, not counting the characters of the strings.
+    size_t GetRetainedSize(const objl::Loader& loader)
+    {
+        return loader.LoadedVertices.capacity() * sizeof(objl::Vertex) + loader.LoadedIndices.capacity() * sizeof(unsigned int) +
+            loader.LoadedMeshes.capacity() * sizeof(objl::Mesh) + loader.LoadedMaterials.capacity() * sizeof(objl::Material);
+    }
+
+    void RunFixture(const std::string& path, const ExpectedHashes& expected)
+    {
+        objl::Loader loader;
+        bool loaded;
+        {
+            QuietOutput quiet;
+            loaded = loader.LoadFile(path);
+        }
+        if (!loaded)
+        {
+            Check(false, path + ": failed to load");
+            return;
+        }
+        CompareHashes(HashLoader(loader), expected.hashes, path);
+
+        //The mesh names and material strings are views of strings the loader owns, the moved to Loader has to hand out the same ones.
+        objl::Loader moved(std::move(loader));
+        CompareHashes(HashLoader(moved), expected.hashes, path + " after a move");
+
+        printf("%-44s %5zu meshes %9zu vertices %9zu indices %2zu materials  retained %8.2f MiB\n", path.c_str(), moved.LoadedMeshes.size(),
+            moved.LoadedVertices.size(), moved.LoadedIndices.size(), moved.LoadedMaterials.size(), GetRetainedSize(moved) / 1048576.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    fs::path workDirectory;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: loader_equivalence_bench [--work-dir <dir>]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "loader_equivalence_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+
+    const std::string mtlPath = (workDirectory / "objects.mtl").string();
+    const std::string objPath = (workDirectory / "objects.obj").string();
+    Check(WriteFile(mtlPath, GenerateMtl()) && WriteFile(objPath, GenerateObj("objects.mtl")), "writing the generated files");
+
+    for (const ExpectedHashes& expected : expectedHashes)
+    {
+        const std::string name = expected.name;
+        RunFixture(name == "objects.obj" ? objPath : name, expected);
+    }
+    fs::remove(objPath, error);
+    fs::remove(mtlPath, error);
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+//Round trip test and benchmark of the mesh compression of the .rtmesh cache.
+//Every model is loaded with ModelLoadTask, which gives the vertices and the indices of every level of detail the way the cache stores them.
+//The vertex and index streams are encoded with MeshCodec and decoded again, and the result has to be bit for bit the same as the input.
+//Every truncation of the encoded streams up to a few kilobytes has to be rejected by the decoder.
+//The compression ratio, the encode speed and the decode speed (fastest of the repeats, in bytes of decoded data per second) are reported
+//for the float vertices, the quantized vertices of the renderer and the indices, with memcpy of the decoded data for comparison.
+//
+//Usage: mesh_codec_bench [--repeat N] [model.obj ...]    (models/teapot.obj and models/rabbit.obj when no model is given)
+
+#include "MeshCodec.h"
+#include "ModelLoadTask.h"
+#include "VertexQuantization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Fastest of repeat runs in seconds.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return std::max(best, 1e-9);
+    }
+
+    //Encodes and decodes a stream of count elements of elementSize bytes, checks the round trip and prints a line for it.
+    bool RunStream(const char* label, const void* data, size_t count, size_t elementSize, int repeat)
+    {
+        const size_t rawSize = count * elementSize;
+        std::vector<uint8_t> encoded;
+        double encodeTime = BestTime(repeat, [&]()
+            {
+                encoded.clear();
+                MeshCodec::EncodeVertices(data, count, elementSize, encoded);
+            });
+
+        std::vector<uint8_t> decoded(rawSize);
+        bool decodedAll = true;
+        size_t bytesRead = 0;
+        double decodeTime = BestTime(repeat, [&]()
+            {
+                decodedAll = MeshCodec::DecodeVertices(decoded.data(), count, elementSize, encoded.data(), encoded.size(), &bytesRead) && decodedAll;
+            });
+        bool lossless = decodedAll && bytesRead == encoded.size() && memcmp(decoded.data(), data, rawSize) == 0;
+
+        std::vector<uint8_t> copy(rawSize);
+        double copyTime = BestTime(repeat, [&]() { memcpy(copy.data(), data, rawSize); });
+
+        //A cut off stream must never decode.
+        bool truncationsRejected = true;
+        for (size_t size = 0; size < encoded.size() && size < 4096; size++)
+        {
+            truncationsRejected = truncationsRejected && !MeshCodec::DecodeVertices(decoded.data(), count, elementSize, encoded.data(), size);
+        }
+
+        printf("  %-18s %10zu -> %10zu bytes (%5.1f%%)   encode %6.2f GB/s   decode %6.2f GB/s   memcpy %6.2f GB/s   %s\n",
+            label, rawSize, encoded.size(), 100.0 * (double)encoded.size() / (double)std::max<size_t>(rawSize, 1),
+            (double)rawSize / encodeTime / 1e9, (double)rawSize / decodeTime / 1e9, (double)rawSize / copyTime / 1e9,
+            lossless && truncationsRejected ? "lossless" : !lossless ? "MISMATCH" : "TRUNCATION ACCEPTED");
+        return lossless && truncationsRejected;
+    }
+
+    bool Run(const std::string& path, int repeat)
+    {
+        ModelLoadTask task;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        task.Start(path);
+        task.Wait();
+        if (!task.TakeResult(vertices, indices))
+        {
+            printf("%s: load failed\n", path.c_str());
+            return false;
+        }
+
+        VertexQuantization::Bounds bounds = VertexQuantization::ComputeBounds(vertices.data(), vertices.size());
+        std::vector<VertexQuantization::QuantizedVertex> quantized(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            VertexQuantization::EncodePosition(vertices[i].position, bounds, quantized[i].position);
+            VertexQuantization::EncodeNormal(vertices[i].normal, quantized[i].normal);
+        }
+
+        printf("%s (%zu vertices, %zu indices with every level of detail)\n", path.c_str(), vertices.size(), indices.size());
+        bool succeeded = RunStream("float vertices", vertices.data(), vertices.size(), sizeof(MeshCache::Vertex), repeat);
+        succeeded = RunStream("quantized vertices", quantized.data(), quantized.size(), sizeof(VertexQuantization::QuantizedVertex), repeat) && succeeded;
+        succeeded = RunStream("indices", indices.data(), indices.size(), sizeof(uint32_t), repeat) && succeeded;
+        printf("\n");
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 20;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: mesh_codec_bench [--repeat N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+
+    bool succeeded = true;
+    for (const std::string& path : paths)
+    {
+        succeeded = Run(path, repeat) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
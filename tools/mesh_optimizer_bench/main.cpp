@@ -0,0 +1,136 @@
+//Benchmark of the import time mesh optimization.
+//Every model is parsed the same way ModelLoadTask parses it, then MeshOptimizer runs on it step by step.
+//The vertex cache statistics are reported before and after, for the cache size the triangles are ordered for and a larger one.
+//Last, the level of detail chain ModelLoadTask stores in the cache is built with MeshSimplifier and every level is reported.
+//
+//Usage: mesh_optimizer_bench [--cache-size N] [model.obj ...]    (models/teapot.obj and models/rabbit.obj when no model is given)
+
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "OBJ_FileManager.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    bool LoadModel(const std::string& path, std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        OBJFileManager ofm;
+        std::vector<objl::Vertex> modelFileVertices;
+        if (!ofm.LoadObjFile(path, modelFileVertices, indices))
+        {
+            return false;
+        }
+        vertices.resize(modelFileVertices.size());
+        for (size_t i = 0; i < modelFileVertices.size(); i++)
+        {
+            const objl::Vector3& position = modelFileVertices[i].Position;
+            vertices[i] = { { position.X, position.Y, position.Z }, { 0.0f, 1.0f, 0.0f } };
+        }
+        return true;
+    }
+
+    void PrintStatistics(const char* label, const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+    {
+        MeshOptimizer::CacheStatistics small = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount, cacheSize);
+        MeshOptimizer::CacheStatistics large = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount, cacheSize * 2);
+        printf("  %-7s %9zu vertices %9zu triangles   ACMR %.3f / %.3f   ATVR %.3f / %.3f\n",
+            label, vertexCount, indices.size() / 3, small.acmr, large.acmr, small.atvr, large.atvr);
+    }
+
+    bool Run(const std::string& path, uint32_t cacheSize)
+    {
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        if (!LoadModel(path, vertices, indices))
+        {
+            printf("%s: load failed\n", path.c_str());
+            return false;
+        }
+        indices.resize(indices.size() / 3 * 3);
+
+        printf("%s (cache sizes %u / %u)\n", path.c_str(), cacheSize, cacheSize * 2);
+        PrintStatistics("before", indices, vertices.size(), cacheSize);
+
+        Clock::time_point start = Clock::now();
+        size_t welded = MeshOptimizer::WeldVertices(vertices, indices);
+        double weldTime = MillisecondsSince(start);
+
+        start = Clock::now();
+        size_t degenerate = MeshOptimizer::RemoveDegenerateTriangles(indices);
+        size_t duplicate = MeshOptimizer::RemoveDuplicateTriangles(indices);
+        double cleanTime = MillisecondsSince(start);
+        PrintStatistics("welded", indices, vertices.size(), cacheSize);
+
+        start = Clock::now();
+        MeshOptimizer::OptimizeVertexCache(indices, vertices.size(), cacheSize);
+        double cacheTime = MillisecondsSince(start);
+
+        start = Clock::now();
+        MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+        double fetchTime = MillisecondsSince(start);
+        PrintStatistics("after", indices, vertices.size(), cacheSize);
+
+        printf("  welded %zu vertices, removed %zu degenerate and %zu duplicate triangles\n", welded, degenerate, duplicate);
+        printf("  weld %.2f ms, clean up %.2f ms, vertex cache %.2f ms, vertex fetch %.2f ms\n", weldTime, cleanTime, cacheTime, fetchTime);
+
+        start = Clock::now();
+        std::vector<MeshCache::Lod> lods;
+        MeshSimplifier::BuildLodChain(vertices, indices, lods);
+        double lodTime = MillisecondsSince(start);
+        printf("  %zu levels of detail in %.2f ms\n", lods.size(), lodTime);
+        for (size_t i = 0; i < lods.size(); i++)
+        {
+            std::vector<uint32_t> levelIndices(indices.begin() + lods[i].firstIndex, indices.begin() + lods[i].firstIndex + lods[i].indexCount);
+            MeshOptimizer::CacheStatistics statistics = MeshOptimizer::AnalyzeVertexCache(levelIndices, vertices.size(), cacheSize);
+            printf("    LOD %zu %9u triangles   error %.5f   ACMR %.3f\n", i, lods[i].indexCount / 3, lods[i].error, statistics.acmr);
+        }
+        printf("\n");
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t cacheSize = MeshOptimizer::DefaultCacheSize;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--cache-size" && i + 1 < argc)
+        {
+            cacheSize = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: mesh_optimizer_bench [--cache-size N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+
+    bool succeeded = true;
+    for (const std::string& path : paths)
+    {
+        succeeded = Run(path, cacheSize) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
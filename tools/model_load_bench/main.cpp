@@ -0,0 +1,531 @@
+//Headless check of the background model loading of ModelLoadTask, the pipeline behind the File Selection panel.
+//Every model is loaded twice with its .rtmesh cache in the work directory: the first load runs every stage, from Parsing through
+//Optimizing, ComputingNormals and GeneratingLods to PreparingBuffers, and the second one reads the cache and skips the middle three.
+//The stages are polled the way the UI polls them and have to come in order with their progress between 0 and 1, the buffer function
+//has to run in the PreparingBuffers stage with what TakeResult() hands over afterwards, and both loads have to give the same result.
+//A generated grid (--triangles N) is then cancelled in every stage, and the load has to end Cancelled without going past the stage
+//it was cancelled in by more than one, drop its result and start again afterwards. The buffer function holds the load until the
+//cancellation is made, so the load can't finish first. Last, a missing file, a file with an invalid face, a buffer function that
+//fails or throws, a cache with an index past its last vertex and a second Start() while a load runs have to fail cleanly, and destroying a
+//running task has to stop it.
+//Before those, an OBJ file is loaded beside its cache while its material library changes, goes away and comes back, and every change
+//has to rebuild the cache instead of loading the stale materials from it.
+//
+//Usage: model_load_bench [--triangles N] [--work-dir <dir>] [model ...]    (models/teapot.obj and models/rabbit.obj when no model is given)
+
+#include "MeshCache.h"
+#include "ModelLoadTask.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef ModelLoadTask::Stage Stage;
+
+    const Stage WorkStages[] = { Stage::Parsing, Stage::Optimizing, Stage::ComputingNormals, Stage::GeneratingLods, Stage::PreparingBuffers };
+
+    int failures = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    struct Result
+    {
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        std::vector<MeshCache::Material> materials;
+    };
+
+    //Polls the task until it stops running, as the UI does every frame, and returns the stages it saw in order.
+    std::vector<Stage> PollUntilDone(const ModelLoadTask& task, bool& progressInRange)
+    {
+        std::vector<Stage> seen;
+        progressInRange = true;
+        while (true)
+        {
+            const Stage stage = task.GetStage();
+            const float progress = task.GetStageProgress();
+            progressInRange = progressInRange && progress >= 0.0f && progress <= 1.0f;
+            if (seen.empty() || seen.back() != stage)
+            {
+                seen.push_back(stage);
+            }
+            if (!task.IsRunning())
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return seen;
+    }
+
+    std::string Describe(const std::vector<Stage>& stages)
+    {
+        std::string text;
+        for (Stage stage : stages)
+        {
+            text += (text.empty() ? "" : " > ") + std::string(ModelLoadTask::GetStageName(stage));
+        }
+        return text;
+    }
+
+    bool IsResultValid(const Result& result)
+    {
+        if (result.vertices.empty() || result.indices.empty() || result.lods.empty() || result.parts.empty())
+        {
+            return false;
+        }
+        for (uint32_t index : result.indices)
+        {
+            if (index >= result.vertices.size())
+            {
+                return false;
+            }
+        }
+        for (const MeshCache::Lod& lod : result.lods)
+        {
+            if ((uint64_t)lod.firstIndex + lod.indexCount > result.indices.size())
+            {
+                return false;
+            }
+        }
+        for (const MeshCache::Part& part : result.parts)
+        {
+            if ((uint64_t)part.firstLod + part.lodCount > result.lods.size() || (part.material != MeshCache::NoMaterial && part.material >= result.materials.size()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<class T>
+    bool SameBytes(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+
+    bool IsSameResult(const Result& a, const Result& b)
+    {
+        return SameBytes(a.vertices, b.vertices) && SameBytes(a.indices, b.indices) && SameBytes(a.lods, b.lods) &&
+            SameBytes(a.parts, b.parts) && SameBytes(a.materials, b.materials);
+    }
+
+    //Loads a model once and checks the stages it went through. cached tells whether the .rtmesh cache is expected to be used.
+    bool LoadAndCheck(const std::string& path, const std::string& cachePath, bool cached, Result& result)
+    {
+        ModelLoadTask task;
+        std::atomic<bool> preparedInStage{ false };
+        std::atomic<size_t> preparedIndexCount{ 0 };
+        task.SetPrepareBuffersFunction([&](const std::vector<MeshCache::Vertex>&, const std::vector<uint32_t>& indices,
+            const std::vector<MeshCache::Lod>&, const std::vector<MeshCache::Part>&, const std::vector<MeshCache::Material>&)
+            {
+                preparedInStage = task.GetStage() == Stage::PreparingBuffers;
+                preparedIndexCount = indices.size();
+                return true;
+            });
+
+        const Clock::time_point start = Clock::now();
+        Check(task.Start(path, cachePath), "Start(" + path + ")");
+        Check(task.IsRunning(), "a started load runs");
+        bool progressInRange = false;
+        const std::vector<Stage> seen = PollUntilDone(task, progressInRange);
+        const double seconds = SecondsSince(start);
+        task.Wait();
+
+        const std::string name = path + (cached ? " (cache)" : "");
+        Check(std::is_sorted(seen.begin(), seen.end()), name + ": stages out of order: " + Describe(seen));
+        Check(task.GetStage() == Stage::Finished, name + ": ended " + ModelLoadTask::GetStageName(task.GetStage()));
+        Check(progressInRange, name + ": stage progress outside of 0 to 1");
+        Check(preparedInStage, name + ": the buffer function didn't run in the PreparingBuffers stage");
+        for (Stage stage : WorkStages)
+        {
+            const bool skipped = cached && stage != Stage::Parsing && stage != Stage::PreparingBuffers;
+            Check(skipped == (task.GetStageSeconds(stage) == 0.0), name + ": " + ModelLoadTask::GetStageName(stage) + (skipped ? " should have been skipped" : " didn't run"));
+        }
+        MeshOptimizer::Report report;
+        Check(task.GetOptimizationReport(report) != cached, name + (cached ? ": optimization report from the cache" : ": no optimization report"));
+
+        Check(task.TakeResult(result.vertices, result.indices, &result.lods, &result.parts, &result.materials), name + ": TakeResult() failed");
+        Result again;
+        Check(!task.TakeResult(again.vertices, again.indices), name + ": TakeResult() succeeded twice");
+        Check(IsResultValid(result), name + ": the result is inconsistent");
+        Check(preparedIndexCount == result.indices.size(), name + ": the buffer function got other indices than TakeResult()");
+
+        printf("  %-32s %8.1f ms  %8zu vertices %8zu triangles %2zu LODs %2zu parts   ", name.c_str(), seconds * 1000.0,
+            result.vertices.size(), result.lods.empty() ? 0 : (size_t)result.lods[0].indexCount / 3, result.lods.size(), result.parts.size());
+        for (Stage stage : WorkStages)
+        {
+            printf(" %s %.1f", ModelLoadTask::GetStageName(stage), task.GetStageSeconds(stage) * 1000.0);
+        }
+        printf("\n");
+        return task.GetStage() == Stage::Finished;
+    }
+
+    void RunModel(const std::string& path, const fs::path& workDirectory)
+    {
+        const std::string cachePath = (workDirectory / (fs::path(path).filename().string() + ".rtmesh")).string();
+        std::error_code error;
+        fs::remove(cachePath, error);
+        Result cold, cached;
+        if (!LoadAndCheck(path, cachePath, false, cold))
+        {
+            return;
+        }
+        Check(fs::exists(cachePath), path + ": the cache wasn't written");
+        if (LoadAndCheck(path, cachePath, true, cached))
+        {
+            Check(IsSameResult(cold, cached), path + ": loading from the cache gives another result");
+        }
+        fs::remove(cachePath, error);
+    }
+
+    //A grid of about triangleCount triangles with a wavy height, large enough for every stage to take a while.
+    bool WriteGrid(const std::string& path, size_t triangleCount)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        const int side = std::max(2, (int)std::sqrt((double)triangleCount / 2.0));
+        for (int y = 0; y <= side; y++)
+        {
+            for (int x = 0; x <= side; x++)
+            {
+                fprintf(file, "v %.5f %.5f %.5f\n", x * 0.01, 0.05 * std::sin(x * 0.3) * std::cos(y * 0.2), y * 0.01);
+            }
+        }
+        for (int y = 0; y < side; y++)
+        {
+            for (int x = 0; x < side; x++)
+            {
+                const int a = y * (side + 1) + x + 1;
+                fprintf(file, "f %d %d %d\nf %d %d %d\n", a, a + side + 1, a + 1, a + 1, a + side + 1, a + side + 2);
+            }
+        }
+        return fclose(file) == 0;
+    }
+
+    void RunCancellation(const std::string& gridPath, const fs::path& workDirectory)
+    {
+        const std::string cachePath = (workDirectory / "grid.rtmesh").string();
+        std::error_code error;
+        for (Stage target : WorkStages)
+        {
+            fs::remove(cachePath, error);
+            ModelLoadTask task;
+            //The load can't finish before the cancellation is made: the buffer function waits for it.
+            std::atomic<bool> released{ false };
+            task.SetPrepareBuffersFunction([&](const std::vector<MeshCache::Vertex>&, const std::vector<uint32_t>&,
+                const std::vector<MeshCache::Lod>&, const std::vector<MeshCache::Part>&, const std::vector<MeshCache::Material>&)
+                {
+                    while (!released)
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                    return true;
+                });
+            Check(task.Start(gridPath, cachePath), "Start(" + gridPath + ")");
+            //Parsing is only cancelled once it has started reading the file.
+            while (task.GetStage() < target || (task.GetStage() == Stage::Parsing && task.GetStageProgress() == 0.0f))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            task.Cancel();
+            const Stage cancelledIn = task.GetStage();
+            released = true;
+            const Clock::time_point cancelTime = Clock::now();
+            task.Wait();
+            const double latency = SecondsSince(cancelTime);
+
+            const std::string name = std::string("cancelled in ") + ModelLoadTask::GetStageName(target);
+            Check(task.GetStage() == Stage::Cancelled, name + ": ended " + ModelLoadTask::GetStageName(task.GetStage()));
+            //The stage the cancellation was seen in may still finish its last step, the one after it has to notice it right away.
+            for (Stage stage : WorkStages)
+            {
+                if ((int)stage > (int)cancelledIn + 1)
+                {
+                    Check(task.GetStageSeconds(stage) == 0.0, name + ": went on to " + ModelLoadTask::GetStageName(stage));
+                }
+            }
+            Result result;
+            Check(!task.TakeResult(result.vertices, result.indices), name + ": a cancelled load has a result");
+            printf("  %-32s stopped %7.1f ms after Cancel() in %s\n", name.c_str(), latency * 1000.0, ModelLoadTask::GetStageName(cancelledIn));
+            if (target == Stage::Parsing)
+            {
+                //The task can be used again after a cancelled load.
+                released = true;
+                Check(task.Start(gridPath, cachePath), "Start() after a cancelled load");
+                task.Wait();
+                Check(task.GetStage() == Stage::Finished, std::string("the load after a cancelled one ended ") + ModelLoadTask::GetStageName(task.GetStage()));
+                Check(task.TakeResult(result.vertices, result.indices) && !result.indices.empty(), "the load after a cancelled one has no result");
+            }
+        }
+
+        //Destroying a running task cancels the load and waits for it.
+        fs::remove(cachePath, error);
+        const Clock::time_point start = Clock::now();
+        {
+            ModelLoadTask task;
+            task.Start(gridPath, cachePath);
+            while (task.GetStageProgress() == 0.0f && task.IsRunning())
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        printf("  %-32s took %7.1f ms\n", "destroying a running load", SecondsSince(start) * 1000.0);
+        fs::remove(cachePath, error);
+    }
+
+    Stage LoadToEnd(ModelLoadTask& task, const std::string& path, const std::string& cachePath)
+    {
+        if (!task.Start(path, cachePath))
+        {
+            return Stage::Idle;
+        }
+        task.Wait();
+        return task.GetStage();
+    }
+
+    //Loads a model with the cache beside it and tells whether the cache was used, which is when there is no optimization report.
+    bool LoadBesideCache(const std::string& path, bool& fromCache, Result& result)
+    {
+        ModelLoadTask task;
+        if (LoadToEnd(task, path, std::string()) != Stage::Finished)
+        {
+            return false;
+        }
+        MeshOptimizer::Report report;
+        fromCache = !task.GetOptimizationReport(report);
+        return task.TakeResult(result.vertices, result.indices, &result.lods, &result.parts, &result.materials);
+    }
+
+    //The cache of an OBJ file has to be rebuilt when only its material library changes, appears or goes away, and a model.obj
+    //and a model.glb in the same folder must not share a cache.
+    void RunCacheKeys(const fs::path& workDirectory)
+    {
+        Check(MeshCache::GetCachePath("models/model.obj") != MeshCache::GetCachePath("models/model.glb"), "model.obj and model.glb share a cache path");
+        Check(MeshCache::GetCachePath("models/model.obj") == "models/model.obj.rtmesh", "the cache path of model.obj is " + MeshCache::GetCachePath("models/model.obj"));
+
+        const std::string objPath = (workDirectory / "keyed.obj").string();
+        const std::string mtlPath = (workDirectory / "keyed.mtl").string();
+        const std::string cachePath = MeshCache::GetCachePath(objPath);
+        std::error_code error;
+        fs::remove(cachePath, error);
+        {
+            std::ofstream file(objPath, std::ios::binary | std::ios::trunc);
+            file << "mtllib keyed.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nusemtl paint\nf 1 2 3\nf 2 4 3\n";
+        }
+        auto writeLibrary = [&mtlPath](const char* diffuse)
+        {
+            std::ofstream file(mtlPath, std::ios::binary | std::ios::trunc);
+            file << "newmtl paint\nKd " << diffuse << "\n";
+        };
+        //Every step loads twice: the first load has to parse the model, the second one has to use the cache it wrote.
+        auto loadTwice = [&](const std::string& step, float red)
+        {
+            Result result;
+            bool fromCache = true;
+            const bool loaded = LoadBesideCache(objPath, fromCache, result);
+            Check(loaded && !fromCache, step + ": the stale cache was used");
+            Check(loaded && result.materials.size() == 1 && result.materials[0].albedo[0] == red, step + ": the material wasn't imported again");
+            Check(LoadBesideCache(objPath, fromCache, result) && fromCache, step + ": the cache wasn't used on the next load");
+        };
+
+        writeLibrary("1 0 0");
+        loadTwice("first load", 1.0f);
+        writeLibrary("0 1 0");
+        loadTwice("changed material library", 0.0f);
+        fs::remove(mtlPath, error);
+        {
+            Result result;
+            bool fromCache = true;
+            Check(LoadBesideCache(objPath, fromCache, result) && !fromCache && result.materials.empty(), "removed material library: the stale cache was used");
+        }
+        writeLibrary("0.5 0 0");
+        loadTwice("restored material library", 0.5f);
+
+        fs::remove(objPath, error);
+        fs::remove(mtlPath, error);
+        fs::remove(cachePath, error);
+        printf("  %-32s %s\n", "cache keys", "checked");
+    }
+
+    void RunFailures(const std::string& modelPath, const fs::path& workDirectory)
+    {
+        const std::string cachePath = (workDirectory / "failure.rtmesh").string();
+        std::error_code error;
+        fs::remove(cachePath, error);
+        Result result;
+
+        ModelLoadTask task;
+        Check(LoadToEnd(task, (workDirectory / "missing.obj").string(), cachePath) == Stage::Failed, "a missing file doesn't fail");
+        Check(!task.TakeResult(result.vertices, result.indices), "a failed load has a result");
+
+        const std::string invalidPath = (workDirectory / "invalid.obj").string();
+        {
+            std::ofstream file(invalidPath, std::ios::binary | std::ios::trunc);
+            file << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n";
+        }
+        Check(LoadToEnd(task, invalidPath, cachePath) == Stage::Failed, "a face with an invalid index doesn't fail");
+        Check(!fs::exists(cachePath), "a failed load wrote a cache");
+        fs::remove(invalidPath, error);
+
+        const std::string baked = (workDirectory / "missing.rtmesh").string();
+        Check(LoadToEnd(task, baked, std::string()) == Stage::Failed, "a missing baked file doesn't fail");
+
+        //A cache whose streams decode fine but reference a vertex that doesn't exist. As a baked file it has to fail,
+        //as the cache of a model it has to be ignored and rebuilt.
+        const std::string trianglePath = (workDirectory / "triangle.obj").string();
+        {
+            std::ofstream file(trianglePath, std::ios::binary | std::ios::trunc);
+            file << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+        }
+        {
+            const MeshCache::Vertex triangle[3] = { { { 0, 0, 0 }, { 0, 0, 1 } }, { { 1, 0, 0 }, { 0, 0, 1 } }, { { 0, 1, 0 }, { 0, 0, 1 } } };
+            const uint32_t outOfRange[3] = { 0, 1, 3 };
+            MeshCache writer;
+            writer.Open(trianglePath, cachePath);
+            Check(writer.Write(triangle, 3, outOfRange, 3), "writing a cache with an index past the last vertex");
+        }
+        MeshCache reader;
+        Check(!reader.OpenBaked(cachePath), "OpenBaked() accepts an index past the last vertex");
+        Check(!reader.Open(trianglePath, cachePath), "Open() accepts an index past the last vertex");
+        reader.Close();
+        const std::string bakedCopy = (workDirectory / "out_of_range.rtmesh").string();
+        fs::copy_file(cachePath, bakedCopy, fs::copy_options::overwrite_existing, error);
+        Check(LoadToEnd(task, bakedCopy, std::string()) == Stage::Failed, "a baked file with an index past the last vertex doesn't fail");
+        Check(LoadToEnd(task, trianglePath, cachePath) == Stage::Finished && task.TakeResult(result.vertices, result.indices) &&
+            result.vertices.size() == 3 && result.indices.size() == 3, "a model whose cache has an index past the last vertex isn't loaded again");
+        fs::remove(bakedCopy, error);
+        fs::remove(trianglePath, error);
+        fs::remove(cachePath, error);
+
+        task.SetPrepareBuffersFunction([](const std::vector<MeshCache::Vertex>&, const std::vector<uint32_t>&,
+            const std::vector<MeshCache::Lod>&, const std::vector<MeshCache::Part>&, const std::vector<MeshCache::Material>&)
+            {
+                return false;
+            });
+        Check(LoadToEnd(task, modelPath, cachePath) == Stage::Failed, "a failing buffer function doesn't fail the load");
+        Check(!task.TakeResult(result.vertices, result.indices), "a failed load has a result");
+
+        task.SetPrepareBuffersFunction([](const std::vector<MeshCache::Vertex>&, const std::vector<uint32_t>&,
+            const std::vector<MeshCache::Lod>&, const std::vector<MeshCache::Part>&, const std::vector<MeshCache::Material>&) -> bool
+            {
+                throw std::runtime_error("out of upload memory");
+            });
+        Check(LoadToEnd(task, modelPath, cachePath) == Stage::Failed, "a throwing buffer function doesn't fail the load");
+
+        std::atomic<bool> released{ false };
+        task.SetPrepareBuffersFunction([&](const std::vector<MeshCache::Vertex>&, const std::vector<uint32_t>&,
+            const std::vector<MeshCache::Lod>&, const std::vector<MeshCache::Part>&, const std::vector<MeshCache::Material>&)
+            {
+                while (!released)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                return true;
+            });
+        Check(task.Start(modelPath, cachePath), "Start() after failed loads");
+        Check(!task.Start(modelPath, cachePath), "a second Start() while a load runs succeeded");
+        released = true;
+        task.Wait();
+        Check(task.GetStage() == Stage::Finished, std::string("the load after failed ones ended ") + ModelLoadTask::GetStageName(task.GetStage()));
+        fs::remove(cachePath, error);
+        printf("  %-32s %s\n", "failures", "checked");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangleCount = 400000;
+    fs::path workDirectory;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--triangles" && i + 1 < argc)
+        {
+            triangleCount = (size_t)std::max(1000LL, atoll(argv[++i]));
+        }
+        else if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: model_load_bench [--triangles N] [--work-dir <dir>] [model ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "model_load_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+
+    printf("loads\n");
+    for (const std::string& path : paths)
+    {
+        RunModel(path, workDirectory);
+    }
+
+    printf("cancellation\n");
+    const std::string gridPath = (workDirectory / "grid.obj").string();
+    if (WriteGrid(gridPath, triangleCount))
+    {
+        RunCancellation(gridPath, workDirectory);
+    }
+    else
+    {
+        Check(false, "writing " + gridPath);
+    }
+    fs::remove(gridPath, error);
+
+    printf("cache keys\n");
+    RunCacheKeys(workDirectory);
+
+    printf("failures\n");
+    RunFailures(paths[0], workDirectory);
+
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+//Benchmark of the vertex normal generation of ModelLoadTask.
+//A closed grid of the requested triangle count (10M by default) is generated in memory, then the normals are computed with pools of
+//1, 2, 4, ... workers up to the hardware thread count, and at least up to 4 so the parallel path runs on any machine. Pools with less
+//than 3 workers (4 threads with the calling one) and meshes of up to 64K triangles take the single threaded path.
+//Every run is checked to give the same bits as the first one, and the face weighted runs are also compared with the serial scatter
+//the normals used to be computed with.
+//
+//Usage: normals_bench [--triangles N] [--repeat N] [model.obj ...]
+
+#include "ModelLoadTask.h"
+#include "OBJ_FileManager.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Mesh
+    {
+        std::string name;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    //Torus of about triangleCount triangles with a wavy surface, so no two neighbouring normals are the same.
+    Mesh GenerateTorus(size_t triangleCount)
+    {
+        Mesh mesh;
+        size_t side = std::max<size_t>(3, (size_t)std::sqrt((double)triangleCount / 2.0));
+        mesh.name = "torus " + std::to_string(side) + "x" + std::to_string(side);
+        mesh.vertices.resize(side * side);
+        const double pi = 3.14159265358979323846;
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                double u = 2.0 * pi * i / side;
+                double v = 2.0 * pi * j / side;
+                double r = 1.0 + 0.05 * std::sin(7.0 * u) * std::cos(5.0 * v);
+                MeshCache::Vertex& vertex = mesh.vertices[i * side + j];
+                vertex.position[0] = (float)((3.0 + r * std::cos(v)) * std::cos(u));
+                vertex.position[1] = (float)((3.0 + r * std::cos(v)) * std::sin(u));
+                vertex.position[2] = (float)(r * std::sin(v));
+            }
+        }
+        mesh.indices.reserve(side * side * 6);
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                uint32_t a = (uint32_t)(i * side + j);
+                uint32_t b = (uint32_t)(((i + 1) % side) * side + j);
+                uint32_t c = (uint32_t)(((i + 1) % side) * side + (j + 1) % side);
+                uint32_t d = (uint32_t)(i * side + (j + 1) % side);
+                mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+            }
+        }
+        return mesh;
+    }
+
+    bool LoadModel(const std::string& path, Mesh& mesh)
+    {
+        OBJFileManager ofm;
+        std::vector<objl::Vertex> modelFileVertices;
+        if (!ofm.LoadObjFile(path, modelFileVertices, mesh.indices))
+        {
+            return false;
+        }
+        mesh.name = path;
+        mesh.vertices.resize(modelFileVertices.size());
+        for (size_t i = 0; i < modelFileVertices.size(); i++)
+        {
+            const objl::Vector3& position = modelFileVertices[i].Position;
+            mesh.vertices[i] = { { position.X, position.Y, position.Z }, { 0.0f, 1.0f, 0.0f } };
+        }
+        mesh.indices.resize(mesh.indices.size() / 3 * 3);
+        return true;
+    }
+
+    //The serial scatter ModelLoadTask::ComputeVertexNormals used before it was parallel, as the reference for the face weighted normals.
+    void ComputeNormalsSerially(std::vector<MeshCache::Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        auto normalize = [](float v[3])
+        {
+            float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (length > 0.0f)
+            {
+                v[0] /= length;
+                v[1] /= length;
+                v[2] /= length;
+            }
+        };
+        for (MeshCache::Vertex& vertex : vertices)
+        {
+            vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+        }
+        for (size_t t = 0; t < indices.size() / 3; t++)
+        {
+            MeshCache::Vertex& v0 = vertices[indices[t * 3]];
+            MeshCache::Vertex& v1 = vertices[indices[t * 3 + 1]];
+            MeshCache::Vertex& v2 = vertices[indices[t * 3 + 2]];
+            float edge1[3] = { v1.position[0] - v0.position[0], v1.position[1] - v0.position[1], v1.position[2] - v0.position[2] };
+            float edge2[3] = { v2.position[0] - v0.position[0], v2.position[1] - v0.position[1], v2.position[2] - v0.position[2] };
+            float normal[3] = {
+                edge1[1] * edge2[2] - edge1[2] * edge2[1],
+                edge1[2] * edge2[0] - edge1[0] * edge2[2],
+                edge1[0] * edge2[1] - edge1[1] * edge2[0]
+            };
+            normalize(normal);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                v0.normal[axis] += normal[axis];
+                v1.normal[axis] += normal[axis];
+                v2.normal[axis] += normal[axis];
+            }
+        }
+        for (MeshCache::Vertex& vertex : vertices)
+        {
+            normalize(vertex.normal);
+            for (float& component : vertex.normal)
+            {
+                component = -component;
+            }
+        }
+    }
+
+    bool SameNormals(const std::vector<MeshCache::Vertex>& a, const std::vector<MeshCache::Vertex>& b)
+    {
+        return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(MeshCache::Vertex)) == 0;
+    }
+
+    //Best time of a few runs, in milliseconds.
+    template <class F>
+    double Measure(int repeat, F&& run)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        return best;
+    }
+
+    void Run(Mesh& mesh, int repeat)
+    {
+        size_t triangleCount = mesh.indices.size() / 3;
+        printf("%s: %zu vertices, %zu triangles\n", mesh.name.c_str(), mesh.vertices.size(), triangleCount);
+
+        std::vector<MeshCache::Vertex> reference = mesh.vertices;
+        double serialTime = Measure(repeat, [&]() { ComputeNormalsSerially(reference, mesh.indices); });
+        printf("  %-22s %10.1f ms %8.1f Mtri/s\n", "serial scatter", serialTime, triangleCount / serialTime / 1000.0);
+
+        unsigned int hardwareThreads = std::max(4u, std::thread::hardware_concurrency());
+        std::vector<unsigned int> workerCounts;
+        for (unsigned int workers = 1; workers < hardwareThreads; workers *= 2)
+        {
+            workerCounts.push_back(workers);
+        }
+        workerCounts.push_back(hardwareThreads);
+
+        const ModelLoadTask::NormalWeighting weightings[] = { ModelLoadTask::NormalWeighting::Face, ModelLoadTask::NormalWeighting::Angle };
+        for (ModelLoadTask::NormalWeighting weighting : weightings)
+        {
+            const char* weightingName = weighting == ModelLoadTask::NormalWeighting::Face ? "face" : "angle";
+            std::vector<MeshCache::Vertex> first;
+            double firstTime = 0.0;
+            for (unsigned int workers : workerCounts)
+            {
+                ThreadPool pool(workers);
+                std::vector<MeshCache::Vertex> vertices = mesh.vertices;
+                double time = Measure(repeat, [&]() { ModelLoadTask::ComputeVertexNormals(vertices, mesh.indices, weighting, nullptr, nullptr, &pool); });
+                bool deterministic = true;
+                if (first.empty())
+                {
+                    first = vertices;
+                    firstTime = time;
+                }
+                else
+                {
+                    deterministic = SameNormals(first, vertices);
+                }
+                std::string label = std::string(weightingName) + ", " + std::to_string(workers) + (workers == 1 ? " worker" : " workers");
+                printf("  %-22s %10.1f ms %8.1f Mtri/s   x%.2f   %s", label.c_str(), time, triangleCount / time / 1000.0, firstTime / time,
+                    deterministic ? "same bits as 1 worker" : "DIFFERENT FROM 1 WORKER");
+                if (weighting == ModelLoadTask::NormalWeighting::Face)
+                {
+                    printf(", %s", SameNormals(reference, vertices) ? "same bits as serial" : "DIFFERENT FROM SERIAL");
+                }
+                printf("\n");
+            }
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangleCount = 10000000;
+    int repeat = 3;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--triangles" && i + 1 < argc)
+        {
+            triangleCount = (size_t)std::max(1LL, atoll(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: normals_bench [--triangles N] [--repeat N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+
+    bool succeeded = true;
+    if (paths.empty())
+    {
+        Mesh mesh = GenerateTorus(triangleCount);
+        Run(mesh, repeat);
+    }
+    for (const std::string& path : paths)
+    {
+        Mesh mesh;
+        if (!LoadModel(path, mesh))
+        {
+            printf("%s: load failed\n", path.c_str());
+            succeeded = false;
+            continue;
+        }
+        Run(mesh, repeat);
+    }
+    return succeeded ? 0 : 1;
+}
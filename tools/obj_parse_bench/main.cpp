@@ -0,0 +1,394 @@
+//Check and benchmark of the OBJ and MTL parsing of objl::Loader.
+//First the number parsing helpers the loaders share are run on awkward input: signs, whitespace, text that isn't a number and
+//numbers that are out of range, which have to be clamped instead of leaving the output as it was. Then files whose faces reference
+//attributes that don't exist (index 0, one past the end, relative indices before the first attribute, indices that don't fit in any
+//integer and ones that aren't numbers) have to fail to load with objl::Loader and OBJFileManager alike.
+//Last, the allocations of objl::Loader::LoadFile and LoadMaterials are counted on generated files that only differ in their number of
+//attribute, face and material property lines. The tokenizer doesn't allocate per line, so the difference has to stay within the few
+//reallocations of the growing geometry arrays, however many lines are added, and it is reported per line with the parse speed.
+//
+//Usage: obj_parse_bench [--work-dir <dir>]
+
+#include "OBJ_FileManager.h"
+#include "OBJ_Loader.h"
+#include "OBJ_ParseUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+//Allocation counting, as in loader_bench. Every operator new form ends up in the replaceable operator new(size_t) below,
+//except the aligned ones, which the loader doesn't use.
+namespace
+{
+    std::atomic<uint64_t> allocationCount{ 0 };
+}
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Allowed growth of the allocation count between the small and the large files, for the arrays that grow geometrically.
+    const uint64_t AllowedExtraAllocations = 64;
+
+    int failures = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    bool WriteFile(const std::string& path, const std::string& contents)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+        return (bool)file;
+    }
+
+    //The loader reports every mesh it loads on std::cout, which would bury the results.
+    class QuietOutput
+    {
+    public:
+        QuietOutput() : output(std::cout.rdbuf(nullptr))
+        {
+        }
+        ~QuietOutput()
+        {
+            std::cout.rdbuf(output);
+            std::cout.clear();
+        }
+
+    private:
+        std::streambuf* output;
+    };
+
+    void CheckFloat(const char* text, float expected)
+    {
+        float value = 12345.0f;
+        const char* end = text + strlen(text);
+        objl::parse::ParseFloat(text, end, value);
+        const bool same = value == expected && std::signbit(value) == std::signbit(expected);
+        char message[160];
+        snprintf(message, sizeof(message), "ParseFloat(\"%.40s\") gave %g, not %g", text, value, expected);
+        Check(same, message);
+    }
+
+    void CheckInt(const char* text, long long expected)
+    {
+        long long value = 12345;
+        const char* end = text + strlen(text);
+        objl::parse::ParseInt(text, end, value);
+        Check(value == expected, "ParseInt(\"" + std::string(text) + "\") gave " + std::to_string(value) + ", not " + std::to_string(expected));
+    }
+
+    void RunNumberChecks()
+    {
+        printf("number parsing\n");
+        const int before = failures;
+        CheckFloat("1.5", 1.5f);
+        CheckFloat(" \t-2.25", -2.25f);
+        CheckFloat("+3.5", 3.5f);
+        CheckFloat("abc", 0.0f);
+        CheckFloat("", 0.0f);
+        CheckFloat("1e999", FLT_MAX);
+        CheckFloat("-1e999", -FLT_MAX);
+        CheckFloat(".5e40", FLT_MAX);
+        CheckFloat("1000000000000000000000000000000000000000000000000", FLT_MAX);
+        CheckFloat("1e-999", 0.0f);
+        CheckFloat("-1e-999", -0.0f);
+        CheckFloat("0.00000000000000000000000000000000000000000000000000001", 0.0f);
+        CheckFloat("123456789e-60", 0.0f);
+        CheckFloat("0.00000000000000000000000000000000000000000000000000001e100", FLT_MAX);
+        CheckInt("42", 42);
+        CheckInt("+7", 7);
+        CheckInt(" -3", -3);
+        CheckInt("x", 0);
+        CheckInt("99999999999999999999999999", LLONG_MAX);
+        CheckInt("-99999999999999999999999999", LLONG_MIN);
+        printf("  %s\n\n", failures == before ? "ok" : "failed");
+    }
+
+    void RunIndexChecks(const fs::path& workDirectory)
+    {
+        printf("face indices\n");
+        const int before = failures;
+        const std::string header = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\n";
+        struct Case
+        {
+            const char* name;
+            const char* face;
+            bool valid;
+        };
+        const Case cases[] = {
+            { "positive", "f 1 2 3", true },
+            { "relative", "f -3 -2 -1", true },
+            { "all attributes", "f 1/1/1 2/1/1 3/-1/-1", true },
+            { "index 0", "f 0 1 2", false },
+            { "one past the end", "f 1 2 4", false },
+            { "before the first", "f -4 -2 -1", false },
+            { "texture coordinate", "f 1/2 2/1 3/1", false },
+            { "normal", "f 1//1 2//1 3//2", false },
+            { "too large for any integer", "f 1 2 99999999999999999999999", false },
+            { "too small for any integer", "f 1 2 -99999999999999999999999", false },
+            { "not a number", "f 1 2 x", false },
+        };
+        const std::string path = (workDirectory / "index.obj").string();
+        for (const Case& test : cases)
+        {
+            Check(WriteFile(path, header + test.face + "\n"), "writing " + path);
+            bool loaded;
+            {
+                QuietOutput quiet;
+                objl::Loader loader;
+                loaded = loader.LoadFile(path);
+            }
+            OBJFileManager manager;
+            std::vector<objl::Vertex> vertices;
+            std::vector<unsigned int> indices;
+            const bool managerLoaded = manager.LoadObjFile(path, vertices, indices);
+            Check(loaded == test.valid, std::string("objl::Loader ") + (loaded ? "loaded" : "failed on") + " \"" + test.face + "\" (" + test.name + ")");
+            Check(managerLoaded == test.valid, std::string("OBJFileManager ") + (managerLoaded ? "loaded" : "failed on") + " \"" + test.face + "\" (" + test.name + ")");
+        }
+
+        //Out of range numbers in attributes and materials are clamped.
+        const std::string materialPath = (workDirectory / "range.mtl").string();
+        Check(WriteFile(materialPath, "newmtl range\nNs 1e999\nd -1e-999\nillum 99999999999999999999\n"), "writing " + materialPath);
+        Check(WriteFile(path, "mtllib range.mtl\nv 1e999 -1e999 1e-999\nv 1 0 0\nv 0 1 0\nusemtl range\nf 1 2 3\n"), "writing " + path);
+        {
+            QuietOutput quiet;
+            objl::Loader loader;
+            const bool loaded = loader.LoadFile(path);
+            Check(loaded && loader.LoadedVertices.size() == 3 && loader.LoadedMaterials.size() == 1, "loading out of range numbers");
+            if (loaded && loader.LoadedVertices.size() == 3 && loader.LoadedMaterials.size() == 1)
+            {
+                const objl::Vector3& position = loader.LoadedVertices[0].Position;
+                const objl::Material& material = loader.LoadedMaterials[0];
+                Check(position.X == FLT_MAX && position.Y == -FLT_MAX && position.Z == 0.0f, "out of range position");
+                Check(material.Ns == FLT_MAX && material.d == 0.0f && material.illum == INT_MAX, "out of range material values");
+            }
+        }
+        printf("  %s\n\n", failures == before ? "ok" : "failed");
+    }
+
+    //A grid of quads with every corner form, in meshes with materials. Only the number of lines changes with side.
+    std::string GenerateObj(int side, const std::string& materialFile)
+    {
+        std::string text = "mtllib " + materialFile + "\n";
+        char line[160];
+        for (int y = 0; y <= side; y++)
+        {
+            for (int x = 0; x <= side; x++)
+            {
+                snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 0 1\n", x * 0.1, y * 0.1, 0.01 * ((x * 7 + y * 3) % 11), (double)x / side, (double)y / side);
+                text += line;
+            }
+        }
+        const int meshCount = 4;
+        for (int mesh = 0; mesh < meshCount; mesh++)
+        {
+            snprintf(line, sizeof(line), "o part%d\nusemtl material%d\n", mesh, mesh);
+            text += line;
+            for (int y = mesh * side / meshCount; y < (mesh + 1) * side / meshCount; y++)
+            {
+                for (int x = 0; x < side; x++)
+                {
+                    const int a = y * (side + 1) + x + 1, b = a + 1, c = a + side + 2, d = a + side + 1;
+                    if ((x + y) % 2 == 0)
+                    {
+                        snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+                    }
+                    else
+                    {
+                        snprintf(line, sizeof(line), "f %d//%d %d//%d %d//%d\nf %d/%d %d/%d %d/%d\n", a, a, b, b, c, c, a, a, c, c, d, d);
+                    }
+                    text += line;
+                }
+            }
+        }
+        return text;
+    }
+
+    //Materials with propertyLines lines each, so only the number of property lines changes with it.
+    std::string GenerateMtl(int propertyLines)
+    {
+        std::string text;
+        char line[128];
+        for (int material = 0; material < 4; material++)
+        {
+            snprintf(line, sizeof(line), "newmtl material%d\n", material);
+            text += line;
+            for (int i = 0; i < propertyLines; i++)
+            {
+                switch (i % 8)
+                {
+                case 0: snprintf(line, sizeof(line), "Ka %.4f %.4f %.4f\n", 0.1, 0.1, 0.01 * i); break;
+                case 1: snprintf(line, sizeof(line), "Kd %.4f %.4f %.4f\n", 0.5, 0.01 * i, 0.5); break;
+                case 2: snprintf(line, sizeof(line), "Ks 1 1 1\n"); break;
+                case 3: snprintf(line, sizeof(line), "Ns %d\n", i); break;
+                case 4: snprintf(line, sizeof(line), "Ni 1.45\n"); break;
+                case 5: snprintf(line, sizeof(line), "d 1\n"); break;
+                case 6: snprintf(line, sizeof(line), "illum 2\n"); break;
+                default: snprintf(line, sizeof(line), "# comment %d\n", i); break;
+                }
+                text += line;
+            }
+        }
+        return text;
+    }
+
+    struct Measurement
+    {
+        uint64_t allocations = 0;
+        double milliseconds = 0.0;
+        bool loaded = false;
+    };
+
+    Measurement MeasureObj(const std::string& path)
+    {
+        QuietOutput quiet;
+        Measurement measurement;
+        objl::Loader loader;
+        const uint64_t before = allocationCount.load();
+        const Clock::time_point start = Clock::now();
+        measurement.loaded = loader.LoadFile(path);
+        measurement.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        measurement.allocations = allocationCount.load() - before;
+        return measurement;
+    }
+
+    Measurement MeasureMtl(const std::string& path)
+    {
+        Measurement measurement;
+        objl::Loader loader;
+        const uint64_t before = allocationCount.load();
+        const Clock::time_point start = Clock::now();
+        measurement.loaded = loader.LoadMaterials(path);
+        measurement.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        measurement.allocations = allocationCount.load() - before;
+        return measurement;
+    }
+
+    size_t CountLines(const std::string& text)
+    {
+        return (size_t)std::count(text.begin(), text.end(), '\n');
+    }
+
+    void ReportGrowth(const char* name, size_t smallLines, const Measurement& small, size_t largeLines, const Measurement& large, size_t largeBytes)
+    {
+        const uint64_t extra = large.allocations > small.allocations ? large.allocations - small.allocations : 0;
+        printf("  %-4s %8zu lines: %6llu allocations, %8zu lines: %6llu allocations, %.5f per added line, %7.1f MB/s\n", name,
+            smallLines, (unsigned long long)small.allocations, largeLines, (unsigned long long)large.allocations,
+            (double)extra / (double)(largeLines - smallLines), largeBytes / 1e6 / (large.milliseconds / 1000.0));
+        Check(small.loaded && large.loaded, std::string(name) + " files failed to load");
+        Check(extra <= AllowedExtraAllocations, std::string(name) + ": " + std::to_string(extra) + " more allocations for the larger file, at most " +
+            std::to_string(AllowedExtraAllocations) + " are allowed");
+    }
+
+    void RunAllocationChecks(const fs::path& workDirectory)
+    {
+        printf("allocations\n");
+        const int before = failures;
+        //Files under parse::MinChunkSizeInBytes are parsed as a single chunk whatever the thread count, so both sizes are kept under it.
+        const int largeSide = 80;
+        const int smallSide = 20;
+        const std::string materialPath = (workDirectory / "grid.mtl").string();
+        const std::string smallPath = (workDirectory / "small.obj").string();
+        const std::string largePath = (workDirectory / "large.obj").string();
+        const std::string smallObj = GenerateObj(smallSide, "grid.mtl");
+        const std::string largeObj = GenerateObj(largeSide, "grid.mtl");
+        Check(WriteFile(materialPath, GenerateMtl(8)) && WriteFile(smallPath, smallObj) && WriteFile(largePath, largeObj), "writing the generated files");
+        //Warm up the thread pool and anything else that is set up on first use.
+        MeasureObj(smallPath);
+        const Measurement smallMeasurement = MeasureObj(smallPath);
+        const Measurement largeMeasurement = MeasureObj(largePath);
+        ReportGrowth("obj", CountLines(smallObj), smallMeasurement, CountLines(largeObj), largeMeasurement, largeObj.size());
+
+        const std::string smallMtl = GenerateMtl(8);
+        const std::string largeMtl = GenerateMtl(4000);
+        const std::string smallMtlPath = (workDirectory / "small.mtl").string();
+        const std::string largeMtlPath = (workDirectory / "large.mtl").string();
+        Check(WriteFile(smallMtlPath, smallMtl) && WriteFile(largeMtlPath, largeMtl), "writing the generated files");
+        MeasureMtl(smallMtlPath);
+        const Measurement smallMtlMeasurement = MeasureMtl(smallMtlPath);
+        const Measurement largeMtlMeasurement = MeasureMtl(largeMtlPath);
+        ReportGrowth("mtl", CountLines(smallMtl), smallMtlMeasurement, CountLines(largeMtl), largeMtlMeasurement, largeMtl.size());
+        printf("  %s\n\n", failures == before ? "ok" : "failed");
+
+        std::error_code error;
+        for (const std::string& path : { materialPath, smallPath, largePath, smallMtlPath, largeMtlPath })
+        {
+            fs::remove(path, error);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    fs::path workDirectory;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: obj_parse_bench [--work-dir <dir>]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "obj_parse_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+
+    RunNumberChecks();
+    RunIndexChecks(workDirectory);
+    RunAllocationChecks(workDirectory);
+    fs::remove((workDirectory / "index.obj"), error);
+    fs::remove((workDirectory / "range.mtl"), error);
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+//Check and benchmark of OBJFileManager::StreamObjFile.
+//A generated file is streamed with the settings StreamSettings::FromMemoryBudget picks for a small budget. The file defines its
+//attributes row by row between the faces, which use relative indices into the rows before them, so faces keep referencing attributes
+//of chunks that were already passed on. The mesh rebuilt from the chunks has to have exactly the triangles LoadObjFile loads from
+//the same file, every chunk has to stay within the settings and the buffers of the stream, counted with the allocations made while
+//it runs, have to fit in the budget. The same is done for a copy of the file with a face line longer than the read block, where
+//the block may only grow as far as it takes to hold the line.
+//
+//Usage: obj_stream_bench [--work-dir <dir>] [--budget <bytes>] [--rows <count>]
+
+#include "OBJ_FileManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+//Allocation tracking. Every block remembers its size and whether it was allocated while tracking was on, so the bytes that blocks
+//allocated by the stream hold can be followed while the consumer, which is not tracked, keeps its own allocations.
+namespace
+{
+    const size_t HeaderSize = 16;
+    bool tracking = false;
+    size_t trackedBytes = 0;
+    size_t peakTrackedBytes = 0;
+}
+
+void* operator new(size_t size)
+{
+    unsigned char* memory = (unsigned char*)malloc(size + HeaderSize);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    const size_t header[2] = { size, tracking ? 1u : 0u };
+    memcpy(memory, header, sizeof(header));
+    if (tracking)
+    {
+        trackedBytes += size;
+        peakTrackedBytes = std::max(peakTrackedBytes, trackedBytes);
+    }
+    return memory + HeaderSize;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+    unsigned char* block = (unsigned char*)memory - HeaderSize;
+    size_t header[2];
+    memcpy(header, block, sizeof(header));
+    if (header[1] != 0)
+    {
+        trackedBytes -= header[0];
+    }
+    free(block);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Vertices in a row of the generated grid.
+    const int RowSize = 65;
+
+    int failures = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    //Rows of positions and texture coordinates with a normal each. Every row after the first is joined to the one before it with
+    //quads in the v/vt/vn, v//vn and v forms in turn, all with relative indices. With a longFaceLength, a face around the first row of
+    //positions that is longer than that is added halfway, with absolute indices.
+    std::string GenerateObj(int rowCount, size_t longFaceLength, size_t& longestLine)
+    {
+        std::string text = "# obj_stream_bench grid\n";
+        char line[160];
+        longestLine = 0;
+        for (int row = 0; row < rowCount; row++)
+        {
+            for (int x = 0; x < RowSize; x++)
+            {
+                snprintf(line, sizeof(line), "v %.4f %.4f %.4f\nvt %.4f %.4f\n", x * 0.1, ((x * 5 + row * 3) % 7) * 0.05, row * 0.1,
+                    x / (double)(RowSize - 1), row / (double)rowCount);
+                text += line;
+            }
+            snprintf(line, sizeof(line), "vn 0 %.4f 0.5\n", 1.0 - (row % 9) * 0.1);
+            text += line;
+            if (row == 0)
+            {
+                continue;
+            }
+
+            //Relative indices count back from the last attribute defined, the last row starts RowSize positions back.
+            for (int x = 0; x + 1 < RowSize; x++)
+            {
+                const int corners[4] = { -2 * RowSize + x, -2 * RowSize + x + 1, -RowSize + x + 1, -RowSize + x };
+                text += "f";
+                for (int corner : corners)
+                {
+                    const int normal = corner < -RowSize ? -2 : -1;
+                    if (row % 3 == 0)
+                    {
+                        snprintf(line, sizeof(line), " %d/%d/%d", corner, corner, normal);
+                    }
+                    else if (row % 3 == 1)
+                    {
+                        snprintf(line, sizeof(line), " %d//%d", corner, normal);
+                    }
+                    else
+                    {
+                        snprintf(line, sizeof(line), " %d", corner);
+                    }
+                    text += line;
+                }
+                text += "\n";
+            }
+
+            if (longFaceLength > 0 && row == rowCount / 2)
+            {
+                const size_t start = text.size();
+                text += "f";
+                for (int i = 0; text.size() - start <= longFaceLength; i++)
+                {
+                    snprintf(line, sizeof(line), " %d/%d/1", i % RowSize + 1, i % RowSize + 1);
+                    text += line;
+                }
+                text += "\n";
+                longestLine = text.size() - start;
+            }
+        }
+        return text;
+    }
+
+    bool WriteFile(const std::string& path, const std::string& contents)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+        return (bool)file;
+    }
+
+    objl::Vertex GetVertex(const OBJFileManager::FaceCorner& corner, const std::vector<objl::Vector3>& positions,
+        const std::vector<objl::Vector2>& texCoords, const std::vector<objl::Vector3>& normals)
+    {
+        objl::Vertex vertex;
+        vertex.Position = positions[corner.position];
+        if (corner.texCoord != OBJFileManager::MissingIndex)
+        {
+            vertex.TextureCoordinate = texCoords[corner.texCoord];
+        }
+        if (corner.normal != OBJFileManager::MissingIndex)
+        {
+            vertex.Normal = normals[corner.normal];
+        }
+        return vertex;
+    }
+
+    //Streams the file, rebuilds its triangles from the chunks and compares them with the triangles of LoadObjFile.
+    void RunFile(const std::string& path, size_t budget, size_t longestLine)
+    {
+        const OBJFileManager::StreamSettings settings = OBJFileManager::StreamSettings::FromMemoryBudget(budget);
+        OBJFileManager manager;
+
+        std::vector<objl::Vector3> positions;
+        std::vector<objl::Vector2> texCoords;
+        std::vector<objl::Vector3> normals;
+        std::vector<OBJFileManager::FaceCorner> corners;
+        size_t chunkCount = 0;
+        size_t earlierChunkCorners = 0;
+        bool chunksInOrder = true;
+        bool chunksWithinSettings = true;
+        bool cornersDefined = true;
+
+        //The consumer is made into a std::function before tracking starts, its captures don't belong to the stream.
+        const std::function<bool(const OBJFileManager::StreamChunk&)> consumer = [&](const OBJFileManager::StreamChunk& chunk)
+            {
+                tracking = false;
+                chunksInOrder = chunksInOrder && chunk.firstPosition == positions.size() && chunk.firstTexCoord == texCoords.size() &&
+                    chunk.firstNormal == normals.size() && chunk.firstTriangle == corners.size() / 3;
+                chunksWithinSettings = chunksWithinSettings && chunk.triangleCount <= settings.trianglesPerChunk &&
+                    chunk.positionCount + chunk.texCoordCount + chunk.normalCount <= settings.attributesPerChunk;
+                positions.insert(positions.end(), chunk.positions, chunk.positions + chunk.positionCount);
+                texCoords.insert(texCoords.end(), chunk.texCoords, chunk.texCoords + chunk.texCoordCount);
+                normals.insert(normals.end(), chunk.normals, chunk.normals + chunk.normalCount);
+                for (size_t i = 0; i < chunk.triangleCount * 3; i++)
+                {
+                    const OBJFileManager::FaceCorner& corner = chunk.corners[i];
+                    cornersDefined = cornersDefined && corner.position < positions.size() &&
+                        (corner.texCoord == OBJFileManager::MissingIndex || corner.texCoord < texCoords.size()) &&
+                        (corner.normal == OBJFileManager::MissingIndex || corner.normal < normals.size());
+                    earlierChunkCorners += corner.position < chunk.firstPosition ? 1 : 0;
+                    corners.push_back(corner);
+                }
+                chunkCount++;
+                tracking = true;
+                return true;
+            };
+
+        trackedBytes = 0;
+        peakTrackedBytes = 0;
+        tracking = true;
+        const Clock::time_point start = Clock::now();
+        const bool streamed = manager.StreamObjFile(path, settings, consumer);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        tracking = false;
+
+        Check(streamed, path + ": the stream failed");
+        Check(chunkCount > 1, path + ": streamed in a single chunk");
+        Check(chunksInOrder, path + ": the chunks don't follow each other");
+        Check(chunksWithinSettings, path + ": a chunk is larger than the settings allow");
+        Check(cornersDefined, path + ": a corner references an attribute that comes later");
+        Check(earlierChunkCorners > 0, path + ": no face references the attributes of an earlier chunk");
+
+        //The read block doubles until it holds the longest line, and while it grows the old block is still held.
+        size_t allowance = 0;
+        size_t blockSize = settings.readBlockSize;
+        while (blockSize < longestLine)
+        {
+            allowance = blockSize * 3 - settings.readBlockSize;
+            blockSize *= 2;
+        }
+        Check(peakTrackedBytes <= budget + allowance, path + ": the stream buffers take " + std::to_string(peakTrackedBytes) +
+            " bytes, more than the budget of " + std::to_string(budget) + (allowance > 0 ? " and the grown read block" : ""));
+
+        std::vector<objl::Vertex> vertices;
+        std::vector<unsigned int> indices;
+        Check(manager.LoadObjFile(path, vertices, indices), path + ": LoadObjFile failed");
+        Check(indices.size() == corners.size(), path + ": LoadObjFile loads " + std::to_string(indices.size() / 3) + " triangles, the stream " +
+            std::to_string(corners.size() / 3));
+        size_t differentCorners = 0;
+        for (size_t i = 0; i < indices.size() && i < corners.size(); i++)
+        {
+            const objl::Vertex vertex = GetVertex(corners[i], positions, texCoords, normals);
+            differentCorners += memcmp(&vertex, &vertices[indices[i]], sizeof(vertex)) == 0 ? 0 : 1;
+        }
+        Check(differentCorners == 0, path + ": " + std::to_string(differentCorners) + " corners differ from LoadObjFile");
+
+        const double megabytes = fs::file_size(path) / 1e6;
+        printf("%-44s %8.2f MB %4zu chunks  %8zu triangles  buffers %7zu of %7zu bytes  %8.1f MB/s\n", path.c_str(), megabytes, chunkCount,
+            corners.size() / 3, peakTrackedBytes, budget, megabytes / seconds);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    fs::path workDirectory;
+    size_t budget = 256 * 1024;
+    int rowCount = 400;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else if (argument == "--budget" && i + 1 < argc)
+        {
+            budget = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--rows" && i + 1 < argc)
+        {
+            rowCount = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: obj_stream_bench [--work-dir <dir>] [--budget <bytes>] [--rows <count>]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (budget < 136 * 1024 || rowCount < 2)
+    {
+        fprintf(stderr, "The budget has to be at least 136 KiB and there have to be at least 2 rows\n");
+        return 1;
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "obj_stream_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+
+    const std::string gridPath = (workDirectory / "grid.obj").string();
+    const std::string longLinePath = (workDirectory / "long_line.obj").string();
+    const size_t readBlockSize = OBJFileManager::StreamSettings::FromMemoryBudget(budget).readBlockSize;
+    size_t gridLongestLine = 0;
+    size_t longestLine = 0;
+    Check(WriteFile(gridPath, GenerateObj(rowCount, 0, gridLongestLine)) &&
+        WriteFile(longLinePath, GenerateObj(rowCount, readBlockSize + readBlockSize / 2, longestLine)), "writing the generated files");
+
+    RunFile(gridPath, budget, 0);
+    RunFile(longLinePath, budget, longestLine);
+    fs::remove(gridPath, error);
+    fs::remove(longLinePath, error);
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
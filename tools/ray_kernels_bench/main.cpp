@@ -0,0 +1,458 @@
+//Agreement test and benchmark of the SIMD ray tracing kernels.
+//Every instruction set the CPU supports has to give exactly what the scalar kernels give: the same hit lane and the same bits of t, u and v
+//for one ray against 8 triangles, and the same mask and entry distances for 8 rays against a box, with and without back face culling.
+//The cases are random, with many of the awkward ones mixed in: rays through corners and along edges, rays in the plane of a triangle,
+//degenerate and repeated triangles, empty lanes, directions with zero components and rays that start on a side of a box.
+//Then each instruction set is timed on packets that fit in the cache, in rays per second.
+//
+//Usage: ray_kernels_bench [--cases N] [--repeat N]
+
+#include "RayKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef RayKernels::InstructionSet InstructionSet;
+    typedef RayKernels::CullMode CullMode;
+    const uint32_t Width = RayKernels::Width;
+
+    //Fastest of repeat runs in seconds.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return std::max(best, 1e-9);
+    }
+
+    bool SameBits(float a, float b)
+    {
+        return memcmp(&a, &b, sizeof(float)) == 0;
+    }
+
+    struct Triangle
+    {
+        float v0[3];
+        float v1[3];
+        float v2[3];
+    };
+
+    struct Ray
+    {
+        float origin[3];
+        float direction[3];
+        float tMax;
+    };
+
+    class CaseGenerator
+    {
+    public:
+        explicit CaseGenerator(uint32_t seed) : random(seed), unit(-1.0f, 1.0f)
+        {
+        }
+
+        //A packet of triangles near the origin. Some lanes are empty, degenerate, or repeat another lane.
+        void MakeTriangles(RayKernels::TrianglePacket& packet, Triangle triangles[Width])
+        {
+            packet.Clear();
+            for (uint32_t lane = 0; lane < Width; lane++)
+            {
+                Triangle& triangle = triangles[lane];
+                const uint32_t kind = random() % 16;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    triangle.v0[axis] = unit(random);
+                    triangle.v1[axis] = unit(random);
+                    triangle.v2[axis] = unit(random);
+                }
+                if (kind == 0)
+                {
+                    //Empty lane.
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        triangle.v1[axis] = triangle.v2[axis] = triangle.v0[axis];
+                    }
+                    continue;
+                }
+                if (kind == 1)
+                {
+                    //All corners on a line.
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        triangle.v2[axis] = triangle.v0[axis] + 2.0f * (triangle.v1[axis] - triangle.v0[axis]);
+                    }
+                }
+                else if (kind == 2 && lane > 0)
+                {
+                    //The same triangle as another lane, so the two are hit at the same distance.
+                    triangle = triangles[random() % lane];
+                }
+                else if (kind == 3)
+                {
+                    //A triangle in an axis plane, which rays along an axis hit exactly at its corners and edges.
+                    triangle.v1[2] = triangle.v2[2] = triangle.v0[2];
+                }
+                packet.Set(lane, triangle.v0, triangle.v1, triangle.v2);
+            }
+        }
+
+        //A ray towards a point of one of the triangles, a corner, a point on an edge, or a random point.
+        Ray MakeRay(const Triangle triangles[Width])
+        {
+            Ray ray;
+            const Triangle& triangle = triangles[random() % Width];
+            float target[3];
+            const uint32_t kind = random() % 8;
+            float a = 0.5f * (unit(random) + 1.0f);
+            float b = 0.5f * (unit(random) + 1.0f) * (1.0f - a);
+            if (kind == 0)
+            {
+                a = 0.0f;
+                b = 0.0f;
+            }
+            else if (kind == 1)
+            {
+                b = 1.0f - a;
+            }
+            for (int axis = 0; axis < 3; axis++)
+            {
+                target[axis] = kind == 7 ? unit(random) : triangle.v0[axis] + a * (triangle.v1[axis] - triangle.v0[axis]) + b * (triangle.v2[axis] - triangle.v0[axis]);
+                ray.origin[axis] = 3.0f * unit(random);
+            }
+            if (random() % 8 == 0)
+            {
+                //Along an axis.
+                const int axis = (int)(random() % 3);
+                for (int other = 0; other < 3; other++)
+                {
+                    ray.origin[other] = other == axis ? ray.origin[other] : target[other];
+                }
+            }
+            else if (random() % 16 == 0)
+            {
+                //In the plane of the triangle.
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    ray.origin[axis] = triangle.v0[axis] + 2.0f * (triangle.v0[axis] - target[axis]);
+                }
+            }
+            for (int axis = 0; axis < 3; axis++)
+            {
+                ray.direction[axis] = target[axis] - ray.origin[axis];
+            }
+            ray.tMax = random() % 4 == 0 ? 0.5f * (unit(random) + 1.0f) : 1e30f;
+            return ray;
+        }
+
+        //A box and 8 rays, half of them aimed at it, some of them parallel to a side of it or starting on one.
+        void MakeBox(float boundsMin[3], float boundsMax[3], RayKernels::RayPacket& rays)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float a = unit(random);
+                float b = random() % 8 == 0 ? a : unit(random);
+                boundsMin[axis] = std::min(a, b);
+                boundsMax[axis] = std::max(a, b);
+            }
+            for (uint32_t lane = 0; lane < Width; lane++)
+            {
+                float origin[3];
+                float direction[3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    const uint32_t kind = random() % 8;
+                    origin[axis] = kind == 0 ? boundsMin[axis] : kind == 1 ? boundsMax[axis] : 3.0f * unit(random);
+                    direction[axis] = random() % 6 == 0 ? 0.0f : unit(random);
+                }
+                if (random() % 2 == 0)
+                {
+                    //Towards a point of the box, keeping the zero components.
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        const float target = boundsMin[axis] + 0.5f * (unit(random) + 1.0f) * (boundsMax[axis] - boundsMin[axis]);
+                        direction[axis] = direction[axis] == 0.0f ? 0.0f : target - origin[axis];
+                    }
+                }
+                const uint32_t kind = random() % 8;
+                rays.Set(lane, origin, direction, kind == 0 ? -1.0f : kind == 1 ? 0.5f * (unit(random) + 1.0f) : 1e30f);
+            }
+        }
+
+    private:
+        std::mt19937 random;
+        std::uniform_real_distribution<float> unit;
+    };
+
+    std::vector<InstructionSet> GetInstructionSets()
+    {
+        std::vector<InstructionSet> instructionSets;
+        for (InstructionSet instructionSet : { InstructionSet::Scalar, InstructionSet::Sse4, InstructionSet::Avx2 })
+        {
+            if ((int)instructionSet <= (int)RayKernels::GetSupportedInstructionSet())
+            {
+                instructionSets.push_back(instructionSet);
+            }
+        }
+        return instructionSets;
+    }
+
+    bool CheckTriangles(uint32_t caseCount)
+    {
+        const std::vector<InstructionSet> instructionSets = GetInstructionSets();
+        std::vector<uint64_t> mismatches(instructionSets.size(), 0);
+        uint64_t hits[2] = {};
+        CaseGenerator generator(1);
+        RayKernels::TrianglePacket packet;
+        Triangle triangles[Width];
+        for (uint32_t i = 0; i < caseCount; i++)
+        {
+            if (i % 16 == 0)
+            {
+                generator.MakeTriangles(packet, triangles);
+            }
+            const Ray ray = generator.MakeRay(triangles);
+            for (int cull = 0; cull < 2; cull++)
+            {
+                const CullMode cullMode = cull == 0 ? CullMode::None : CullMode::BackFacing;
+                //A ray that hits is tested again with the distance it found, like a traversal that comes back to the same leaf,
+                //where nothing is closer and a hit exactly at tMax must not count.
+                float tMax = ray.tMax;
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    //The reference, the scalar test of every lane in order.
+                    float tExpected = tMax, uExpected = -1.0f, vExpected = -1.0f;
+                    int expectedLane = -1;
+                    for (uint32_t lane = 0; lane < Width; lane++)
+                    {
+                        const float v0[3] = { packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane] };
+                        const float edge1[3] = { packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane] };
+                        const float edge2[3] = { packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane] };
+                        if (RayKernels::IntersectTriangle(v0, edge1, edge2, ray.origin, ray.direction, cullMode, tExpected, uExpected, vExpected))
+                        {
+                            expectedLane = (int)lane;
+                        }
+                    }
+                    hits[cull] += pass == 0 && expectedLane >= 0 ? 1 : 0;
+                    for (size_t set = 0; set < instructionSets.size(); set++)
+                    {
+                        RayKernels::SetInstructionSet(instructionSets[set]);
+                        float t = tMax, u = -1.0f, v = -1.0f;
+                        const int lane = RayKernels::IntersectTriangles(packet, ray.origin, ray.direction, cullMode, t, u, v);
+                        const bool same = lane == expectedLane && SameBits(t, tExpected) && SameBits(u, uExpected) && SameBits(v, vExpected);
+                        mismatches[set] += same ? 0 : 1;
+                    }
+                    if (expectedLane < 0)
+                    {
+                        break;
+                    }
+                    tMax = tExpected;
+                }
+            }
+        }
+        RayKernels::SetInstructionSet(RayKernels::GetSupportedInstructionSet());
+
+        bool succeeded = true;
+        printf("one ray against 8 triangles: %u rays, %.1f%% hit without culling, %.1f%% with back faces culled\n", caseCount,
+            100.0 * hits[0] / caseCount, 100.0 * hits[1] / caseCount);
+        for (size_t set = 0; set < instructionSets.size(); set++)
+        {
+            printf("  %-8s %s\n", RayKernels::GetName(instructionSets[set]),
+                mismatches[set] == 0 ? "same as scalar" : (std::to_string(mismatches[set]) + " MISMATCHES").c_str());
+            succeeded = succeeded && mismatches[set] == 0;
+        }
+        return succeeded;
+    }
+
+    bool CheckBoxes(uint32_t caseCount)
+    {
+        const std::vector<InstructionSet> instructionSets = GetInstructionSets();
+        std::vector<uint64_t> mismatches(instructionSets.size(), 0);
+        uint64_t hits = 0;
+        CaseGenerator generator(2);
+        RayKernels::RayPacket rays;
+        for (uint32_t i = 0; i < caseCount; i++)
+        {
+            float boundsMin[3];
+            float boundsMax[3];
+            generator.MakeBox(boundsMin, boundsMax, rays);
+            float expected[Width];
+            uint32_t expectedMask = 0;
+            for (uint32_t lane = 0; lane < Width; lane++)
+            {
+                const float origin[3] = { rays.origin[0][lane], rays.origin[1][lane], rays.origin[2][lane] };
+                const float inverseDirection[3] = { rays.inverseDirection[0][lane], rays.inverseDirection[1][lane], rays.inverseDirection[2][lane] };
+                expected[lane] = RayKernels::IntersectBoxScalar(boundsMin, boundsMax, origin, inverseDirection, rays.tMax[lane]);
+                expectedMask |= expected[lane] >= 0.0f ? 1u << lane : 0u;
+            }
+            for (uint32_t lane = 0; lane < Width; lane++)
+            {
+                hits += (expectedMask >> lane) & 1;
+            }
+            for (size_t set = 0; set < instructionSets.size(); set++)
+            {
+                RayKernels::SetInstructionSet(instructionSets[set]);
+                float tEnter[Width];
+                const uint32_t mask = RayKernels::IntersectBox(rays, boundsMin, boundsMax, tEnter);
+                bool same = mask == expectedMask;
+                for (uint32_t lane = 0; lane < Width; lane++)
+                {
+                    same = same && (!((mask >> lane) & 1) || SameBits(tEnter[lane], expected[lane]));
+                }
+                mismatches[set] += same ? 0 : 1;
+            }
+        }
+        RayKernels::SetInstructionSet(RayKernels::GetSupportedInstructionSet());
+
+        bool succeeded = true;
+        printf("8 rays against a box: %u boxes, %.1f%% of the rays hit\n", caseCount, 100.0 * hits / ((double)caseCount * Width));
+        for (size_t set = 0; set < instructionSets.size(); set++)
+        {
+            printf("  %-8s %s\n", RayKernels::GetName(instructionSets[set]),
+                mismatches[set] == 0 ? "same as scalar" : (std::to_string(mismatches[set]) + " MISMATCHES").c_str());
+            succeeded = succeeded && mismatches[set] == 0;
+        }
+        return succeeded;
+    }
+
+    //Rays through a cloud of small triangles, each ray against every packet, like the leaves a ray visits in a hierarchy.
+    void BenchmarkTriangles(int repeat)
+    {
+        const uint32_t packetCount = 1024;
+        const uint32_t rayCount = 512;
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<RayKernels::TrianglePacket> packets(packetCount);
+        for (RayKernels::TrianglePacket& packet : packets)
+        {
+            for (uint32_t lane = 0; lane < Width; lane++)
+            {
+                float v0[3], v1[3], v2[3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    v0[axis] = unit(random);
+                    v1[axis] = v0[axis] + 0.3f * unit(random);
+                    v2[axis] = v0[axis] + 0.3f * unit(random);
+                }
+                packet.Set(lane, v0, v1, v2);
+            }
+        }
+        std::vector<Ray> rays(rayCount);
+        for (Ray& ray : rays)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                ray.origin[axis] = 3.0f * unit(random);
+                ray.direction[axis] = 0.5f * unit(random) - ray.origin[axis];
+            }
+        }
+
+        printf("one ray against 8 triangles, %u rays against %u packets:\n", rayCount, packetCount);
+        double scalarTime = 0.0;
+        for (InstructionSet instructionSet : GetInstructionSets())
+        {
+            RayKernels::SetInstructionSet(instructionSet);
+            for (int cull = 0; cull < 2; cull++)
+            {
+                const CullMode cullMode = cull == 0 ? CullMode::None : CullMode::BackFacing;
+                double time = BestTime(repeat, [&]()
+                    {
+                        for (const Ray& ray : rays)
+                        {
+                            float t = 1e30f, u, v;
+                            for (const RayKernels::TrianglePacket& packet : packets)
+                            {
+                                RayKernels::IntersectTriangles(packet, ray.origin, ray.direction, cullMode, t, u, v);
+                            }
+                        }
+                    });
+                const double tests = (double)rayCount * packetCount;
+                scalarTime = instructionSet == InstructionSet::Scalar && cull == 0 ? time : scalarTime;
+                std::string label = std::string(RayKernels::GetName(instructionSet)) + (cull == 0 ? "" : ", culled");
+                printf("  %-16s %8.1f Mrays/s against 8 triangles   %8.1f M ray-triangle tests/s   x%.2f\n", label.c_str(), tests / time / 1e6,
+                    tests * Width / time / 1e6, scalarTime / time);
+            }
+        }
+        RayKernels::SetInstructionSet(RayKernels::GetSupportedInstructionSet());
+    }
+
+    void BenchmarkBoxes(int repeat)
+    {
+        const uint32_t boxCount = 4096;
+        const uint32_t packetCount = 64;
+        CaseGenerator generator(4);
+        std::vector<float> bounds(6 * (size_t)boxCount);
+        std::vector<RayKernels::RayPacket> packets(packetCount);
+        for (uint32_t box = 0; box < boxCount; box++)
+        {
+            generator.MakeBox(&bounds[6 * (size_t)box], &bounds[6 * (size_t)box + 3], packets[box % packetCount]);
+        }
+
+        printf("8 rays against a box, %u packets against %u boxes:\n", packetCount, boxCount);
+        double scalarTime = 0.0;
+        for (InstructionSet instructionSet : GetInstructionSets())
+        {
+            RayKernels::SetInstructionSet(instructionSet);
+            double time = BestTime(repeat, [&]()
+                {
+                    float tEnter[Width];
+                    for (const RayKernels::RayPacket& packet : packets)
+                    {
+                        for (uint32_t box = 0; box < boxCount; box++)
+                        {
+                            RayKernels::IntersectBox(packet, &bounds[6 * (size_t)box], &bounds[6 * (size_t)box + 3], tEnter);
+                        }
+                    }
+                });
+            const double rays = (double)packetCount * boxCount * Width;
+            scalarTime = instructionSet == InstructionSet::Scalar ? time : scalarTime;
+            printf("  %-16s %8.1f Mrays/s against a box   x%.2f\n", RayKernels::GetName(instructionSet), rays / time / 1e6, scalarTime / time);
+        }
+        RayKernels::SetInstructionSet(RayKernels::GetSupportedInstructionSet());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t caseCount = 1000000;
+    int repeat = 5;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--cases" && i + 1 < argc)
+        {
+            caseCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else
+        {
+            fprintf(stderr, "Usage: ray_kernels_bench [--cases N] [--repeat N]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+
+    printf("CPU supports %s\n\n", RayKernels::GetName(RayKernels::GetSupportedInstructionSet()));
+    bool succeeded = CheckTriangles(caseCount);
+    succeeded = CheckBoxes(caseCount) && succeeded;
+    printf("\n");
+    BenchmarkTriangles(repeat);
+    BenchmarkBoxes(repeat);
+    return succeeded ? 0 : 1;
+}
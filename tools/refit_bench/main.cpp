@@ -0,0 +1,333 @@
+//Benchmark of refitting the CPU BVH of a deforming mesh instead of building it again, what BottomLevelASGenerator::Generate(updateOnly) does
+//for the driver. The model (the full detail level of all its parts) and a generated torus are animated for a number of frames with three
+//deformations: a wave that moves every vertex a little, a twist that grows every frame, and a bump that travels over the mesh and moves few
+//vertices. Each frame the hierarchy is refit with the vertices that moved since the last frame, once with a pool of 1 worker and once with
+//the largest pool, and both have to give the same nodes. It is also built from scratch for comparison: the refit has to give the same closest
+//hits as the new build for random rays and validate, and its time and SAH cost are reported against the build's. The refit rebuilds by itself
+//once its SAH cost is Settings::rebuildThreshold times the cost it was built with, which the twist runs into.
+//
+//Usage: refit_bench [--triangles N] [--frames N] [--rays N] [model.obj ...]    (models/teapot.obj when no model is given)
+
+#include "Bvh.h"
+#include "ModelLoadTask.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Mesh
+    {
+        std::string name;
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    enum class Deformation
+    {
+        Wave,
+        Twist,
+        Bump,
+    };
+
+    const char* const DeformationNames[] = { "wave", "twist", "bump" };
+
+    double Time(const std::function<void()>& run)
+    {
+        Clock::time_point start = Clock::now();
+        run();
+        return std::max(1e-9, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    //Torus of about triangleCount triangles with a wavy surface.
+    Mesh GenerateTorus(size_t triangleCount)
+    {
+        Mesh mesh;
+        size_t side = std::max<size_t>(3, (size_t)std::sqrt((double)triangleCount / 2.0));
+        mesh.name = "torus " + std::to_string(side) + "x" + std::to_string(side);
+        mesh.vertices.resize(side * side);
+        const double pi = 3.14159265358979323846;
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                double u = 2.0 * pi * i / side;
+                double v = 2.0 * pi * j / side;
+                double r = 1.0 + 0.05 * std::sin(7.0 * u) * std::cos(5.0 * v);
+                MeshCache::Vertex& vertex = mesh.vertices[i * side + j];
+                vertex.position[0] = (float)((3.0 + r * std::cos(v)) * std::cos(u));
+                vertex.position[1] = (float)((3.0 + r * std::cos(v)) * std::sin(u));
+                vertex.position[2] = (float)(r * std::sin(v));
+            }
+        }
+        mesh.indices.reserve(side * side * 6);
+        for (size_t i = 0; i < side; i++)
+        {
+            for (size_t j = 0; j < side; j++)
+            {
+                uint32_t a = (uint32_t)(i * side + j);
+                uint32_t b = (uint32_t)(((i + 1) % side) * side + j);
+                uint32_t c = (uint32_t)(((i + 1) % side) * side + (j + 1) % side);
+                uint32_t d = (uint32_t)(i * side + (j + 1) % side);
+                mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+            }
+        }
+        return mesh;
+    }
+
+    //The full detail level of every part of the model, the geometry the renderer builds its bottom level acceleration structures from.
+    bool LoadModel(const std::string& path, Mesh& mesh)
+    {
+        ModelLoadTask task;
+        std::vector<uint32_t> indices;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        task.Start(path);
+        task.Wait();
+        if (!task.TakeResult(mesh.vertices, indices, &lods, &parts))
+        {
+            return false;
+        }
+        mesh.name = path;
+        for (const MeshCache::Part& part : parts)
+        {
+            const MeshCache::Lod& lod = lods[part.firstLod];
+            mesh.indices.insert(mesh.indices.end(), indices.begin() + lod.firstIndex, indices.begin() + lod.firstIndex + lod.indexCount);
+        }
+        return true;
+    }
+
+    //The rest pose deformed for frame of frameCount. Frame 0 is the rest pose.
+    void Deform(const std::vector<MeshCache::Vertex>& rest, const float boundsMin[3], const float boundsMax[3], Deformation deformation, uint32_t frame,
+        uint32_t frameCount, std::vector<MeshCache::Vertex>& deformed)
+    {
+        float center[3], size = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            center[axis] = 0.5f * (boundsMin[axis] + boundsMax[axis]);
+            size = std::max(size, boundsMax[axis] - boundsMin[axis]);
+        }
+        const float progress = (float)frame / (float)frameCount;
+        deformed = rest;
+        for (MeshCache::Vertex& vertex : deformed)
+        {
+            float* p = vertex.position;
+            const float x = (p[0] - center[0]) / size;
+            if (deformation == Deformation::Wave)
+            {
+                p[2] += 0.02f * size * std::sin(12.0f * x + 6.2831853f * progress) * std::min(1.0f, 4.0f * progress);
+            }
+            else if (deformation == Deformation::Twist)
+            {
+                //Rotation about the x axis by an angle that grows along it, half a turn from one end to the other at the last frame.
+                const float angle = 3.1415927f * x * progress;
+                const float y = p[1] - center[1], z = p[2] - center[2];
+                p[1] = center[1] + y * std::cos(angle) - z * std::sin(angle);
+                p[2] = center[2] + y * std::sin(angle) + z * std::cos(angle);
+            }
+            else
+            {
+                //A bump that crosses the mesh along x and lifts what is within a tenth of the size of its center.
+                const float dx = x - (progress - 0.5f), dy = (p[1] - center[1]) / size;
+                const float falloff = 1.0f - (dx * dx + dy * dy) / 0.01f;
+                if (frame > 0 && falloff > 0.0f)
+                {
+                    p[2] += 0.1f * size * falloff * falloff;
+                }
+            }
+        }
+    }
+
+    bool SameHierarchy(const Bvh& a, const Bvh& b)
+    {
+        return a.GetNodeCount() == b.GetNodeCount() && a.GetTriangleCount() == b.GetTriangleCount() &&
+            memcmp(a.GetNodes(), b.GetNodes(), a.GetNodeCount() * sizeof(Bvh::Node)) == 0 &&
+            memcmp(a.GetTriangles(), b.GetTriangles(), a.GetTriangleCount() * sizeof(Bvh::Triangle)) == 0;
+    }
+
+    //Rays from a sphere around the mesh towards random points inside its bounds have to hit at the same distances in both hierarchies. The
+    //triangle tests are the same and only the order they are done in differs, so the closest distances are equal.
+    bool SameHits(const Bvh& refit, const Bvh& built, uint32_t rayCount, uint32_t seed)
+    {
+        const Bvh::Node& root = built.GetNodes()[0];
+        float center[3];
+        float radius = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            center[axis] = 0.5f * (root.boundsMin[axis] + root.boundsMax[axis]);
+            radius = std::max(radius, root.boundsMax[axis] - root.boundsMin[axis]);
+        }
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        for (uint32_t ray = 0; ray < rayCount; ray++)
+        {
+            float origin[3], direction[3];
+            float onSphere[3] = { unit(random), unit(random), unit(random) };
+            float length = std::max(1e-6f, std::sqrt(onSphere[0] * onSphere[0] + onSphere[1] * onSphere[1] + onSphere[2] * onSphere[2]));
+            for (int axis = 0; axis < 3; axis++)
+            {
+                origin[axis] = center[axis] + 2.0f * radius * onSphere[axis] / length;
+                float target = root.boundsMin[axis] + (root.boundsMax[axis] - root.boundsMin[axis]) * 0.5f * (unit(random) + 1.0f);
+                direction[axis] = target - origin[axis];
+            }
+            Bvh::Hit refitHit, builtHit;
+            bool refitFound = refit.Intersect(origin, direction, FLT_MAX, refitHit);
+            bool builtFound = built.Intersect(origin, direction, FLT_MAX, builtHit);
+            if (refitFound != builtFound || (refitFound && refitHit.t != builtHit.t))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Run(const Mesh& mesh, uint32_t frameCount, uint32_t rayCount)
+    {
+        const size_t triangleCount = mesh.indices.size() / 3;
+        printf("%s: %zu vertices, %zu triangles\n", mesh.name.c_str(), mesh.vertices.size(), triangleCount);
+        const unsigned int workers = std::max(4u, std::thread::hardware_concurrency());
+        ThreadPool singlePool(1);
+        ThreadPool pool(workers);
+
+        Bvh rest;
+        if (!rest.Build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), nullptr, &pool))
+        {
+            printf("  build failed\n");
+            return false;
+        }
+        const Bvh::Node& root = rest.GetNodes()[0];
+
+        bool succeeded = true;
+        for (Deformation deformation : { Deformation::Wave, Deformation::Twist, Deformation::Bump })
+        {
+            //Refit with 1 worker and with the largest pool, in step.
+            Bvh refit[2] = { rest, rest };
+            std::vector<MeshCache::Vertex> previous = mesh.vertices, vertices;
+            std::vector<uint8_t> moved(mesh.vertices.size());
+            double refitTotal = 0.0, buildTotal = 0.0;
+            uint32_t rebuilds = 0;
+            for (uint32_t frame = 1; frame <= frameCount; frame++)
+            {
+                Deform(mesh.vertices, root.boundsMin, root.boundsMax, deformation, frame, frameCount, vertices);
+                for (size_t vertex = 0; vertex < vertices.size(); vertex++)
+                {
+                    moved[vertex] = memcmp(vertices[vertex].position, previous[vertex].position, sizeof(vertices[vertex].position)) != 0;
+                }
+                previous = vertices;
+
+                Bvh::RefitStatistics statistics[2];
+                bool refitSucceeded = true;
+                double refitTime[2];
+                for (int i = 0; i < 2; i++)
+                {
+                    refitTime[i] = Time([&]()
+                        {
+                            refitSucceeded = refit[i].Refit(vertices.data(), vertices.size(), mesh.indices.data(), mesh.indices.size(), moved.data(),
+                                i == 0 ? &singlePool : &pool, &statistics[i]) && refitSucceeded;
+                        });
+                }
+                Bvh built;
+                double buildTime = Time([&]() { built.Build(vertices.data(), vertices.size(), mesh.indices.data(), mesh.indices.size(), nullptr, &pool); });
+                if (!refitSucceeded)
+                {
+                    printf("  %s: refit failed\n", DeformationNames[(int)deformation]);
+                    return false;
+                }
+
+                const bool deterministic = SameHierarchy(refit[0], refit[1]);
+                const bool valid = refit[1].Validate();
+                const bool sameHits = SameHits(refit[1], built, rayCount, frame);
+                succeeded = deterministic && valid && sameHits && succeeded;
+                if (statistics[1].rebuilt)
+                {
+                    rebuilds++;
+                }
+                else
+                {
+                    refitTotal += refitTime[1];
+                    buildTotal += buildTime;
+                }
+                printf("  %-5s %2u: refit %8.2f ms (1 worker %8.2f ms), build %8.2f ms, x%-6.1f %5.1f%% moved, %8u nodes refit, SAH %.2f x%.2f (built %.2f)%s   %s%s%s\n",
+                    DeformationNames[(int)deformation], frame, refitTime[1] * 1000.0, refitTime[0] * 1000.0, buildTime * 1000.0, buildTime / refitTime[1],
+                    100.0 * statistics[1].movedTriangles / triangleCount, statistics[1].refitNodes, statistics[1].sahCost, statistics[1].sahDegradation,
+                    built.ComputeSahCost(), statistics[1].rebuilt ? ", rebuilt" : "", deterministic ? "" : "DIFFERENT FROM 1 WORKER ", valid ? "" : "INVALID ",
+                    sameHits ? "same hits" : "DIFFERENT HITS");
+            }
+            if (refitTotal > 0.0)
+            {
+                printf("  %-5s: refit x%.1f faster than building on the frames it didn't rebuild, %u rebuilds\n", DeformationNames[(int)deformation],
+                    buildTotal / refitTotal, rebuilds);
+            }
+        }
+        printf("\n");
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangleCount = 1000000;
+    uint32_t frameCount = 8;
+    uint32_t rayCount = 10000;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--triangles" && i + 1 < argc)
+        {
+            triangleCount = (size_t)std::max(0LL, atoll(argv[++i]));
+        }
+        else if (argument == "--frames" && i + 1 < argc)
+        {
+            frameCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--rays" && i + 1 < argc)
+        {
+            rayCount = (uint32_t)std::max(0, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            paths.push_back(argument);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: refit_bench [--triangles N] [--frames N] [--rays N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (paths.empty())
+    {
+        paths = { "models/teapot.obj" };
+    }
+
+    bool succeeded = true;
+    for (const std::string& path : paths)
+    {
+        Mesh mesh;
+        if (!LoadModel(path, mesh))
+        {
+            printf("%s: load failed\n", path.c_str());
+            succeeded = false;
+            continue;
+        }
+        succeeded = Run(mesh, frameCount, rayCount) && succeeded;
+    }
+    if (triangleCount > 0)
+    {
+        succeeded = Run(GenerateTorus(triangleCount), frameCount, rayCount) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+//Stress test of MeshResidency with a generated scene that does not fit in its memory budget.
+//The scene is a row of instances of generated meshes of 2K to 150K triangles, written into a pack file one mesh at a time.
+//A camera moves along the row. The instances in front of it are live and hold their mesh (pinned), and every frame also looks up a few
+//meshes further ahead the way a streaming system would prefetch them. Every mesh that is acquired is checked against the hash of the mesh that
+//was written, the live meshes are checked every few frames to catch a pinned mesh that was evicted, and the resident bytes are checked to stay
+//within the budget whenever the pinned meshes fit in it. Then several threads acquire and release random meshes at the same time.
+//The hit, miss and eviction counters and the paging speed are reported for both runs.
+//
+//Usage: residency_bench [--meshes N] [--budget MiB] [--frames N] [--threads N] [--pack FILE]    (the budget is a quarter of the scene by default)
+
+#include "MeshResidency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const uint32_t InstancesPerMesh = 3;
+    const uint32_t LiveInstances = 24;
+    const uint32_t PrefetchesPerFrame = 4;
+
+    //A wavy grid whose size and shape depend on the id of the mesh, so that every mesh has its own contents.
+    void GenerateMesh(uint32_t id, std::mt19937& random, std::vector<MeshCache::Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        //The triangle counts are spread evenly on a log scale from 2K to 150K.
+        const double triangles = 2000.0 * pow(75.0, std::uniform_real_distribution<double>(0.0, 1.0)(random));
+        const uint32_t side = std::max(2u, (uint32_t)sqrt(triangles / 2.0));
+        const float frequency = 1.0f + (float)(id % 7);
+        vertices.resize((size_t)(side + 1) * (side + 1));
+        indices.clear();
+        for (uint32_t y = 0; y <= side; y++)
+        {
+            for (uint32_t x = 0; x <= side; x++)
+            {
+                const float u = (float)x / side;
+                const float v = (float)y / side;
+                MeshCache::Vertex& vertex = vertices[(size_t)y * (side + 1) + x];
+                vertex.position[0] = u;
+                vertex.position[1] = 0.1f * sinf(frequency * 6.2831853f * u) * cosf(frequency * 6.2831853f * v);
+                vertex.position[2] = v + (float)id;
+                vertex.normal[0] = 0.0f;
+                vertex.normal[1] = 1.0f;
+                vertex.normal[2] = 0.0f;
+            }
+        }
+        for (uint32_t y = 0; y < side; y++)
+        {
+            for (uint32_t x = 0; x < side; x++)
+            {
+                const uint32_t corner = y * (side + 1) + x;
+                indices.insert(indices.end(), { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 });
+            }
+        }
+    }
+
+    uint64_t HashMesh(const MeshCache::Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+    {
+        return MeshCache::HashBytes(indices, indexCount * sizeof(uint32_t), MeshCache::HashBytes(vertices, vertexCount * sizeof(MeshCache::Vertex)));
+    }
+
+    //Checks the contents of an acquired mesh against what was written into the pack.
+    bool IsIntact(const MeshResidency::Mesh* mesh, uint64_t hash)
+    {
+        return mesh != nullptr && HashMesh(mesh->vertices, mesh->vertexCount, mesh->indices, mesh->indexCount) == hash;
+    }
+
+    //The meshes may only take more than the budget when the pinned meshes alone do.
+    bool IsWithinBudget(const MeshResidency::Statistics& statistics, size_t budget)
+    {
+        return statistics.residentBytes <= std::max(budget, statistics.pinnedBytes);
+    }
+
+    void PrintStatistics(const char* label, const MeshResidency::Statistics& statistics, double seconds, size_t budget)
+    {
+        const uint64_t acquires = statistics.hits + statistics.misses;
+        printf("  %-8s %9llu acquires   hit rate %5.1f%%   %7llu misses   %7llu evictions   paged in %8.1f MiB (%6.1f MiB/s)   peak %6.1f MiB of %6.1f MiB budget\n",
+            label, (unsigned long long)acquires, 100.0 * (double)statistics.hits / (double)std::max<uint64_t>(acquires, 1),
+            (unsigned long long)statistics.misses, (unsigned long long)statistics.evictions, (double)statistics.bytesPagedIn / 1048576.0,
+            (double)statistics.bytesPagedIn / 1048576.0 / std::max(seconds, 1e-9), (double)statistics.peakResidentBytes / 1048576.0, (double)budget / 1048576.0);
+    }
+
+    //Moves the camera along the row of instances. The instances in the window in front of it hold their mesh.
+    bool RunCamera(MeshResidency& residency, const std::vector<uint64_t>& hashes, uint32_t frames, size_t budget)
+    {
+        const uint32_t meshCount = (uint32_t)hashes.size();
+        const uint32_t instanceCount = meshCount * InstancesPerMesh;
+        std::mt19937 random(1);
+        //Instance i uses mesh i % meshCount, so every mesh is used by InstancesPerMesh instances spread along the row.
+        std::vector<const MeshResidency::Mesh*> live(instanceCount, nullptr);
+        bool succeeded = true;
+        uint64_t brokenBudget = 0;
+        uint64_t corrupted = 0;
+
+        Clock::time_point start = Clock::now();
+        for (uint32_t frame = 0; frame < frames && succeeded; frame++)
+        {
+            const uint32_t first = frame % instanceCount;
+            for (uint32_t i = 0; i < instanceCount; i++)
+            {
+                const bool inWindow = (i + instanceCount - first) % instanceCount < LiveInstances;
+                const uint32_t mesh = i % meshCount;
+                if (inWindow && live[i] == nullptr)
+                {
+                    live[i] = residency.Acquire(mesh);
+                    corrupted += IsIntact(live[i], hashes[mesh]) ? 0 : 1;
+                }
+                else if (!inWindow && live[i] != nullptr)
+                {
+                    residency.Release(mesh);
+                    live[i] = nullptr;
+                }
+                brokenBudget += IsWithinBudget(residency.GetStatistics(), budget) ? 0 : 1;
+            }
+            //Prefetches of instances up to four windows ahead, which are often evicted again before the camera gets there.
+            for (uint32_t i = 0; i < PrefetchesPerFrame; i++)
+            {
+                const uint32_t instance = (first + LiveInstances + (uint32_t)(random() % (4 * LiveInstances))) % instanceCount;
+                const uint32_t mesh = instance % meshCount;
+                corrupted += IsIntact(residency.Acquire(mesh), hashes[mesh]) ? 0 : 1;
+                residency.Release(mesh);
+                brokenBudget += IsWithinBudget(residency.GetStatistics(), budget) ? 0 : 1;
+            }
+            //A pinned mesh that was evicted anyway has lost its memory, which shows as a hash mismatch (or as an error under a sanitizer).
+            if (frame % 16 == 0)
+            {
+                for (uint32_t i = 0; i < instanceCount; i++)
+                {
+                    corrupted += live[i] == nullptr || IsIntact(live[i], hashes[i % meshCount]) ? 0 : 1;
+                }
+            }
+            succeeded = corrupted == 0 && brokenBudget == 0;
+        }
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            if (live[i] != nullptr)
+            {
+                residency.Release(i % meshCount);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        MeshResidency::Statistics statistics = residency.GetStatistics();
+        PrintStatistics("camera", statistics, seconds, budget);
+        succeeded = succeeded && statistics.pinnedMeshes == 0 && statistics.residentBytes <= budget && statistics.failures == 0;
+        if (!succeeded)
+        {
+            printf("  camera run FAILED: %llu corrupted meshes, %llu budget overruns, %u meshes still pinned\n",
+                (unsigned long long)corrupted, (unsigned long long)brokenBudget, statistics.pinnedMeshes);
+        }
+        return succeeded;
+    }
+
+    //Threads acquire random meshes, skewed towards the low ids, and hold a few of them at a time.
+    bool RunThreads(MeshResidency& residency, const std::vector<uint64_t>& hashes, uint32_t operations, uint32_t threadCount, size_t budget)
+    {
+        std::atomic<uint64_t> corrupted(0);
+        std::atomic<uint64_t> brokenBudget(0);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (uint32_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    std::mt19937 random(100 + t);
+                    std::geometric_distribution<uint32_t> pick(4.0 / (double)hashes.size());
+                    std::vector<uint32_t> held;
+                    for (uint32_t i = 0; i < operations; i++)
+                    {
+                        const uint32_t mesh = pick(random) % (uint32_t)hashes.size();
+                        const MeshResidency::Mesh* acquired = residency.Acquire(mesh);
+                        corrupted += IsIntact(acquired, hashes[mesh]) ? 0 : 1;
+                        if (acquired != nullptr)
+                        {
+                            held.push_back(mesh);
+                        }
+                        if (held.size() > 3)
+                        {
+                            residency.Release(held.front());
+                            held.erase(held.begin());
+                        }
+                        brokenBudget += IsWithinBudget(residency.GetStatistics(), budget) ? 0 : 1;
+                    }
+                    for (uint32_t mesh : held)
+                    {
+                        residency.Release(mesh);
+                    }
+                });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        MeshResidency::Statistics statistics = residency.GetStatistics();
+        PrintStatistics("threads", statistics, seconds, budget);
+        bool succeeded = corrupted == 0 && brokenBudget == 0 && statistics.pinnedMeshes == 0 && statistics.residentBytes <= budget && statistics.failures == 0;
+        if (!succeeded)
+        {
+            printf("  thread run FAILED: %llu corrupted meshes, %llu budget overruns, %u meshes still pinned\n",
+                (unsigned long long)corrupted.load(), (unsigned long long)brokenBudget.load(), statistics.pinnedMeshes);
+        }
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t meshCount = 160;
+    double budgetMiB = 0.0;
+    uint32_t frames = 2000;
+    uint32_t threadCount = 4;
+    std::string packPath = "residency_bench.rtpack";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--meshes" && i + 1 < argc)
+        {
+            meshCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--budget" && i + 1 < argc)
+        {
+            budgetMiB = std::max(0.0, atof(argv[++i]));
+        }
+        else if (argument == "--frames" && i + 1 < argc)
+        {
+            frames = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--threads" && i + 1 < argc)
+        {
+            threadCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--pack" && i + 1 < argc)
+        {
+            packPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: residency_bench [--meshes N] [--budget MiB] [--frames N] [--threads N] [--pack FILE]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+
+    //The meshes are generated and written one at a time, only their hashes are kept.
+    Clock::time_point start = Clock::now();
+    MeshResidency::PackWriter writer;
+    std::vector<uint64_t> hashes;
+    std::vector<MeshCache::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::mt19937 random(meshCount);
+    size_t sceneBytes = 0;
+    bool written = writer.Open(packPath);
+    for (uint32_t mesh = 0; mesh < meshCount && written; mesh++)
+    {
+        GenerateMesh(mesh, random, vertices, indices);
+        written = writer.Add(vertices.data(), vertices.size(), indices.data(), indices.size()) == mesh;
+        hashes.push_back(HashMesh(vertices.data(), vertices.size(), indices.data(), indices.size()));
+        sceneBytes += vertices.size() * sizeof(MeshCache::Vertex) + indices.size() * sizeof(uint32_t);
+    }
+    written = written && writer.Finish();
+    if (!written)
+    {
+        fprintf(stderr, "Could not write %s\n", packPath.c_str());
+        return 1;
+    }
+    const double writeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const size_t budget = budgetMiB > 0.0 ? (size_t)(budgetMiB * 1048576.0) : sceneBytes / 4;
+    MeshResidency residency;
+    if (!residency.Open(packPath, budget))
+    {
+        fprintf(stderr, "Could not open %s\n", packPath.c_str());
+        remove(packPath.c_str());
+        return 1;
+    }
+    FILE* pack = fopen(packPath.c_str(), "rb");
+    long packBytes = 0;
+    if (pack != nullptr)
+    {
+        fseek(pack, 0, SEEK_END);
+        packBytes = ftell(pack);
+        fclose(pack);
+    }
+    printf("%u meshes, %.1f MiB decoded, %.1f MiB pack written in %.2f s, budget %.1f MiB\n", meshCount, (double)sceneBytes / 1048576.0,
+        (double)packBytes / 1048576.0, writeSeconds, (double)budget / 1048576.0);
+
+    bool succeeded = RunCamera(residency, hashes, frames, budget);
+    residency.ResetCounters();
+    succeeded = RunThreads(residency, hashes, frames, threadCount, budget) && succeeded;
+
+    //Shrinking the budget drops the meshes that no longer fit right away.
+    residency.SetBudget(budget / 4);
+    MeshResidency::Statistics statistics = residency.GetStatistics();
+    const bool shrunk = statistics.residentBytes <= budget / 4;
+    printf("  budget cut to %.1f MiB: %.1f MiB in %u meshes resident%s\n", (double)(budget / 4) / 1048576.0, (double)statistics.residentBytes / 1048576.0,
+        statistics.residentMeshes, shrunk ? "" : ", FAILED");
+
+    residency.Close();
+    remove(packPath.c_str());
+    return succeeded && shrunk ? 0 : 1;
+}
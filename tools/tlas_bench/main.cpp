@@ -0,0 +1,321 @@
+//Benchmark of the two level CPU hierarchy, the counterpart of the top and bottom level acceleration structures of CreateAccelerationStructures.
+//The model is loaded with ModelLoadTask, one bottom level hierarchy is built over the full detail level of all its parts, and it is instanced
+//many times with random rotations, scales (some of them mirroring) and positions, the way the renderer instances one BLAS at every placement.
+//The top level build is timed with pools of 1 worker up to the hardware thread count, every build has to give the same nodes as the first one
+//and the hierarchy is validated. The memory of the instance records and the top level nodes is compared with what copying the geometry and
+//hierarchy of the mesh into every instance would take. Random rays are traced through it, with and without back face culling, and the
+//closest hits of some of them are compared with a loop over every instance. The any hit traversal has to find the rays that hit and nothing in
+//front of their closest hits.
+//
+//Usage: tlas_bench [--instances N] [--rays N] [--repeat N] [model.obj]    (models/teapot.obj when no model is given)
+
+#include "ModelLoadTask.h"
+#include "ThreadPool.h"
+#include "TopLevelBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //Rays checked against every instance are capped at about this many bottom level traversals.
+    const double BruteForceBudget = 2e7;
+
+    struct Mesh
+    {
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    //Fastest of repeat runs in seconds.
+    double BestTime(int repeat, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeat; i++)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            double time = std::chrono::duration<double>(Clock::now() - start).count();
+            best = i == 0 ? time : std::min(best, time);
+        }
+        return std::max(best, 1e-9);
+    }
+
+    //The full detail level of every part of the model, the geometry the renderer builds its bottom level acceleration structures from.
+    bool LoadModel(const std::string& path, Mesh& mesh)
+    {
+        ModelLoadTask task;
+        std::vector<uint32_t> indices;
+        std::vector<MeshCache::Lod> lods;
+        std::vector<MeshCache::Part> parts;
+        task.Start(path);
+        task.Wait();
+        if (!task.TakeResult(mesh.vertices, indices, &lods, &parts))
+        {
+            return false;
+        }
+        for (const MeshCache::Part& part : parts)
+        {
+            const MeshCache::Lod& lod = lods[part.firstLod];
+            mesh.indices.insert(mesh.indices.end(), indices.begin() + lod.firstIndex, indices.begin() + lod.firstIndex + lod.indexCount);
+        }
+        return true;
+    }
+
+    //Instances of the bottom level hierarchy spread over a cube, about two model sizes apart on average so that their boxes overlap here and there.
+    std::vector<TopLevelBvh::Instance> GenerateInstances(const Bvh& blas, uint32_t instanceCount, float& sceneSize)
+    {
+        const Bvh::Node& root = blas.GetNodes()[0];
+        float modelSize = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            modelSize = std::max(modelSize, root.boundsMax[axis] - root.boundsMin[axis]);
+        }
+        sceneSize = 2.0f * modelSize * std::cbrt((float)instanceCount);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<TopLevelBvh::Instance> instances(instanceCount);
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            //Rotation about a random axis (Rodrigues), a uniform scale and a mirror for every eighth instance.
+            float axis[3] = { unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f };
+            const float length = std::max(1e-6f, std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]));
+            for (float& component : axis)
+            {
+                component /= length;
+            }
+            const float angle = 6.2831853f * unit(random);
+            const float c = std::cos(angle), s = std::sin(angle), k = 1.0f - c;
+            const float rotation[3][3] = {
+                { c + axis[0] * axis[0] * k, axis[0] * axis[1] * k - axis[2] * s, axis[0] * axis[2] * k + axis[1] * s },
+                { axis[1] * axis[0] * k + axis[2] * s, c + axis[1] * axis[1] * k, axis[1] * axis[2] * k - axis[0] * s },
+                { axis[2] * axis[0] * k - axis[1] * s, axis[2] * axis[1] * k + axis[0] * s, c + axis[2] * axis[2] * k } };
+            const float scale = 0.5f + unit(random);
+            const float mirror = i % 8 == 7 ? -1.0f : 1.0f;
+            TopLevelBvh::Instance& instance = instances[i];
+            instance.blas = &blas;
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 3; column++)
+                {
+                    instance.transform[row][column] = rotation[row][column] * scale * (column == 0 ? mirror : 1.0f);
+                }
+                instance.transform[row][3] = sceneSize * unit(random);
+            }
+            instance.hitGroupIndex = 0;
+            instance.materialIndex = i;
+        }
+        return instances;
+    }
+
+    bool SameHierarchy(const Bvh& a, const Bvh& b)
+    {
+        return a.GetNodeCount() == b.GetNodeCount() && a.GetTriangleCount() == b.GetTriangleCount() &&
+            memcmp(a.GetNodes(), b.GetNodes(), a.GetNodeCount() * sizeof(Bvh::Node)) == 0 &&
+            memcmp(a.GetTriangleIndices(), b.GetTriangleIndices(), a.GetTriangleCount() * sizeof(uint32_t)) == 0;
+    }
+
+    //What the top level hierarchy replaces: every instance in order, each keeping a hit only if it is closer than the ones before.
+    bool IntersectAll(const TopLevelBvh& topLevel, const float origin[3], const float direction[3], RayKernels::CullMode cull, TopLevelBvh::Hit& hit)
+    {
+        bool found = false;
+        float closest = FLT_MAX;
+        for (uint32_t instance = 0; instance < topLevel.GetInstanceCount(); instance++)
+        {
+            float objectOrigin[3], objectDirection[3];
+            topLevel.ToObjectSpace(instance, origin, direction, objectOrigin, objectDirection);
+            Bvh::Hit instanceHit;
+            if (topLevel.GetInstance(instance).blas->Intersect(objectOrigin, objectDirection, closest, instanceHit, cull))
+            {
+                closest = instanceHit.t;
+                hit = { instanceHit.t, instance, instanceHit.triangle, instanceHit.u, instanceHit.v };
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    //Rays from a sphere around the scene towards random points inside it, the odd ones with back faces culled. The closest hits of the first
+    //ones have to be the hits of the loop over every instance, the same instance, triangle and distance. Occluded() has to find the same rays
+    //and nothing in front of their closest hits.
+    bool CheckRays(const TopLevelBvh& topLevel, float sceneSize, uint32_t rayCount, int repeat)
+    {
+        std::mt19937 random(2);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<float> rays(6 * (size_t)rayCount);
+        for (uint32_t ray = 0; ray < rayCount; ray++)
+        {
+            float* origin = &rays[6 * (size_t)ray];
+            float* direction = origin + 3;
+            float onSphere[3] = { unit(random), unit(random), unit(random) };
+            float length = std::max(1e-6f, std::sqrt(onSphere[0] * onSphere[0] + onSphere[1] * onSphere[1] + onSphere[2] * onSphere[2]));
+            for (int axis = 0; axis < 3; axis++)
+            {
+                origin[axis] = 0.5f * sceneSize + sceneSize * onSphere[axis] / length;
+                direction[axis] = 0.5f * sceneSize * (unit(random) + 1.0f) - origin[axis];
+            }
+        }
+        auto cullOf = [](uint32_t ray) { return ray % 2 == 1 ? RayKernels::CullMode::BackFacing : RayKernels::CullMode::None; };
+
+        std::vector<TopLevelBvh::Hit> hits(rayCount);
+        std::vector<uint8_t> hitFound(rayCount);
+        const double traversalTime = BestTime(repeat, [&]()
+            {
+                for (uint32_t ray = 0; ray < rayCount; ray++)
+                {
+                    hitFound[ray] = topLevel.Intersect(&rays[6 * (size_t)ray], &rays[6 * (size_t)ray + 3], FLT_MAX, hits[ray], cullOf(ray));
+                }
+            });
+        uint32_t occludedCount = 0;
+        const double occlusionTime = BestTime(repeat, [&]()
+            {
+                occludedCount = 0;
+                for (uint32_t ray = 0; ray < rayCount; ray++)
+                {
+                    occludedCount += topLevel.Occluded(&rays[6 * (size_t)ray], &rays[6 * (size_t)ray + 3], FLT_MAX, cullOf(ray)) ? 1 : 0;
+                }
+            });
+
+        const uint32_t checkedCount = (uint32_t)std::min<double>(rayCount, std::max(64.0, BruteForceBudget / (double)topLevel.GetInstanceCount()));
+        uint32_t mismatches = 0;
+        uint32_t hitCount = 0;
+        for (uint32_t ray = 0; ray < rayCount; ray++)
+        {
+            const float* origin = &rays[6 * (size_t)ray];
+            const float* direction = origin + 3;
+            //The any hit traversal finds nothing in front of the closest hit.
+            if (hitFound[ray] && topLevel.Occluded(origin, direction, hits[ray].t, cullOf(ray)))
+            {
+                mismatches++;
+            }
+            if (ray >= checkedCount)
+            {
+                continue;
+            }
+            TopLevelBvh::Hit expected;
+            bool expectedFound = IntersectAll(topLevel, origin, direction, cullOf(ray), expected);
+            hitCount += expectedFound ? 1 : 0;
+            mismatches += expectedFound != (hitFound[ray] != 0) || (expectedFound && (expected.t != hits[ray].t || expected.instance != hits[ray].instance ||
+                expected.triangle != hits[ray].triangle)) ? 1 : 0;
+        }
+        uint32_t foundCount = 0;
+        for (uint8_t found : hitFound)
+        {
+            foundCount += found;
+        }
+        mismatches += occludedCount != foundCount ? 1 : 0;
+
+        printf("  rays: %u traced at %.2f Mrays/s closest hit and %.2f Mrays/s any hit (%u hit), %u checked against every instance (%u hit): %s\n", rayCount,
+            rayCount / traversalTime / 1e6, rayCount / occlusionTime / 1e6, foundCount, checkedCount, hitCount,
+            mismatches == 0 ? "same hits" : (std::to_string(mismatches) + " MISMATCHES").c_str());
+        return mismatches == 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t instanceCount = 100000;
+    uint32_t rayCount = 100000;
+    int repeat = 3;
+    std::string path = "models/teapot.obj";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--instances" && i + 1 < argc)
+        {
+            instanceCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--rays" && i + 1 < argc)
+        {
+            rayCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            path = argument;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: tlas_bench [--instances N] [--rays N] [--repeat N] [model.obj]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+
+    Mesh mesh;
+    Bvh blas;
+    if (!LoadModel(path, mesh) || !blas.Build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size()))
+    {
+        printf("%s: load failed\n", path.c_str());
+        return 1;
+    }
+    float sceneSize;
+    const std::vector<TopLevelBvh::Instance> instances = GenerateInstances(blas, instanceCount, sceneSize);
+    printf("%s: %u triangles, %u instances\n", path.c_str(), blas.GetTriangleCount(), instanceCount);
+
+    unsigned int hardwareThreads = std::max(4u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> workerCounts;
+    for (unsigned int workers = 1; workers < hardwareThreads; workers *= 2)
+    {
+        workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(hardwareThreads);
+
+    bool succeeded = true;
+    TopLevelBvh first;
+    double firstTime = 0.0;
+    for (unsigned int workers : workerCounts)
+    {
+        ThreadPool pool(workers);
+        TopLevelBvh topLevel;
+        bool built = true;
+        double time = BestTime(repeat, [&]() { built = topLevel.Build(instances.data(), instances.size(), nullptr, &pool) && built; });
+        if (!built)
+        {
+            printf("  build failed\n");
+            return 1;
+        }
+        bool deterministic = true;
+        if (first.GetInstanceCount() == 0)
+        {
+            first = topLevel;
+            firstTime = time;
+        }
+        else
+        {
+            deterministic = SameHierarchy(first.GetHierarchy(), topLevel.GetHierarchy());
+            succeeded = deterministic && succeeded;
+        }
+        std::string label = std::to_string(workers) + (workers == 1 ? " worker" : " workers");
+        printf("  %-12s %10.2f ms %8.2f Minstances/s   x%.2f   %s\n", label.c_str(), time * 1000.0, instanceCount / time / 1e6, firstTime / time,
+            deterministic ? "same nodes as 1 worker" : "DIFFERENT FROM 1 WORKER");
+    }
+    Bvh::Statistics statistics = first.GetHierarchy().ComputeStatistics();
+    bool valid = first.GetHierarchy().Validate();
+    succeeded = valid && succeeded;
+    printf("  %u nodes, %u leaves, depth %u, %.2f instances per leaf (at most %u), SAH cost %.2f, %s\n", statistics.nodeCount, statistics.leafCount,
+        statistics.maxDepth, statistics.averageLeafSize, statistics.maxLeafSize, statistics.sahCost, valid ? "valid" : "INVALID");
+
+    //Flattening copies the triangles, their indices and the nodes of the mesh into every instance.
+    const double blasBytes = (double)blas.GetNodeCount() * sizeof(Bvh::Node) + blas.GetTriangleCount() * (sizeof(Bvh::Triangle) + sizeof(uint32_t));
+    const double topLevelBytes = (double)first.GetMemorySize();
+    printf("  memory: %.2f MB for the instances (%.0f bytes each) and %.2f MB for the shared mesh, flattened %.2f MB (x%.0f)\n", topLevelBytes / 1e6,
+        topLevelBytes / instanceCount, blasBytes / 1e6, blasBytes * instanceCount / 1e6, blasBytes * instanceCount / (topLevelBytes + blasBytes));
+
+    succeeded = CheckRays(first, sceneSize, rayCount, repeat) && succeeded;
+    return succeeded ? 0 : 1;
+}
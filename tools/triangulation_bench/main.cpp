@@ -0,0 +1,577 @@
+//Check and benchmark of the polygon triangulation of objl::Loader.
+//Every test polygon is written to an .obj file with one object per polygon and loaded with objl::Loader, so the faces take the path
+//the loader gives them. The polygons are convex, concave, have collinear or duplicate points, touch themselves or cross themselves,
+//and each of them is placed in three planes with both windings. The triangles of every face are checked against the 2D polygon it was
+//made from: there have to be n - 2 of them over the face's own corners, and the more regular the polygon, the more has to hold:
+//  closed  any face: the indices are valid and no triangle uses a corner twice
+//  weak    polygons with duplicate points or that touch themselves: the triangles face the way of the polygon and add up to its area
+//  simple  simple polygons: also no triangle edge crosses an edge of the polygon, so the triangles tile it
+//The same checks are run on the triangulator objl used before the ear clipper, kept below as the reference, and its results are
+//reported next to the new ones. Only failures of the loader make the run fail.
+//Last, a convex and a star shaped polygon of --vertices corners are triangulated by both to time them.
+//
+//Usage: triangulation_bench [--vertices N] [--repeat N] [--work-dir <dir>]
+
+#include "OBJ_Loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Level
+    {
+        Closed,
+        Weak,
+        Simple
+    };
+
+    const char* LevelName(Level level)
+    {
+        return level == Level::Simple ? "simple" : (level == Level::Weak ? "weak" : "closed");
+    }
+
+    struct Point
+    {
+        double x;
+        double y;
+    };
+
+    struct Polygon
+    {
+        std::string name;
+        Level level;
+        std::vector<Point> points;
+    };
+
+    //The planes the polygons are placed in: the XY plane, the YZ plane mirrored and a tilted plane away from the origin.
+    const int PlaneCount = 3;
+    const char* PlaneNames[PlaneCount] = { "xy", "zy", "tilted" };
+
+    objl::Vector3 Place(const Point& point, int plane)
+    {
+        if (plane == 0)
+        {
+            return objl::Vector3((float)point.x, (float)point.y, 0.0f);
+        }
+        if (plane == 1)
+        {
+            return objl::Vector3(0.0f, (float)point.y, (float)point.x);
+        }
+        //Rows of a rotation about an axis that isn't any of the coordinate axes.
+        const double rotation[3][3] = { { 0.36, 0.48, -0.80 }, { -0.80, 0.60, 0.00 }, { 0.48, 0.64, 0.60 } };
+        const double z = 0.0;
+        return objl::Vector3(
+            (float)(rotation[0][0] * point.x + rotation[0][1] * point.y + rotation[0][2] * z + 10.0),
+            (float)(rotation[1][0] * point.x + rotation[1][1] * point.y + rotation[1][2] * z - 5.0),
+            (float)(rotation[2][0] * point.x + rotation[2][1] * point.y + rotation[2][2] * z + 2.0));
+    }
+
+    Polygon RegularPolygon(const std::string& name, int cornerCount, double innerRadius)
+    {
+        Polygon polygon = { name, Level::Simple, {} };
+        const double pi = 3.14159265358979323846;
+        for (int i = 0; i < cornerCount; i++)
+        {
+            const double angle = 2.0 * pi * i / cornerCount;
+            const double radius = (i % 2 == 1) ? innerRadius : 1.0;
+            polygon.points.push_back({ radius * std::cos(angle), radius * std::sin(angle) });
+        }
+        return polygon;
+    }
+
+    std::vector<Polygon> GetTestPolygons()
+    {
+        std::vector<Polygon> polygons;
+        polygons.push_back({ "triangle", Level::Simple, { { 0, 0 }, { 1, 0 }, { 0, 1 } } });
+        polygons.push_back({ "square", Level::Simple, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } } });
+        polygons.push_back(RegularPolygon("hexagon", 6, 1.0));
+        polygons.push_back(RegularPolygon("64-gon", 64, 1.0));
+        //A dart, a quad with one reflex corner, starting at each of its corners so every corner is the reflex one once.
+        const Point dart[4] = { { 0, 0 }, { 2, 1 }, { 0, 2 }, { 0.5, 1 } };
+        for (int start = 0; start < 4; start++)
+        {
+            Polygon polygon = { "dart reflex " + std::to_string((3 - start + 4) % 4), Level::Simple, {} };
+            for (int i = 0; i < 4; i++)
+            {
+                polygon.points.push_back(dart[(start + i) % 4]);
+            }
+            polygons.push_back(polygon);
+        }
+        polygons.push_back({ "L", Level::Simple, { { 0, 0 }, { 2, 0 }, { 2, 1 }, { 1, 1 }, { 1, 2 }, { 0, 2 } } });
+        Polygon comb = { "comb", Level::Simple, { { 0, 0 }, { 9, 0 } } };
+        for (int tooth = 4; tooth >= 0; tooth--)
+        {
+            comb.points.push_back({ 2.0 * tooth + 1.0, 3 });
+            comb.points.push_back({ 2.0 * tooth, 3 });
+            if (tooth > 0)
+            {
+                comb.points.push_back({ 2.0 * tooth, 1 });
+                comb.points.push_back({ 2.0 * tooth - 1.0, 1 });
+            }
+        }
+        polygons.push_back(comb);
+        polygons.push_back(RegularPolygon("5 point star", 10, 0.4));
+        polygons.push_back(RegularPolygon("16 point star", 32, 0.2));
+        //A C shaped band: an outer arc out and an inner arc back, every inner corner is reflex.
+        Polygon band = { "C band", Level::Simple, {} };
+        for (int i = 0; i <= 24; i++)
+        {
+            const double angle = 0.25 + 5.5 * i / 24.0;
+            band.points.push_back({ 2.0 * std::cos(angle), 2.0 * std::sin(angle) });
+        }
+        for (int i = 24; i >= 0; i--)
+        {
+            const double angle = 0.25 + 5.5 * i / 24.0;
+            band.points.push_back({ 1.5 * std::cos(angle), 1.5 * std::sin(angle) });
+        }
+        polygons.push_back(band);
+
+        polygons.push_back({ "edge midpoints", Level::Simple, { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 2 }, { 0, 2 }, { 0, 1 } } });
+        polygons.push_back({ "collinear start", Level::Simple, { { 1, 0 }, { 2, 0 }, { 3, 0 }, { 3, 1 }, { 1.5, 0.5 }, { 0, 1 }, { 0, 0 } } });
+        polygons.push_back({ "collinear notch", Level::Simple, { { 0, 0 }, { 4, 0 }, { 4, 2 }, { 3, 2 }, { 3, 1 }, { 2, 1 }, { 1, 1 }, { 1, 2 }, { 0, 2 } } });
+        polygons.push_back({ "repeated corner", Level::Weak, { { 0, 0 }, { 1, 0 }, { 1, 0 }, { 1, 1 }, { 0.5, 1.5 }, { 0, 1 } } });
+        polygons.push_back({ "closing point", Level::Weak, { { 0, 0 }, { 2, 0 }, { 2, 1 }, { 1, 0.5 }, { 0, 1 }, { 0, 0 } } });
+        //Two squares that share a corner, the shared corner is listed twice.
+        polygons.push_back({ "touching squares", Level::Weak, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 }, { 1, 2 }, { 1, 1 }, { 0, 1 } } });
+        //A square with a square hole, joined to the outside by a bridge that is walked both ways.
+        polygons.push_back({ "keyhole", Level::Weak, { { 0, 2 }, { 0, 0 }, { 4, 0 }, { 4, 4 }, { 0, 4 }, { 0, 2 },
+            { 1, 2 }, { 1, 3 }, { 3, 3 }, { 3, 1 }, { 1, 1 }, { 1, 2 } } });
+        polygons.push_back({ "bowtie", Level::Closed, { { 0, 0 }, { 1, 1 }, { 1, 0 }, { 0, 1 } } });
+        Polygon pentagram = { "pentagram", Level::Closed, {} };
+        for (int i = 0; i < 5; i++)
+        {
+            const double angle = 2.0 * 3.14159265358979323846 * ((i * 2) % 5) / 5.0;
+            pentagram.points.push_back({ std::cos(angle), std::sin(angle) });
+        }
+        polygons.push_back(pentagram);
+        polygons.push_back({ "all collinear", Level::Closed, { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 1.5, 0 } } });
+        polygons.push_back({ "all the same", Level::Closed, { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 }, { 1, 1 } } });
+        return polygons;
+    }
+
+    double Cross(const Point& a, const Point& b, const Point& c)
+    {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    //Whether the segments ab and cd cross at a point inside both of them. Touching at a point or overlapping collinearly doesn't count.
+    bool ProperlyCross(const Point& a, const Point& b, const Point& c, const Point& d)
+    {
+        const double abc = Cross(a, b, c), abd = Cross(a, b, d), cda = Cross(c, d, a), cdb = Cross(c, d, b);
+        return ((abc > 0 && abd < 0) || (abc < 0 && abd > 0)) && ((cda > 0 && cdb < 0) || (cda < 0 && cdb > 0));
+    }
+
+    //Checks the triangles of a polygon, indices relative to its first corner. Returns an empty string if they pass.
+    std::string CheckTriangles(const Polygon& polygon, const std::vector<unsigned int>& indices)
+    {
+        const std::vector<Point>& points = polygon.points;
+        const size_t n = points.size();
+        if (indices.size() != 3 * (n - 2))
+        {
+            return std::to_string(indices.size() / 3) + " triangles (" + std::to_string(indices.size()) + " indices), not " + std::to_string(n - 2);
+        }
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if (a >= n || b >= n || c >= n)
+            {
+                return "index out of range";
+            }
+            if (a == b || b == c || a == c)
+            {
+                return "triangle " + std::to_string(i / 3) + " uses a corner twice";
+            }
+        }
+        if (polygon.level == Level::Closed)
+        {
+            return "";
+        }
+
+        double area = 0.0;
+        double scale = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const Point& a = points[i];
+            const Point& b = points[(i + 1) % n];
+            area += a.x * b.y - a.y * b.x;
+            scale = std::max(scale, std::max(std::fabs(a.x), std::fabs(a.y)));
+        }
+        const double tolerance = 1e-9 * scale * scale * n;
+        double triangleArea = 0.0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const double twiceArea = Cross(points[indices[i]], points[indices[i + 1]], points[indices[i + 2]]);
+            if (twiceArea * area < -tolerance)
+            {
+                return "triangle " + std::to_string(i / 3) + " is flipped";
+            }
+            triangleArea += twiceArea;
+        }
+        if (std::fabs(triangleArea - area) > tolerance)
+        {
+            char message[96];
+            snprintf(message, sizeof(message), "triangles cover an area of %.6g, the polygon %.6g", triangleArea / 2.0, area / 2.0);
+            return message;
+        }
+        if (polygon.level == Level::Weak)
+        {
+            return "";
+        }
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            const Point& a = points[indices[i]];
+            const Point& b = points[indices[i % 3 == 2 ? i - 2 : i + 1]];
+            for (size_t j = 0; j < n; j++)
+            {
+                if (ProperlyCross(a, b, points[j], points[(j + 1) % n]))
+                {
+                    return "triangle " + std::to_string(i / 3) + " crosses edge " + std::to_string(j);
+                }
+            }
+        }
+        return "";
+    }
+
+    //The triangulator of objl before the ear clipper replaced it, kept to compare against. It is unchanged except that it stops
+    //when a pass over the remaining corners finds no ear, where the original loops forever.
+    void ReferenceTriangulation(std::vector<unsigned int>& oIndices, const std::vector<objl::Vertex>& iVerts)
+    {
+        if (iVerts.size() < 3)
+        {
+            return;
+        }
+        if (iVerts.size() == 3)
+        {
+            oIndices.push_back(0);
+            oIndices.push_back(1);
+            oIndices.push_back(2);
+            return;
+        }
+
+        std::vector<objl::Vertex> tVerts = iVerts;
+        while (true)
+        {
+            bool clipped = false;
+            for (int i = 0; i < int(tVerts.size()); i++)
+            {
+                objl::Vertex pPrev = i == 0 ? tVerts[tVerts.size() - 1] : tVerts[i - 1];
+                objl::Vertex pCur = tVerts[i];
+                objl::Vertex pNext = i == int(tVerts.size()) - 1 ? tVerts[0] : tVerts[i + 1];
+
+                if (tVerts.size() == 3)
+                {
+                    for (int j = 0; j < int(tVerts.size()); j++)
+                    {
+                        if (iVerts[j].Position == pCur.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == pPrev.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == pNext.Position)
+                            oIndices.push_back(j);
+                    }
+                    tVerts.clear();
+                    break;
+                }
+                if (tVerts.size() == 4)
+                {
+                    for (int j = 0; j < int(iVerts.size()); j++)
+                    {
+                        if (iVerts[j].Position == pCur.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == pPrev.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == pNext.Position)
+                            oIndices.push_back(j);
+                    }
+                    objl::Vector3 tempVec;
+                    for (int j = 0; j < int(tVerts.size()); j++)
+                    {
+                        if (tVerts[j].Position != pCur.Position
+                            && tVerts[j].Position != pPrev.Position
+                            && tVerts[j].Position != pNext.Position)
+                        {
+                            tempVec = tVerts[j].Position;
+                            break;
+                        }
+                    }
+                    for (int j = 0; j < int(iVerts.size()); j++)
+                    {
+                        if (iVerts[j].Position == pPrev.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == pNext.Position)
+                            oIndices.push_back(j);
+                        if (iVerts[j].Position == tempVec)
+                            oIndices.push_back(j);
+                    }
+                    tVerts.clear();
+                    break;
+                }
+
+                float angle = objl::math::AngleBetweenV3(pPrev.Position - pCur.Position, pNext.Position - pCur.Position) * (180 / 3.14159265359);
+                if (angle <= 0 && angle >= 180)
+                    continue;
+
+                bool inTri = false;
+                for (int j = 0; j < int(iVerts.size()); j++)
+                {
+                    if (objl::algorithm::inTriangle(iVerts[j].Position, pPrev.Position, pCur.Position, pNext.Position)
+                        && iVerts[j].Position != pPrev.Position
+                        && iVerts[j].Position != pCur.Position
+                        && iVerts[j].Position != pNext.Position)
+                    {
+                        inTri = true;
+                        break;
+                    }
+                }
+                if (inTri)
+                    continue;
+
+                for (int j = 0; j < int(iVerts.size()); j++)
+                {
+                    if (iVerts[j].Position == pCur.Position)
+                        oIndices.push_back(j);
+                    if (iVerts[j].Position == pPrev.Position)
+                        oIndices.push_back(j);
+                    if (iVerts[j].Position == pNext.Position)
+                        oIndices.push_back(j);
+                }
+                for (int j = 0; j < int(tVerts.size()); j++)
+                {
+                    if (tVerts[j].Position == pCur.Position)
+                    {
+                        tVerts.erase(tVerts.begin() + j);
+                        break;
+                    }
+                }
+                clipped = true;
+                i = -1;
+            }
+
+            if (oIndices.size() == 0 || tVerts.size() == 0 || !clipped)
+                break;
+        }
+    }
+
+    struct Face
+    {
+        Polygon polygon;
+        std::vector<objl::Vertex> vertices;
+    };
+
+    //Writes the faces to an .obj file, one object of one face each, and loads it. Returns the triangles of every face relative to
+    //its first corner, or false if the file doesn't load back with one mesh per face.
+    bool Triangulate(const std::string& path, const std::vector<Face>& faces, std::vector<std::vector<unsigned int>>& triangles, double* loadMilliseconds)
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                return false;
+            }
+            char line[128];
+            size_t vertexCount = 0;
+            for (size_t i = 0; i < faces.size(); i++)
+            {
+                file << "o face" << i << "\n";
+                for (const objl::Vertex& vertex : faces[i].vertices)
+                {
+                    snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+                    file << line;
+                }
+                file << "f";
+                for (size_t j = 0; j < faces[i].vertices.size(); j++)
+                {
+                    file << " " << vertexCount + j + 1;
+                }
+                file << "\n";
+                vertexCount += faces[i].vertices.size();
+            }
+            if (!file)
+            {
+                return false;
+            }
+        }
+
+        //The loader reports every mesh it loads on std::cout, which would bury the results.
+        objl::Loader loader;
+        std::streambuf* output = std::cout.rdbuf(nullptr);
+        const Clock::time_point start = Clock::now();
+        const bool loaded = loader.LoadFile(path);
+        if (loadMilliseconds != nullptr)
+        {
+            *loadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+        std::cout.rdbuf(output);
+        std::cout.clear();
+        if (!loaded || loader.LoadedMeshes.size() != faces.size())
+        {
+            return false;
+        }
+        triangles.assign(faces.size(), {});
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            const objl::Mesh& mesh = loader.LoadedMeshes[i];
+            if (mesh.VertexCount != faces[i].vertices.size())
+            {
+                return false;
+            }
+            const unsigned int* indices = loader.GetMeshIndices(mesh);
+            for (unsigned int j = 0; j < mesh.IndexCount; j++)
+            {
+                //Out of range indices wrap around to large values and fail the checks.
+                triangles[i].push_back(indices[j] - mesh.VertexStart);
+            }
+        }
+        return true;
+    }
+
+    std::vector<objl::Vertex> MakeVertices(const Polygon& polygon, int plane)
+    {
+        std::vector<objl::Vertex> vertices(polygon.points.size());
+        for (size_t i = 0; i < polygon.points.size(); i++)
+        {
+            vertices[i].Position = Place(polygon.points[i], plane);
+        }
+        return vertices;
+    }
+
+    bool RunChecks(const std::string& path)
+    {
+        std::vector<Face> faces;
+        for (const Polygon& polygon : GetTestPolygons())
+        {
+            for (int reversed = 0; reversed < 2; reversed++)
+            {
+                Polygon wound = polygon;
+                if (reversed == 1)
+                {
+                    std::reverse(wound.points.begin(), wound.points.end());
+                    wound.name += ", reversed";
+                }
+                for (int plane = 0; plane < PlaneCount; plane++)
+                {
+                    Face face = { wound, MakeVertices(wound, plane) };
+                    face.polygon.name += std::string(", ") + PlaneNames[plane];
+                    faces.push_back(face);
+                }
+            }
+        }
+
+        std::vector<std::vector<unsigned int>> triangles;
+        if (!Triangulate(path, faces, triangles, nullptr))
+        {
+            printf("%s: writing or loading the test polygons failed\n", path.c_str());
+            return false;
+        }
+
+        size_t failures = 0;
+        size_t referenceFailures = 0;
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            const Polygon& polygon = faces[i].polygon;
+            const std::string result = CheckTriangles(polygon, triangles[i]);
+            std::vector<unsigned int> referenceTriangles;
+            ReferenceTriangulation(referenceTriangles, faces[i].vertices);
+            const std::string referenceResult = CheckTriangles(polygon, referenceTriangles);
+            failures += result.empty() ? 0 : 1;
+            referenceFailures += referenceResult.empty() ? 0 : 1;
+            printf("  %-36s %3zu corners  %-6s  %-4s %s\n", polygon.name.c_str(), polygon.points.size(), LevelName(polygon.level),
+                result.empty() ? "ok" : "FAIL", result.c_str());
+            if (!referenceResult.empty())
+            {
+                printf("  %-36s %-20s  before: %s\n", "", "", referenceResult.c_str());
+            }
+        }
+        printf("%zu polygons: %zu failed, %zu failed with the triangulator from before the ear clipper\n\n", faces.size(), failures, referenceFailures);
+        return failures == 0;
+    }
+
+    bool RunTiming(const std::string& path, int cornerCount, int repeat)
+    {
+        bool succeeded = true;
+        const Polygon polygons[2] = { RegularPolygon("convex", cornerCount, 1.0), RegularPolygon("star", cornerCount, 0.5) };
+        for (const Polygon& polygon : polygons)
+        {
+            std::vector<Face> faces = { { polygon, MakeVertices(polygon, 2) } };
+            double loadMilliseconds = 1e30;
+            std::vector<std::vector<unsigned int>> triangles;
+            for (int i = 0; i < repeat; i++)
+            {
+                double milliseconds = 0.0;
+                succeeded = Triangulate(path, faces, triangles, &milliseconds) && succeeded;
+                loadMilliseconds = std::min(loadMilliseconds, milliseconds);
+            }
+            const std::string result = triangles.empty() ? "load failed" : CheckTriangles(polygon, triangles[0]);
+            succeeded = succeeded && result.empty();
+
+            double referenceMilliseconds = 1e30;
+            std::vector<unsigned int> referenceTriangles;
+            for (int i = 0; i < repeat; i++)
+            {
+                referenceTriangles.clear();
+                const Clock::time_point start = Clock::now();
+                ReferenceTriangulation(referenceTriangles, faces[0].vertices);
+                referenceMilliseconds = std::min(referenceMilliseconds, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            const std::string referenceResult = CheckTriangles(polygon, referenceTriangles);
+            printf("  %-7s %6d corners: loaded in %9.3f ms (%s), triangulated before the ear clipper in %9.3f ms (%s)\n", polygon.name.c_str(),
+                cornerCount, loadMilliseconds, result.empty() ? "ok" : result.c_str(), referenceMilliseconds,
+                referenceResult.empty() ? "ok" : referenceResult.c_str());
+        }
+        return succeeded;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int cornerCount = 1000;
+    int repeat = 3;
+    fs::path workDirectory;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--vertices" && i + 1 < argc)
+        {
+            cornerCount = std::max(4, atoi(argv[++i]));
+        }
+        else if (argument == "--repeat" && i + 1 < argc)
+        {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--work-dir" && i + 1 < argc)
+        {
+            workDirectory = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: triangulation_bench [--vertices N] [--repeat N] [--work-dir <dir>]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+    }
+    if (workDirectory.empty())
+    {
+        workDirectory = fs::temp_directory_path() / "triangulation_bench";
+    }
+    std::error_code error;
+    fs::create_directories(workDirectory, error);
+    const std::string path = (workDirectory / "polygons.obj").string();
+
+    bool succeeded = RunChecks(path);
+    succeeded = RunTiming(path, cornerCount, repeat) && succeeded;
+    fs::remove(path, error);
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+//Check of the error bounds of the 12 byte quantized vertex layout.
+//Random positions in boxes of different sizes and offsets have to decode within VertexQuantization::GetPositionErrorBound on every
+//axis, both through DecodePosition and through the dequantization transform the BLAS and the raster path use. Random unit normals,
+//and the axes, diagonals and fold edges of the octahedron, have to decode to unit vectors within GetNormalErrorBound. Then the edge
+//cases are checked: the corners of the box, flat boxes, a zero normal and the per mesh format choice. Last, the vertices of the
+//bundled models are quantized and their largest errors are reported against the bounds.
+//
+//Usage: vertex_quantization_bench [--normals N] [model.obj ...]
+
+#include "OBJ_Loader.h"
+#include "VertexQuantization.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    int failures = 0;
+
+    void Check(bool passed, const std::string& what)
+    {
+        if (!passed)
+        {
+            printf("  FAIL %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    //Angle between two vectors in radians, in double precision so that it doesn't add to the error it measures.
+    double GetAngle(const float a[3], const float b[3])
+    {
+        const double cross[3] = {
+            (double)a[1] * b[2] - (double)a[2] * b[1],
+            (double)a[2] * b[0] - (double)a[0] * b[2],
+            (double)a[0] * b[1] - (double)a[1] * b[0] };
+        const double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+        return std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot);
+    }
+
+    //Applies the dequantization transform to the snorm values the way the GPU sees them, as [-1, 1] floats.
+    void TransformPosition(const float transform[12], const int16_t encoded[4], float position[3])
+    {
+        float snorm[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            snorm[axis] = std::max(encoded[axis] / 32767.0f, -1.0f);
+        }
+        for (int row = 0; row < 3; row++)
+        {
+            position[row] = transform[row * 4 + 0] * snorm[0] + transform[row * 4 + 1] * snorm[1] + transform[row * 4 + 2] * snorm[2] + transform[row * 4 + 3];
+        }
+    }
+
+    //Largest error of the positions on each axis, as a fraction of the bound of that axis.
+    struct PositionError
+    {
+        double decoded = 0.0;
+        double transformed = 0.0;
+    };
+
+    PositionError MeasurePosition(const float position[3], const VertexQuantization::Bounds& bounds, const float transform[12])
+    {
+        int16_t encoded[4];
+        VertexQuantization::EncodePosition(position, bounds, encoded);
+        float decoded[3];
+        VertexQuantization::DecodePosition(encoded, bounds, decoded);
+        float transformed[3];
+        TransformPosition(transform, encoded, transformed);
+
+        PositionError error;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const double bound = VertexQuantization::GetPositionErrorBound(bounds, axis);
+            error.decoded = std::max(error.decoded, std::fabs((double)decoded[axis] - position[axis]) / bound);
+            error.transformed = std::max(error.transformed, std::fabs((double)transformed[axis] - position[axis]) / bound);
+        }
+        return error;
+    }
+
+    //Returns the angle between the normal and its decoded value, or a negative value when the decoded normal isn't unit length.
+    double MeasureNormal(const float normal[3])
+    {
+        int16_t encoded[2];
+        VertexQuantization::EncodeNormal(normal, encoded);
+        float decoded[3];
+        VertexQuantization::DecodeNormal(encoded, decoded);
+        const double length = std::sqrt((double)decoded[0] * decoded[0] + (double)decoded[1] * decoded[1] + (double)decoded[2] * decoded[2]);
+        if (std::fabs(length - 1.0) > 1e-6)
+        {
+            return -1.0;
+        }
+        return GetAngle(normal, decoded);
+    }
+
+    void RunPositionChecks()
+    {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        const float centers[] = { 0.0f, 0.37f, -250.0f, 12000.0f };
+        const float halfExtents[] = { 1e-3f, 1.0f, 13.5f, 4000.0f };
+        const int samples = 100000;
+
+        PositionError worst;
+        for (float center : centers)
+        {
+            for (float halfExtent : halfExtents)
+            {
+                //The axes get different sizes so that a mixed up axis shows.
+                VertexQuantization::Bounds bounds;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    bounds.center[axis] = center * (axis + 1);
+                    bounds.halfExtent[axis] = halfExtent * (1.0f + axis * 0.5f);
+                }
+                float transform[12];
+                VertexQuantization::GetDequantizationTransform(bounds, transform);
+                for (int i = 0; i < samples; i++)
+                {
+                    float position[3];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        position[axis] = bounds.center[axis] + unit(random) * bounds.halfExtent[axis];
+                    }
+                    const PositionError error = MeasurePosition(position, bounds, transform);
+                    worst.decoded = std::max(worst.decoded, error.decoded);
+                    worst.transformed = std::max(worst.transformed, error.transformed);
+                }
+
+                //The corners of the box are the extreme snorm values. A box that is small next to its offset has corners that are rounded
+                //by more than a quantization step already, those only have to stay within the bound.
+                const bool exactCorners = (std::fabs(center) * 3.0f + halfExtent * 2.0f) * FLT_EPSILON < halfExtent / 32767.0f;
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    float position[3];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        position[axis] = bounds.center[axis] + ((corner >> axis) & 1 ? 1.0f : -1.0f) * bounds.halfExtent[axis];
+                    }
+                    int16_t encoded[4];
+                    VertexQuantization::EncodePosition(position, bounds, encoded);
+                    bool extreme = encoded[3] == 0;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        extreme = extreme && encoded[axis] == ((corner >> axis) & 1 ? 32767 : -32767);
+                    }
+                    Check(extreme || !exactCorners, "corner " + std::to_string(corner) + " of a box at " + std::to_string(center) + " encodes to the extreme snorm values");
+                    const PositionError error = MeasurePosition(position, bounds, transform);
+                    worst.decoded = std::max(worst.decoded, error.decoded);
+                    worst.transformed = std::max(worst.transformed, error.transformed);
+                }
+            }
+        }
+        printf("positions: largest error %.3f of the bound decoded, %.3f through the dequantization transform\n", worst.decoded, worst.transformed);
+        Check(worst.decoded <= 1.0, "positions decode within GetPositionErrorBound");
+        Check(worst.transformed <= 1.0, "positions through the dequantization transform are within GetPositionErrorBound");
+
+        //A flat mesh gets a half extent of 1 on its flat axis, so every vertex has to come back exactly on the plane.
+        const MeshCache::Vertex flat[] = { { { -2.0f, 5.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } }, { { 3.0f, 5.0f, -4.0f }, { 0.0f, 1.0f, 0.0f } } };
+        const VertexQuantization::Bounds flatBounds = VertexQuantization::ComputeBounds(flat, 2);
+        Check(flatBounds.halfExtent[1] == 1.0f && flatBounds.center[1] == 5.0f, "a flat axis gets a half extent of 1");
+        for (const MeshCache::Vertex& vertex : flat)
+        {
+            int16_t encoded[4];
+            VertexQuantization::EncodePosition(vertex.position, flatBounds, encoded);
+            float decoded[3];
+            VertexQuantization::DecodePosition(encoded, flatBounds, decoded);
+            Check(decoded[1] == 5.0f, "a vertex of a flat mesh stays on its plane");
+        }
+    }
+
+    void RunNormalChecks(int normalCount)
+    {
+        const double bound = VertexQuantization::GetNormalErrorBound();
+        double worst = 0.0;
+        int notUnit = 0;
+        const Clock::time_point start = Clock::now();
+        std::mt19937 random(5);
+        std::normal_distribution<float> gaussian;
+        for (int i = 0; i < normalCount; i++)
+        {
+            //Gaussian coordinates give directions that are uniform on the sphere.
+            float normal[3] = { gaussian(random), gaussian(random), gaussian(random) };
+            const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length < 1e-6f)
+            {
+                continue;
+            }
+            for (float& coordinate : normal)
+            {
+                coordinate /= length;
+            }
+            const double angle = MeasureNormal(normal);
+            notUnit += angle < 0.0 ? 1 : 0;
+            worst = std::max(worst, angle);
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        //The axes, the diagonals of every octant and directions next to the fold of the lower half, where the encoding changes the most.
+        std::vector<std::vector<float>> special;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (float sign : { 1.0f, -1.0f })
+            {
+                std::vector<float> normal(3, 0.0f);
+                normal[axis] = sign;
+                special.push_back(normal);
+            }
+        }
+        for (int octant = 0; octant < 8; octant++)
+        {
+            const float value = 1.0f / std::sqrt(3.0f);
+            special.push_back({ octant & 1 ? value : -value, octant & 2 ? value : -value, octant & 4 ? value : -value });
+        }
+        for (float z : { 1e-7f, -1e-7f, -1e-3f, -0.5f, -0.999f })
+        {
+            for (int quadrant = 0; quadrant < 4; quadrant++)
+            {
+                const float side = std::sqrt((1.0f - z * z) * 0.5f);
+                special.push_back({ quadrant & 1 ? side : -side, quadrant & 2 ? side : -side, z });
+                special.push_back({ quadrant & 1 ? std::sqrt(1.0f - z * z) : -std::sqrt(1.0f - z * z), 0.0f, z });
+            }
+        }
+        for (const std::vector<float>& normal : special)
+        {
+            const double angle = MeasureNormal(normal.data());
+            notUnit += angle < 0.0 ? 1 : 0;
+            worst = std::max(worst, angle);
+            Check(angle >= 0.0 && angle <= bound, "normal (" + std::to_string(normal[0]) + ", " + std::to_string(normal[1]) + ", " + std::to_string(normal[2]) + ") is within the bound");
+        }
+
+        printf("normals: %d random and %zu special, largest error %.3g rad, bound %.3g rad (%.1f ns per normal)\n", normalCount, special.size(), worst, bound,
+            normalCount > 0 ? seconds * 1e9 / normalCount : 0.0);
+        Check(notUnit == 0, std::to_string(notUnit) + " decoded normals aren't unit length");
+        Check(worst <= bound, "normals decode within GetNormalErrorBound");
+
+        //A zero normal has no direction, it decodes to +Z instead of NaN.
+        const float zero[3] = { 0.0f, 0.0f, 0.0f };
+        int16_t encoded[2];
+        VertexQuantization::EncodeNormal(zero, encoded);
+        float decoded[3];
+        VertexQuantization::DecodeNormal(encoded, decoded);
+        Check(decoded[0] == 0.0f && decoded[1] == 0.0f && decoded[2] == 1.0f, "a zero normal decodes to +Z");
+
+        //The normal doesn't have to be normalized.
+        const float longNormal[3] = { 0.0f, -30.0f, 0.0f };
+        VertexQuantization::EncodeNormal(longNormal, encoded);
+        VertexQuantization::DecodeNormal(encoded, decoded);
+        Check(std::fabs(decoded[1] + 1.0f) < 1e-6f, "a normal that isn't unit length keeps its direction");
+    }
+
+    void RunLayoutChecks()
+    {
+        Check(VertexQuantization::QuantizedVertexSize == 12, "the quantized vertex is 12 bytes");
+        Check(VertexQuantization::GetVertexSize(VertexQuantization::Format::Float) == 24, "the float vertex is 24 bytes");
+
+        std::vector<MeshCache::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        //A grid of 64 x 64 quads.
+        const int side = 64;
+        for (int y = 0; y <= side; y++)
+        {
+            for (int x = 0; x <= side; x++)
+            {
+                vertices.push_back({ { (float)x, 0.1f * (float)((x * 7 + y * 3) % 5), (float)y }, { 0.0f, 1.0f, 0.0f } });
+            }
+        }
+        for (int y = 0; y < side; y++)
+        {
+            for (int x = 0; x < side; x++)
+            {
+                const uint32_t corner = (uint32_t)(y * (side + 1) + x);
+                indices.insert(indices.end(), { corner, corner + side + 1, corner + 1, corner + 1, corner + side + 1, corner + side + 2 });
+            }
+        }
+        Check(VertexQuantization::ChooseFormat(vertices.data(), vertices.size(), indices.data(), indices.size()) == VertexQuantization::Format::Quantized,
+            "a grid gets the quantized format");
+
+        const VertexQuantization::Bounds bounds = VertexQuantization::ComputeBounds(vertices.data(), vertices.size());
+        std::vector<VertexQuantization::QuantizedVertex> quantized(vertices.size());
+        VertexQuantization::Encode(vertices.data(), vertices.size(), VertexQuantization::Format::Quantized, bounds, quantized.data());
+        bool sameAsEncoders = true;
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            int16_t position[4];
+            int16_t normal[2];
+            VertexQuantization::EncodePosition(vertices[i].position, bounds, position);
+            VertexQuantization::EncodeNormal(vertices[i].normal, normal);
+            sameAsEncoders = sameAsEncoders && memcmp(position, quantized[i].position, sizeof(position)) == 0 && memcmp(normal, quantized[i].normal, sizeof(normal)) == 0;
+        }
+        Check(sameAsEncoders, "Encode writes the same vertices as EncodePosition and EncodeNormal");
+
+        std::vector<MeshCache::Vertex> copied(vertices.size());
+        VertexQuantization::Encode(vertices.data(), vertices.size(), VertexQuantization::Format::Float, bounds, copied.data());
+        Check(memcmp(copied.data(), vertices.data(), vertices.size() * sizeof(MeshCache::Vertex)) == 0, "the float format is a copy");
+
+        //A triangle far smaller than a quantization step of the grid collapses, so the mesh has to stay in floats.
+        const uint32_t first = (uint32_t)vertices.size();
+        vertices.push_back({ { 10.0f, 0.0f, 10.0f }, { 0.0f, 1.0f, 0.0f } });
+        vertices.push_back({ { 10.0001f, 0.0f, 10.0f }, { 0.0f, 1.0f, 0.0f } });
+        vertices.push_back({ { 10.0f, 0.0f, 10.0001f }, { 0.0f, 1.0f, 0.0f } });
+        indices.insert(indices.end(), { first, first + 1, first + 2 });
+        Check(VertexQuantization::ChooseFormat(vertices.data(), vertices.size(), indices.data(), indices.size()) == VertexQuantization::Format::Float,
+            "a mesh with detail below a quantization step keeps the float format");
+        Check(VertexQuantization::ChooseFormat(nullptr, 0, nullptr, 0) == VertexQuantization::Format::Float, "an empty mesh keeps the float format");
+    }
+
+    void RunModel(const std::string& path)
+    {
+        objl::Loader loader;
+        std::streambuf* output = std::cout.rdbuf(nullptr);
+        const bool loaded = loader.LoadFile(path);
+        std::cout.rdbuf(output);
+        std::cout.clear();
+        if (!loaded)
+        {
+            Check(false, path + ": failed to load");
+            return;
+        }
+
+        std::vector<MeshCache::Vertex> vertices(loader.LoadedVertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const objl::Vertex& vertex = loader.LoadedVertices[i];
+            vertices[i] = { { vertex.Position.X, vertex.Position.Y, vertex.Position.Z }, { vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z } };
+        }
+        const std::vector<uint32_t> indices(loader.LoadedIndices.begin(), loader.LoadedIndices.end());
+        const VertexQuantization::Format format = VertexQuantization::ChooseFormat(vertices.data(), vertices.size(), indices.data(), indices.size());
+        const VertexQuantization::Bounds bounds = VertexQuantization::ComputeBounds(vertices.data(), vertices.size());
+        float transform[12];
+        VertexQuantization::GetDequantizationTransform(bounds, transform);
+
+        PositionError worstPosition;
+        double worstNormal = 0.0;
+        for (const MeshCache::Vertex& vertex : vertices)
+        {
+            const PositionError error = MeasurePosition(vertex.position, bounds, transform);
+            worstPosition.decoded = std::max(worstPosition.decoded, error.decoded);
+            worstPosition.transformed = std::max(worstPosition.transformed, error.transformed);
+            const float length = std::sqrt(vertex.normal[0] * vertex.normal[0] + vertex.normal[1] * vertex.normal[1] + vertex.normal[2] * vertex.normal[2]);
+            if (length > 0.0f)
+            {
+                worstNormal = std::max(worstNormal, MeasureNormal(vertex.normal));
+            }
+        }
+        printf("%-24s %9zu vertices  %-9s  position error %.3f of the bound, normal error %.3g rad\n", path.c_str(), vertices.size(),
+            format == VertexQuantization::Format::Quantized ? "quantized" : "float", std::max(worstPosition.decoded, worstPosition.transformed), worstNormal);
+        Check(worstPosition.decoded <= 1.0 && worstPosition.transformed <= 1.0, path + ": positions are within the bound");
+        Check(worstNormal <= VertexQuantization::GetNormalErrorBound(), path + ": normals are within the bound");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int normalCount = 2000000;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--normals" && i + 1 < argc)
+        {
+            normalCount = atoi(argv[++i]);
+        }
+        else if (argument.rfind("--", 0) == 0 || argument == "-h")
+        {
+            fprintf(stderr, "Usage: vertex_quantization_bench [--normals N] [model.obj ...]\n");
+            return argument == "--help" || argument == "-h" ? 0 : 1;
+        }
+        else
+        {
+            models.push_back(argument);
+        }
+    }
+    if (models.empty())
+    {
+        models = { "models/teapot.obj", "models/rabbit.obj" };
+    }
+
+    RunPositionChecks();
+    RunNormalChecks(normalCount);
+    RunLayoutChecks();
+    for (const std::string& model : models)
+    {
+        RunModel(model);
+    }
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}